@@ -0,0 +1,144 @@
+/*
+ * =====================================================================================
+ *
+ *       Filename:  affinity.c
+ *
+ *    Description:  Implementation of the placement of the FUSE workers and of the script processes
+ *
+ *        Version:  2.0
+ *        Created:  10/18/2026
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  
+ *        Company:  
+ *
+ * =====================================================================================
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#include "affinity.h"
+
+static int fuse_reserved=0;	//!< Non-zero if some CPUs are reserved for the FUSE workers
+static cpu_set_t fuse_set;	//!< CPUs reserved for the FUSE workers
+static int script_placed=0;	//!< Non-zero if the scripts do not run on all the CPUs
+static cpu_set_t script_set;	//!< CPUs on which the scripts run
+static int node_count=0;	//!< Number of NUMA nodes known, 0 if the scripts are not kept on the node of their worker
+static int node_ids[AFFINITY_MAX_NODES];	//!< IDs of the known NUMA nodes
+static cpu_set_t node_sets[AFFINITY_MAX_NODES];	//!< CPUs of the known NUMA nodes
+
+/**
+ * \brief Parse a list of CPUs or nodes in the format of the kernel (such as 0-3,8,10-11)
+ *
+ * \param list List to parse
+ * \param set Set receiving the elements of the list
+ * \return 0 if the list is valid and not empty, -1 otherwise
+ */
+static int parse_list(const char *list,cpu_set_t *set) {
+	CPU_ZERO(set);
+	while (*list!=0 && *list!='\n') {
+		char *end;
+		if (!isdigit((unsigned char)*list)) return -1;
+		long first=strtol(list,&end,10),last=first;
+		if (*end=='-') {
+			if (!isdigit((unsigned char)end[1])) return -1;
+			last=strtol(end+1,&end,10);
+		}
+		if (last<first || last>=CPU_SETSIZE) return -1;
+		for (;first<=last;++first) CPU_SET(first,set);
+		if (*end==',') ++end;
+		else if (*end!=0 && *end!='\n') return -1;
+		list=end;
+	}
+	return (CPU_COUNT(set)>0)?0:-1;
+}
+
+/**
+ * \brief Parse a list of the file system of the kernel
+ *
+ * \param path Path of the file holding the list
+ * \param set Set receiving the elements of the list
+ * \return 0 if the list was read, -1 otherwise
+ */
+static int read_list(const char *path,cpu_set_t *set) {
+	char line[0x1000];
+	FILE *f=fopen(path,"re");
+	if (f==0) return -1;
+	int code=(fgets(line,sizeof line,f)!=0)?parse_list(line,set):-1;
+	fclose(f);
+	return code;
+}
+
+int init_affinity(const char *fuse_cpus,const char *script_cpus,int numa_local) {
+	cpu_set_t online;
+	if (sched_getaffinity(0,sizeof online,&online)!=0) return errno;
+	fuse_reserved=(fuse_cpus!=0);
+	if (fuse_reserved && parse_list(fuse_cpus,&fuse_set)!=0) return EINVAL;
+	if (script_cpus!=0 && parse_list(script_cpus,&script_set)!=0) return EINVAL;
+	if (script_cpus==0) script_set=online;
+	if (fuse_reserved) {	// The reserved CPUs are never used by the scripts
+		CPU_AND(&fuse_set,&fuse_set,&online);
+		if (CPU_COUNT(&fuse_set)==0) return EINVAL;
+		int cpu;
+		for (cpu=0;cpu<CPU_SETSIZE;++cpu) if (CPU_ISSET(cpu,&fuse_set)) CPU_CLR(cpu,&script_set);
+	}
+	CPU_AND(&script_set,&script_set,&online);
+	if (CPU_COUNT(&script_set)==0) return EINVAL;
+	script_placed=(fuse_reserved || script_cpus!=0);
+	node_count=0;
+	cpu_set_t nodes;
+	if (numa_local && read_list("/sys/devices/system/node/online",&nodes)==0) {
+		int node;
+		for (node=0;node<AFFINITY_MAX_NODES;++node) {	// The memory policy is given as a mask of one word
+			char path[64];
+			if (!CPU_ISSET(node,&nodes)) continue;
+			snprintf(path,sizeof path,"/sys/devices/system/node/node%d/cpulist",node);
+			if (read_list(path,&node_sets[node_count])!=0) continue;	// Node without CPU
+			node_ids[node_count++]=node;
+		}
+	}
+	return 0;
+}
+
+int bind_fuse_workers() {
+	if (!fuse_reserved) return 0;
+	return (sched_setaffinity(0,sizeof fuse_set,&fuse_set)==0)?0:errno;
+}
+
+void prepare_placement(Placement *placement) {
+	placement->active=(script_placed || node_count>0);
+	placement->cpus=script_set;
+	placement->node=-1;
+	int cpu=(node_count>0)?sched_getcpu():-1;
+	int i;
+	for (i=0;cpu>=0 && i<node_count;++i) {
+		if (!CPU_ISSET(cpu,&node_sets[i])) continue;
+		cpu_set_t local;
+		CPU_AND(&local,&script_set,&node_sets[i]);
+		if (CPU_COUNT(&local)>0) placement->cpus=local;	// Otherwise the script runs on any of its CPUs, but still allocates on the node of the worker
+		placement->node=node_ids[i];
+		break;
+	}
+}
+
+void apply_placement(const Placement *placement) {
+	if (!placement->active) return;
+	sched_setaffinity(0,sizeof placement->cpus,&placement->cpus);	// Also undoes the reservation of the FUSE workers inherited from the parent
+	if (placement->node>=0) {
+		unsigned long mask=1UL<<placement->node;
+		syscall(SYS_set_mempolicy,MPOL_PREFERRED,&mask,8*sizeof mask+1);
+	}
+}
+
+void place_process(pid_t pid,const Placement *placement) {
+	if (placement->active) sched_setaffinity(pid,sizeof placement->cpus,&placement->cpus);
+}
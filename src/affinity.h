@@ -0,0 +1,80 @@
+/**
+ * \file
+ *
+ * =====================================================================================
+ *
+ *       Filename:  affinity.h
+ *
+ *    Description:  Placement of the FUSE workers and of the script processes on the CPUs
+ *
+ *        Version:  2.0
+ *        Created:  10/18/2026
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  
+ *        Company:  
+ *
+ * =====================================================================================
+ */
+
+#ifndef  AFFINITY_INC
+#define  AFFINITY_INC
+
+#include <sched.h>
+
+#define AFFINITY_MAX_NODES 64	//!< Number of NUMA nodes taken into account (nodes with a higher ID are ignored)
+
+/**
+ * \brief Placement of a child process, computed by the parent before the fork
+ */
+typedef struct Placement {
+	int active;	//!< Non-zero if the child has to be placed
+	cpu_set_t cpus;	//!< CPUs on which the child may run
+	int node;	//!< NUMA node from which the child should allocate its memory, -1 for no preference
+} Placement;
+
+/**
+ * \brief Set the placement policy
+ *
+ * The CPUs reserved for the FUSE workers are removed from the CPUs of the scripts, so that the workers never compete with the scripts they wait for. Without explicit list, the scripts run on all the online CPUs which are not reserved.
+ * \param fuse_cpus List of the CPUs reserved for the FUSE workers (such as 0-3,8), null for no reservation
+ * \param script_cpus List of the CPUs on which the scripts run, null for all the CPUs which are not reserved
+ * \param numa_local If non-zero, a script runs and allocates its memory on the NUMA node of the worker which started it, when the CPUs of the scripts include some CPUs of this node
+ * \return 0 if everything went fine, EINVAL if a list is invalid or if no CPU is left for the scripts
+ */
+int init_affinity(const char *fuse_cpus,const char *script_cpus,int numa_local);
+
+/**
+ * \brief Bind the calling thread to the CPUs reserved for the FUSE workers
+ *
+ * The function must be called before the FUSE sessions are started: the worker threads inherit the affinity of the thread which creates them.
+ * \return 0 if everything went fine or if no CPU is reserved, an error code otherwise
+ */
+int bind_fuse_workers();
+
+/**
+ * \brief Compute the placement of a child process started by the calling thread
+ *
+ * \param placement Structure receiving the placement
+ */
+void prepare_placement(Placement *placement);
+
+/**
+ * \brief Apply a placement to the calling process
+ *
+ * The function is called by the child process between the fork and the execution of the program. It only makes system calls.
+ * \param placement Placement computed by prepare_placement in the parent process
+ */
+void apply_placement(const Placement *placement);
+
+/**
+ * \brief Apply the CPUs of a placement to another process
+ *
+ * The function is used for the processes which are not started by the file system itself (see forkserver.h). Their memory policy cannot be changed from outside.
+ * \param pid ID of the process
+ * \param placement Placement computed by prepare_placement
+ */
+void place_process(pid_t pid,const Placement *placement);
+
+#endif   /* ----- #ifndef AFFINITY_INC  ----- */
@@ -0,0 +1,332 @@
+/*
+ * =====================================================================================
+ *
+ *       Filename:  cache.c
+ *
+ *    Description:  Implementation of the cache of script outputs
+ *
+ *        Version:  2.0
+ *        Created:  10/18/2026
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  
+ *        Company:  
+ *
+ * =====================================================================================
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <errno.h>
+#include "operations.h"
+#include "stats.h"
+#include "cache.h"
+
+extern struct Persistent persistent;
+
+#define CACHE_BUCKETS 0x1000	//!< Number of buckets of the hash table of the cache
+
+static CacheEntry *cache_table[CACHE_BUCKETS];	//!< Hash table of the entries, indexed by path
+static size_t cache_entries=0;	//!< Number of entries in the table
+static unsigned long long cache_bytes=0;	//!< Number of bytes of the cached outputs, including those reserved by cache_reserve
+static pthread_mutex_t cache_mutex=PTHREAD_MUTEX_INITIALIZER;	//!< Protects the table and its entries
+
+/**
+ * \brief Compute the bucket of a path in the hash table
+ *
+ * \param path Path relative to the mirror folder
+ * \return Index of the bucket
+ */
+static size_t cache_bucket(const char *path) {
+	return hash_path(FNV_OFFSET,path)%CACHE_BUCKETS;
+}
+
+/**
+ * \brief Find the entry of a path of a mount, must be called with cache_mutex locked
+ *
+ * \param mount Mount of the mirror folder
+ * \param path Path relative to the mirror folder
+ * \return Pointer to the entry, null if there is none
+ */
+static CacheEntry *cache_find_mount(const Mount *mount,const char *path) {
+	CacheEntry *e;
+	for (e=cache_table[cache_bucket(path)];e!=0;e=e->next) if (e->mount==mount && strcmp(e->path,path)==0) return e;
+	return 0;
+}
+
+/**
+ * \brief Find the entry of a path of the current mount, must be called with cache_mutex locked
+ *
+ * \param path Path relative to the mirror folder
+ * \return Pointer to the entry, null if there is none
+ */
+static CacheEntry *cache_find(const char *path) {
+	return cache_find_mount(current_mount(),path);
+}
+
+/**
+ * \brief Tell if an entry was recorded for the same version of a script
+ *
+ * \param e Entry of the cache
+ * \param source Current attributes of the script
+ * \return 1 if the script did not change, 0 otherwise
+ */
+static int same_source(const CacheEntry *e,const struct stat *source) {
+	return e->dev==source->st_dev && e->ino==source->st_ino && e->source_size==source->st_size && e->mtime.tv_sec==source->st_mtim.tv_sec && e->mtime.tv_nsec==source->st_mtim.tv_nsec;
+}
+
+/**
+ * \brief Remove the cached output of an entry, must be called with cache_mutex locked
+ *
+ * \param e Entry of the cache
+ */
+static void cache_drop_output(CacheEntry *e) {
+	if (e->fd<0) return;
+	close(e->fd);
+	e->fd=-1;
+	cache_bytes-=e->size;
+	e->size=0;
+}
+
+/**
+ * \brief Forget everything about the previous executions recorded in an entry, must be called with cache_mutex locked
+ *
+ * \param e Entry of the cache
+ * \param proc New procedure of the entry
+ * \param source New attributes of the script
+ */
+static void cache_reset(CacheEntry *e,Procedure *proc,const struct stat *source) {
+	cache_drop_output(e);
+	e->proc=proc;
+	e->dev=source->st_dev;
+	e->ino=source->st_ino;
+	e->source_size=source->st_size;
+	e->mtime=source->st_mtim;
+	e->state=CS_OBSERVING;
+	e->has_digest=0;
+	e->runs=0;
+	e->stable_runs=0;
+	e->avg_ms=0;
+	e->ttl=0;
+	e->expires=0;
+}
+
+uint64_t hash_path(uint64_t hash,const char *path) {
+	while (*path) {hash^=(unsigned char)*(path++);hash*=FNV_PRIME;}
+	return hash;
+}
+
+uint64_t digest_fd(int fd) {
+	uint64_t hash=FNV_OFFSET;
+	unsigned char buf[0x10000];
+	ssize_t num,i;
+	off_t offset=0;
+	while ((num=pread(fd,buf,sizeof buf,offset))>0) {
+		for (i=0;i<num;++i) {hash^=buf[i];hash*=FNV_PRIME;}
+		offset+=num;
+	}
+	return hash;
+}
+
+int cache_mode(const Procedure *proc) {
+	if (proc->cache_mode!=CACHE_DEFAULT) return proc->cache_mode;
+	return persistent.adaptive_cache?CACHE_AUTO:CACHE_NEVER;
+}
+
+int cache_lookup(const char *relative,Procedure *proc,struct stat *source,int stale) {
+	memset(source,0,sizeof(struct stat));
+	if (cache_mode(proc)==CACHE_NEVER) return -1;
+	if (fstatat(current_mount()->mirror_fd,relative,source,0)!=0) {
+		memset(source,0,sizeof(struct stat));
+		return -1;
+	}
+	int fd=-1;
+	pthread_mutex_lock(&cache_mutex);
+	CacheEntry *e=cache_find(relative);
+	if (e!=0 && e->fd>=0) {
+		if (e->proc==proc && same_source(e,source) && (stale || e->expires==0 || now_ms()<e->expires)) fd=dup(e->fd);
+		else cache_drop_output(e);	// Expired or obsolete, the state is kept so that the next output can be compared
+	}
+	pthread_mutex_unlock(&cache_mutex);
+	if (fd>=0) STAT_ADD(cache_hits,1); else STAT_ADD(cache_misses,1);
+	return fd;
+}
+
+int cache_store(const char *relative,Procedure *proc,const struct stat *source,int fd,uint64_t digest,long long duration) {
+	int mode=cache_mode(proc);
+	if (mode==CACHE_NEVER || source->st_ino==0) return -1;
+	struct stat st;
+	if (fstat(fd,&st)!=0) return -1;
+	long long now=now_ms();
+	pthread_mutex_lock(&cache_mutex);
+	CacheEntry *e=cache_find(relative);
+	if (e==0) {
+		e=(CacheEntry*)calloc(1,sizeof(CacheEntry));
+		if (e==0) {pthread_mutex_unlock(&cache_mutex);return -1;}
+		e->path=strdup(relative);
+		e->mount=current_mount();
+		e->fd=-1;
+		size_t bucket=cache_bucket(relative);
+		e->next=cache_table[bucket];
+		cache_table[bucket]=e;
+		++cache_entries;
+		cache_reset(e,proc,source);
+	} else if (e->proc!=proc || !same_source(e,source)) cache_reset(e,proc,source);
+	// Update the statistics of the path
+	++e->runs;
+	e->avg_ms=(e->runs==1)?duration:(3*e->avg_ms+duration)/4;
+	if (e->has_digest && e->digest==digest) ++e->stable_runs;
+	else {
+		if (e->has_digest && e->state==CS_CACHED) {	// The output changed, stop caching it
+			e->state=CS_DEMOTED;
+			++e->demotions;
+			STAT_ADD(cache_demotions,1);
+		}
+		e->stable_runs=1;
+		e->stable_since=now;
+	}
+	e->digest=digest;
+	e->has_digest=1;
+	// Apply the caching policy
+	int cache=0;
+	if (mode==CACHE_ALWAYS) {
+		cache=1;
+		e->state=CS_CACHED;
+		e->ttl=proc->cache_ttl;
+	} else if (e->state==CS_CACHED) {	// The output expired but did not change, keep it longer next time
+		cache=1;
+		e->ttl=(proc->cache_ttl!=0)?proc->cache_ttl:(e->ttl*2>CACHE_MAX_TTL)?CACHE_MAX_TTL:e->ttl*2;
+	} else if (e->stable_runs>=CACHE_SAMPLES && e->avg_ms>=persistent.cache_min_ms) {	// Stable and expensive, start caching
+		cache=1;
+		e->state=CS_CACHED;
+		STAT_ADD(cache_promotions,1);
+		if (proc->cache_ttl!=0) e->ttl=proc->cache_ttl;
+		else {
+			long long span=(now-e->stable_since)/1000;
+			e->ttl=(span<CACHE_MIN_TTL)?CACHE_MIN_TTL:(span>CACHE_MAX_TTL)?CACHE_MAX_TTL:span;
+		}
+	}
+	if (cache) {
+		cache_drop_output(e);
+		if (cache_bytes+st.st_size<=persistent.cache_size && (e->fd=dup(fd))>=0) {
+			e->size=st.st_size;
+			cache_bytes+=e->size;
+		}
+		e->expires=(e->ttl==0)?0:now+e->ttl*1000LL;
+	}
+	int ttl=cache?(int)e->ttl:-1;
+	pthread_mutex_unlock(&cache_mutex);
+	return ttl;
+}
+
+int cache_expected(const char *relative,Procedure *proc) {
+	int mode=cache_mode(proc);
+	if (mode!=CACHE_AUTO) return mode==CACHE_ALWAYS;
+	pthread_mutex_lock(&cache_mutex);
+	CacheEntry *e=cache_find(relative);
+	int expected=(e!=0 && e->proc==proc && e->state==CS_CACHED);
+	pthread_mutex_unlock(&cache_mutex);
+	return expected;
+}
+
+int cache_reserve(unsigned long long bytes) {
+	int code=-1;
+	pthread_mutex_lock(&cache_mutex);
+	if (cache_bytes+bytes<=persistent.cache_size) {
+		cache_bytes+=bytes;
+		code=0;
+	}
+	pthread_mutex_unlock(&cache_mutex);
+	return code;
+}
+
+void cache_release(unsigned long long bytes) {
+	pthread_mutex_lock(&cache_mutex);
+	cache_bytes-=bytes;
+	pthread_mutex_unlock(&cache_mutex);
+}
+
+void cache_foreach(CacheVisitor visit,void *arg) {
+	size_t i;
+	CacheEntry *e;
+	pthread_mutex_lock(&cache_mutex);
+	for (i=0;i<CACHE_BUCKETS;++i) for (e=cache_table[i];e!=0;e=e->next) visit(e,arg);
+	pthread_mutex_unlock(&cache_mutex);
+}
+
+int cache_import(const CacheEntry *model,int fd) {
+	pthread_mutex_lock(&cache_mutex);
+	if (cache_find_mount(model->mount,model->path)!=0) {	// Already known, keep the local state
+		pthread_mutex_unlock(&cache_mutex);
+		if (fd>=0) close(fd);
+		return EEXIST;
+	}
+	CacheEntry *e=(CacheEntry*)malloc(sizeof(CacheEntry));
+	if (e==0) {
+		pthread_mutex_unlock(&cache_mutex);
+		if (fd>=0) close(fd);
+		return ENOMEM;
+	}
+	*e=*model;
+	e->path=strdup(model->path);
+	e->fd=-1;
+	e->size=0;
+	if (fd>=0 && cache_bytes+model->size<=persistent.cache_size) {
+		e->fd=fd;
+		e->size=model->size;
+		cache_bytes+=e->size;
+	} else if (fd>=0) close(fd);
+	size_t bucket=cache_bucket(e->path);
+	e->next=cache_table[bucket];
+	cache_table[bucket]=e;
+	++cache_entries;
+	pthread_mutex_unlock(&cache_mutex);
+	return 0;
+}
+
+void free_cache() {
+	size_t i;
+	pthread_mutex_lock(&cache_mutex);
+	for (i=0;i<CACHE_BUCKETS;++i) {
+		CacheEntry *e=cache_table[i];
+		while (e!=0) {
+			CacheEntry *next=e->next;
+			cache_drop_output(e);
+			free(e->path);
+			free(e);
+			e=next;
+		}
+		cache_table[i]=0;
+	}
+	cache_entries=0;
+	pthread_mutex_unlock(&cache_mutex);
+}
+
+void render_cache(FILE *f) {
+	static const char *states[]={"observing","cached","demoted"};
+	static const char *modes[]={"default","never","auto","always"};
+	size_t i;
+	long long now=now_ms();
+	fprintf(f,"%-9s %-6s %6s %6s %8s %6s %8s %10s %9s %s\n","state","policy","runs","stable","avg_ms","ttl","expires","size","demotions","path");
+	pthread_mutex_lock(&cache_mutex);
+	for (i=0;i<CACHE_BUCKETS;++i) {
+		CacheEntry *e;
+		for (e=cache_table[i];e!=0;e=e->next) {
+			long long expires=(e->fd<0)?-1:(e->expires==0)?0:(e->expires-now)/1000;
+			fprintf(f,"%-9s %-6s %6u %6u %8lld %6u %8lld %10lld %9u %s/%s\n",states[e->state],modes[cache_mode(e->proc)],e->runs,e->stable_runs,e->avg_ms,e->ttl,expires,(long long)e->size,e->demotions,e->mount->mirror,e->path);
+		}
+	}
+	pthread_mutex_unlock(&cache_mutex);
+}
+
+void render_cache_summary(FILE *f) {
+	pthread_mutex_lock(&cache_mutex);
+	fprintf(f,"cache_entries %zu\n",cache_entries);
+	fprintf(f,"cache_bytes %llu\n",cache_bytes);
+	pthread_mutex_unlock(&cache_mutex);
+	fprintf(f,"cache_size %llu\n",persistent.cache_size);
+}
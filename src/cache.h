@@ -0,0 +1,196 @@
+/**
+ * \file
+ *
+ * =====================================================================================
+ *
+ *       Filename:  cache.h
+ *
+ *    Description:  Cache of script outputs with adaptive caching policy
+ *
+ *        Version:  2.0
+ *        Created:  10/18/2026
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  
+ *        Company:  
+ *
+ * =====================================================================================
+ */
+
+#ifndef  CACHE_INC
+#define  CACHE_INC
+
+#include <stdio.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include "procedures.h"
+
+#define CACHE_SAMPLES 3	//!< Number of successive identical outputs needed before a script is cached by the adaptive policy
+#define CACHE_MIN_TTL 1	//!< Minimal time to live (in seconds) inferred by the adaptive policy
+#define CACHE_MAX_TTL 3600	//!< Maximal time to live (in seconds) inferred by the adaptive policy
+#define DEFAULT_CACHE_MIN_MS 100	//!< Default minimal duration (in milliseconds) of a script for the adaptive policy to cache it
+#define DEFAULT_CACHE_SIZE 0x10000000	//!< Default maximal number of bytes of cached outputs
+#define FNV_OFFSET 0xcbf29ce484222325ULL	//!< Offset basis of the 64-bit FNV-1a hash
+#define FNV_PRIME 0x100000001b3ULL	//!< Prime of the 64-bit FNV-1a hash
+
+/**
+ * \brief State of a path for the caching policy
+ */
+enum CacheState {
+	CS_OBSERVING,	//!< Executions of the script are observed, the output is not cached
+	CS_CACHED,	//!< The output of the script is cached
+	CS_DEMOTED	//!< The output was cached but changed, executions are observed again
+};
+
+/**
+ * \brief Entry of the cache
+ *
+ * An entry is created for each script path which procedure may cache the output. It holds the identity of the script when it was last executed, the statistics used by the adaptive policy and, if the output is cached, a descriptor of the file holding the output.
+ */
+typedef struct CacheEntry {
+	char *path;	//!< Path of the script, relative to the mirror folder
+	struct Mount *mount;	//!< Mount of the mirror folder
+	Procedure *proc;	//!< Procedure used to produce the output
+	dev_t dev;	//!< Device of the script when it was last executed
+	ino_t ino;	//!< Inode of the script when it was last executed
+	off_t source_size;	//!< Size of the script when it was last executed
+	struct timespec mtime;	//!< Last modification time of the script when it was last executed
+	int state;	//!< State of the path for the caching policy (see enum CacheState)
+	int fd;	//!< Descriptor of the unlinked file holding the output, -1 if the output is not cached
+	off_t size;	//!< Size of the cached output
+	uint64_t digest;	//!< Digest of the last output
+	int has_digest;	//!< Tells if digest holds a valid value
+	unsigned int runs;	//!< Number of executions observed
+	unsigned int stable_runs;	//!< Number of successive executions with the same output
+	long long stable_since;	//!< Time (in milliseconds) of the first execution with the current output
+	long long avg_ms;	//!< Moving average of the duration of the executions, in milliseconds
+	unsigned int ttl;	//!< Time to live of the cached output in seconds, 0 to keep it until the script changes
+	long long expires;	//!< Time (in milliseconds) when the cached output expires, 0 if it never expires
+	unsigned int demotions;	//!< Number of times the cached output changed
+	struct CacheEntry *next;	//!< Next entry in the same bucket of the hash table
+} CacheEntry;
+
+/**
+ * \brief Add a path to a 64-bit FNV-1a hash
+ *
+ * It is the hash of the tables indexed by path (cache, index, compressed outputs, generations, hot paths).
+ * \param hash Current value of the hash, FNV_OFFSET to start a new one
+ * \param path Path, without its terminating null character
+ * \return New value of the hash
+ */
+uint64_t hash_path(uint64_t hash,const char *path);
+
+/**
+ * \brief Compute the digest of the content of a file
+ *
+ * \param fd Descriptor of the file, which position is not changed
+ * \return 64-bit FNV-1a digest of the content of the file
+ */
+uint64_t digest_fd(int fd);
+
+/**
+ * \brief Get the effective caching policy of a procedure
+ *
+ * \param proc Procedure
+ * \return Caching policy (see enum CacheMode), never CACHE_DEFAULT
+ */
+int cache_mode(const Procedure *proc);
+
+/**
+ * \brief Look for the cached output of a script
+ *
+ * The function gets the current identity of the script and returns a new descriptor of the cached output if there is one for the same procedure and the same version of the script, and it has not expired (or stale outputs are accepted).
+ * \param relative Path of the script relative to the mirror folder of the current mount
+ * \param proc Procedure used to produce the output
+ * \param source Structure filled with the attributes of the script, to be given to cache_store after the execution
+ * \param stale If non-zero, an output which expired is still returned, as long as the script did not change
+ * \return New descriptor of the cached output, which must be closed by the caller, -1 if the output is not cached
+ */
+int cache_lookup(const char *relative,Procedure *proc,struct stat *source,int stale);
+
+/**
+ * \brief Record an execution of a script
+ *
+ * The function updates the statistics of the path with the duration and the digest of the output, then applies the caching policy of the procedure. If the output has to be cached, a duplicate of the descriptor is kept in the cache. The adaptive policy caches the output after CACHE_SAMPLES successive identical outputs if the script is slower than the configured threshold, with a time to live inferred from the time during which the output remained the same. A change of the output removes the script from the cache.
+ * \param relative Path of the script relative to the mirror folder
+ * \param proc Procedure used to produce the output
+ * \param source Attributes of the script before its execution, as given by cache_lookup
+ * \param fd Descriptor of the file holding the output
+ * \param digest Digest of the output (see digest_fd), computed once by the caller for all the consumers of the output
+ * \param duration Duration of the execution in milliseconds
+ * \return Time to live of the output in seconds if the policy decided to cache it (0 if it is kept until the script changes), -1 otherwise
+ */
+int cache_store(const char *relative,Procedure *proc,const struct stat *source,int fd,uint64_t digest,long long duration);
+
+/**
+ * \brief Tell if the next output of a script is expected to be cached
+ *
+ * It is the case if the procedure always caches its outputs, or if the adaptive policy already cached the output of the script.
+ * \param relative Path of the script relative to the mirror folder of the current mount
+ * \param proc Procedure used to produce the output
+ * \return 1 if the output is expected to be cached, 0 otherwise
+ */
+int cache_expected(const char *relative,Procedure *proc);
+
+/**
+ * \brief Take bytes from the budget of the cached outputs
+ *
+ * The budget (persistent.cache_size) is shared by the outputs of the cache and the compressed outputs (see compress_output), which reserve their size with this function.
+ * \param bytes Number of bytes
+ * \return 0 if the bytes fit in the budget and were reserved, -1 otherwise
+ */
+int cache_reserve(unsigned long long bytes);
+
+/**
+ * \brief Give back bytes reserved by cache_reserve
+ *
+ * \param bytes Number of bytes
+ */
+void cache_release(unsigned long long bytes);
+
+/**
+ * \brief Type of a function called on each entry of the cache by cache_foreach
+ *
+ * The function is called with the entry and the argument given to cache_foreach. The cache is locked during the call, the function must not call the other functions of the cache nor block (it should copy what it needs, and use the copy once cache_foreach returned).
+ */
+typedef void (*CacheVisitor)(const CacheEntry*,void*);
+
+/**
+ * \brief Call a function on each entry of the cache
+ *
+ * \param visit Function called on each entry
+ * \param arg Argument given to the function
+ */
+void cache_foreach(CacheVisitor visit,void *arg);
+
+/**
+ * \brief Add an entry recorded by another process to the cache
+ *
+ * The statistics, state and identity of the script are copied from the model, whose path, mount and procedure must be valid in this process. The entry is not added if the path is already known. The descriptor of the cached output is kept by the cache if its budget allows it, otherwise it is closed.
+ * \param model Entry to copy, the next and fd fields are ignored
+ * \param fd Descriptor of the cached output, owned by the function, -1 if the output is not cached
+ * \return 0 if the entry was added, an error code otherwise
+ */
+int cache_import(const CacheEntry *model,int fd);
+
+/**
+ * \brief Release all the entries of the cache
+ */
+void free_cache();
+
+/**
+ * \brief Write the state of each path of the cache
+ *
+ * \param f Stream on which the state is written
+ */
+void render_cache(FILE *f);
+
+/**
+ * \brief Write a summary of the cache (number of entries and cached bytes)
+ *
+ * \param f Stream on which the summary is written
+ */
+void render_cache_summary(FILE *f);
+
+#endif   /* ----- #ifndef CACHE_INC  ----- */
@@ -0,0 +1,419 @@
+/**
+ * \file
+ *
+ * =====================================================================================
+ *
+ *       Filename:  cacheserver.c
+ *
+ *    Description:  Reference server of the remote cache of script outputs
+ *
+ *        Version:  2.0
+ *        Created:  10/18/2026
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  
+ *        Company:  
+ *
+ * =====================================================================================
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <limits.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <netdb.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sysexits.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/sendfile.h>
+#include "sha256.h"
+
+#define KEY_LENGTH 64	//!< Number of hexadecimal digits of a key
+#define MAC_LENGTH (2*SHA256_SIZE)	//!< Number of hexadecimal digits of the authentication code of an output
+#define LINE_LENGTH 0x100	//!< Maximal length of a line of the protocol
+#define SECRET_LENGTH 0x400	//!< Maximal length of the shared secret
+#define DEFAULT_SIZE 0x40000000ULL	//!< Default maximal number of bytes of the stored outputs
+
+/**
+ * \brief Output found while enforcing the budget of the store
+ */
+typedef struct StoredFile {
+	char name[KEY_LENGTH+1];	//!< Key of the output
+	time_t atime;	//!< Last use of the output
+	off_t size;	//!< Size of the output
+} StoredFile;
+
+static int store_fd=-1;	//!< Descriptor of the folder holding the outputs
+static unsigned long long store_size=DEFAULT_SIZE;	//!< Maximal number of bytes of the stored outputs
+static int verbose=0;	//!< If non-zero, each request is written on the standard error
+static pthread_mutex_t store_mutex=PTHREAD_MUTEX_INITIALIZER;	//!< Serializes the evictions
+static unsigned char secret[SECRET_LENGTH];	//!< Secret shared with the clients, authenticates the outputs
+static size_t secret_length=0;	//!< Length of the secret, 0 if the outputs are not authenticated
+static const char no_mac[MAC_LENGTH+1]="0000000000000000000000000000000000000000000000000000000000000000";	//!< Authentication code stored with the outputs sent without one
+
+/**
+ * \brief Display a brief help about the syntax and exit the program
+ *
+ * \param code Error code that will be returned at the termination of the program
+ */
+void print_usage(int code) {
+	printf("Syntax: scriptfs-cacheserver [arguments] address folder\n");
+	printf("Arguments:\n");
+	printf("	--size=megabytes\n\t\tMaximal size of the stored outputs (default: %llu)\n",DEFAULT_SIZE>>20);
+	printf("	--secret=file\n\t\tOnly store the outputs authenticated with the secret held by this file\n");
+	printf("	-v\n\t\tWrite each request on the standard error\n");
+	printf("	address\n\t\tunix:/path/to/socket or tcp:[host]:port\n");
+	printf("	folder\n\t\tFolder in which the outputs are stored\n");
+	exit(code);
+}
+
+/**
+ * \brief Tell if a string is made of a given number of hexadecimal digits
+ *
+ * \param str String
+ * \param len Number of digits
+ * \return 1 if the string holds len lowercase hexadecimal digits, 0 otherwise
+ */
+static int valid_hex(const char *str,size_t len) {
+	size_t i;
+	for (i=0;i<len;++i) if (!((str[i]>='0' && str[i]<='9') || (str[i]>='a' && str[i]<='f'))) return 0;
+	return str[len]==0;
+}
+
+/**
+ * \brief Tell if a string is a valid key
+ *
+ * \param key String
+ * \return 1 if the string holds KEY_LENGTH lowercase hexadecimal digits, 0 otherwise
+ */
+static int valid_key(const char *key) {
+	return valid_hex(key,KEY_LENGTH);
+}
+
+/**
+ * \brief Compare two outputs by last use, for qsort
+ *
+ * \param a Pointer to the first StoredFile structure
+ * \param b Pointer to the second StoredFile structure
+ * \return Negative value if a was used before b, positive value if it was used after, 0 otherwise
+ */
+static int compare_use(const void *a,const void *b) {
+	time_t ta=((const StoredFile*)a)->atime,tb=((const StoredFile*)b)->atime;
+	return (ta<tb)?-1:(ta>tb)?1:0;
+}
+
+/**
+ * \brief Remove the least recently used outputs until a new output fits in the budget, must be called with store_mutex locked
+ *
+ * \param incoming Size of the new output
+ */
+static void evict(off_t incoming) {
+	int fd=openat(store_fd,".",O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	DIR *dir=(fd>=0)?fdopendir(fd):0;
+	StoredFile *files=0;
+	size_t num=0,max=0,i;
+	unsigned long long total=0;
+	struct dirent *de;
+	while (dir!=0 && (de=readdir(dir))!=0) {
+		struct stat st;
+		if (!valid_key(de->d_name) || fstatat(store_fd,de->d_name,&st,AT_SYMLINK_NOFOLLOW)!=0 || !S_ISREG(st.st_mode)) continue;
+		if (num==max) {
+			StoredFile *more=(StoredFile*)realloc(files,(max=max?2*max:0x100)*sizeof(StoredFile));
+			if (more==0) break;
+			files=more;
+		}
+		strcpy(files[num].name,de->d_name);
+		files[num].atime=st.st_atime;
+		files[num].size=st.st_size;
+		total+=st.st_size;
+		++num;
+	}
+	if (dir!=0) closedir(dir); else if (fd>=0) close(fd);
+	if (total+incoming>store_size) {
+		qsort(files,num,sizeof(StoredFile),compare_use);
+		for (i=0;i<num && total+incoming>store_size;++i) {
+			unlinkat(store_fd,files[i].name,0);
+			total-=files[i].size;
+			if (verbose) fprintf(stderr,"EVICT %s\n",files[i].name);
+		}
+	}
+	free(files);
+}
+
+/**
+ * \brief Read a line of the protocol
+ *
+ * \param sock Connected socket
+ * \param line Buffer receiving the line, without the newline character
+ * \param size Size of the buffer
+ * \return 0 if a line was read, -1 otherwise
+ */
+static int read_line(int sock,char *line,size_t size) {
+	size_t len=0;
+	while (len+1<size) {
+		ssize_t num=read(sock,line+len,1);
+		if (num<0 && errno==EINTR) continue;
+		if (num<=0) return -1;
+		if (line[len]=='\n') {line[len]=0;return 0;}
+		++len;
+	}
+	return -1;
+}
+
+/**
+ * \brief Write a string on a socket
+ *
+ * \param sock Connected socket
+ * \param str String
+ * \return 0 if everything was written, -1 otherwise
+ */
+static int write_string(int sock,const char *str) {
+	size_t len=strlen(str);
+	while (len>0) {
+		ssize_t num=send(sock,str,len,MSG_NOSIGNAL);
+		if (num<0 && errno==EINTR) continue;
+		if (num<=0) return -1;
+		str+=num;
+		len-=num;
+	}
+	return 0;
+}
+
+/**
+ * \brief Answer a GET request
+ *
+ * \param sock Connected socket
+ * \param key Key of the output
+ * \return 0 if the connection may go on, -1 otherwise
+ */
+static int serve_get(int sock,const char *key) {
+	char line[LINE_LENGTH];
+	struct stat st;
+	char mac[MAC_LENGTH+1];
+	int fd=valid_key(key)?openat(store_fd,key,O_RDONLY | O_CLOEXEC):-1;
+	if (fd<0 || fstat(fd,&st)!=0 || st.st_size<=MAC_LENGTH || pread(fd,mac,MAC_LENGTH+1,0)!=MAC_LENGTH+1 || mac[MAC_LENGTH]!='\n') {	// The file starts with the authentication code of the output
+		if (fd>=0) close(fd);
+		if (verbose) fprintf(stderr,"MISS %s\n",key);
+		return write_string(sock,"MISS\n");
+	}
+	struct timespec ts[2]={{0,UTIME_NOW},{0,UTIME_OMIT}};
+	futimens(fd,ts);	// Record the use for the eviction
+	mac[MAC_LENGTH]=0;
+	snprintf(line,sizeof line,"HIT %lld %s\n",(long long)st.st_size-MAC_LENGTH-1,mac);
+	int code=write_string(sock,line);
+	off_t offset=MAC_LENGTH+1;
+	while (code==0 && offset<st.st_size) {
+		ssize_t num=sendfile(sock,fd,&offset,st.st_size-offset);
+		if (num<0 && errno==EINTR) continue;
+		if (num<=0) code=-1;
+	}
+	close(fd);
+	if (verbose) fprintf(stderr,"HIT %s %lld\n",key,(long long)st.st_size-MAC_LENGTH-1);
+	return code;
+}
+
+/**
+ * \brief Answer a PUT request
+ *
+ * The output is received in an unnamed file of the folder, after its authentication code, then linked under a temporary name and renamed over its key once complete, so that a GET never sees a partial output. With a secret, the output is only stored if its code is valid.
+ * \param sock Connected socket
+ * \param key Key of the output
+ * \param size Size of the output
+ * \param mac Authentication code of the output, empty if the client gave none
+ * \return 0 if the connection may go on, -1 otherwise
+ */
+static int serve_put(int sock,const char *key,long long size,const char *mac) {
+	static unsigned int temps=0;	// Makes the temporary names unique
+	char buf[0x10000];
+	int fd=(size>=0 && size<=store_size && valid_key(key))?openat(store_fd,".",O_TMPFILE | O_RDWR | O_CLOEXEC,0644):-1;
+	if (*mac!=0 && !valid_hex(mac,MAC_LENGTH) && fd>=0) {close(fd);fd=-1;}
+	if (fd>=0 && (write(fd,(*mac)?mac:no_mac,MAC_LENGTH)!=MAC_LENGTH || write(fd,"\n",1)!=1)) {close(fd);fd=-1;}
+	Hmac m;
+	if (secret_length>0) {
+		int len=snprintf(buf,sizeof buf,"%s %lld\n",key,size);
+		hmac_init(&m,secret,secret_length);
+		hmac_update(&m,buf,len);
+	}
+	long long left=size;
+	while (left>0) {	// Always read the output, so that the connection stays usable
+		ssize_t num=read(sock,buf,(left<sizeof buf)?left:sizeof buf);
+		if (num<0 && errno==EINTR) continue;
+		if (num<=0) {
+			if (fd>=0) close(fd);
+			return -1;
+		}
+		if (fd>=0 && write(fd,buf,num)!=num) {close(fd);fd=-1;}
+		if (secret_length>0) hmac_update(&m,buf,num);
+		left-=num;
+	}
+	if (fd<0) return write_string(sock,"ERROR output not stored\n");
+	if (secret_length>0) {
+		unsigned char code[SHA256_SIZE];
+		char hex[MAC_LENGTH+1];
+		hmac_final(&m,code);
+		to_hex(code,sizeof code,hex);
+		if (strcmp(hex,mac)!=0) {
+			close(fd);
+			if (verbose) fprintf(stderr,"REFUSED %s\n",key);
+			return write_string(sock,"ERROR output not authenticated\n");
+		}
+	}
+	char path[64],temp[KEY_LENGTH+32];
+	snprintf(path,sizeof path,"/proc/self/fd/%d",fd);
+	snprintf(temp,sizeof temp,"%s.%u.tmp",key,__atomic_fetch_add(&temps,1,__ATOMIC_RELAXED));	// Not a key, never taken for an output
+	pthread_mutex_lock(&store_mutex);
+	evict(size+MAC_LENGTH+1);
+	if (linkat(AT_FDCWD,path,store_fd,temp,AT_SYMLINK_FOLLOW)==0 && renameat(store_fd,temp,store_fd,key)!=0) unlinkat(store_fd,temp,0);
+	pthread_mutex_unlock(&store_mutex);
+	close(fd);
+	if (verbose) fprintf(stderr,"PUT %s %lld\n",key,size);
+	return write_string(sock,"STORED\n");
+}
+
+/**
+ * \brief Serve the requests of a connection until it is closed
+ *
+ * \param arg Connected socket, cast to a pointer
+ * \return Null pointer
+ */
+static void *serve_connection(void *arg) {
+	int sock=(int)(intptr_t)arg;
+	char line[LINE_LENGTH],key[LINE_LENGTH],mac[LINE_LENGTH];
+	long long size;
+	int code=0;
+	while (code==0 && read_line(sock,line,sizeof line)==0) {
+		*mac=0;
+		if (sscanf(line,"GET %255s",key)==1) code=serve_get(sock,key);
+		else if (sscanf(line,"PUT %255s %lld %255s",key,&size,mac)>=2) code=serve_put(sock,key,size,mac);
+		else code=-1;
+	}
+	close(sock);
+	return 0;
+}
+
+/**
+ * \brief Create the listening socket
+ *
+ * \param address Address, unix:/path or tcp:[host]:port
+ * \return Listening socket, -1 if it cannot be created (a message is printed)
+ */
+static int listen_on(const char *address) {
+	int sock=-1;
+	if (strncmp(address,"unix:",5)==0) {
+		struct sockaddr_un addr;
+		memset(&addr,0,sizeof addr);
+		addr.sun_family=AF_UNIX;
+		if (strlen(address+5)>=sizeof addr.sun_path) {
+			fprintf(stderr,"Socket path too long: %s\n",address+5);
+			return -1;
+		}
+		strcpy(addr.sun_path,address+5);
+		unlink(addr.sun_path);
+		sock=socket(AF_UNIX,SOCK_STREAM | SOCK_CLOEXEC,0);
+		if (sock>=0 && (bind(sock,(struct sockaddr*)&addr,sizeof addr)!=0 || listen(sock,SOMAXCONN)!=0)) {close(sock);sock=-1;}
+	} else if (strncmp(address,"tcp:",4)==0 && strrchr(address+4,':')!=0) {
+		char host[LINE_LENGTH];
+		const char *port=strrchr(address+4,':');
+		snprintf(host,sizeof host,"%.*s",(int)(port-address-4),address+4);
+		struct addrinfo hints,*res,*ai;
+		memset(&hints,0,sizeof hints);
+		hints.ai_socktype=SOCK_STREAM;
+		hints.ai_flags=AI_PASSIVE;
+		if (getaddrinfo((*host)?host:0,port+1,&hints,&res)!=0) {
+			fprintf(stderr,"Cannot resolve %s\n",address);
+			return -1;
+		}
+		for (ai=res;ai!=0 && sock<0;ai=ai->ai_next) {
+			int one=1;
+			sock=socket(ai->ai_family,ai->ai_socktype | SOCK_CLOEXEC,ai->ai_protocol);
+			if (sock<0) continue;
+			setsockopt(sock,SOL_SOCKET,SO_REUSEADDR,&one,sizeof one);
+			if (bind(sock,ai->ai_addr,ai->ai_addrlen)!=0 || listen(sock,SOMAXCONN)!=0) {close(sock);sock=-1;}
+		}
+		freeaddrinfo(res);
+	} else {
+		fprintf(stderr,"Invalid address %s\n",address);
+		return -1;
+	}
+	if (sock<0) fprintf(stderr,"Cannot listen on %s: %s\n",address,strerror(errno));
+	return sock;
+}
+
+/**
+ * \brief Main program, serves the remote cache
+ *
+ * The server stores each output in a file of the folder named after its key, after a line holding its authentication code, and removes the least recently used outputs when the budget is exceeded. See \ref remoteprotocol "Protocol of the remote cache". Possible command line arguments are:
+ *      - --size=megabytes
+ *              Maximal size of the stored outputs.
+ *      - --secret=file
+ *              Refuse the outputs which are not authenticated with the secret held by the file (trailing newline characters are ignored). Without a secret, anybody who can connect may store outputs: the socket must then only be reachable by trusted hosts.
+ *      - -v
+ *              Write each request on the standard error.
+ *
+ * \param argc Number of command line arguments, including the name of the calling program
+ * \param argv Array of command line arguments, the first one being the path to the calling program
+ * \return Error code, 0 if everything went fine
+ */
+int main(int argc,char **argv) {
+	int i;
+	for (i=1;i<argc && argv[i][0]=='-';++i) {
+		if (strncmp(argv[i],"--size=",7)==0) {
+			char *end;
+			const char *value=argv[i]+7;
+			errno=0;
+			unsigned long long size=strtoull(value,&end,10);
+			if (*value<'0' || *value>'9' || *end!=0 || errno!=0 || size>(ULLONG_MAX>>20)) {
+				fprintf(stderr,"--size needs a number of megabytes\n");
+				print_usage(EX_USAGE);
+			}
+			store_size=size<<20;
+		} else if (strncmp(argv[i],"--secret=",9)==0) {
+			int fd=open(argv[i]+9,O_RDONLY | O_CLOEXEC);
+			ssize_t len=(fd>=0)?read(fd,secret,sizeof secret):-1;
+			if (fd>=0) close(fd);
+			while (len>0 && (secret[len-1]=='\n' || secret[len-1]=='\r')) --len;
+			if (len<=0 || len==sizeof secret) {
+				fprintf(stderr,"Cannot read the secret from %s\n",argv[i]+9);
+				return EX_NOINPUT;
+			}
+			secret_length=len;
+		} else if (strcmp(argv[i],"-v")==0) verbose=1;
+		else print_usage(EX_USAGE);
+	}
+	if (argc-i!=2) print_usage(EX_USAGE);
+	if (mkdir(argv[i+1],0755)!=0 && errno!=EEXIST) {
+		fprintf(stderr,"Cannot create folder %s: %s\n",argv[i+1],strerror(errno));
+		return EX_CANTCREAT;
+	}
+	store_fd=open(argv[i+1],O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (store_fd<0) {
+		fprintf(stderr,"Cannot open folder %s: %s\n",argv[i+1],strerror(errno));
+		return EX_NOINPUT;
+	}
+	int sock=listen_on(argv[i]);
+	if (sock<0) return EX_UNAVAILABLE;
+	signal(SIGPIPE,SIG_IGN);
+	for (;;) {
+		int conn=accept4(sock,0,0,SOCK_CLOEXEC);
+		if (conn<0) {
+			if (errno==EINTR || errno==ECONNABORTED) continue;
+			fprintf(stderr,"accept failed: %s\n",strerror(errno));
+			return EX_OSERR;
+		}
+		pthread_t thread;
+		if (pthread_create(&thread,0,serve_connection,(void*)(intptr_t)conn)!=0) close(conn);
+		else pthread_detach(thread);
+	}
+	return 0;
+}
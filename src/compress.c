@@ -0,0 +1,360 @@
+/*
+ * =====================================================================================
+ *
+ *       Filename:  compress.c
+ *
+ *    Description:  Implementation of the compressed siblings
+ *
+ *        Version:  2.0
+ *        Created:  10/18/2026
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  
+ *        Company:  
+ *
+ * =====================================================================================
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <zlib.h>
+#include "operations.h"
+#include "stats.h"
+#include "cache.h"
+#include "parallel.h"
+#include "compress.h"
+
+extern struct Persistent persistent;
+
+#define COMPRESS_BUCKETS 0x400	//!< Number of buckets of the hash table of the compressed outputs
+
+/**
+ * \brief Compressed output kept for the next requests
+ */
+typedef struct Compressed {
+	char *path;	//!< Path of the script, relative to the mirror folder
+	const struct Mount *mount;	//!< Mount of the mirror folder
+	int compression;	//!< Format of the compressed output
+	uint64_t digest;	//!< Digest of the output which was compressed
+	int fd;	//!< Descriptor of the unlinked file holding the compressed output
+	off_t size;	//!< Size of the compressed output, reserved in the budget of the cache
+	struct Compressed *next;	//!< Next element in the same bucket of the hash table
+	struct Compressed *newer;	//!< Compressed output used more recently, null for the most recent one or if the output is not kept
+	struct Compressed *older;	//!< Compressed output used less recently, null for the least recent one or if the output is not kept
+} Compressed;
+
+static Compressed *compressed_table[COMPRESS_BUCKETS];	//!< Hash table of the compressed outputs, indexed by path
+static Compressed *compressed_newest=0;	//!< Kept compressed output used most recently
+static Compressed *compressed_oldest=0;	//!< Kept compressed output used least recently, the first one evicted
+static unsigned int compress_helpers=0;	//!< Number of threads helping the compressions in progress
+static pthread_mutex_t compressed_mutex=PTHREAD_MUTEX_INITIALIZER;	//!< Protects the table, its elements and compress_helpers
+
+/**
+ * \brief Block of an output compressed by a job
+ */
+typedef struct CompressJob {
+	int fd;	//!< Descriptor of the output
+	off_t offset;	//!< Position of the block in the output
+	size_t size;	//!< Size of the block
+	unsigned char *out;	//!< Gzip member of the block, allocated by the job
+	size_t out_size;	//!< Size of the gzip member
+	int code;	//!< 0 if the block was compressed, negative error code otherwise
+} CompressJob;
+
+int sibling_base(const char *relative,char *base,size_t size) {
+	size_t len=strlen(relative);
+	if (len<=3 || strcmp(relative+len-3,".gz")!=0 || len-3>=size || relative[len-4]=='/') return COMPRESS_NONE;
+	memcpy(base,relative,len-3);
+	base[len-3]=0;
+	return COMPRESS_GZIP;
+}
+
+/**
+ * \brief Compute the bucket of a path in the hash table
+ *
+ * \param path Path relative to the mirror folder
+ * \return Index of the bucket
+ */
+static size_t compressed_bucket(const char *path) {
+	return hash_path(FNV_OFFSET,path)%COMPRESS_BUCKETS;
+}
+
+/**
+ * \brief Find the compressed output of a path of the current mount, must be called with compressed_mutex locked
+ *
+ * \param path Path relative to the mirror folder
+ * \param compression Format of the compressed output
+ * \return Pointer to the compressed output, null if there is none
+ */
+static Compressed *compressed_find(const char *path,int compression) {
+	const Mount *mount=current_mount();
+	Compressed *e;
+	for (e=compressed_table[compressed_bucket(path)];e!=0;e=e->next) if (e->mount==mount && e->compression==compression && strcmp(e->path,path)==0) return e;
+	return 0;
+}
+
+/**
+ * \brief Remove a kept compressed output from the LRU list, must be called with compressed_mutex locked
+ *
+ * \param e Compressed output
+ */
+static void compressed_unlink(Compressed *e) {
+	if (e->newer) e->newer->older=e->older; else compressed_newest=e->older;
+	if (e->older) e->older->newer=e->newer; else compressed_oldest=e->newer;
+	e->newer=0;
+	e->older=0;
+}
+
+/**
+ * \brief Make a kept compressed output the most recently used one, must be called with compressed_mutex locked
+ *
+ * \param e Compressed output, either in the LRU list or just kept
+ */
+static void compressed_touch(Compressed *e) {
+	if (e==compressed_newest) return;
+	if (e->newer!=0 || e->older!=0 || e==compressed_oldest) compressed_unlink(e);
+	e->older=compressed_newest;
+	if (compressed_newest) compressed_newest->newer=e; else compressed_oldest=e;
+	compressed_newest=e;
+}
+
+/**
+ * \brief Stop keeping a compressed output and give its size back to the budget, must be called with compressed_mutex locked
+ *
+ * \param e Compressed output
+ */
+static void compressed_drop(Compressed *e) {
+	if (e->fd<0) return;
+	compressed_unlink(e);
+	close(e->fd);
+	cache_release(e->size);
+	e->fd=-1;
+	e->size=0;
+}
+
+/**
+ * \brief Reserve room for a compressed output, evicting the least recently used ones if needed, must be called with compressed_mutex locked
+ *
+ * \param size Size of the compressed output
+ * \return 0 if the size was reserved in the budget of the cache, -1 if it does not fit even without any other compressed output
+ */
+static int compressed_reserve(off_t size) {
+	if ((unsigned long long)size>persistent.cache_size) return -1;	// Evicting would not help
+	while (cache_reserve(size)!=0) {
+		if (compressed_oldest==0) return -1;
+		compressed_drop(compressed_oldest);
+		STAT_ADD(compressed_evictions,1);
+	}
+	return 0;
+}
+
+/**
+ * \brief Take threads to help a compression, within persistent.compress_jobs for all the compressions at once
+ *
+ * \param wanted Number of threads wanted
+ * \return Number of threads granted, which must be given back with give_helpers
+ */
+static unsigned int take_helpers(unsigned int wanted) {
+	pthread_mutex_lock(&compressed_mutex);
+	unsigned int available=(compress_helpers+1<persistent.compress_jobs)?persistent.compress_jobs-1-compress_helpers:0;	// The thread of the request is not counted
+	if (wanted>available) wanted=available;
+	compress_helpers+=wanted;
+	pthread_mutex_unlock(&compressed_mutex);
+	return wanted;
+}
+
+/**
+ * \brief Give back threads taken with take_helpers
+ *
+ * \param num Number of threads
+ */
+static void give_helpers(unsigned int num) {
+	pthread_mutex_lock(&compressed_mutex);
+	compress_helpers-=num;
+	pthread_mutex_unlock(&compressed_mutex);
+}
+
+/**
+ * \brief Job compressing one block of an output into a gzip member
+ *
+ * \param arg Array of CompressJob structures
+ * \param i Index of the block in the array
+ */
+static void compress_job(void *arg,size_t i) {
+	CompressJob *job=((CompressJob*)arg)+i;
+	unsigned char *in=(unsigned char*)malloc(job->size+1);
+	if (in==0) {job->code=-ENOMEM;return;}
+	size_t done=0;
+	while (done<job->size) {
+		ssize_t num=pread(job->fd,in+done,job->size-done,job->offset+done);
+		if (num<0 && errno==EINTR) continue;
+		if (num<=0) break;
+		done+=num;
+	}
+	if (done<job->size) {
+		free(in);
+		job->code=-EIO;
+		return;
+	}
+	z_stream z;
+	memset(&z,0,sizeof z);
+	if (deflateInit2(&z,Z_DEFAULT_COMPRESSION,Z_DEFLATED,15+16,8,Z_DEFAULT_STRATEGY)!=Z_OK) {	// 16 asks for a gzip header and trailer
+		free(in);
+		job->code=-ENOMEM;
+		return;
+	}
+	uLong bound=deflateBound(&z,job->size);
+	job->out=(unsigned char*)malloc(bound);
+	if (job->out!=0) {
+		z.next_in=in;
+		z.avail_in=job->size;
+		z.next_out=job->out;
+		z.avail_out=bound;
+		if (deflate(&z,Z_FINISH)==Z_STREAM_END) {
+			job->out_size=bound-z.avail_out;
+			job->code=0;
+		} else job->code=-EIO;
+	} else job->code=-ENOMEM;
+	deflateEnd(&z);
+	free(in);
+}
+
+/**
+ * \brief Compress an output in a new temporary file
+ *
+ * \param handle Descriptor of the output
+ * \param size Size of the output
+ * \return Descriptor of the compressed output, negative error code if something went wrong
+ */
+static int compress_file(int handle,off_t size) {
+	char temp_filename[sizeof(persistent.tmp_template)];
+	strncpy(temp_filename,persistent.tmp_template,sizeof temp_filename-1);
+	temp_filename[sizeof temp_filename-1]=0;
+	int fd=mkstemp(temp_filename);
+	if (fd<0) return -errno;
+	unlink(temp_filename);
+	size_t blocks=(size+COMPRESS_BLOCK-1)/COMPRESS_BLOCK;
+	if (blocks==0) blocks=1;	// An empty output still gives a gzip member
+	unsigned int helpers=take_helpers((blocks-1<UINT_MAX)?blocks-1:UINT_MAX);
+	unsigned int width=helpers+1;
+	size_t batch=(blocks<2*width)?blocks:2*width;	// Blocks compressed at once, their members are held in memory until they are written
+	CompressJob *jobs=(CompressJob*)malloc(batch*sizeof(CompressJob));
+	if (jobs==0) {
+		give_helpers(helpers);
+		close(fd);
+		return -ENOMEM;
+	}
+	int code=0;
+	size_t first,i;
+	for (first=0;first<blocks && code==0;first+=batch) {
+		size_t num=(blocks-first<batch)?blocks-first:batch;
+		for (i=0;i<num;++i) {
+			jobs[i].fd=handle;
+			jobs[i].offset=(off_t)(first+i)*COMPRESS_BLOCK;
+			jobs[i].size=(size-jobs[i].offset<COMPRESS_BLOCK)?size-jobs[i].offset:COMPRESS_BLOCK;
+			jobs[i].out=0;
+			jobs[i].out_size=0;
+			jobs[i].code=-EIO;
+		}
+		parallel_for(num,width,compress_job,jobs);
+		for (i=0;i<num;++i) {
+			if (code==0) code=jobs[i].code;
+			size_t done=0;
+			while (code==0 && done<jobs[i].out_size) {
+				ssize_t written=write(fd,jobs[i].out+done,jobs[i].out_size-done);
+				if (written<0 && errno==EINTR) continue;
+				if (written<=0) code=(written<0)?-errno:-EIO;
+				else done+=written;
+			}
+			free(jobs[i].out);
+		}
+	}
+	free(jobs);
+	give_helpers(helpers);
+	if (code!=0) {
+		close(fd);
+		return code;
+	}
+	return fd;
+}
+
+int compress_output(const char *relative,int compression,int handle,uint64_t digest) {
+	struct stat st;
+	if (fstat(handle,&st)!=0) {
+		int code=-errno;
+		close(handle);
+		return code;
+	}
+	if (digest==0) digest=digest_fd(handle);
+	int fd=-1;
+	pthread_mutex_lock(&compressed_mutex);
+	Compressed *e=compressed_find(relative,compression);
+	if (e!=0 && e->fd>=0 && e->digest==digest && (fd=dup(e->fd))>=0) compressed_touch(e);
+	pthread_mutex_unlock(&compressed_mutex);
+	if (fd>=0) {	// Same output as last time
+		close(handle);
+		STAT_ADD(compressed_hits,1);
+		return fd;
+	}
+	fd=compress_file(handle,st.st_size);
+	close(handle);
+	if (fd<0) return fd;
+	STAT_ADD(compressed_outputs,1);
+	struct stat cst;
+	if (fstat(fd,&cst)!=0) return fd;
+	pthread_mutex_lock(&compressed_mutex);
+	e=compressed_find(relative,compression);
+	if (e!=0) compressed_drop(e);	// Replace the previous output
+	else if ((e=(Compressed*)malloc(sizeof(Compressed)))!=0) {
+		if ((e->path=strdup(relative))==0) {
+			free(e);
+			e=0;
+		} else {
+			size_t bucket=compressed_bucket(relative);
+			e->mount=current_mount();
+			e->compression=compression;
+			e->fd=-1;
+			e->size=0;
+			e->newer=0;
+			e->older=0;
+			e->next=compressed_table[bucket];
+			compressed_table[bucket]=e;
+		}
+	}
+	if (e!=0 && compressed_reserve(cst.st_size)==0) {	// If it does not fit, the next request compresses again
+		if ((e->fd=dup(fd))>=0) {
+			e->digest=digest;
+			e->size=cst.st_size;
+			compressed_touch(e);
+		} else cache_release(cst.st_size);
+	}
+	pthread_mutex_unlock(&compressed_mutex);
+	lseek(fd,0,SEEK_SET);
+	return fd;
+}
+
+void free_compressed() {
+	size_t i;
+	pthread_mutex_lock(&compressed_mutex);
+	for (i=0;i<COMPRESS_BUCKETS;++i) {
+		while (compressed_table[i]!=0) {
+			Compressed *e=compressed_table[i];
+			compressed_table[i]=e->next;
+			if (e->fd>=0) close(e->fd);
+			free(e->path);
+			free(e);
+		}
+	}
+	compressed_newest=0;
+	compressed_oldest=0;
+	pthread_mutex_unlock(&compressed_mutex);
+}
@@ -0,0 +1,57 @@
+/**
+ * \file
+ *
+ * =====================================================================================
+ *
+ *       Filename:  compress.h
+ *
+ *    Description:  Compressed siblings of the outputs of the scripts
+ *
+ *        Version:  2.0
+ *        Created:  10/18/2026
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  
+ *        Company:  
+ *
+ * =====================================================================================
+ */
+
+#ifndef  COMPRESS_INC
+#define  COMPRESS_INC
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define COMPRESS_BLOCK 0x100000	//!< Size of the blocks of an output compressed independently, each one in its own gzip member
+
+/**
+ * \brief Tell if a path names the compressed sibling of a file
+ *
+ * A compressed sibling is named after the file with the suffix of its format (".gz"). The function only looks at the name, the caller must check that no such file exists in the mirror and that the file is a script which procedure offers this format.
+ * \param relative Path relative to the mirror folder
+ * \param base Buffer receiving the path of the file without the suffix
+ * \param size Size of the buffer
+ * \return Format of the sibling (see enum Compression), COMPRESS_NONE if the path has no known suffix
+ */
+int sibling_base(const char *relative,char *base,size_t size);
+
+/**
+ * \brief Compress an output
+ *
+ * The output is split into blocks of COMPRESS_BLOCK bytes, compressed in parallel by the thread of the request and the helper threads left within persistent.compress_jobs for all the compressions at once. Each block is a gzip member, and the members are written one after the other in a temporary file: the result is a regular gzip file, as produced by pigz or bgzip. The compressed output is kept as long as the output it was produced from does not change (its digest is compared). It takes its size from the budget of the cache (persistent.cache_size, see cache_reserve), and the least recently used compressed outputs are evicted to make room for it.
+ * \param relative Path of the script relative to the mirror folder of the current mount
+ * \param compression Format of the compressed output (see enum Compression)
+ * \param handle Descriptor of the output, closed by the function
+ * \param digest Digest of the output (see digest_fd) if run_script computed it, 0 to let the function compute it
+ * \return Descriptor of the compressed output, negative error code if something went wrong
+ */
+int compress_output(const char *relative,int compression,int handle,uint64_t digest);
+
+/**
+ * \brief Release the compressed outputs kept
+ */
+void free_compressed();
+
+#endif   /* ----- #ifndef COMPRESS_INC  ----- */
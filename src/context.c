@@ -0,0 +1,99 @@
+/*
+ * =====================================================================================
+ *
+ *       Filename:  context.c
+ *
+ *    Description:  Implementation of the context shared by the executions of a mount
+ *
+ *        Version:  2.0
+ *        Created:  10/18/2026
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  
+ *        Company:  
+ *
+ * =====================================================================================
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "operations.h"
+#include "stats.h"
+#include "context.h"
+
+static __thread int producing=0;	//!< Non-zero while the current thread runs a context producer
+
+int set_context(Mount *mount,const char *script,unsigned int ttl) {
+	if (script[0]=='/' || script[0]==0) return EINVAL;
+	char *copy=strdup(script);
+	if (copy==0) return ENOMEM;
+	free(mount->context);
+	mount->context=copy;
+	mount->context_ttl=ttl;
+	return 0;
+}
+
+/**
+ * \brief Run the context producer of a mount
+ *
+ * \param mount Mount
+ * \return Descriptor of a sealed memory file holding the output of the producer, -1 if it failed
+ */
+static int produce_context(Mount *mount) {
+	producing=1;	// The tests and the producer do not get any context
+	Procedure *proc=get_script(mount->procs,mount->context);
+	int fd=(proc==0)?-1:memfd_create("scriptfs-context",MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if (fd>=0 && proc->program->func(proc->program,mount->context,fd)!=0) {
+		close(fd);
+		fd=-1;
+	}
+	producing=0;
+	if (fd<0) return -1;
+	fcntl(fd,F_ADD_SEALS,F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL);
+	return fd;
+}
+
+int context_descriptor() {
+	Mount *mount=current_mount();
+	if (mount->context==0 || producing) return -1;
+	pthread_mutex_lock(&mount->context_mutex);
+	if (!mount->context_busy && ((mount->context_fd<0 && mount->context_expiry==0) || now_ms()>=mount->context_expiry)) {	// After a failure, the producer is only run again once the context expired
+		mount->context_busy=1;
+		pthread_mutex_unlock(&mount->context_mutex);
+		int fd=produce_context(mount);
+		pthread_mutex_lock(&mount->context_mutex);
+		if (fd<0) fprintf(stderr,"context_descriptor: Cannot produce the context %s of %s\n",mount->context,mount->mirror);
+		else if (mount->context_fd<0) mount->context_fd=fd;
+		else {	// Same number, so that the descriptor given to a program being started stays valid
+			dup3(fd,mount->context_fd,O_CLOEXEC);
+			close(fd);
+		}
+		if (fd>=0) STAT_ADD(context_refreshes,1);
+		mount->context_expiry=now_ms()+mount->context_ttl*1000LL;	// Also after a failure, not to run the producer for every program
+		mount->context_busy=0;
+		pthread_cond_broadcast(&mount->context_cond);
+	}
+	while (mount->context_busy && mount->context_fd<0) pthread_cond_wait(&mount->context_cond,&mount->context_mutex);	// The first context is being produced
+	int fd=mount->context_fd;
+	pthread_mutex_unlock(&mount->context_mutex);
+	return fd;
+}
+
+void inherit_context(int fd,char *var,size_t size) {
+	char path[64];
+	snprintf(path,sizeof path,"/proc/self/fd/%d",fd);
+	int own=open(path,O_RDONLY);
+	if (own>=0) {
+		dup2(own,fd);	// Not closed on exec
+		close(own);
+	} else fcntl(fd,F_SETFD,0);
+	snprintf(var,size,"%s=%d",CONTEXT_ENV,fd);
+}
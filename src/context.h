@@ -0,0 +1,59 @@
+/**
+ * \file
+ *
+ * =====================================================================================
+ *
+ *       Filename:  context.h
+ *
+ *    Description:  Context shared by all the executions of a mount
+ *
+ *        Version:  2.0
+ *        Created:  10/18/2026
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  
+ *        Company:  
+ *
+ * =====================================================================================
+ */
+
+#ifndef  CONTEXT_INC
+#define  CONTEXT_INC
+
+#include <stddef.h>
+#include "mount.h"
+
+#define CONTEXT_ENV "SCRIPTFS_CONTEXT_FD"	//!< Environment variable giving the descriptor of the context to the executed programs
+#define DEFAULT_CONTEXT_TTL 300	//!< Default lifetime of a context in seconds
+
+/**
+ * \brief Set the context producer of a mount
+ *
+ * The producer is a script of the mirror run with the procedures of the mount. Its output is the context of the mount: it is kept in a sealed memory file, given to every program executed for the mount as a read-only descriptor which number is in the CONTEXT_ENV environment variable, and produced again when its lifetime expires.
+ * \param mount Mount
+ * \param script Path of the producer relative to the mirror
+ * \param ttl Lifetime of the context in seconds
+ * \return 0 if everything went fine, EINVAL if the path is not relative, ENOMEM if there is not enough memory
+ */
+int set_context(Mount *mount,const char *script,unsigned int ttl);
+
+/**
+ * \brief Get the context of the current mount, producing it if it expired
+ *
+ * Only one thread runs the producer. The others keep using the previous context meanwhile, or wait for it if there is none yet. The programs run by the producer itself get no context.
+ * \return Descriptor of the context, -1 if the mount has no context or it could not be produced
+ */
+int context_descriptor();
+
+/**
+ * \brief Give a context to the calling process
+ *
+ * The function is called by a child process between the fork and the execution of the program. It replaces the descriptor with a private read-only one at the same number, so that the offsets of the executions are independent, and writes the environment variable.
+ * \param fd Descriptor given by context_descriptor in the parent process
+ * \param var Buffer receiving the definition of the environment variable (NAME=value)
+ * \param size Size of the buffer
+ */
+void inherit_context(int fd,char *var,size_t size);
+
+#endif   /* ----- #ifndef CONTEXT_INC  ----- */
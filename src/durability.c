@@ -0,0 +1,126 @@
+/*
+ * =====================================================================================
+ *
+ *       Filename:  durability.c
+ *
+ *    Description:  Implementation of the durability policy
+ *
+ *        Version:  2.0
+ *        Created:  10/18/2026
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  
+ *        Company:  
+ *
+ * =====================================================================================
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "operations.h"
+#include "durability.h"
+
+extern struct Persistent persistent;
+
+/********************************************/
+/*              GROUP COMMIT                */
+/********************************************/
+static pthread_t group_thread;	//!< Thread committing the mirror file system periodically
+static int group_running=0;	//!< Tells if the group commit thread was started
+static int group_stop=0;	//!< Set to ask the group commit thread to exit
+static int group_dirty=0;	//!< Tells if a file was modified since the last commit
+static pthread_mutex_t group_mutex=PTHREAD_MUTEX_INITIALIZER;	//!< Protects the variables above
+static pthread_cond_t group_cond=PTHREAD_COND_INITIALIZER;	//!< Signaled when the thread has to exit
+
+/**
+ * \brief Commit the mirror file system if it is dirty
+ *
+ * The function must be called with group_mutex locked. The lock is released during the actual commit so that writers are not blocked by the device.
+ */
+static void group_commit() {
+	if (!group_dirty) return;
+	group_dirty=0;
+	pthread_mutex_unlock(&group_mutex);
+#ifdef TRACE
+	fprintf(stderr,"group_commit: syncfs on mirrors\n");
+#endif
+	Mount *mount;
+	for (mount=persistent.mounts;mount!=0;mount=mount->next) if (syncfs(mount->mirror_fd)!=0) fprintf(stderr,"group_commit: syncfs failed on %s: %s\n",mount->mirror,strerror(errno));
+	pthread_mutex_lock(&group_mutex);
+}
+
+/**
+ * \brief Main function of the group commit thread
+ *
+ * \param arg Not used
+ * \return Always null
+ */
+static void *group_loop(void *arg) {
+	pthread_mutex_lock(&group_mutex);
+	while (!group_stop) {
+		struct timespec ts;
+		clock_gettime(CLOCK_REALTIME,&ts);
+		ts.tv_sec+=persistent.sync_interval;
+		while (!group_stop && pthread_cond_timedwait(&group_cond,&group_mutex,&ts)!=ETIMEDOUT);
+		group_commit();
+	}
+	pthread_mutex_unlock(&group_mutex);
+	return 0;
+}
+
+int start_group_commit() {
+	if (persistent.durability!=DUR_GROUP || group_running) return 0;
+	group_stop=0;
+	int code=pthread_create(&group_thread,0,group_loop,0);
+	if (code!=0) {
+		fprintf(stderr,"start_group_commit: Cannot start thread: %s\n",strerror(code));
+		return code;
+	}
+	group_running=1;
+	return 0;
+}
+
+void stop_group_commit() {
+	if (!group_running) return;
+	pthread_mutex_lock(&group_mutex);
+	group_stop=1;
+	pthread_cond_signal(&group_cond);
+	pthread_mutex_unlock(&group_mutex);
+	pthread_join(group_thread,0);
+	group_running=0;
+}
+
+/********************************************/
+/*                 POLICY                   */
+/********************************************/
+int get_durability_from_string(const char *str) {
+	if (str==0) return -1;
+	if (strcasecmp(str,"NONE")==0) return DUR_NONE;
+	if (strcasecmp(str,"CLOSE")==0) return DUR_CLOSE;
+	if (strcasecmp(str,"GROUP")==0) return DUR_GROUP;
+	return -1;
+}
+
+int durability_flush(int fd,int dirty) {
+	switch (persistent.durability) {
+	case DUR_NONE:
+		return 0;
+	case DUR_GROUP:
+		if (dirty) {
+			pthread_mutex_lock(&group_mutex);
+			group_dirty=1;
+			pthread_mutex_unlock(&group_mutex);
+		}
+		return 0;
+	default:
+		return fsync(fd);
+	}
+}
@@ -0,0 +1,70 @@
+/**
+ * \file
+ *
+ * =====================================================================================
+ *
+ *       Filename:  durability.h
+ *
+ *    Description:  Durability policy applied when files of the mirror are flushed
+ *
+ *        Version:  2.0
+ *        Created:  10/18/2026
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  
+ *        Company:  
+ *
+ * =====================================================================================
+ */
+
+#ifndef  DURABILITY_INC
+#define  DURABILITY_INC
+
+#define DEFAULT_SYNC_INTERVAL 5	//!< Default number of seconds between two group commits of the mirror file system
+
+/**
+ * \brief Durability policy
+ *
+ * Tells what the file system does with the data written on a regular file of the mirror when the file is flushed (that is, each time it is closed by an application). Explicit fsync calls from applications are always honored, whatever the policy.
+ */
+enum Durability {
+	DUR_NONE,	//!< Do nothing and rely on the underlying file system to write the data back
+	DUR_CLOSE,	//!< Synchronize the file with fsync on every flush (historical behavior)
+	DUR_GROUP	//!< Remember that the mirror is dirty and commit all modified files at once with a periodic syncfs
+};
+
+/**
+ * \brief Convert the name of a durability policy to its value
+ *
+ * \param str Name of the policy, one of "none", "close" or "group" (case-insensitive)
+ * \return Value of the policy, or -1 if the name is not recognized
+ */
+int get_durability_from_string(const char *str);
+
+/**
+ * \brief Apply the durability policy to a file which is being flushed
+ *
+ * This function is called each time a regular file of the mirror is flushed. Depending on the policy, it synchronizes the file immediately, marks the mirror as dirty for the next group commit, or does nothing.
+ * \param fd Descriptor of the file in the mirror file system
+ * \param dirty Non-zero if data has been written on the file since it was opened
+ * \return 0 if everything went fine, -1 otherwise (errno is then set)
+ */
+int durability_flush(int fd,int dirty);
+
+/**
+ * \brief Start the group commit thread
+ *
+ * If the durability policy is DUR_GROUP, the function starts a thread which periodically commits the mirror file system with syncfs if any file was modified since the last commit. It does nothing for other policies. The function must be called after the process is daemonized.
+ * \return 0 if everything went fine, an error code otherwise
+ */
+int start_group_commit();
+
+/**
+ * \brief Stop the group commit thread
+ *
+ * The function stops the thread started by start_group_commit, after a last commit of the pending modifications. It does nothing if the thread was not started.
+ */
+void stop_group_commit();
+
+#endif   /* ----- #ifndef DURABILITY_INC  ----- */
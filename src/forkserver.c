@@ -0,0 +1,399 @@
+/*
+ * =====================================================================================
+ *
+ *       Filename:  forkserver.c
+ *
+ *    Description:  Implementation of the fork servers of the interpreters
+ *
+ *        Version:  2.0
+ *        Created:  10/18/2026
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  
+ *        Company:  
+ *
+ * =====================================================================================
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include "operations.h"
+#include "affinity.h"
+#include "stats.h"
+#include "context.h"
+#include "forkserver.h"
+
+extern struct Persistent persistent;
+
+#define FORK_SERVER_FD "3"	//!< Descriptor of the socket of the file system in the fork server
+#define FORK_SERVER_MESSAGE 0x10000	//!< Maximal size of a request
+
+/**
+ * \brief Fork server of an interpreter
+ */
+typedef struct ForkServer {
+	char *interpreter;	//!< Path of the interpreter, as given on the shebang line of the scripts
+	char **modules;	//!< Modules preloaded by the server, ending with a null pointer
+	pid_t pid;	//!< ID of the server process, -1 if it is not running
+	int sock;	//!< Socket connected to the server, -1 if it is not running
+	int failures;	//!< Number of successive failures to start the server
+} ForkServer;
+
+static ForkServer servers[FORK_SERVER_MAX];	//!< Fork servers
+static int server_count=0;	//!< Number of fork servers
+static pthread_mutex_t server_mutex=PTHREAD_MUTEX_INITIALIZER;	//!< Serializes the starts and stops of the servers
+
+/**
+ * \brief Program run by the Python interpreter of a fork server (see \ref forkserver "Fork servers")
+ */
+static const char server_program[]=
+	"import os,sys,socket,signal,select,struct,array,fcntl,runpy,traceback\n"
+	"for m in sys.argv[2:]:\n"
+	"\ttry: __import__(m)\n"
+	"\texcept Exception as e: sys.stderr.write('fork server: Cannot preload %s: %s\\n'%(m,e))\n"
+	"sock=socket.socket(fileno=int(sys.argv[1]))\n"
+	"r,w=os.pipe()\n"
+	"os.set_blocking(w,False)\n"
+	"signal.set_wakeup_fd(w)\n"
+	"signal.signal(signal.SIGCHLD,lambda n,f:None)\n"
+	"pending={}\n"
+	"def run(fds,fields):\n"
+	"\tsignal.set_wakeup_fd(-1)\n"
+	"\tsignal.signal(signal.SIGCHLD,signal.SIG_DFL)\n"
+	"\tsock.close()\n"
+	"\tos.close(r)\n"
+	"\tos.close(w)\n"
+	"\tfor fd in pending.values(): os.close(fd)\n"
+	"\tos.close(fds[0])\n"
+	"\tos.setpgid(0,0)\n"
+	"\tflags=fields[0]\n"
+	"\ti=3\n"
+	"\tif b'i' in flags:\n"
+	"\t\tos.dup2(fds[i],0)\n"
+	"\t\ti+=1\n"
+	"\telse: os.close(0)\n"
+	"\tif b'c' in flags:\n"
+	"\t\town=os.open('/proc/self/fd/%d'%fds[i],os.O_RDONLY)\n"
+	"\t\tcontext=fcntl.fcntl(own,fcntl.F_DUPFD,3)\n"
+	"\t\tos.close(own)\n"
+	"\t\tos.set_inheritable(context,True)\n"
+	"\t\tos.environ['" CONTEXT_ENV "']=str(context)\n"
+	"\tos.dup2(fds[1],1)\n"
+	"\tos.dup2(fds[2],2)\n"
+	"\tfor fd in fds[1:]:\n"
+	"\t\tif fd>2: os.close(fd)\n"
+	"\tcode=0\n"
+	"\ttry:\n"
+	"\t\tos.chdir(fields[1])\n"
+	"\t\tsys.path[0]=os.path.dirname(os.path.abspath(fields[2])).decode(errors='surrogateescape')\n"
+	"\t\tsys.argv=[a.decode(errors='surrogateescape') for a in fields[3:]]\n"
+	"\t\tsys.stdin=os.fdopen(0,'r') if b'i' in flags else None\n"
+	"\t\tsys.stdout=os.fdopen(1,'w')\n"
+	"\t\tsys.stderr=os.fdopen(2,'w')\n"
+	"\t\trunpy.run_path(fields[2].decode(errors='surrogateescape'),run_name='__main__')\n"
+	"\texcept SystemExit as e:\n"
+	"\t\tcode=e.code if isinstance(e.code,int) else (0 if e.code is None else 1)\n"
+	"\t\tif not isinstance(e.code,int) and e.code is not None: sys.stderr.write('%s\\n'%e.code)\n"
+	"\texcept BaseException:\n"
+	"\t\ttraceback.print_exc()\n"
+	"\t\tcode=1\n"
+	"\ttry:\n"
+	"\t\tsys.stdout.flush()\n"
+	"\t\tsys.stderr.flush()\n"
+	"\texcept Exception: pass\n"
+	"\tos._exit(code&0xff)\n"
+	"while True:\n"
+	"\tready,_,_=select.select([sock,r],[],[])\n"
+	"\tif r in ready:\n"
+	"\t\tos.read(r,0x100)\n"
+	"\t\twhile pending:\n"
+	"\t\t\ttry: pid,status=os.waitpid(-1,os.WNOHANG)\n"
+	"\t\t\texcept ChildProcessError: break\n"
+	"\t\t\tif pid==0: break\n"
+	"\t\t\tfd=pending.pop(pid,None)\n"
+	"\t\t\tif fd is not None:\n"
+	"\t\t\t\ttry: os.write(fd,struct.pack('i',status))\n"
+	"\t\t\t\texcept OSError: pass\n"
+	"\t\t\t\tos.close(fd)\n"
+	"\tif sock in ready:\n"
+	"\t\tfds=array.array('i')\n"
+	"\t\tmsg,anc,mflags,addr=sock.recvmsg(0x10000,socket.CMSG_SPACE(5*fds.itemsize))\n"
+	"\t\tif not msg: break\n"
+	"\t\tfor level,kind,data in anc:\n"
+	"\t\t\tif level==socket.SOL_SOCKET and kind==socket.SCM_RIGHTS: fds.frombytes(data[:len(data)-len(data)%fds.itemsize])\n"
+	"\t\tfields=msg.split(b'\\0')[:-1]\n"
+	"\t\tif len(fds)<3 or len(fields)<4 or len(fds)<3+len(fields[0]):\n"
+	"\t\t\tfor fd in fds: os.close(fd)\n"
+	"\t\t\tcontinue\n"
+	"\t\tpid=os.fork()\n"
+	"\t\tif pid==0: run(fds,fields)\n"
+	"\t\ttry: os.setpgid(pid,pid)\n"
+	"\t\texcept OSError: pass\n"
+	"\t\tfor fd in fds[1:]: os.close(fd)\n"
+	"\t\ttry: os.write(fds[0],struct.pack('i',pid))\n"
+	"\t\texcept OSError: pass\n"
+	"\t\tpending[pid]=fds[0]\n";
+
+int add_fork_server(const char *spec) {
+	if (spec[0]!='/') return EINVAL;
+	if (server_count==FORK_SERVER_MAX) return ENOSPC;
+	ForkServer *s=&servers[server_count];
+	const char *colon=strchr(spec,':');
+	s->interpreter=(colon==0)?strdup(spec):strndup(spec,colon-spec);
+	size_t num=0;
+	const char *p;
+	for (p=colon;p!=0;p=strchr(p+1,',')) ++num;
+	s->modules=(char**)calloc(num+1,sizeof(char*));
+	if (s->interpreter==0 || s->modules==0) {
+		free(s->interpreter);
+		free(s->modules);
+		return ENOMEM;
+	}
+	num=0;
+	for (p=colon;p!=0;) {
+		const char *end=strchr(p+1,',');
+		size_t len=(end==0)?strlen(p+1):(size_t)(end-p-1);
+		if (len>0) s->modules[num++]=strndup(p+1,len);
+		p=end;
+	}
+	s->pid=-1;
+	s->sock=-1;
+	s->failures=0;
+	++server_count;
+	return 0;
+}
+
+/**
+ * \brief Stop a fork server, must be called with server_mutex locked
+ *
+ * \param s Pointer to the server
+ */
+static void stop_server(ForkServer *s) {
+	if (s->sock>=0) close(s->sock);	// The server exits at the end of the stream of requests
+	if (s->pid>0) while (waitpid(s->pid,0,0)<0 && errno==EINTR);
+	s->sock=-1;
+	s->pid=-1;
+}
+
+void free_fork_servers() {
+	int i;
+	pthread_mutex_lock(&server_mutex);
+	for (i=0;i<server_count;++i) {
+		stop_server(&servers[i]);
+		free(servers[i].interpreter);
+		char **m;
+		for (m=servers[i].modules;*m!=0;++m) free(*m);
+		free(servers[i].modules);
+	}
+	server_count=0;
+	pthread_mutex_unlock(&server_mutex);
+}
+
+/**
+ * \brief Start a fork server, must be called with server_mutex locked
+ *
+ * The server gets the CPUs of the scripts, and its own session so that the signals of the terminal do not reach it.
+ * \param s Pointer to the server
+ * \return 0 if the server was started, -1 otherwise
+ */
+static int start_server(ForkServer *s) {
+	int sv[2];
+	if (socketpair(AF_UNIX,SOCK_SEQPACKET | SOCK_CLOEXEC,0,sv)!=0) return -1;
+	size_t num=0;
+	while (s->modules[num]!=0) ++num;
+	const char *args[num+5];
+	args[0]=s->interpreter;
+	args[1]="-c";
+	args[2]=server_program;
+	args[3]=FORK_SERVER_FD;
+	memcpy(args+4,s->modules,(num+1)*sizeof(char*));
+	Placement placement;
+	prepare_placement(&placement);
+	pid_t pid=fork();
+	if (pid==0) {
+		setsid();
+		apply_placement(&placement);
+		dup2(sv[1],atoi(FORK_SERVER_FD));	// Not closed on exec, unlike sv[1]
+		int null=open("/dev/null",O_RDONLY);
+		if (null>=0) dup2(null,STDIN_FILENO);
+		dup2(STDERR_FILENO,STDOUT_FILENO);
+		execve(s->interpreter,(char *const*)args,persistent.envp);
+		_exit(127);
+	}
+	close(sv[1]);
+	if (pid<0) {
+		close(sv[0]);
+		return -1;
+	}
+	s->pid=pid;
+	s->sock=sv[0];
+#ifdef TRACE
+	fprintf(stderr,"start_server: Fork server %d started for %s\n",pid,s->interpreter);
+#endif
+	return 0;
+}
+
+/**
+ * \brief Find the fork server of the interpreter of a script
+ *
+ * The interpreter is read on the shebang line like call_program does.
+ * \param file Path of the program
+ * \return Pointer to the server, null if the program is not a script or its interpreter has no fork server
+ */
+static ForkServer *find_server(const char *file) {
+	char line[0x200];
+	int fd=openat(current_mount()->mirror_fd,file,O_RDONLY | O_CLOEXEC);
+	if (fd<0) fd=open(file,O_RDONLY | O_CLOEXEC);
+	if (fd<0) return 0;
+	ssize_t n=read(fd,line,sizeof line-1);
+	close(fd);
+	if (n<2 || line[0]!='#' || line[1]!='!') return 0;
+	line[n]=0;
+	char *path=line+2;
+	path+=strspn(path," \t");
+	path[strcspn(path," \t\n")]=0;
+	int i;
+	for (i=0;i<server_count;++i) if (servers[i].failures<FORK_SERVER_RETRIES && strcmp(servers[i].interpreter,path)==0) return &servers[i];
+	return 0;
+}
+
+/**
+ * \brief Stop a fork server which did not answer, and count the failure
+ *
+ * \param s Pointer to the server
+ * \param sock Socket of the server which failed, nothing is done if the server was already restarted
+ */
+static void server_failed(ForkServer *s,int sock) {
+	pthread_mutex_lock(&server_mutex);
+	if (s->sock==sock) {
+		fprintf(stderr,"fork server: Server of %s stopped\n",s->interpreter);
+		stop_server(s);
+		if (++s->failures==FORK_SERVER_RETRIES) fprintf(stderr,"fork server: Giving up the server of %s\n",s->interpreter);
+	}
+	pthread_mutex_unlock(&server_mutex);
+}
+
+/**
+ * \brief Send a request to a fork server, starting or restarting it if needed
+ *
+ * \param s Pointer to the server
+ * \param msg Message of the request
+ * \param len Size of the message
+ * \param fds Descriptors given with the request
+ * \param count Number of descriptors
+ * \param sock Variable receiving the socket on which the request was sent
+ * \return 0 if the request was sent, -1 otherwise
+ */
+static int send_request(ForkServer *s,const char *msg,size_t len,const int *fds,int count,int *sock) {
+	char control[CMSG_SPACE(5*sizeof(int))];
+	struct iovec iov={(void*)msg,len};
+	struct msghdr mh;
+	memset(&mh,0,sizeof mh);
+	memset(control,0,sizeof control);
+	mh.msg_iov=&iov;
+	mh.msg_iovlen=1;
+	mh.msg_control=control;
+	mh.msg_controllen=CMSG_SPACE(count*sizeof(int));
+	struct cmsghdr *cm=CMSG_FIRSTHDR(&mh);
+	cm->cmsg_level=SOL_SOCKET;
+	cm->cmsg_type=SCM_RIGHTS;
+	cm->cmsg_len=CMSG_LEN(count*sizeof(int));
+	memcpy(CMSG_DATA(cm),fds,count*sizeof(int));
+	int attempt;
+	for (attempt=0;attempt<2;++attempt) {
+		pthread_mutex_lock(&server_mutex);
+		*sock=s->sock;
+		if (*sock<0 && s->failures<FORK_SERVER_RETRIES) {
+			if (start_server(s)==0) *sock=s->sock;
+			else if (++s->failures==FORK_SERVER_RETRIES) fprintf(stderr,"fork server: Cannot start the server of %s\n",s->interpreter);
+		}
+		pthread_mutex_unlock(&server_mutex);
+		if (*sock<0) return -1;
+		if (sendmsg(*sock,&mh,MSG_NOSIGNAL)==(ssize_t)len) return 0;
+		server_failed(s,*sock);	// The server died, start a new one
+	}
+	return -1;
+}
+
+/**
+ * \brief Append a null-terminated string to a request
+ *
+ * \param msg Buffer of the request, of FORK_SERVER_MESSAGE bytes
+ * \param len Size of the request, updated by the function
+ * \param str String to append
+ * \return 0 if the string was appended, -1 if the request is too long
+ */
+static int append_field(char *msg,size_t *len,const char *str) {
+	size_t l=strlen(str)+1;
+	if (*len+l>FORK_SERVER_MESSAGE) return -1;
+	memcpy(msg+*len,str,l);
+	*len+=l;
+	return 0;
+}
+
+int fork_server_spawn(const char *file,const char **args,int out,const char *path_in,int context,Execution **exec) {
+	if (server_count==0 || !supervising()) return -1;
+	ForkServer *s=find_server(file);
+	if (s==0) return -1;
+	// Message of the request: optional descriptors, current folder, script and arguments
+	char msg[FORK_SERVER_MESSAGE];
+	char cwd[FILENAME_MAX_LENGTH];
+	size_t len=0;
+	if (getcwd(cwd,sizeof cwd)==0) return -1;
+	int in=(path_in==0)?-1:openat(current_mount()->mirror_fd,path_in,O_RDONLY | O_CLOEXEC);
+	int fds[5]={-1,(out!=0)?out:STDERR_FILENO,STDERR_FILENO};
+	int count=3;
+	char flags[3]="";
+	if (in>=0) {fds[count++]=in;strcat(flags,"i");}
+	if (context>=0) {fds[count++]=context;strcat(flags,"c");}
+	if (append_field(msg,&len,flags)!=0 || append_field(msg,&len,cwd)!=0 || append_field(msg,&len,file)!=0) {
+		if (in>=0) close(in);
+		return -1;
+	}
+	const char **arg;
+	for (arg=args;*arg!=0;++arg) if (append_field(msg,&len,*arg)!=0) break;
+	// Descriptors: status, output, error, then input and context
+	int status[2];
+	if (*arg!=0 || socketpair(AF_UNIX,SOCK_SEQPACKET | SOCK_CLOEXEC,0,status)!=0) {
+		if (in>=0) close(in);
+		return -1;
+	}
+	fds[0]=status[1];
+	Placement placement;
+	prepare_placement(&placement);
+	int sock;
+	int code=send_request(s,msg,len,fds,count,&sock);
+	close(status[1]);
+	if (in>=0) close(in);
+	pid_t pid;
+	if (code==0 && read(status[0],&pid,sizeof pid)!=sizeof pid) {	// The server died with the request
+		server_failed(s,sock);
+		code=-1;
+	}
+	if (code!=0) {	// Run it normally
+		close(status[0]);
+		return -1;
+	}
+	pthread_mutex_lock(&server_mutex);
+	s->failures=0;
+	pthread_mutex_unlock(&server_mutex);
+	place_process(pid,&placement);
+	STAT_ADD(fork_server_runs,1);
+	*exec=supervise_remote(pid,status[0]);
+	if (*exec==0) {	// Nobody would get its status
+		kill(-pid,SIGKILL);
+		close(status[0]);
+	}
+	return 0;
+}
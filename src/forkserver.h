@@ -0,0 +1,62 @@
+/**
+ * \file
+ *
+ * =====================================================================================
+ *
+ *       Filename:  forkserver.h
+ *
+ *    Description:  Preloaded interpreters forking themselves to run the scripts
+ *
+ *        Version:  2.0
+ *        Created:  10/18/2026
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  
+ *        Company:  
+ *
+ * =====================================================================================
+ */
+
+#ifndef  FORKSERVER_INC
+#define  FORKSERVER_INC
+
+#include "supervisor.h"
+
+#define FORK_SERVER_MAX 8	//!< Maximal number of interpreters with a fork server
+#define FORK_SERVER_RETRIES 3	//!< Number of successive failures to start a fork server after which its interpreter is run normally
+
+/**
+ * \page forkserver Fork servers
+ *
+ * A fork server is a long-lived Python interpreter, started on the first script which needs it, which imports the configured modules once. It reads requests on a unix socket (SOCK_SEQPACKET), each one made of null-terminated strings (the letters of the optional descriptors, the current folder, the path of the script and its arguments) with descriptors: a socket for the status, the standard output, the standard error, then the standard input if the letters hold i and the context of the mount if they hold c. For each request, the server forks: the child moves to its own process group, takes the descriptors as its standard streams, opens its own read-only descriptor of the context and gives its number in the CONTEXT_ENV environment variable, and runs the script as __main__ in the preloaded interpreter. The server writes the ID of the child (an int) on the status socket, then its wait status when it exits. The server stops when the socket of the file system is closed.
+ */
+
+/**
+ * \brief Add a fork server for an interpreter
+ *
+ * \param spec Path of the interpreter, as given on the shebang line of the scripts, followed by the modules to preload after a colon, separated by commas (such as /usr/bin/python3:json,yaml)
+ * \return 0 if everything went fine, EINVAL if the specification is invalid, ENOSPC if there are too many servers, ENOMEM if there is not enough memory
+ */
+int add_fork_server(const char *spec);
+
+/**
+ * \brief Stop the fork servers and forget them
+ */
+void free_fork_servers();
+
+/**
+ * \brief Run a program through the fork server of its interpreter
+ *
+ * The function is used by spawn_program before forking. It only applies when the program is a script whose interpreter has a fork server, and when the supervisor is running (the process is not a child of the file system, only the supervisor gets its status).
+ * \param file Path of the program, as given to spawn_program
+ * \param args Array of arguments, ending with a null pointer
+ * \param out Descriptor of the output, 0 if no output is required
+ * \param path_in Path of the file given on the standard input, 0 for none
+ * \param context Descriptor of the context of the mount (see context.h), -1 for none
+ * \param exec Variable receiving the Execution structure of the script, null if the script could not be started
+ * \return 0 if the fork server was asked to run the script, -1 if the program has to be started normally
+ */
+int fork_server_spawn(const char *file,const char **args,int out,const char *path_in,int context,Execution **exec);
+
+#endif   /* ----- #ifndef FORKSERVER_INC  ----- */
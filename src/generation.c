@@ -0,0 +1,116 @@
+/*
+ * =====================================================================================
+ *
+ *       Filename:  generation.c
+ *
+ *    Description:  Implementation of the times of the generations
+ *
+ *        Version:  2.0
+ *        Created:  10/18/2026
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  
+ *        Company:  
+ *
+ * =====================================================================================
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "operations.h"
+#include "stats.h"
+#include "cache.h"
+#include "generation.h"
+
+extern struct Persistent persistent;
+
+#define GENERATION_BUCKETS 0x1000	//!< Number of buckets of the hash table of the generations
+
+/**
+ * \brief Last generation of the output of a script
+ */
+typedef struct Generation {
+	char *path;	//!< Path of the script, relative to the mirror folder
+	const struct Mount *mount;	//!< Mount of the mirror folder
+	uint64_t digest;	//!< Digest of the last output
+	struct timespec changed;	//!< Time when the output last changed
+	struct timespec generated;	//!< Time when the output was last generated
+	struct Generation *next;	//!< Next generation in the same bucket of the hash table
+} Generation;
+
+static Generation *generation_table[GENERATION_BUCKETS];	//!< Hash table of the generations, indexed by path
+static pthread_mutex_t generation_mutex=PTHREAD_MUTEX_INITIALIZER;	//!< Protects the table and its elements
+
+/**
+ * \brief Find the generation of a path of the current mount, must be called with generation_mutex locked
+ *
+ * \param path Path relative to the mirror folder
+ * \param bucket Set to the bucket of the path
+ * \return Pointer to the generation, null if there is none
+ */
+static Generation *generation_find(const char *path,size_t *bucket) {
+	*bucket=hash_path(FNV_OFFSET,path)%GENERATION_BUCKETS;
+	const Mount *mount=current_mount();
+	Generation *g;
+	for (g=generation_table[*bucket];g!=0;g=g->next) if (g->mount==mount && strcmp(g->path,path)==0) return g;
+	return 0;
+}
+
+void record_generation(const char *relative,uint64_t digest) {
+	if (!persistent.generation_times) return;
+	struct timespec now;
+	clock_gettime(CLOCK_REALTIME,&now);
+	size_t bucket;
+	pthread_mutex_lock(&generation_mutex);
+	Generation *g=generation_find(relative,&bucket);
+	if (g==0) {
+		g=(Generation*)malloc(sizeof(Generation));
+		if (g==0 || (g->path=strdup(relative))==0) {
+			free(g);
+			pthread_mutex_unlock(&generation_mutex);
+			return;
+		}
+		g->mount=current_mount();
+		g->digest=digest;
+		g->changed=now;
+		g->next=generation_table[bucket];
+		generation_table[bucket]=g;
+	} else if (g->digest!=digest) {
+		g->digest=digest;
+		g->changed=now;
+		STAT_ADD(output_changes,1);
+	}
+	g->generated=now;
+	pthread_mutex_unlock(&generation_mutex);
+}
+
+void generation_times(const char *relative,struct stat *stbuf) {
+	if (!persistent.generation_times) return;
+	size_t bucket;
+	pthread_mutex_lock(&generation_mutex);
+	const Generation *g=generation_find(relative,&bucket);
+	if (g!=0) {
+		stbuf->st_mtim=g->changed;
+		stbuf->st_ctim=g->generated;
+	}
+	pthread_mutex_unlock(&generation_mutex);
+}
+
+void free_generations() {
+	size_t i;
+	pthread_mutex_lock(&generation_mutex);
+	for (i=0;i<GENERATION_BUCKETS;++i) {
+		while (generation_table[i]!=0) {
+			Generation *g=generation_table[i];
+			generation_table[i]=g->next;
+			free(g->path);
+			free(g);
+		}
+	}
+	pthread_mutex_unlock(&generation_mutex);
+}
@@ -0,0 +1,50 @@
+/**
+ * \file
+ *
+ * =====================================================================================
+ *
+ *       Filename:  generation.h
+ *
+ *    Description:  Times of the generations of the outputs of the scripts
+ *
+ *        Version:  2.0
+ *        Created:  10/18/2026
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  
+ *        Company:  
+ *
+ * =====================================================================================
+ */
+
+#ifndef  GENERATION_INC
+#define  GENERATION_INC
+
+#include <stdint.h>
+#include <sys/stat.h>
+
+/**
+ * \brief Record a new output of a script
+ *
+ * The function does nothing unless persistent.generation_times is set. Otherwise it compares the digest of the output with the one of the previous output of the same path: the time of the last change of the output is updated if they differ, the time of the last generation is always updated.
+ * \param relative Path of the script relative to the mirror folder of the current mount
+ * \param digest Digest of the output (see digest_fd)
+ */
+void record_generation(const char *relative,uint64_t digest);
+
+/**
+ * \brief Replace the times of a script by those of its output
+ *
+ * If an output of the script was recorded, the modification time becomes the time of the last change of the output and the change time the time of its last generation. The times of the script are kept otherwise.
+ * \param relative Path of the script relative to the mirror folder of the current mount
+ * \param stbuf Attributes of the script, updated by the function
+ */
+void generation_times(const char *relative,struct stat *stbuf);
+
+/**
+ * \brief Release the times recorded
+ */
+void free_generations();
+
+#endif   /* ----- #ifndef GENERATION_INC  ----- */
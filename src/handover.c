@@ -0,0 +1,426 @@
+/*
+ * =====================================================================================
+ *
+ *       Filename:  handover.c
+ *
+ *    Description:  Implementation of the handover of the mounts to a new process
+ *
+ *        Version:  2.0
+ *        Created:  10/18/2026
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  
+ *        Company:  
+ *
+ * =====================================================================================
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/mount.h>
+#include <sys/wait.h>
+#include "operations.h"
+#include "cache.h"
+#include "handover.h"
+
+extern struct Persistent persistent;
+
+#define HANDOVER_DATA_SIZE 0x10000	//!< Maximal size of the data of a message
+
+/**
+ * \brief Entry of the output cache as sent to the new process
+ */
+typedef struct HandoverCache {
+	uint32_t mount;	//!< Position of the mount in the HO_MOUNT messages
+	uint32_t proc;	//!< Position of the procedure in the procedures of the mount
+	uint64_t dev;	//!< Device of the script
+	uint64_t ino;	//!< Inode of the script
+	int64_t source_size;	//!< Size of the script
+	int64_t mtime_sec;	//!< Last modification time of the script, seconds
+	int64_t mtime_nsec;	//!< Last modification time of the script, nanoseconds
+	int32_t state;	//!< State of the path for the caching policy
+	int32_t has_digest;	//!< Tells if digest holds a valid value
+	int64_t size;	//!< Size of the cached output
+	uint64_t digest;	//!< Digest of the last output
+	uint32_t runs;	//!< Number of executions observed
+	uint32_t stable_runs;	//!< Number of successive executions with the same output
+	int64_t stable_since;	//!< Time (monotonic, in milliseconds) of the first execution with the current output
+	int64_t avg_ms;	//!< Moving average of the duration of the executions
+	uint32_t ttl;	//!< Time to live of the cached output in seconds
+	uint32_t demotions;	//!< Number of times the cached output changed
+	int64_t expires;	//!< Time (monotonic, in milliseconds) when the cached output expires, 0 if it never expires
+	char path[MAX_PATH_LENGTH];	//!< Path of the script relative to the mirror folder
+} HandoverCache;
+
+static int handover_socket=-1;	//!< Listening socket, -1 if handover is not enabled
+static pthread_t handover_thread;	//!< Thread waiting for a new process
+static int handover_running=0;	//!< Tells if the thread was started
+static int handed_over=0;	//!< Tells if a new process took over the mounts, accessed with atomic operations
+
+/**
+ * \brief Send a message of the handover protocol
+ *
+ * \param sock Connected socket
+ * \param type Type of the message (see enum HandoverMessage)
+ * \param data Data of the message
+ * \param len Size of the data
+ * \param fd Descriptor attached to the message, -1 if there is none
+ * \return 0 if everything went fine, an error code otherwise
+ */
+static int send_message(int sock,uint32_t type,const void *data,size_t len,int fd) {
+	struct iovec iov[2]={{&type,sizeof type},{(void*)data,len}};
+	union {char buf[CMSG_SPACE(sizeof(int))];struct cmsghdr align;} control;
+	struct msghdr msg;
+	memset(&msg,0,sizeof msg);
+	msg.msg_iov=iov;
+	msg.msg_iovlen=(len>0)?2:1;
+	if (fd>=0) {
+		msg.msg_control=control.buf;
+		msg.msg_controllen=sizeof control.buf;
+		struct cmsghdr *cmsg=CMSG_FIRSTHDR(&msg);
+		cmsg->cmsg_level=SOL_SOCKET;
+		cmsg->cmsg_type=SCM_RIGHTS;
+		cmsg->cmsg_len=CMSG_LEN(sizeof(int));
+		memcpy(CMSG_DATA(cmsg),&fd,sizeof(int));
+	}
+	while (sendmsg(sock,&msg,MSG_NOSIGNAL)<0) if (errno!=EINTR) return errno;
+	return 0;
+}
+
+/**
+ * \brief Receive a message of the handover protocol
+ *
+ * \param sock Connected socket
+ * \param type Pointer to the type of the message, filled by the function
+ * \param data Buffer receiving the data of the message
+ * \param size Size of the buffer
+ * \param fd Pointer to the descriptor attached to the message, filled by the function (-1 if there is none)
+ * \return Size of the data, -1 if the connection was closed or failed
+ */
+static ssize_t recv_message(int sock,uint32_t *type,void *data,size_t size,int *fd) {
+	struct iovec iov[2]={{type,sizeof(uint32_t)},{data,size}};
+	union {char buf[CMSG_SPACE(sizeof(int))];struct cmsghdr align;} control;
+	struct msghdr msg;
+	ssize_t len;
+	memset(&msg,0,sizeof msg);
+	msg.msg_iov=iov;
+	msg.msg_iovlen=2;
+	msg.msg_control=control.buf;
+	msg.msg_controllen=sizeof control.buf;
+	*fd=-1;
+	while ((len=recvmsg(sock,&msg,MSG_CMSG_CLOEXEC))<0 && errno==EINTR);
+	if (len<(ssize_t)sizeof(uint32_t)) return -1;
+	struct cmsghdr *cmsg=CMSG_FIRSTHDR(&msg);
+	if (cmsg!=0 && cmsg->cmsg_level==SOL_SOCKET && cmsg->cmsg_type==SCM_RIGHTS) memcpy(fd,CMSG_DATA(cmsg),sizeof(int));
+	return len-sizeof(uint32_t);
+}
+
+/**
+ * \brief Copy of the entries of the output cache, sent to the new process once the cache is unlocked
+ */
+typedef struct CacheSnapshot {
+	HandoverCache **records;	//!< Records of the entries, each allocated with the length of its path
+	int *fds;	//!< Duplicates of the descriptors of the cached outputs, -1 for the entries without output
+	size_t num;	//!< Number of entries copied
+	size_t size;	//!< Number of entries allocated in the arrays
+} CacheSnapshot;
+
+/**
+ * \brief Copy an entry of the output cache, called by cache_foreach
+ *
+ * The cache is locked during the call, so the entry is only copied (and its descriptor duplicated): the messages, which may block on the socket, are sent by send_cache_snapshot after cache_foreach returned.
+ * \param e Entry of the cache
+ * \param arg Pointer to the CacheSnapshot structure
+ */
+static void snapshot_cache_entry(const CacheEntry *e,void *arg) {
+	CacheSnapshot *snapshot=(CacheSnapshot*)arg;
+	const Mount *m;
+	const Procedures *p;
+	uint32_t mount=0,proc=0;
+	for (m=persistent.mounts;m!=0 && m!=e->mount;m=m->next) ++mount;
+	for (p=e->mount->procs;p!=0 && p->procedure!=e->proc;p=p->next) ++proc;
+	size_t len=strlen(e->path);
+	if (m==0 || p==0 || len>=MAX_PATH_LENGTH) return;
+	if (snapshot->num==snapshot->size) {
+		size_t size=(snapshot->size==0)?0x100:2*snapshot->size;
+		HandoverCache **records=(HandoverCache**)realloc(snapshot->records,size*sizeof(HandoverCache*));
+		if (records==0) return;
+		snapshot->records=records;
+		int *fds=(int*)realloc(snapshot->fds,size*sizeof(int));
+		if (fds==0) return;
+		snapshot->fds=fds;
+		snapshot->size=size;
+	}
+	HandoverCache *rec=(HandoverCache*)calloc(1,offsetof(HandoverCache,path)+len+1);
+	if (rec==0) return;
+	int fd=-1;
+	if (e->fd>=0 && (fd=fcntl(e->fd,F_DUPFD_CLOEXEC,0))<0) {	// Without its output, the entry would be imported empty
+		free(rec);
+		return;
+	}
+	rec->mount=mount;
+	rec->proc=proc;
+	rec->dev=e->dev;
+	rec->ino=e->ino;
+	rec->source_size=e->source_size;
+	rec->mtime_sec=e->mtime.tv_sec;
+	rec->mtime_nsec=e->mtime.tv_nsec;
+	rec->state=e->state;
+	rec->has_digest=e->has_digest;
+	rec->size=e->size;
+	rec->digest=e->digest;
+	rec->runs=e->runs;
+	rec->stable_runs=e->stable_runs;
+	rec->stable_since=e->stable_since;
+	rec->avg_ms=e->avg_ms;
+	rec->ttl=e->ttl;
+	rec->demotions=e->demotions;
+	rec->expires=e->expires;
+	memcpy(rec->path,e->path,len+1);
+	snapshot->records[snapshot->num]=rec;
+	snapshot->fds[snapshot->num++]=fd;
+}
+
+/**
+ * \brief Send the entries of the output cache to the new process
+ *
+ * The entries are copied while the cache is locked, then sent without holding the lock, so that the requests of the mounts are not blocked by a slow peer.
+ * \param sock Connected socket
+ */
+static void send_cache_snapshot(int sock) {
+	CacheSnapshot snapshot;
+	size_t i;
+	memset(&snapshot,0,sizeof snapshot);
+	cache_foreach(snapshot_cache_entry,&snapshot);
+	for (i=0;i<snapshot.num;++i) {
+		HandoverCache *rec=snapshot.records[i];
+		send_message(sock,HO_CACHE,rec,offsetof(HandoverCache,path)+strlen(rec->path)+1,snapshot.fds[i]);
+		if (snapshot.fds[i]>=0) close(snapshot.fds[i]);
+		free(rec);
+	}
+	free(snapshot.records);
+	free(snapshot.fds);
+}
+
+/**
+ * \brief Detach a mount point lazily
+ *
+ * The mount point disappears from the namespace at once, but the session keeps serving the files which are still open. The kernel ends the session when the last one is closed.
+ * \param mountpoint Path of the mount point
+ * \return 0 if everything went fine, an error code otherwise
+ */
+static int detach_mount(const char *mountpoint) {
+	if (geteuid()==0) return (umount2(mountpoint,MNT_DETACH)==0)?0:errno;
+	pid_t child=fork();
+	if (child<0) return errno;
+	if (child==0) {
+		execlp("fusermount3","fusermount3","-u","-z","--",mountpoint,(char*)0);
+		_exit(127);
+	}
+	int status;
+	while (waitpid(child,&status,0)<0 && errno==EINTR);
+	return (WIFEXITED(status) && WEXITSTATUS(status)==0)?0:EPERM;
+}
+
+/**
+ * \brief Hand the mounts over to a new process connected on the socket
+ *
+ * \param sock Connected socket
+ * \return 0 if the new process took over, an error code otherwise (the mounts are then still served by this process)
+ */
+static int serve_handover(int sock) {
+	struct ucred cred;
+	socklen_t len=sizeof cred;
+	char data[HANDOVER_DATA_SIZE];
+	uint32_t type;
+	int fd;
+	Mount *m;
+	if (getsockopt(sock,SOL_SOCKET,SO_PEERCRED,&cred,&len)!=0 || (cred.uid!=geteuid() && cred.uid!=0)) return EPERM;
+	if (recv_message(sock,&type,data,sizeof data,&fd)!=sizeof(uint32_t) || type!=HO_HELLO) return EPROTO;
+	if (*(uint32_t*)data!=HANDOVER_VERSION) {
+		send_message(sock,HO_REFUSED,0,0,-1);
+		return EPROTO;
+	}
+	for (m=persistent.mounts;m!=0;m=m->next) {
+		int n=snprintf(data,sizeof data,"%s%c%s%c%s",m->mountpoint?m->mountpoint:"",0,m->mirror,0,m->signature?m->signature:"");
+		if (n>=sizeof data) return ENAMETOOLONG;
+		send_message(sock,HO_MOUNT,data,n+1,m->mirror_fd);
+	}
+	send_cache_snapshot(sock);
+	send_message(sock,HO_END,0,0,-1);
+	if (recv_message(sock,&type,data,sizeof data,&fd)<0 || type!=HO_DETACH) return ECONNABORTED;	// The new process gave up, keep serving
+	int code=0;
+	for (m=persistent.mounts;m!=0;m=m->next) if (m->mountpoint && detach_mount(m->mountpoint)!=0) {
+		fprintf(stderr,"handover: Cannot detach %s\n",m->mountpoint);
+		code=EBUSY;
+	}
+	send_message(sock,HO_DETACHED,&code,sizeof code,-1);
+	return 0;	// Even if some mount points could not be detached, the new process now serves the others
+}
+
+/**
+ * \brief Loop of the handover thread, serves the new processes until one takes over
+ *
+ * \param arg Unused
+ * \return Null pointer
+ */
+static void *handover_loop(void *arg) {
+	while (!__atomic_load_n(&handed_over,__ATOMIC_ACQUIRE)) {
+		int sock=accept4(handover_socket,0,0,SOCK_CLOEXEC);
+		if (sock<0) {
+			if (errno==EINTR || errno==ECONNABORTED) continue;
+			break;	// The socket was shut down
+		}
+		int code=serve_handover(sock);
+		close(sock);
+		if (code==0) {
+			__atomic_store_n(&handed_over,1,__ATOMIC_RELEASE);
+			fprintf(stderr,"handover: Mount points handed over, serving the open files until they are closed\n");
+		}
+#ifdef TRACE
+		else fprintf(stderr,"handover: Failed: %s\n",strerror(code));
+#endif
+	}
+	return 0;
+}
+
+int start_handover() {
+	if (persistent.handover==0 || handover_running) return 0;
+	struct sockaddr_un addr;
+	memset(&addr,0,sizeof addr);
+	addr.sun_family=AF_UNIX;
+	if (strlen(persistent.handover)>=sizeof addr.sun_path) return ENAMETOOLONG;
+	strcpy(addr.sun_path,persistent.handover);
+	handover_socket=socket(AF_UNIX,SOCK_SEQPACKET | SOCK_CLOEXEC,0);
+	if (handover_socket<0) return errno;
+	unlink(persistent.handover);	// The socket of a previous process, which may be the one this process took over from
+	if (bind(handover_socket,(struct sockaddr*)&addr,sizeof addr)!=0 || listen(handover_socket,1)!=0) {
+		int code=errno;
+		fprintf(stderr,"start_handover: Cannot listen on %s: %s\n",persistent.handover,strerror(code));
+		close(handover_socket);
+		handover_socket=-1;
+		return code;
+	}
+	int code=pthread_create(&handover_thread,0,handover_loop,0);
+	if (code!=0) {
+		fprintf(stderr,"start_handover: Cannot start thread: %s\n",strerror(code));
+		close(handover_socket);
+		handover_socket=-1;
+		return code;
+	}
+	handover_running=1;
+	return 0;
+}
+
+int handover_done() {
+	return __atomic_load_n(&handed_over,__ATOMIC_ACQUIRE);
+}
+
+void stop_handover() {
+	if (!handover_running) return;
+	shutdown(handover_socket,SHUT_RDWR);	// Wake the thread up if it is waiting for a connection
+	pthread_join(handover_thread,0);
+	close(handover_socket);
+	handover_socket=-1;
+	if (!handover_done()) unlink(persistent.handover);
+	handover_running=0;
+}
+
+int take_over(const char *path) {
+	struct sockaddr_un addr;
+	char data[HANDOVER_DATA_SIZE];
+	uint32_t type,version=HANDOVER_VERSION;
+	Mount *map[HANDOVER_DATA_SIZE/sizeof(Mount*)];	// Mounts of this process matching the HO_MOUNT messages, null if the state does not apply
+	size_t num_map=0,mounts=0,entries=0;
+	ssize_t len;
+	int fd,code=0;
+	memset(&addr,0,sizeof addr);
+	addr.sun_family=AF_UNIX;
+	if (strlen(path)>=sizeof addr.sun_path) return ENAMETOOLONG;
+	strcpy(addr.sun_path,path);
+	int sock=socket(AF_UNIX,SOCK_SEQPACKET | SOCK_CLOEXEC,0);
+	if (sock<0) return errno;
+	if (connect(sock,(struct sockaddr*)&addr,sizeof addr)!=0 || send_message(sock,HO_HELLO,&version,sizeof version,-1)!=0) {
+		code=errno;
+		fprintf(stderr,"Cannot reach the running process on %s: %s\n",path,strerror(code));
+		close(sock);
+		return code;
+	}
+	while ((len=recv_message(sock,&type,data,sizeof data-1,&fd))>=0 && type!=HO_END) {
+		data[len]=0;
+		if (type==HO_MOUNT) {	// Use the same mirror folder as the running process, and its cache if the procedures are the same
+			const char *mountpoint=data;
+			const char *mirror=mountpoint+strlen(mountpoint)+1;
+			const char *signature=mirror+strlen(mirror)+1;
+			Mount *m;
+			for (m=persistent.mounts;m!=0;m=m->next) if (m->mountpoint && strcmp(m->mountpoint,mountpoint)==0 && strcmp(m->mirror,mirror)==0) break;
+			if (m!=0 && fd>=0) {
+				close(m->mirror_fd);
+				m->mirror_fd=fd;
+				++mounts;
+			} else if (fd>=0) close(fd);
+			if (m!=0 && strcmp(m->signature?m->signature:"",signature)!=0) m=0;
+			if (num_map<sizeof map/sizeof(Mount*)) map[num_map++]=m;
+		} else if (type==HO_CACHE && len>offsetof(HandoverCache,path)) {
+			const HandoverCache *rec=(const HandoverCache*)data;
+			Procedures *p=0;
+			uint32_t i;
+			if (rec->mount<num_map && map[rec->mount]!=0) for (i=0,p=map[rec->mount]->procs;p!=0 && i<rec->proc;++i) p=p->next;
+			if (p==0) {
+				if (fd>=0) close(fd);
+				continue;
+			}
+			CacheEntry model;
+			memset(&model,0,sizeof model);
+			model.path=(char*)rec->path;
+			model.mount=map[rec->mount];
+			model.proc=p->procedure;
+			model.dev=rec->dev;
+			model.ino=rec->ino;
+			model.source_size=rec->source_size;
+			model.mtime.tv_sec=rec->mtime_sec;
+			model.mtime.tv_nsec=rec->mtime_nsec;
+			model.state=rec->state;
+			model.has_digest=rec->has_digest;
+			model.size=rec->size;
+			model.digest=rec->digest;
+			model.runs=rec->runs;
+			model.stable_runs=rec->stable_runs;
+			model.stable_since=rec->stable_since;
+			model.avg_ms=rec->avg_ms;
+			model.ttl=rec->ttl;
+			model.demotions=rec->demotions;
+			model.expires=rec->expires;
+			if (cache_import(&model,fd)==0) ++entries;
+		} else {
+			if (fd>=0) close(fd);
+			if (type==HO_REFUSED) break;
+		}
+	}
+	if (len<0 || type!=HO_END) {
+		fprintf(stderr,"The running process on %s refused the handover\n",path);
+		close(sock);
+		return EPROTO;
+	}
+	// Everything is ready, the mount points are mounted again as soon as they are detached
+	if (send_message(sock,HO_DETACH,0,0,-1)!=0 || recv_message(sock,&type,&code,sizeof code,&fd)<0 || type!=HO_DETACHED) {
+		fprintf(stderr,"The running process on %s did not detach its mount points\n",path);
+		close(sock);
+		return ECONNABORTED;
+	}
+	close(sock);
+	if (code!=0) fprintf(stderr,"The running process on %s could not detach all its mount points: %s\n",path,strerror(code));
+	fprintf(stderr,"Took over %zu mirror folders and %zu cache entries from %s\n",mounts,entries,path);
+	return 0;
+}
@@ -0,0 +1,73 @@
+/**
+ * \file
+ *
+ * =====================================================================================
+ *
+ *       Filename:  handover.h
+ *
+ *    Description:  Handover of the mounts and of the warm state to a new process
+ *
+ *        Version:  2.0
+ *        Created:  10/18/2026
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  
+ *        Company:  
+ *
+ * =====================================================================================
+ */
+
+#ifndef  HANDOVER_INC
+#define  HANDOVER_INC
+
+#define HANDOVER_VERSION 1	//!< Version of the handover protocol, both processes must use the same
+
+/**
+ * \brief Type of the messages of the handover protocol
+ *
+ * Each message is one packet of a SOCK_SEQPACKET unix socket, starting with its type. Descriptors are attached with SCM_RIGHTS.
+ */
+enum HandoverMessage {
+	HO_HELLO,	//!< New process: asks for the state, gives the version of the protocol
+	HO_MOUNT,	//!< Running process: mount point and signature of a mount, with the descriptor of its mirror folder
+	HO_CACHE,	//!< Running process: entry of the output cache, with the descriptor of the cached output if any
+	HO_END,	//!< Running process: the whole state was sent
+	HO_DETACH,	//!< New process: ready to mount, asks the running process to detach its mount points
+	HO_DETACHED,	//!< Running process: the mount points are detached
+	HO_REFUSED	//!< Running process: the handover is not possible (other version or handover already done)
+};
+
+/**
+ * \brief Start listening for a new process taking over the mounts
+ *
+ * If a handover socket was given, the function creates it and starts a thread which waits for a new process. When one connects, the thread sends it the mirror folders and the output cache, then detaches the mount points when the new process is ready to mount them. The sessions keep serving the files which are still open until they are closed. The function must be called after the process is daemonized.
+ * \return 0 if everything went fine, an error code otherwise
+ */
+int start_handover();
+
+/**
+ * \brief Tell if a new process took over the mounts
+ *
+ * Once it is the case, the mount points of this process belong to the new process: the sessions of this process must never unmount them, even when they end.
+ * \return 1 if the mounts were handed over, 0 otherwise
+ */
+int handover_done();
+
+/**
+ * \brief Stop listening for a new process
+ *
+ * The socket is removed, unless a new process took over (the socket may then be its own).
+ */
+void stop_handover();
+
+/**
+ * \brief Take over the mounts of a running process
+ *
+ * The function connects to the handover socket of the running process, replaces the mirror folders of the mounts with the same mount points by the ones of the running process and imports its output cache (for the mounts with the same procedures). It then asks the running process to detach its mount points and returns once they are detached, so that the caller mounts them again immediately.
+ * \param path Path of the handover socket of the running process
+ * \return 0 if everything went fine, an error code otherwise (a message is printed)
+ */
+int take_over(const char *path);
+
+#endif   /* ----- #ifndef HANDOVER_INC  ----- */
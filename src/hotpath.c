@@ -0,0 +1,207 @@
+/*
+ * =====================================================================================
+ *
+ *       Filename:  hotpath.c
+ *
+ *    Description:  Implementation of the heavy hitters
+ *
+ *        Version:  2.0
+ *        Created:  10/18/2026
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  
+ *        Company:  
+ *
+ * =====================================================================================
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "operations.h"
+#include "cache.h"
+#include "hotpath.h"
+
+extern struct Persistent persistent;
+
+/**
+ * \brief Path of the top of a metric
+ */
+typedef struct HotEntry {
+	uint64_t key;	//!< Hash of the mount and of the path
+	const Mount *mount;	//!< Mount of the path
+	unsigned long long count;	//!< Estimate of the metric for the path when it was last updated
+	char name[HOT_NAME_LENGTH];	//!< Path relative to the mirror folder, possibly truncated
+} HotEntry;
+
+/**
+ * \brief Count-min sketch and top of a metric
+ */
+typedef struct HotTable {
+	unsigned long long sketch[HOT_DEPTH][HOT_WIDTH];	//!< Counters of the sketch, updated with atomic operations
+	HotEntry top[HOT_TOP];	//!< Min-heap of the paths with the largest estimates
+	unsigned char index[HOT_INDEX];	//!< Open-addressing index of the paths of the top by hash (linear probing), each slot holds the position in top plus one, 0 if it is free
+	size_t num;	//!< Number of paths in the top
+	unsigned long long floor;	//!< Smallest estimate of the top once it is full, 0 before, read without lock
+} HotTable;
+
+static HotTable hot_tables[HOT_METRICS];	//!< Sketches and tops of the metrics
+static pthread_mutex_t hot_mutex=PTHREAD_MUTEX_INITIALIZER;	//!< Protects the tops
+static const char *hot_names[HOT_METRICS]={"executions","cpu_us","bytes_read","opens","lookups","tests"};	//!< Names of the metrics in the top control file
+
+/**
+ * \brief Find the slot of the index holding a path of a top
+ *
+ * \param t Table of the metric
+ * \param key Hash of the mount and of the path
+ * \param mount Mount of the path
+ * \return Slot of the path, or the free slot where it would be inserted if it is not in the top
+ */
+static size_t hot_slot(const HotTable *t,uint64_t key,const Mount *mount) {
+	size_t s=key&(HOT_INDEX-1);
+	while (t->index[s]!=0) {
+		const HotEntry *e=t->top+t->index[s]-1;
+		if (e->key==key && e->mount==mount) return s;
+		s=(s+1)&(HOT_INDEX-1);
+	}
+	return s;
+}
+
+/**
+ * \brief Remove a path from the index of a top
+ *
+ * The following slots of the same cluster are shifted back when their home slot allows it, so that no lookup stops on the freed slot too early.
+ * \param t Table of the metric
+ * \param s Slot of the path
+ */
+static void hot_unindex(HotTable *t,size_t s) {
+	size_t next=(s+1)&(HOT_INDEX-1);
+	t->index[s]=0;
+	while (t->index[next]!=0) {
+		size_t home=t->top[t->index[next]-1].key&(HOT_INDEX-1);
+		if (((next-home)&(HOT_INDEX-1))>=((next-s)&(HOT_INDEX-1))) {	// The home slot is not after the free slot, the path may move there
+			t->index[s]=t->index[next];
+			t->index[next]=0;
+			s=next;
+		}
+		next=(next+1)&(HOT_INDEX-1);
+	}
+}
+
+/**
+ * \brief Swap two entries of a top and update the index
+ *
+ * \param t Table of the metric
+ * \param i Position of the first entry
+ * \param j Position of the second entry
+ */
+static void hot_swap(HotTable *t,size_t i,size_t j) {
+	size_t si=hot_slot(t,t->top[i].key,t->top[i].mount);
+	size_t sj=hot_slot(t,t->top[j].key,t->top[j].mount);
+	HotEntry swap=t->top[i];
+	t->top[i]=t->top[j];
+	t->top[j]=swap;
+	t->index[si]=j+1;
+	t->index[sj]=i+1;
+}
+
+/**
+ * \brief Restore the heap order below an entry of a top whose count increased
+ *
+ * \param t Table of the metric
+ * \param i Index of the entry
+ */
+static void hot_sift_down(HotTable *t,size_t i) {
+	for (;;) {
+		size_t smallest=i,child;
+		for (child=2*i+1;child<=2*i+2 && child<t->num;++child) if (t->top[child].count<t->top[smallest].count) smallest=child;
+		if (smallest==i) return;
+		hot_swap(t,i,smallest);
+		i=smallest;
+	}
+}
+
+/**
+ * \brief Restore the heap order above a new entry of a top
+ *
+ * \param t Table of the metric
+ * \param i Index of the entry
+ */
+static void hot_sift_up(HotTable *t,size_t i) {
+	while (i>0 && t->top[i].count<t->top[(i-1)/2].count) {
+		hot_swap(t,i,(i-1)/2);
+		i=(i-1)/2;
+	}
+}
+
+void hot_add(int metric,const char *relative,unsigned long long value) {
+	if (!persistent.control || value==0 || metric<0 || metric>=HOT_METRICS) return;
+	HotTable *t=hot_tables+metric;
+	const Mount *mount=current_mount();
+	uint64_t key=hash_path(FNV_OFFSET^(uint64_t)(uintptr_t)mount,relative);
+	uint64_t step=((key>>32)|(key<<32))*FNV_PRIME|1;	// Each row uses another counter (double hashing)
+	unsigned long long estimate=~0ULL;
+	int i;
+	for (i=0;i<HOT_DEPTH;++i) {
+		unsigned long long count=__atomic_add_fetch(&t->sketch[i][(key+i*step)%HOT_WIDTH],value,__ATOMIC_RELAXED);
+		if (count<estimate) estimate=count;
+	}
+	if (estimate<=__atomic_load_n(&t->floor,__ATOMIC_RELAXED)) return;	// A path of the top has an estimate at least as large as the floor, so this one is not in it
+	pthread_mutex_lock(&hot_mutex);
+	size_t j,s=hot_slot(t,key,mount);
+	if (t->index[s]!=0) {	// Already in the top
+		j=t->index[s]-1;
+		if (estimate>t->top[j].count) t->top[j].count=estimate;
+		hot_sift_down(t,j);
+	} else if (t->num<HOT_TOP || estimate>t->top[0].count) {	// Enter the top, in place of the smallest path if it is full
+		if (t->num<HOT_TOP) j=t->num++;
+		else {
+			j=0;
+			hot_unindex(t,hot_slot(t,t->top[0].key,t->top[0].mount));
+			s=hot_slot(t,key,mount);	// The removal may have moved the free slot of the new path
+		}
+		t->index[s]=j+1;
+		t->top[j].key=key;
+		t->top[j].mount=mount;
+		t->top[j].count=estimate;
+		strncpy(t->top[j].name,relative,HOT_NAME_LENGTH-1);
+		t->top[j].name[HOT_NAME_LENGTH-1]=0;
+		if (j==0) hot_sift_down(t,0); else hot_sift_up(t,j);
+	}
+	if (t->num==HOT_TOP) __atomic_store_n(&t->floor,t->top[0].count,__ATOMIC_RELAXED);
+	pthread_mutex_unlock(&hot_mutex);
+}
+
+/**
+ * \brief Compare two entries of a top by decreasing count, for qsort
+ *
+ * \param a First entry
+ * \param b Second entry
+ * \return Negative if a comes first, positive if b comes first, 0 otherwise
+ */
+static int hot_compare(const void *a,const void *b) {
+	unsigned long long ca=((const HotEntry*)a)->count;
+	unsigned long long cb=((const HotEntry*)b)->count;
+	return (ca>cb)?-1:(ca<cb)?1:0;
+}
+
+void render_top(FILE *f) {
+	static HotEntry copy[HOT_TOP];	// The control files are rendered one at a time, under hot_mutex
+	int metric;
+	size_t i;
+	pthread_mutex_lock(&hot_mutex);
+	for (metric=0;metric<HOT_METRICS;++metric) {
+		HotTable *t=hot_tables+metric;
+		size_t num=t->num;
+		memcpy(copy,t->top,num*sizeof(HotEntry));
+		qsort(copy,num,sizeof(HotEntry),hot_compare);
+		fprintf(f,"%s# %s\n",(metric==0)?"":"\n",hot_names[metric]);
+		for (i=0;i<num && i<HOT_SHOWN;++i) {
+			if (persistent.mounts!=0 && persistent.mounts->next!=0) fprintf(f,"%llu %s/%s\n",copy[i].count,copy[i].mount->mirror,copy[i].name);
+			else fprintf(f,"%llu %s\n",copy[i].count,copy[i].name);
+		}
+	}
+	pthread_mutex_unlock(&hot_mutex);
+}
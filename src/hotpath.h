@@ -0,0 +1,63 @@
+/**
+ * \file
+ *
+ * =====================================================================================
+ *
+ *       Filename:  hotpath.h
+ *
+ *    Description:  Heavy hitters among the paths of the mounts
+ *
+ *        Version:  2.0
+ *        Created:  10/18/2026
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  
+ *        Company:  
+ *
+ * =====================================================================================
+ */
+
+#ifndef  HOTPATH_INC
+#define  HOTPATH_INC
+
+#include <stdio.h>
+
+#define HOT_DEPTH 4	//!< Number of rows of the count-min sketches
+#define HOT_WIDTH 0x1000	//!< Number of counters in each row of the count-min sketches
+#define HOT_TOP 64	//!< Number of paths kept in the top of each metric
+#define HOT_INDEX (4*HOT_TOP)	//!< Number of slots of the index of each top, a power of 2 so that the home slot is a mask of the hash
+#define HOT_SHOWN 50	//!< Number of paths of each metric written in the top control file
+#define HOT_NAME_LENGTH 0x100	//!< Maximal length of the paths kept in the tops, longer paths are truncated
+
+/**
+ * \brief Metric by which the paths are ranked
+ */
+enum HotMetric {
+	HOT_EXECUTIONS,	//!< Number of executions of the script
+	HOT_CPU,	//!< CPU time used by the executions of the script, in microseconds
+	HOT_BYTES,	//!< Number of bytes read from the file
+	HOT_OPENS,	//!< Number of times the file was opened
+	HOT_LOOKUPS,	//!< Number of times the attributes of the file were asked
+	HOT_TESTS,	//!< Number of test programs run on the file
+	HOT_METRICS	//!< Number of metrics
+};
+
+/**
+ * \brief Count an operation on a path of the current mount
+ *
+ * The value is added to a count-min sketch of the metric, which gives an estimate of the total of the path that is never below the actual one. If the estimate is large enough, the path enters the top of the metric, a min-heap of the HOT_TOP largest estimates. The cost is constant and the memory fixed, whatever the number of paths: a path is found in the top through an index of its hash, not by scanning the top. Nothing is counted unless the control files are enabled.
+ * \param metric Metric of the operation (see enum HotMetric)
+ * \param relative Path relative to the mirror folder
+ * \param value Value to add to the metric of the path
+ */
+void hot_add(int metric,const char *relative,unsigned long long value);
+
+/**
+ * \brief Write the paths with the largest estimates for each metric
+ *
+ * \param f Stream on which the tops are written
+ */
+void render_top(FILE *f);
+
+#endif   /* ----- #ifndef HOTPATH_INC  ----- */
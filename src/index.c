@@ -0,0 +1,176 @@
+/*
+ * =====================================================================================
+ *
+ *       Filename:  index.c
+ *
+ *    Description:  Implementation of the in-memory index of an immutable mirror
+ *
+ *        Version:  2.0
+ *        Created:  10/18/2026
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  
+ *        Company:  
+ *
+ * =====================================================================================
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "operations.h"
+#include "parallel.h"
+#include "cache.h"
+#include "index.h"
+
+extern struct Persistent persistent;
+
+#define INDEX_BUCKETS 0x10000	//!< Number of buckets of the hash table of the index
+
+static IndexEntry *index_table[INDEX_BUCKETS];	//!< Hash table of the entries, indexed by path
+static size_t index_entries=0;	//!< Number of entries in the table
+static pthread_mutex_t index_mutex=PTHREAD_MUTEX_INITIALIZER;	//!< Protects the table while it is built, it is read without lock afterwards
+static int index_error=0;	//!< First error met while the index was built
+
+/**
+ * \brief Compute the bucket of a path in the hash table
+ *
+ * \param path Path relative to the mirror folder
+ * \return Index of the bucket
+ */
+static size_t index_bucket(const char *path) {
+	return hash_path(FNV_OFFSET,path)%INDEX_BUCKETS;
+}
+
+/**
+ * \brief Create an entry and add it to the hash table
+ *
+ * \param path Path relative to the mirror folder
+ * \param base Position of the name of the entry in path
+ * \param st Attributes of the entry in the mirror
+ * \return Pointer to the new entry, null if it could not be allocated
+ */
+static IndexEntry *index_add(const char *path,size_t base,const struct stat *st) {
+	IndexEntry *e=(IndexEntry*)calloc(1,sizeof(IndexEntry));
+	if (e==0) return 0;
+	e->path=strdup(path);
+	if (e->path==0) {free(e);return 0;}
+	e->name=e->path+base;
+	e->mount=current_mount();
+	e->st=*st;
+	size_t bucket=index_bucket(path);
+	pthread_mutex_lock(&index_mutex);
+	e->next=index_table[bucket];
+	index_table[bucket]=e;
+	++index_entries;
+	pthread_mutex_unlock(&index_mutex);
+	return e;
+}
+
+/**
+ * \brief Record an error met while the index is built
+ *
+ * \param path Path on which the error occurred
+ * \param code Error code
+ */
+static void index_fail(const char *path,int code) {
+	fprintf(stderr,"build_index: Cannot read %s: %s\n",path,strerror(code));
+	__atomic_compare_exchange_n(&index_error,&(int){0},code,0,__ATOMIC_RELAXED,__ATOMIC_RELAXED);
+}
+
+/**
+ * \brief Task of the index build, which lists one folder
+ *
+ * The function adds all the entries of the folder to the index and submits a new task for each subfolder.
+ * \param pool Pool running the task
+ * \param arg Function measuring the output of scripts, or null
+ * \param task Entry of the folder
+ */
+static void index_folder(TaskPool *pool,void *arg,void *task) {
+	MeasureFunction measure=(MeasureFunction)arg;
+	IndexEntry *folder=(IndexEntry*)task;
+	set_thread_mount(folder->mount);
+	int fd=openat(current_mount()->mirror_fd,folder->path,O_RDONLY | O_DIRECTORY);
+	DIR *dir=(fd<0)?0:fdopendir(fd);
+	if (dir==0) {
+		index_fail(folder->path,errno);
+		if (fd>=0) close(fd);
+		return;
+	}
+	const char *prefix=(strcmp(folder->path,".")==0)?"":folder->path;
+	size_t size=0;
+	struct dirent *entry;
+	char path[FILENAME_MAX_LENGTH];
+	for (;;) {
+		errno=0;
+		entry=readdir(dir);
+		if (entry==0) break;
+		if (strcmp(entry->d_name,".")==0 || strcmp(entry->d_name,"..")==0) continue;
+		int len=snprintf(path,sizeof path,"%s%s%s",prefix,(*prefix)?"/":"",entry->d_name);
+		if (len>=sizeof path) {index_fail(entry->d_name,ENAMETOOLONG);continue;}
+		struct stat st;
+		if (fstatat(current_mount()->mirror_fd,path,&st,AT_SYMLINK_NOFOLLOW)!=0) {index_fail(path,errno);continue;}
+		IndexEntry *e=index_add(path,len-strlen(entry->d_name),&st);
+		if (e==0) {index_fail(path,ENOMEM);continue;}
+		if (folder->num_children==size) {
+			size=(size==0)?0x10:2*size;
+			IndexEntry **children=(IndexEntry**)realloc(folder->children,size*sizeof(IndexEntry*));
+			if (children==0) {index_fail(path,ENOMEM);break;}
+			folder->children=children;
+		}
+		folder->children[folder->num_children++]=e;
+		if (S_ISDIR(st.st_mode)) submit_task(pool,e);
+		else if (S_ISREG(st.st_mode) && (e->proc=get_script(current_mount()->procs,path))!=0) {
+			e->st.st_mode&=~(S_IWUSR | S_IWGRP | S_IWOTH);	// Writing on scripts is not handled
+			if (measure) {
+				off_t out=measure(path,e->proc);
+				if (out>=0) e->st.st_size=out;
+			}
+		}
+	}
+	if (errno!=0) index_fail(folder->path,errno);
+	closedir(dir);
+}
+
+int build_index(unsigned int width,MeasureFunction measure) {
+	struct stat st;
+	if (fstatat(current_mount()->mirror_fd,".",&st,0)!=0) return errno;
+	IndexEntry *root=index_add(".",0,&st);
+	if (root==0) return ENOMEM;
+	index_error=0;
+	parallel_tasks(width,index_folder,(void*)measure,root);
+#ifdef TRACE
+	fprintf(stderr,"build_index: %zu entries\n",index_entries);
+#endif
+	return index_error;
+}
+
+const IndexEntry *find_index(const char *relative) {
+	IndexEntry *e;
+	Mount *mount=current_mount();
+	for (e=index_table[index_bucket(relative)];e!=0;e=e->next) if (e->mount==mount && strcmp(e->path,relative)==0) return e;
+	return 0;
+}
+
+void free_index() {
+	size_t i;
+	for (i=0;i<INDEX_BUCKETS;++i) {
+		IndexEntry *e=index_table[i];
+		while (e!=0) {
+			IndexEntry *next=e->next;
+			free(e->children);
+			free(e->path);
+			free(e);
+			e=next;
+		}
+		index_table[i]=0;
+	}
+	index_entries=0;
+}
@@ -0,0 +1,73 @@
+/**
+ * \file
+ *
+ * =====================================================================================
+ *
+ *       Filename:  index.h
+ *
+ *    Description:  In-memory index of an immutable mirror
+ *
+ *        Version:  2.0
+ *        Created:  10/18/2026
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  
+ *        Company:  
+ *
+ * =====================================================================================
+ */
+
+#ifndef  INDEX_INC
+#define  INDEX_INC
+
+#include <sys/stat.h>
+#include "procedures.h"
+
+/**
+ * \brief Entry of the index, for one file or folder of the mirror
+ *
+ * The entry holds everything needed to answer metadata requests without going to the mirror: the attributes as they appear in the virtual file system, the procedure of the file if it is a script, and the list of the entries of a folder.
+ */
+typedef struct IndexEntry {
+	char *path;	//!< Path relative to the mirror folder, "." for the root
+	struct Mount *mount;	//!< Mount of the mirror folder
+	const char *name;	//!< Name of the entry in its folder, pointing inside path
+	struct stat st;	//!< Attributes of the entry in the virtual file system
+	Procedure *proc;	//!< Procedure of the file if it is a script, null otherwise
+	struct IndexEntry **children;	//!< Entries of the folder, null if the entry is not a folder
+	size_t num_children;	//!< Number of entries of the folder
+	struct IndexEntry *next;	//!< Next entry in the same bucket of the hash table
+} IndexEntry;
+
+/**
+ * \brief Type of a function giving the size of the output of a script
+ *
+ * The function is called with the path of the script relative to the mirror folder and its procedure. It returns the size of the output, or a negative value if it cannot be measured.
+ */
+typedef off_t (*MeasureFunction)(const char*,Procedure*);
+
+/**
+ * \brief Build the index of the mirror of the current mount
+ *
+ * The function walks the whole mirror with a work-stealing pool of threads (see parallel_tasks), one task per folder. For each entry, it records its attributes, finds if it is a script with get_script and, if measure is not null, replaces the size of the scripts with the size of their output. Write access is removed from scripts as in the normal mode. The mirror must not change afterwards.
+ * \param width Maximal number of folders processed at the same time
+ * \param measure Function measuring the output of a script, null to keep the size of the script
+ * \return 0 if everything went fine, an error code otherwise
+ */
+int build_index(unsigned int width,MeasureFunction measure);
+
+/**
+ * \brief Find the entry of a path of the current mount in the index
+ *
+ * \param relative Path relative to the mirror folder
+ * \return Pointer to the entry, null if the path does not exist in the mirror
+ */
+const IndexEntry *find_index(const char *relative);
+
+/**
+ * \brief Release the index
+ */
+void free_index();
+
+#endif   /* ----- #ifndef INDEX_INC  ----- */
@@ -0,0 +1,228 @@
+/*
+ * =====================================================================================
+ *
+ *       Filename:  materialize.c
+ *
+ *    Description:  Implementation of the offline rendering of the virtual file system
+ *
+ *        Version:  2.0
+ *        Created:  10/18/2026
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  
+ *        Company:  
+ *
+ * =====================================================================================
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <linux/fs.h>
+#include "operations.h"
+#include "parallel.h"
+#include "materialize.h"
+
+extern struct Persistent persistent;
+
+/**
+ * \brief Shared state of a materialization
+ */
+struct Materialization {
+	int out_fd;	//!< Descriptor of the destination folder
+	int link;	//!< Way non-script files are reproduced (see enum LinkMode)
+	FILE *report;	//!< Stream receiving the per-file report, or null
+	pthread_mutex_t mutex;	//!< Protects the report and the counters
+	int error;	//!< First error met
+	size_t scripts;	//!< Number of scripts executed
+	size_t files;	//!< Number of other entries reproduced
+	unsigned long long bytes;	//!< Number of bytes written or linked
+};
+
+/**
+ * \brief Entry of the mirror waiting to be rendered
+ */
+struct MaterializeTask {
+	char path[FILENAME_MAX_LENGTH];	//!< Path relative to the mirror folder, "." for the root
+	struct stat st;	//!< Attributes of the entry in the mirror
+};
+
+int get_link_mode_from_string(const char *str) {
+	if (strcasecmp(str,"reflink")==0) return LINK_REFLINK;
+	if (strcasecmp(str,"hard")==0) return LINK_HARD;
+	if (strcasecmp(str,"copy")==0) return LINK_COPY;
+	return -1;
+}
+
+/**
+ * \brief Record the result of an entry in the report and the counters
+ *
+ * \param m Materialization
+ * \param kind Kind of operation made on the entry
+ * \param path Path of the entry
+ * \param start Time (in milliseconds) when the entry started to be processed
+ * \param size Number of bytes produced
+ * \param code Error code, 0 if the entry was rendered
+ */
+static void materialize_done(struct Materialization *m,const char *kind,const char *path,long long start,off_t size,int code) {
+	long long duration=now_ms()-start;
+	pthread_mutex_lock(&m->mutex);
+	if (code!=0) {
+		fprintf(stderr,"materialize: %s: %s\n",path,strerror(code));
+		if (m->error==0) m->error=code;
+	} else {
+		if (strcmp(kind,"script")==0) ++m->scripts; else ++m->files;
+		m->bytes+=size;
+	}
+	if (m->report) fprintf(m->report,"%s\t%lld\t%lld\t%s\n",(code==0)?kind:"error",duration,(long long)size,path);
+	pthread_mutex_unlock(&m->mutex);
+}
+
+/**
+ * \brief Reproduce a non-script file in the destination folder
+ *
+ * \param m Materialization
+ * \param task Entry of the file
+ * \param kind Pointer to the variable receiving the kind of operation actually made
+ * \return Error code, 0 if everything went fine
+ */
+static int materialize_file(struct Materialization *m,struct MaterializeTask *task,const char **kind) {
+	unlinkat(m->out_fd,task->path,0);	// A previous rendering must not be modified through a hard link
+	if (m->link==LINK_HARD) {
+		*kind="link";
+		if (linkat(current_mount()->mirror_fd,task->path,m->out_fd,task->path,0)==0) return 0;
+		if (errno!=EXDEV && errno!=EPERM) return errno;
+	}
+	int fin=openat(current_mount()->mirror_fd,task->path,O_RDONLY);
+	if (fin<0) return errno;
+	int fout=openat(m->out_fd,task->path,O_WRONLY | O_CREAT | O_TRUNC,task->st.st_mode & 07777);
+	if (fout<0) {
+		int code=errno;
+		close(fin);
+		return code;
+	}
+	int code=0;
+	*kind="reflink";
+	if (m->link==LINK_COPY || ioctl(fout,FICLONE,fin)!=0) {
+		*kind="copy";
+		if (copy_data(fin,fout)<0) code=errno;
+	}
+	close(fin);
+	if (close(fout)!=0 && code==0) code=errno;
+	return code;
+}
+
+/**
+ * \brief Task of the materialization, which renders one entry of the mirror
+ *
+ * Folders are created in the destination and a new task is submitted for each of their entries.
+ * \param pool Pool running the task
+ * \param arg Materialization
+ * \param data Entry to render (struct MaterializeTask), released by the function
+ */
+static void materialize_task(TaskPool *pool,void *arg,void *data) {
+	struct Materialization *m=(struct Materialization*)arg;
+	struct MaterializeTask *task=(struct MaterializeTask*)data;
+	long long start=now_ms();
+	int code=0;
+	off_t size=0;
+	const char *kind="other";
+	if (S_ISDIR(task->st.st_mode)) {
+		kind="folder";
+		if (strcmp(task->path,".")!=0 && mkdirat(m->out_fd,task->path,(task->st.st_mode & 07777) | S_IWUSR | S_IXUSR)!=0 && errno!=EEXIST) code=errno;
+		int fd=(code!=0)?-1:openat(current_mount()->mirror_fd,task->path,O_RDONLY | O_DIRECTORY);
+		DIR *dir=(fd<0)?0:fdopendir(fd);
+		if (code==0 && dir==0) {
+			code=errno;
+			if (fd>=0) close(fd);
+		}
+		if (dir) {
+			const char *prefix=(strcmp(task->path,".")==0)?"":task->path;
+			struct dirent *entry;
+			while ((entry=readdir(dir))!=0) {
+				if (strcmp(entry->d_name,".")==0 || strcmp(entry->d_name,"..")==0) continue;
+				struct MaterializeTask *child=(struct MaterializeTask*)malloc(sizeof(struct MaterializeTask));
+				if (child==0) {code=ENOMEM;break;}
+				int len=snprintf(child->path,sizeof child->path,"%s%s%s",prefix,(*prefix)?"/":"",entry->d_name);
+				if (len>=sizeof child->path || fstatat(current_mount()->mirror_fd,child->path,&child->st,AT_SYMLINK_NOFOLLOW)!=0) {
+					materialize_done(m,kind,child->path,start,0,(len>=sizeof child->path)?ENAMETOOLONG:errno);
+					free(child);
+					continue;
+				}
+				submit_task(pool,child);
+			}
+			closedir(dir);
+		}
+	} else if (S_ISLNK(task->st.st_mode)) {
+		char target[FILENAME_MAX_LENGTH];
+		ssize_t len=readlinkat(current_mount()->mirror_fd,task->path,target,sizeof target-1);
+		kind="symlink";
+		if (len<0) code=errno;
+		else {
+			target[len]=0;
+			unlinkat(m->out_fd,task->path,0);
+			if (symlinkat(target,m->out_fd,task->path)!=0) code=errno;
+		}
+	} else if (S_ISREG(task->st.st_mode)) {
+		Procedure *proc=get_script(current_mount()->procs,task->path);
+		if (proc) {	// Write the output of the script directly on the destination file
+			kind="script";
+			unlinkat(m->out_fd,task->path,0);
+			int fd=openat(m->out_fd,task->path,O_WRONLY | O_CREAT | O_TRUNC,task->st.st_mode & 07777 & ~(S_IWUSR | S_IWGRP | S_IWOTH));
+			if (fd<0) code=errno;
+			else {
+				int status=proc->program->func(proc->program,task->path,fd);
+				struct stat st;
+				if (fstat(fd,&st)==0) size=st.st_size;
+				if (close(fd)!=0) code=errno;
+				if (code==0 && status!=0) {	// A truncated output must not look like a complete one
+					fprintf(stderr,"materialize: %s: The script exited with code %d\n",task->path,status);
+					code=EIO;
+				}
+				if (code!=0) unlinkat(m->out_fd,task->path,0);
+			}
+		} else {
+			code=materialize_file(m,task,&kind);
+			size=task->st.st_size;
+		}
+	} else kind="skipped";	// Devices, pipes and sockets are not reproduced
+	materialize_done(m,kind,task->path,start,size,code);
+	free(task);
+}
+
+int materialize(const char *outdir,unsigned int width,int link,FILE *report) {
+	struct Materialization m;
+	m.out_fd=open(outdir,O_RDONLY | O_DIRECTORY);
+	if (m.out_fd<0) return errno;
+	m.link=link;
+	m.report=report;
+	pthread_mutex_init(&m.mutex,0);
+	m.error=0;
+	m.scripts=m.files=0;
+	m.bytes=0;
+	struct MaterializeTask *root=(struct MaterializeTask*)malloc(sizeof(struct MaterializeTask));
+	if (root==0) {close(m.out_fd);return ENOMEM;}
+	strcpy(root->path,".");
+	if (fstatat(current_mount()->mirror_fd,".",&root->st,0)!=0) {
+		int code=errno;
+		free(root);
+		close(m.out_fd);
+		return code;
+	}
+	long long start=now_ms();
+	if (report) fprintf(report,"kind\tms\tbytes\tpath\n");
+	parallel_tasks(width,materialize_task,&m,root);
+	fprintf(stderr,"materialize: %zu scripts and %zu other entries (%llu bytes) in %lld ms\n",m.scripts,m.files,m.bytes,now_ms()-start);
+	close(m.out_fd);
+	pthread_mutex_destroy(&m.mutex);
+	return m.error;
+}
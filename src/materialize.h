@@ -0,0 +1,55 @@
+/**
+ * \file
+ *
+ * =====================================================================================
+ *
+ *       Filename:  materialize.h
+ *
+ *    Description:  Offline rendering of the virtual file system into a folder
+ *
+ *        Version:  2.0
+ *        Created:  10/18/2026
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  
+ *        Company:  
+ *
+ * =====================================================================================
+ */
+
+#ifndef  MATERIALIZE_INC
+#define  MATERIALIZE_INC
+
+#include <stdio.h>
+
+/**
+ * \brief Way non-script files are reproduced in the destination folder
+ */
+enum LinkMode {
+	LINK_REFLINK,	//!< Clone the file (copy-on-write) if the file system supports it, copy it otherwise
+	LINK_HARD,	//!< Make a hard link to the file of the mirror if both folders are on the same file system, clone or copy it otherwise
+	LINK_COPY	//!< Copy the file
+};
+
+/**
+ * \brief Get the link mode from its name
+ *
+ * \param str Name of the mode: reflink, hard or copy
+ * \return Link mode (see enum LinkMode), -1 if the name is unknown
+ */
+int get_link_mode_from_string(const char *str);
+
+/**
+ * \brief Render the whole virtual file system into a folder, without mounting it
+ *
+ * The function walks the mirror with a work-stealing pool of threads, one task per folder and per file. The folders are created in the destination, the scripts are executed with their procedure and their output is written directly on the destination file (which is removed if the script fails), symbolic links are reproduced, and the other files are cloned, linked or copied according to the link mode. For each entry, a line with its kind, its duration in milliseconds, its size and its path is written on the report.
+ * \param outdir Path of the destination folder, which must exist
+ * \param width Maximal number of entries processed at the same time
+ * \param link Way non-script files are reproduced (see enum LinkMode)
+ * \param report Stream on which the per-file report is written, null for no report
+ * \return 0 if every entry was rendered, an error code otherwise
+ */
+int materialize(const char *outdir,unsigned int width,int link,FILE *report);
+
+#endif   /* ----- #ifndef MATERIALIZE_INC  ----- */
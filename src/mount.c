@@ -0,0 +1,239 @@
+/*
+ * =====================================================================================
+ *
+ *       Filename:  mount.c
+ *
+ *    Description:  Implementation of the mirrors served by the file system process
+ *
+ *        Version:  2.0
+ *        Created:  10/18/2026
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  
+ *        Company:  
+ *
+ * =====================================================================================
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "operations.h"
+#include "mount.h"
+#include "context.h"
+
+extern struct Persistent persistent;
+
+#define MOUNT_LINE_LENGTH 0x1000	//!< Maximal length of a line of the table of mounts
+
+static __thread Mount *thread_mount=0;	//!< Mount set for the current thread by set_thread_mount
+
+Mount *new_mount() {
+	Mount *mount=(Mount*)calloc(1,sizeof(Mount));
+	if (mount==0) return 0;
+	mount->mirror_fd=-1;
+	mount->context_fd=-1;
+	pthread_mutex_init(&mount->context_mutex,0);
+	pthread_cond_init(&mount->context_cond,0);
+	return mount;
+}
+
+void free_mounts(Mount *mount) {
+	while (mount!=0) {
+		Mount *next=mount->next;
+		if (mount->mirror_fd>=0) close(mount->mirror_fd);
+		free(mount->mirror);
+		free(mount->mountpoint);
+		free(mount->signature);
+		free(mount->context);
+		if (mount->context_fd>=0) close(mount->context_fd);
+		pthread_mutex_destroy(&mount->context_mutex);
+		pthread_cond_destroy(&mount->context_cond);
+		free_procedures(mount->procs);
+		free(mount);
+		mount=next;
+	}
+}
+
+Mount *current_mount() {
+	if (thread_mount) return thread_mount;
+	if (persistent.request_mount) {
+		Mount *mount=persistent.request_mount();
+		if (mount) return mount;
+	}
+	return persistent.mounts;
+}
+
+void set_thread_mount(Mount *mount) {
+	thread_mount=mount;
+}
+
+int open_mirror(Mount *mount,const char *path) {
+	struct stat sb;
+	if (stat(path,&sb)!=0 || !S_ISDIR(sb.st_mode)) return ENOTDIR;
+	mount->mirror=realpath(path,0);
+	if (mount->mirror==0) return errno;
+	mount->mirror_len=strlen(mount->mirror);
+	mount->mirror_fd=open(mount->mirror,O_RDONLY);
+	if (mount->mirror_fd<0) return errno;
+	return 0;
+}
+
+int add_procedure(Mount *mount,const char *str) {
+	Procedure *proc=get_procedure_from_string(str);
+	if (proc==0) return -1;
+	Procedures *procs=(Procedures*)malloc(sizeof(Procedures));
+	procs->procedure=proc;
+	procs->next=0;
+	Procedures **last=&mount->procs;
+	while (*last) last=&(*last)->next;
+	*last=procs;
+	size_t len=(mount->signature)?strlen(mount->signature):0;
+	char *signature=(char*)realloc(mount->signature,len+strlen(str)+2);
+	if (signature!=0) {
+		sprintf(signature+len,"%s\n",str);
+		mount->signature=signature;
+	}
+	return 0;
+}
+
+void default_procedures(Mount *mount) {
+	if (mount->procs!=0) return;
+	mount->procs=(Procedures*)malloc(sizeof(Procedures));
+	mount->procs->procedure=(Procedure*)malloc(sizeof(Procedure));
+	mount->procs->procedure->cache_mode=CACHE_DEFAULT;
+	mount->procs->procedure->cache_ttl=0;
+	mount->procs->procedure->compress=COMPRESS_NONE;
+	mount->procs->procedure->inputs=0;
+	mount->procs->procedure->program=(Program*)malloc(sizeof(Program));
+	mount->procs->procedure->program->path=0;
+	mount->procs->procedure->program->args=0;
+	mount->procs->procedure->program->filearg=0;
+	mount->procs->procedure->program->func=&program_shell;
+	mount->procs->procedure->test=(Test*)malloc(sizeof(Test));
+	mount->procs->procedure->test->func=&test_shell_executable;
+	mount->procs->procedure->test->path=0;
+	mount->procs->procedure->test->args=0;
+	mount->procs->procedure->test->filearg=0;
+	mount->procs->procedure->test->filter=0;
+	mount->procs->procedure->test->compiled=0;
+	mount->procs->next=0;
+}
+
+const char *procedure_definition(const Mount *mount,const Procedure *proc,size_t *len) {
+	const Procedures *p;
+	const char *line=mount->signature;
+	for (p=mount->procs;line!=0 && p!=0 && p->procedure!=proc;p=p->next) {
+		line=strchr(line,'\n');
+		if (line) ++line;
+	}
+	if (line==0 || p==0) {
+		*len=4;
+		return "auto";
+	}
+	const char *end=strchr(line,'\n');
+	*len=(end!=0)?end-line:strlen(line);
+	return line;
+}
+
+/**
+ * \brief Give its procedures to the last mount read from the table
+ *
+ * \param mount Mount, or null
+ * \param defaults Array of the procedures given on the command line, ending with a null pointer
+ * \return 0 if everything went fine, -1 if one of the procedures is not valid
+ */
+static int finish_mount(Mount *mount,char **defaults) {
+	if (mount==0 || mount->procs!=0) return 0;
+	for (;defaults!=0 && *defaults!=0;++defaults) if (add_procedure(mount,*defaults)!=0) return -1;
+	default_procedures(mount);
+	return 0;
+}
+
+int read_mount_table(const char *file,char **defaults,Mount **mounts) {
+	FILE *f=fopen(file,"r");
+	if (f==0) {
+		fprintf(stderr,"Cannot read table of mounts %s: %s\n",file,strerror(errno));
+		return errno;
+	}
+	Mount **last=mounts;
+	while (*last) last=&(*last)->next;
+	Mount *mount=0;
+	char line[MOUNT_LINE_LENGTH];
+	int num=0,code=0;
+	while (code==0 && fgets(line,sizeof line,f)!=0) {
+		++num;
+		size_t len=strlen(line);
+		while (len>0 && isspace((unsigned char)line[len-1])) line[--len]=0;
+		char *s=line;
+		while (isspace((unsigned char)*s)) ++s;
+		if (*s==0 || *s=='#') continue;
+		if (s==line) {	// New mount: mirror and mount point
+			if (finish_mount(mount,defaults)!=0) {code=EINVAL;break;}
+			char *mirror=strtok(s," \t");
+			char *mountpoint=strtok(0," \t");
+			if (mountpoint==0 || strtok(0," \t")!=0) {
+				fprintf(stderr,"%s:%d: A mount needs a mirror folder and a mount point\n",file,num);
+				code=EINVAL;
+				break;
+			}
+			mount=new_mount();
+			*last=mount;
+			last=&mount->next;
+			mount->mountpoint=realpath(mountpoint,0);
+			if (mount->mountpoint==0) mount->mountpoint=strdup(mountpoint);
+			if ((code=open_mirror(mount,mirror))!=0) fprintf(stderr,"%s:%d: Cannot open mirror folder %s: %s\n",file,num,mirror,strerror(code));
+		} else if (mount==0) {
+			fprintf(stderr,"%s:%d: Option given before the first mount\n",file,num);
+			code=EINVAL;
+		} else if (strncmp(s,"-p",2)==0 && isspace((unsigned char)s[2])) {
+			s+=2;
+			while (isspace((unsigned char)*s)) ++s;
+			if (add_procedure(mount,s)!=0) {
+				fprintf(stderr,"%s:%d: Invalid procedure %s\n",file,num,s);
+				code=EINVAL;
+			}
+		} else if (strncmp(s,"max-jobs",8)==0 && isspace((unsigned char)s[8])) {
+			unsigned long long jobs;
+			s+=8;
+			while (isspace((unsigned char)*s)) ++s;
+			if (read_number(s,UINT_MAX,&jobs)!=0) {
+				fprintf(stderr,"%s:%d: max-jobs needs a number (0 for no quota)\n",file,num);
+				code=EINVAL;
+			} else mount->max_jobs=jobs;
+		}
+		else if (strncmp(s,"context",7)==0 && isspace((unsigned char)s[7])) {
+			char *script=strtok(s+7," \t");
+			char *ttl=strtok(0," \t");
+			unsigned long long seconds=DEFAULT_CONTEXT_TTL;
+			if (ttl!=0 && (read_number(ttl,UINT_MAX,&seconds)!=0 || seconds==0)) {
+				fprintf(stderr,"%s:%d: The lifetime of the context needs a number of seconds larger than 0\n",file,num);
+				code=EINVAL;
+			}
+			else if (script==0 || set_context(mount,script,seconds)!=0) {
+				fprintf(stderr,"%s:%d: The context needs the path of a script relative to the mirror\n",file,num);
+				code=EINVAL;
+			}
+		}
+		else {
+			fprintf(stderr,"%s:%d: Unknown option %s\n",file,num,s);
+			code=EINVAL;
+		}
+	}
+	fclose(f);
+	if (code==0 && finish_mount(mount,defaults)!=0) code=EINVAL;
+	return code;
+}
+
+void render_mounts(FILE *f) {
+	Mount *mount;
+	fprintf(f,"%8s %8s %10s %s\n","max_jobs","jobs","executions","mirror -> mountpoint");
+	for (mount=persistent.mounts;mount!=0;mount=mount->next) fprintf(f,"%8u %8u %10llu %s -> %s\n",mount->max_jobs,__atomic_load_n(&mount->jobs,__ATOMIC_RELAXED),__atomic_load_n(&mount->executions,__ATOMIC_RELAXED),mount->mirror,(mount->mountpoint)?mount->mountpoint:"");
+}
@@ -0,0 +1,137 @@
+/**
+ * \file
+ *
+ * =====================================================================================
+ *
+ *       Filename:  mount.h
+ *
+ *    Description:  Mirrors served by the file system process
+ *
+ *        Version:  2.0
+ *        Created:  10/18/2026
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  
+ *        Company:  
+ *
+ * =====================================================================================
+ */
+
+#ifndef  MOUNT_INC
+#define  MOUNT_INC
+
+#include <stdio.h>
+#include <pthread.h>
+#include "procedures.h"
+
+/**
+ * \brief Mirror served on a mount point
+ *
+ * A single process may serve several mounts, each on its own FUSE session. The scheduler, the supervisor, the caches and the statistics are shared, while the mirror, the procedures and the execution quota belong to the mount.
+ */
+typedef struct Mount {
+	char *mirror;	//!< Path to the mirror folder
+	size_t mirror_len;	//!< Length of the mirror string
+	int mirror_fd;	//!< File descriptor of the mirror folder, -1 if it is not opened
+	char *mountpoint;	//!< Path of the mount point, null until it is known
+	Procedures *procs;	//!< List of procedures describing what to do with files
+	char *signature;	//!< Definitions of the procedures added with add_procedure, one per line, null if there is none
+	unsigned int max_jobs;	//!< Maximal number of scripts executed at once for ordinary requests on this mount, 0 for no quota (the global limit still applies)
+	unsigned int jobs;	//!< Number of scripts being executed for ordinary requests on this mount
+	unsigned long long executions;	//!< Number of scripts executed for this mount
+	char *context;	//!< Path relative to the mirror of the script producing the context of the mount, null if there is none (see context.h)
+	unsigned int context_ttl;	//!< Lifetime of the context in seconds
+	int context_fd;	//!< Descriptor of the current context, -1 if there is none yet
+	long long context_expiry;	//!< Time (in milliseconds on the monotonic clock) after which the context is produced again
+	int context_busy;	//!< Non-zero while a thread runs the producer
+	pthread_mutex_t context_mutex;	//!< Protects the state of the context
+	pthread_cond_t context_cond;	//!< Signaled each time the producer finishes
+	struct Mount *next;	//!< Next mount served by the process
+} Mount;
+
+/**
+ * \brief Create a new mount, with no mirror and no procedure
+ *
+ * \return Pointer to the new mount, null if it could not be allocated
+ */
+Mount *new_mount();
+
+/**
+ * \brief Release a list of mounts, closing their mirror folders
+ *
+ * \param mount First mount of the list
+ */
+void free_mounts(Mount *mount);
+
+/**
+ * \brief Get the mount of the current request
+ *
+ * The mount is the one set for the thread by set_thread_mount if any, else the mount of the FUSE session of the request (given by persistent.request_mount), else the first mount.
+ * \return Pointer to the mount
+ */
+Mount *current_mount();
+
+/**
+ * \brief Set the mount used by the current thread
+ *
+ * It is used by helper threads which do not serve a FUSE request themselves.
+ * \param mount Mount, null to use the mount of the FUSE session again
+ */
+void set_thread_mount(Mount *mount);
+
+/**
+ * \brief Open the mirror folder of a mount
+ *
+ * \param mount Mount
+ * \param path Path of the mirror folder
+ * \return 0 if everything went fine, an error code otherwise
+ */
+int open_mirror(Mount *mount,const char *path);
+
+/**
+ * \brief Add a procedure at the end of the procedures of a mount
+ *
+ * The definition is also appended to the signature of the mount.
+ * \param mount Mount
+ * \param str Definition of the procedure, as given to the -p option
+ * \return 0 if everything went fine, -1 if the procedure is not valid
+ */
+int add_procedure(Mount *mount,const char *str);
+
+/**
+ * \brief Give the default procedure (auto) to a mount without procedure
+ *
+ * \param mount Mount
+ */
+void default_procedures(Mount *mount);
+
+/**
+ * \brief Get the definition of a procedure of a mount
+ *
+ * \param mount Mount
+ * \param proc Procedure of the mount
+ * \param len Pointer to the length of the definition, filled by the function
+ * \return Pointer to the definition in the signature of the mount (not null-terminated), "auto" for the default procedure
+ */
+const char *procedure_definition(const Mount *mount,const Procedure *proc,size_t *len);
+
+/**
+ * \brief Read a table of mounts
+ *
+ * Each line of the table starts with the path of a mirror and the path of its mount point, separated by blanks. The following lines starting with a blank give the options of this mount: "-p procedure" adds a procedure (the rest of the line is the procedure), "max-jobs number" sets the execution quota, "context script [seconds]" sets the context producer (see set_context). Empty lines and lines starting with # are ignored. The procedures given on the command line are used by the mounts without their own procedures.
+ * \param file Path of the table
+ * \param defaults Array of the procedures given on the command line, ending with a null pointer
+ * \param mounts Pointer to the list to which the mounts are appended
+ * \return 0 if everything went fine, an error code otherwise (a message is printed)
+ */
+int read_mount_table(const char *file,char **defaults,Mount **mounts);
+
+/**
+ * \brief Write the state of each mount
+ *
+ * \param f Stream on which the state is written
+ */
+void render_mounts(FILE *f);
+
+#endif   /* ----- #ifndef MOUNT_INC  ----- */
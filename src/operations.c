@@ -16,17 +16,37 @@
  * =====================================================================================
  */
 
+#define _GNU_SOURCE
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <sys/sendfile.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <signal.h>
+#include <time.h>
 #include "procedures.h"
 #include "operations.h"
+#include "durability.h"
+#include "supervisor.h"
+#include "cache.h"
+#include "index.h"
+#include "stats.h"
+#include "shared.h"
+#include "remote.h"
+#include "affinity.h"
+#include "forkserver.h"
+#include "context.h"
+#include "readahead.h"
+#include "generation.h"
+#include "compress.h"
+#include "hotpath.h"
+#include "uring.h"
 
 /********************************************/
 /*         DATA TYPES AND FUNCTIONS         */
@@ -35,28 +55,132 @@
 struct Persistent persistent;
 
 void init_resources() {
-	persistent.mirror=0;
-	persistent.mirror_len=0;
-	persistent.procs=0;
+	persistent.mounts=0;
+	persistent.request_mount=0;
+	persistent.durability=DUR_CLOSE;
+	persistent.sync_interval=DEFAULT_SYNC_INTERVAL;
+	persistent.exec_timeout=0;
+	persistent.parallel_tests=0;
+	long cpus=sysconf(_SC_NPROCESSORS_ONLN);
+	persistent.size_jobs=(cpus>0)?cpus:1;
+	persistent.adaptive_cache=0;
+	persistent.cache_min_ms=DEFAULT_CACHE_MIN_MS;
+	persistent.cache_size=DEFAULT_CACHE_SIZE;
+	persistent.control=0;
+	persistent.max_jobs=DEFAULT_MAX_JOBS;
+	persistent.adaptive_min_jobs=0;
+	persistent.adaptive_max_jobs=0;
+	persistent.nested_cache=0;
+	persistent.generation_times=0;
+	persistent.immutable=0;
+	persistent.handover=0;
+	persistent.cancel_grace=0;
+	persistent.inline_max=DEFAULT_INLINE_MAX;
+	persistent.readahead_max=DEFAULT_READAHEAD_MAX;
+	persistent.compress_jobs=persistent.size_jobs;
+	persistent.shared_cache_size=DEFAULT_SHARED_CACHE_SIZE;
 }
 
 void free_resources() {
-	free(persistent.mirror);
-	free_procedures(persistent.procs);
+	free_mounts(persistent.mounts);
+	persistent.mounts=0;
+	free_cache();
+	close_shared_cache();
+	close_remote_cache();
+	free_fork_servers();
+	free_index();
+	free_generations();
+	free_compressed();
 }
 
 /********************************************/
 /*             COMMON FUNCTIONS             */
 /********************************************/
+#define MAX_ANCESTORS 0x100	//!< Maximal number of parent processes followed by is_descendant
+
+int is_descendant(pid_t pid) {
+	pid_t self=getpid();
+	char path[64];
+	char line[0x200];
+	int depth;
+	for (depth=0;depth<MAX_ANCESTORS && pid>1;++depth) {
+		if (pid==self) return 1;
+		snprintf(path,sizeof path,"/proc/%d/stat",(int)pid);
+		FILE *f=fopen(path,"r");
+		if (f==0) return 0;
+		char *res=fgets(line,sizeof line,f);
+		fclose(f);
+		if (res==0) return 0;
+		char *end=strrchr(line,')');	// The name of the program may contain spaces and parentheses
+		int ppid;
+		if (end==0 || sscanf(end+1," %*c %d",&ppid)!=1) return 0;
+		pid=ppid;
+	}
+	return 0;
+}
+
+long long now_ms() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return ts.tv_sec*1000LL+ts.tv_nsec/1000000;
+}
+
+int read_number(const char *value,unsigned long long max,unsigned long long *number) {
+	if (value==0 || *value<'0' || *value>'9') return -1;	// strtoull accepts spaces and signs
+	char *end;
+	errno=0;
+	unsigned long long n=strtoull(value,&end,0);
+	if (errno!=0 || *end!=0 || n>max) return -1;
+	*number=n;
+	return 0;
+}
+
+#define COPY_CHUNK 0x100000	//!< Maximal number of bytes copied by the kernel in one system call
+
+/**
+ * \brief Copy the content of a file to another file
+ *
+ * The function copies everything from the current position of fin to the current position of fout. It lets the kernel do the copy with copy_file_range, or sendfile if the two files are not on file systems that support it, so that the data never goes through user space and only a few system calls are issued. If neither works, it falls back to a classic read/write loop. When the io_uring engine is enabled (--mirror-uring), the copy is first made of linked read-write chains on the ring of the thread (see uring_copy), and the other methods are only used if no ring is available or the files are not seekable.
+ * \param fin Descriptor of the source file
+ * \param fout Descriptor of the destination file
+ * \return Number of bytes copied, or -1 if an error occurred (errno is then set)
+ */
+ssize_t copy_data(int fin,int fout) {
+	ssize_t num,total=0;
+	if (persistent.uring_depth>0) {	// Linked read-write chains on the ring of the thread
+		total=uring_copy(fin,fout);
+		if (total>=0) return total;
+		if (errno!=ENOSYS && errno!=ESPIPE) return -1;
+		total=0;
+	}
+	while ((num=copy_file_range(fin,0,fout,0,COPY_CHUNK,0))>0) total+=num;
+	if (num==0) return total;
+	if (total>0 || (errno!=EXDEV && errno!=EINVAL && errno!=ENOSYS && errno!=EOPNOTSUPP)) return -1;
+	while ((num=sendfile(fout,fin,0,COPY_CHUNK))>0) total+=num;
+	if (num==0) return total;
+	if (total>0 || (errno!=EINVAL && errno!=ENOSYS)) return -1;
+	char buf[0x10000];
+	while ((num=read(fin,buf,sizeof buf))>0) {
+		ssize_t numw=0,num2;
+		while (numw<num) {
+			num2=write(fout,buf+numw,num-numw);
+			if (num2<0) return -1;
+			numw+=num2;
+		}
+		total+=num;
+	}
+	return (num<0)?-1:total;
+}
+
 /**
  * \brief Make a temporary copy of a file
  *
- * The function tries to copy the file in argument in a temporary folder, on a random name. The file name is relative to the folder which descriptor is in the global variable persistent.mirror_fd. If it succeeds, it returns a newly-allocated string with the name of the temporary file. Otherwise, it returns 0.
+ * The function tries to copy the file in argument in a temporary folder, on a random name. The file name is relative to the mirror folder of the current mount (see current_mount). If it succeeds, it returns a newly-allocated string with the name of the temporary file. Otherwise, it returns 0.
  * \param file Source file which should be copied
  * \return New string with the name of the temporary file. The user is responsible for releasing the memory allocated for this string.
  */
 char *temp_copy(const char *file) {
-	int fin=openat(persistent.mirror_fd,file,O_RDONLY);
+	int fin=openat(current_mount()->mirror_fd,file,O_RDONLY);
 	if (fin==-1) return 0;
 	char *res = strdup(persistent.tmp_template);
 	int fout=mkstemp(res);
@@ -65,11 +189,13 @@ char *temp_copy(const char *file) {
 		close(fin);
 		return 0;
 	}
-	ssize_t num, total = 0;
-	char buf[0x400];
-	while ((num = read(fin, &buf, sizeof(buf))) > 0) {
-		write(fout, &buf, num);
-		total += num;
+	if (copy_data(fin, fout) < 0) {
+		fprintf(stderr,"temp_copy: Failed to copy %s (%d)\n", file, errno);
+		close(fin);
+		close(fout);
+		unlink(res);
+		free(res);
+		return 0;
 	}
 	struct stat st;
 	int code = fstat(fin, &st);
@@ -86,6 +212,25 @@ char *temp_copy(const char *file) {
 	return res;
 }
 
+/**
+ * \brief Build the array of arguments of a call to an external program
+ *
+ * The arrays of arguments of the Program and Test structures hold a null element at the position of the exclamation mark. Since the structures are shared by all the requests, this function makes a copy of the array for one call, with the null element replaced by the name of the file. Only the array is allocated, not the strings.
+ * \param args Array of arguments of the Program or Test structure
+ * \param filearg Position of the exclamation mark in args, or null
+ * \param file Name of the file which replaces the exclamation mark
+ * \return Newly-allocated array of arguments, ending with a null pointer. The user is responsible for releasing it.
+ */
+static const char **make_args(char **args,char **filearg,const char *file) {
+	size_t num=0;
+	while (args[num]!=0 || args+num==filearg) ++num;
+	const char **res=(const char**)malloc((num+1)*sizeof(char*));
+	size_t i;
+	for (i=0;i<num;++i) res[i]=(args+i==filearg)?file:args[i];
+	res[num]=0;
+	return res;
+}
+
 /********************************************/
 /*              TEST FUNCTIONS              */
 /********************************************/
@@ -93,7 +238,7 @@ int test_true(PTest test,const char *file) {return 1;}
 int test_false(PTest test,const char *file) {return 0;}
 
 int test_shell(PTest test,const char *file) {
-	int fd=openat(persistent.mirror_fd,file,O_RDONLY);
+	int fd=openat(current_mount()->mirror_fd,file,O_RDONLY);
 	FILE *f=fdopen(fd,"r");
 	if (f==0) return 0;
 	char magic[2];
@@ -104,7 +249,7 @@ int test_shell(PTest test,const char *file) {
 }
 
 int test_executable(PTest test,const char *file) {
-	return faccessat(persistent.mirror_fd,file,X_OK,0)==0;
+	return faccessat(current_mount()->mirror_fd,file,X_OK,0)==0;
 }
 
 int test_shell_executable(PTest test,const char *file) {
@@ -116,16 +261,23 @@ int test_pattern(PTest test,const char *file) {
 	return regexec(test->compiled,file,0,0,0)==0;
 }
 
-int test_program(PTest test,const char *file) {
+Execution *spawn_test(PTest test,const char *file) {
 	// Create the array of arguments of the program by replacing the exclamation mark with the name of the file
-	if (test->args!=0 && test->filearg!=0) *(test->filearg)=(char*)file;
+	const char **args=make_args(test->args,test->filearg,file);
 	// If the program is a filter that requires standard input, add the name of the file in the arguments of the call to execute_program
 	const char *f=(test->filter)?file:0;
 	// Launch the program
-	int code=execute_program(test->path,(const char**)(test->args),0,f);
-	if (test->args && test->filearg)
-		*(test->filearg) = strdup(""); // A hack to give it something non-zero to free() to avoid errors
-	return (code==0);
+	STAT_ADD(tests,1);
+	hot_add(HOT_TESTS,file,1);
+	Execution *exec=spawn_program(test->path,args,0,f);
+	free(args);
+	return exec;
+}
+
+int test_program(PTest test,const char *file) {
+	Execution *exec=spawn_test(test,file);
+	if (exec==0) return 0;
+	return (wait_execution(exec)==0);
 }
 
 /********************************************/
@@ -147,18 +299,17 @@ int program_shell(PProgram program,const char *file,int fd) {
 int program_external(PProgram program,const char *file,int fd) {
 	// Create the array of arguments of the program by replacing the exclamation mark with the name of a file with the same content
 	// The actual file is not used because it may not be accessible for external programs since the host folder can be mounted over with the new file system [this is no longer true, but I am leaving the code --eje]. To prevent that case, the script file is copied in the temporary folder and this new file name is given as the argument of the external program at the location of the exclamation mark. The temporary file is deleted after the end of the procedure.
-	if (program->args!=0 && program->filearg!=0) *(program->filearg)=temp_copy(file);
+	char *tmpfil=(program->filearg!=0)?temp_copy(file):0;
+	const char **args=make_args(program->args,program->filearg,tmpfil);
 	// If the program is a filter that requires standard input, add the name of the file in the arguments of the call to execute_program
 	const char *f=(program->filter && program->filearg==0)?file:0;
 	// Launch the program
-	int code=execute_program(program->path,(const char**)(program->args),fd,f);
-	// Release memory, restore structure in previous state and exit
-	if (program->args!=0 && program->filearg!=0) {
-		if (*(program->filearg)!=0) {
-			unlink(*(program->filearg));
-			free(*(program->filearg));
-		}
-		*(program->filearg)=0;
+	int code=execute_program(program->path,args,fd,f);
+	// Release memory and exit
+	free(args);
+	if (tmpfil!=0) {
+		unlink(tmpfil);
+		free(tmpfil);
 	}
 	return code;
 }
@@ -166,10 +317,59 @@ int program_external(PProgram program,const char *file,int fd) {
 /********************************************/
 /*             OTHER OPERATIONS             */
 /********************************************/
+/**
+ * \brief Find the script associated with a file, running the external tests concurrently
+ *
+ * This function gives the same result as the sequential search of get_script, but as soon as an external test program has to be run, it launches the external tests of all the remaining procedures at once. The procedures are then examined in their order: the result of each external test is awaited, the other tests are evaluated directly, and the first positive one wins. The executions of the following procedures are then cancelled. The latency of the classification is thus roughly the one of the slowest relevant test instead of the sum of all of them.
+ * \param procs List of procedures that will be tested against the file
+ * \param file Path of the actual file
+ * \return Pointer to a procedure which test function succeeds when applied to the file, null if no procedure is found
+ */
+static Procedure* get_script_parallel(const Procedures *procs,const char *file) {
+	size_t num=0,i;
+	const Procedures *p;
+	for (p=procs;p!=0;p=p->next) ++num;
+	Execution *execs[num];
+	int launched=0;
+	Procedure *res=0;
+	for (i=0,p=procs;res==0 && p!=0;++i,p=p->next) {
+		Test *test=p->procedure->test;
+		if (test==0 || test->func==0) continue;
+		if (test->func!=&test_program) {
+			if (test->func(test,file)!=0) res=p->procedure;
+			continue;
+		}
+		if (!launched) {	// First external test, launch it with all the following ones
+			const Procedures *q;
+			size_t j;
+			for (j=i,q=p;q!=0;++j,q=q->next)
+				execs[j]=(q->procedure->test!=0 && q->procedure->test->func==&test_program)?spawn_test(q->procedure->test,file):0;
+			launched=1;
+		}
+		if (execs[i]!=0) {
+			if (wait_execution(execs[i])==0) res=p->procedure;
+			execs[i]=0;
+		}
+	}
+	// Give up the tests of the procedures after the one which was found
+	if (launched) for (;i<num;++i) if (execs[i]!=0) {
+		cancel_execution(execs[i]);
+		release_execution(execs[i]);
+	}
+	return res;
+}
+
 Procedure* get_script(const Procedures *procs,const char *file) {
 #ifdef TRACE
 	fprintf(stderr,"get_script(%s)\n", file);
 #endif
+	if (persistent.parallel_tests) {
+		Procedure *res=get_script_parallel(procs,file);
+#ifdef TRACE
+		fprintf(stderr,"get_script() <-- %p\n", res);
+#endif
+		return res;
+	}
 	Procedure *res=0;
 	while (res==0 && procs!=0) {
 		if (procs->procedure->test!=0 && procs->procedure->test->func!=0 && procs->procedure->test->func(procs->procedure->test,file)!=0) res=procs->procedure;
@@ -186,7 +386,7 @@ void call_program(const char *file,const char **args) {
 	fprintf(stderr,"call_program(%s)\n", file);
 #endif
 	// Check the nature of file
-	int fd=openat(persistent.mirror_fd,file,O_RDONLY);
+	int fd=openat(current_mount()->mirror_fd,file,O_RDONLY);
 	if (fd <= 0) {
 		// This is sort of an experimental hack. It's not clear from the original documentation,
 		// but apparently filters are *supposed* to be in the mirror directory, except this didn't
@@ -223,7 +423,7 @@ void call_program(const char *file,const char **args) {
 		j=1;
 		while (j<i+2) {newargs[j]=args[j-1];++j;}
 		// Launch program
-		int fde=openat(persistent.mirror_fd,path,O_RDONLY);
+		int fde=openat(current_mount()->mirror_fd,path,O_RDONLY);
 #ifdef TRACE
 		fprintf(stderr,"call_program: Executing shell script with %s\n", path);
 #endif
@@ -231,10 +431,10 @@ void call_program(const char *file,const char **args) {
 			fexecve(fde, (char* const*)newargs, persistent.envp);
 		} else {
 			fprintf(stderr, "call_program: Open of script %s/%s failed\n",
-				persistent.mirror, path);
+				current_mount()->mirror, path);
 		}
 	} else {
-		int fde=openat(persistent.mirror_fd,file,O_RDONLY);
+		int fde=openat(current_mount()->mirror_fd,file,O_RDONLY);
 #ifdef TRACE
 		fprintf(stderr, "call_program: executable file handle is %d\n", fde);
 #endif
@@ -242,50 +442,52 @@ void call_program(const char *file,const char **args) {
 			fexecve(fde, (char *const*)args, persistent.envp);
 		} else {
 			fprintf(stderr, "call_program: Open of executable %s/%s failed\n",
-				persistent.mirror, file);
+				current_mount()->mirror, file);
 		}
 	}
 }
 
-int execute_program(const char *file,const char **args,int out,const char* path_in) {
+Execution *spawn_program(const char *file,const char **args,int out,const char* path_in) {
 #ifdef TRACE
-	fprintf(stderr,"execute_program(%s,..., %d, %s)\n", file, out, path_in);
+	fprintf(stderr,"spawn_program(%s,..., %d, %s)\n", file, out, path_in);
 #endif
+	int context=context_descriptor();
+	Execution *served;
+	if (fork_server_spawn(file,args,out,path_in,context,&served)==0) return served;	// Forked by a preloaded interpreter
 	pid_t child;	// ID of child process executing external program
-	int fds[2];	// Handles of the two ends of the pipe, only used if input has to be provided to the standard input of the external program
-	int in;
-	if (path_in!=0) pipe(fds);	// Prepare a pipe to feed standard input of the external program, fork and copy the file to the pipe
+	Placement placement;
+	prepare_placement(&placement);	// Before the fork, on the CPU of the requesting worker
 	child=fork();
+	if (child<0) return 0;
 	if (child!=0) {	// Parent process (caller)
-		if (path_in!=0) {	// If a path is provided, feed the content of the file to the pipe so that it is used as the standard input of the child process
-			close(fds[0]);	// Close input descriptor
-			in=openat(persistent.mirror_fd,path_in,O_RDONLY);
-			if (in<0) path_in=0; else {	// Copy file to standard input
-				char buffer[0x400];
-				ssize_t num,numw,num2;
-				do {
-					num=read(in, buffer, sizeof buffer);
-					numw=0;
-					while (numw<num) {
-						num2=write(fds[1],buffer+numw,num-numw);
-						if (num2<0) numw=num; else numw+=num2;
-					}
-				} while (num>0);
-			}
-			fsync(fds[1]);
-			close(fds[1]);
+		setpgid(child,child);	// Also done by the child, whichever runs first, so that the process group exists before anybody tries to kill it
+		Execution *exec=supervise(child);
+		if (exec==0) {
+			kill(-child,SIGKILL);
+			while (waitpid(child,0,0)<0 && errno==EINTR);
 		}
-		int code;
-		waitpid(child,&code,0);
-		if (WIFEXITED(code)) return WEXITSTATUS(code);
+		return exec;
 	} else {	// Child process (external program)
+		setpgid(0,0);	// Own process group, so that the program and all its own children can be killed at once
+		apply_placement(&placement);
 		if (out!=0) dup2(out,STDOUT_FILENO);	// Redirect output to out descriptor
 		else dup2(STDERR_FILENO,STDOUT_FILENO);	// Redirect standard output on standard error, to avoid mixing outputs from the external program and the parent process
-		if (path_in==0) {
+		int in=(path_in==0)?-1:openat(current_mount()->mirror_fd,path_in,O_RDONLY);
+		if (in<0) {
 			close(STDIN_FILENO);	// We do not want the external program to use anything from the common standard input
-		} else {
-			close(fds[1]);	// Close output descriptor
-			dup2(fds[0],STDIN_FILENO);	// Redirect standard input to pipe output
+		} else {	// The file itself becomes the standard input, so that its content does not have to be pumped through a pipe by the parent process
+			dup2(in,STDIN_FILENO);
+			close(in);
+		}
+		size_t num=0;
+		if (context>=0) while (persistent.envp[num]!=0) ++num;
+		char context_var[64];
+		char *envp[num+2];
+		if (context>=0) {	// Environment announcing the context of the mount, which must remain valid until the program is executed
+			inherit_context(context,context_var,sizeof context_var);
+			envp[0]=context_var;
+			memcpy(envp+1,persistent.envp,(num+1)*sizeof(char*));
+			persistent.envp=envp;	// Only changes the copy of the child process
 		}
 		//execvp(file,(char *const *)args);
 		call_program(file,args);
@@ -295,5 +497,11 @@ int execute_program(const char *file,const char **args,int out,const char* path_
 		fprintf(stderr,"\n");
 		abort();
 	}
-	return 1;
+	return 0;
+}
+
+int execute_program(const char *file,const char **args,int out,const char* path_in) {
+	Execution *exec=spawn_program(file,args,out,path_in);
+	if (exec==0) return 1;
+	return wait_execution(exec);
 }
@@ -21,9 +21,13 @@
 #ifndef  OPERATIONS_INC
 #define  OPERATIONS_INC
 
+#include <pthread.h>
 #include "procedures.h"
+#include "supervisor.h"
+#include "mount.h"
 
 #define	FILENAME_MAX_LENGTH 0x400	//!< Maximum length of a path name in the virtual filesystem
+#define	DEFAULT_INLINE_MAX 0x4000	//!< Default maximal size of the outputs kept in memory by the opened files
 
 /********************************************/
 /*         DATA TYPES AND FUNCTIONS         */
@@ -35,12 +39,32 @@
  */
 struct Persistent {
 	char** envp;	//!< Array of environment variables as defined when the program is called
-	char* mirror;	//!< Path to the mirror folder
-	size_t mirror_len;	//!< Length of the mirror string
-	int mirror_fd;	//!< File descriptor of the mirror folder
-	Procedures *procs;	//!< List of procedures describing what to do with files
+	Mount *mounts;	//!< List of the mounts served by the process (mirror folders and their procedures)
+	Mount *(*request_mount)(void);	//!< Function giving the mount of the FUSE session of the current request, null if there is none
 	char tmp_template[FILENAME_MAX_LENGTH]; //! Temp file template, either /tmp/sfs.XXXXXX or /dev/shm/sfs.XXXXXX
 	int return_real_size; //! If non-zero, getattr always executes the script to return the real size rather than the script size
+	int durability;	//!< Durability policy applied when a regular file is flushed (see enum Durability)
+	unsigned int sync_interval;	//!< Number of seconds between two commits of the mirror with the DUR_GROUP policy
+	unsigned int exec_timeout;	//!< Maximal number of seconds an external program may run before it is killed, 0 for no limit
+	unsigned int compress_jobs;	//!< Maximal number of threads compressing outputs, all compressions together
+	unsigned int uring_depth;	//!< Number of entries of the io_uring rings used for the I/O on the mirror, 0 to issue blocking system calls
+	size_t readahead_max;	//!< Maximal readahead window on the files of the mirror, 0 to disable the readahead
+	size_t inline_max;	//!< Maximal size of an output kept in memory by the opened file instead of its temporary file, 0 to always keep the file
+	unsigned int cancel_grace;	//!< Number of milliseconds an execution may still run after its request was interrupted, 0 to kill it at once
+	int parallel_tests;	//!< If non-zero, the external test programs of all candidate procedures are run concurrently
+	unsigned int size_jobs;	//!< Maximal number of scripts executed in parallel to get their sizes when a directory is listed
+	int adaptive_cache;	//!< If non-zero, the procedures without explicit caching policy use the adaptive policy
+	unsigned int cache_min_ms;	//!< Minimal average duration (in milliseconds) of a script for the adaptive policy to cache it
+	unsigned long long cache_size;	//!< Maximal number of bytes of cached outputs
+	int control;	//!< If non-zero, the control files are available in the CONTROL_FOLDER virtual folder
+	unsigned int max_jobs;	//!< Maximal number of scripts executed at once for ordinary requests, 0 for no limit
+	unsigned int adaptive_min_jobs;	//!< Lower bound of the adaptive limit of executions
+	unsigned int adaptive_max_jobs;	//!< Upper bound of the adaptive limit of executions, 0 if the limit is static (persistent.max_jobs)
+	int nested_cache;	//!< If non-zero, nested requests are served from the cache even when the cached output expired
+	int generation_times;	//!< If non-zero, the times of a script are those of the last change and of the last generation of its output
+	int immutable;	//!< If non-zero, the mirror is declared immutable and metadata are served from the index built at mount time
+	unsigned long long shared_cache_size;	//!< Maximal number of bytes of the outputs of the shared cache, for the whole host
+	const char *handover;	//!< Path of the socket on which a new process may take over the mounts, null if handover is disabled
 };
 
 /**
@@ -57,8 +81,17 @@ typedef struct FileStruct {
 		T_SCRIPT,	//!< Script file (detected in such a way by the file system, so it should not be overwritten)
 		T_FOLDER	//!< Directory
 	} type;	//!< Type of the file
-	int file_handle;	//!< Handle of the corresponding item on the mirror file system if the system is a file
+	int file_handle;	//!< Handle of the corresponding item on the mirror file system if the system is a file, -1 if the content is in data
+	char *data;	//!< Output of a script small enough to be kept in memory, 0 if it is read from file_handle
+	size_t data_size;	//!< Number of bytes of data
+	off_t ra_next;	//!< Highest offset read so far since the last random read, to detect sequential reads (see readahead_hint)
+	off_t ra_end;	//!< End of the region already prefetched
+	size_t ra_window;	//!< Current readahead window, 0 if the last read was not sequential
+	int ra_random;	//!< Number of non-sequential reads in a row
+	pthread_mutex_t ra_mutex;	//!< Protects the ra_ fields against concurrent reads of the handle, initialized for the files of the mirror only (see init_readahead)
+	unsigned long long hot_bytes;	//!< Bytes read through the handle, added to the hot paths once when it is released (updated with atomic operations)
 	void* dir_handle; //!< Pointer to the directory flow if the file is actually a directory
+	int dirty;	//!< Non-zero if data was written on the file since it was opened
 	//int dirfd;	//!< Handle of the directory if the file is a directory. This handle is kept to close the open directory when it is no longer used, but it should not be used by the application
 	char filename[FILENAME_MAX_LENGTH];	//!< Name of the file
 } FileStruct;
@@ -77,6 +110,33 @@ void init_resources();
  */
 void free_resources();
 
+/**
+ * \brief Get the current time of the monotonic clock
+ *
+ * \return Current time in milliseconds
+ */
+long long now_ms();
+
+/**
+ * \brief Read the number given to an option
+ *
+ * The value must only hold a number without sign, in decimal or in hexadecimal with the 0x prefix.
+ * \param value Value of the option
+ * \param max Largest number accepted
+ * \param number Set to the number read if it is valid
+ * \return 0 if the value is a valid number not larger than max, -1 otherwise
+ */
+int read_number(const char *value,unsigned long long max,unsigned long long *number);
+
+/**
+ * \brief Tell if a process was started by the file system
+ *
+ * The function follows the parent processes of pid, through /proc, until it finds the file system process itself (then pid is a descendant of one of the child processes executing scripts and test programs) or the root of the process tree.
+ * \param pid ID of the process
+ * \return 1 if the process is a descendant of the file system process, 0 otherwise
+ */
+int is_descendant(pid_t pid);
+
 /********************************************/
 /*              TEST FUNCTIONS              */
 /********************************************/
@@ -150,6 +210,16 @@ int test_pattern(PTest test,const char *file);
  */
 int test_program(PTest test,const char *file);
 
+/**
+ * \brief Launch the test program of a Test structure without waiting for its result
+ *
+ * This function starts the external program of a test based on a program (see test_program) and returns immediately. The file is considered as a script if the exit code given by wait_execution is 0.
+ * \param test Pointer to the Test structure, which function must be test_program
+ * \param file Path of the file which has to be tested
+ * \return Pointer to the Execution structure of the test program, null if it could not be launched
+ */
+Execution *spawn_test(PTest test,const char *file);
+
 /********************************************/
 /*           EXECUTION FUNCTIONS            */
 /********************************************/
@@ -178,10 +248,20 @@ int program_external(PProgram program,const char *file,int fd);
 /********************************************/
 /*             OTHER OPERATIONS             */
 /********************************************/
+/**
+ * \brief Copy the content of a file to another file
+ *
+ * The function copies everything from the current position of fin to the current position of fout, with copy_file_range or sendfile when possible so that the data does not go through user space.
+ * \param fin Descriptor of the source file
+ * \param fout Descriptor of the destination file
+ * \return Number of bytes copied, or -1 if an error occurred (errno is then set)
+ */
+ssize_t copy_data(int fin,int fout);
+
 /**
  * \brief Find the script associated with a file
  *
- * This function tests the file in argument and tells if it is a script. It goes through all the procedures in the list given as argument, in the order in which they are stored. As soon as a test succeeds, the file is recognized as a script and a pointer to the corresponding procedure is returned. If no matching procedure is found, the function returns a null pointer. Since it is called very often (each time a folder is explored and a file is opened), it should be very fast and not rely too much on external programs.
+ * This function tests the file in argument and tells if it is a script. It goes through all the procedures in the list given as argument, in the order in which they are stored. As soon as a test succeeds, the file is recognized as a script and a pointer to the corresponding procedure is returned. If no matching procedure is found, the function returns a null pointer. Since it is called very often (each time a folder is explored and a file is opened), it should be very fast and not rely too much on external programs. If persistent.parallel_tests is set, the external test programs are run concurrently, with the same result.
  * \param procs List of procedures that will be tested against the file
  * \param file Path of the actual file
  * \return Pointer to a procedure which test function succeeds when applied to the file, null if no procedure is found
@@ -197,15 +277,27 @@ Procedure* get_script(const Procedures *procs,const char *file);
  */
 void call_program(const char *file,const char **args);
 
+/**
+ * \brief Spawn a process that executes an external program without waiting for it
+ *
+ * This function creates a new process, in its own process group, which will execute the external program located at file, and hands it over to the supervisor. If the program is a script whose interpreter has a fork server (see forkserver.h), the process is forked by the server instead. The arguments are the same as those of execute_program. The caller gets the result with wait_execution, or gives up with cancel_execution and release_execution.
+ * \param file Path to the executable file
+ * \param args Array of arguments, ending with a null pointer
+ * \param out Descriptor of the file on which the output will be redirected, 0 if no output is required
+ * \param path_in Path of the file that should be provided to the standard input, 0 if no file has to be provided
+ * \return Pointer to the Execution structure of the child process, null if the process could not be created
+ */
+Execution *spawn_program(const char *file,const char **args,int out,const char *path_in);
+
 /**
  * \brief Spawn a process that executes an external program
  *
- * This function creates a new process which will execute the external program located at file. The third argument is a file descriptor on which the output will be written. If the descriptor is null, no output will be written at all. The last argument is a path to a file which content should be provided on the standard input of the external program. If nothing has to be sent to the external program, the user should give a null value to this parameter.
+ * This function creates a new process which will execute the external program located at file. The third argument is a file descriptor on which the output will be written. If the descriptor is null, no output will be written at all. The last argument is a path to a file which content should be provided on the standard input of the external program. The file is opened in the mirror file system and given as is as the standard input of the program, so its content is not copied. If nothing has to be sent to the external program, the user should give a null value to this parameter.
  * \param file Path to the executable file
  * \param args Array of arguments to be added after the name of the program. The array must end with a null pointer. By convention, the first element of the array should be the path of the program itself but this function does not take care of adding the path of the program (file) at the beginning of the array.
  * \param out Descriptor of the file on which the output will be redirected, 0 if no output is required
- * \param path_in Path of the file that should be provided to the standard output, 0 if no file has to be provided
- * \return Error code of the program after the end of its execution
+ * \param path_in Path of the file that should be provided to the standard input, 0 if no file has to be provided
+ * \return Error code of the program after the end of its execution, 1 if it did not end normally (killed after the execution timeout or interrupted request)
  */
 int execute_program(const char *file,const char **args,int out,const char *path_in);
 
@@ -0,0 +1,241 @@
+/*
+ * =====================================================================================
+ *
+ *       Filename:  parallel.c
+ *
+ *    Description:  Implementation of the parallel execution of jobs
+ *
+ *        Version:  2.0
+ *        Created:  10/18/2026
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  
+ *        Company:  
+ *
+ * =====================================================================================
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+#include "parallel.h"
+
+/**
+ * \brief Shared state of the threads of a parallel_for call
+ */
+struct ParallelFor {
+	size_t count;	//!< Number of jobs
+	size_t next;	//!< Index of the next job to run, incremented atomically
+	JobFunction func;	//!< Function executing one job
+	void *arg;	//!< Argument of the function
+};
+
+/**
+ * \brief Run jobs until there are no more left
+ *
+ * \param data Pointer to the shared ParallelFor structure
+ * \return Always null
+ */
+static void *parallel_worker(void *data) {
+	struct ParallelFor *pf=(struct ParallelFor*)data;
+	size_t i;
+	while ((i=__atomic_fetch_add(&pf->next,1,__ATOMIC_RELAXED))<pf->count) pf->func(pf->arg,i);
+	return 0;
+}
+
+void parallel_for(size_t count,unsigned int width,JobFunction func,void *arg) {
+	struct ParallelFor pf={count,0,func,arg};
+	if (width>count) width=count;
+	if (width<1) width=1;
+	pthread_t threads[width-1];
+	unsigned int i,num=0;
+	for (i=0;i<width-1;++i) {
+		int code=pthread_create(threads+num,0,parallel_worker,&pf);
+		if (code!=0) {
+			fprintf(stderr,"parallel_for: Cannot start thread: %s\n",strerror(code));
+			break;
+		}
+		++num;
+	}
+	parallel_worker(&pf);
+	for (i=0;i<num;++i) pthread_join(threads[i],0);
+}
+
+/**
+ * \brief Queue of tasks of one thread of a TaskPool
+ *
+ * The owner pushes and pops tasks at the end of the queue, the other threads steal them from the start.
+ */
+struct TaskQueue {
+	void **tasks;	//!< Circular array of tasks
+	size_t size;	//!< Allocated size of the array
+	size_t head;	//!< Position of the oldest task in the array
+	size_t count;	//!< Number of tasks in the queue
+	pthread_mutex_t mutex;	//!< Protects the queue
+};
+
+/**
+ * \brief Shared state of the threads of a parallel_tasks call
+ */
+struct TaskPool {
+	struct TaskQueue *queues;	//!< Queue of each thread
+	unsigned int width;	//!< Number of queues
+	size_t pending;	//!< Number of tasks submitted and not finished yet, the pool stops when it drops to 0
+	unsigned int idle;	//!< Number of threads waiting for a task
+	pthread_mutex_t mutex;	//!< Protects idle and is used with cond
+	pthread_cond_t cond;	//!< Signaled when a task is submitted or when all the tasks are finished
+	TaskFunction func;	//!< Function executing one task
+	void *arg;	//!< Argument of the function
+};
+
+static __thread struct TaskQueue *task_queue=0;	//!< Queue of the current thread in the running pool
+
+/**
+ * \brief Add a task at the end of a queue
+ *
+ * \param q Queue
+ * \param task Task
+ * \return 0 if the task was added, -1 if the queue could not grow
+ */
+static int queue_push(struct TaskQueue *q,void *task) {
+	pthread_mutex_lock(&q->mutex);
+	if (q->count==q->size) {
+		size_t size=(q->size==0)?0x40:2*q->size;
+		void **tasks=(void**)malloc(size*sizeof(void*));
+		if (tasks==0) {pthread_mutex_unlock(&q->mutex);return -1;}
+		size_t i;
+		for (i=0;i<q->count;++i) tasks[i]=q->tasks[(q->head+i)%q->size];
+		free(q->tasks);
+		q->tasks=tasks;
+		q->size=size;
+		q->head=0;
+	}
+	q->tasks[(q->head+q->count)%q->size]=task;
+	++q->count;
+	pthread_mutex_unlock(&q->mutex);
+	return 0;
+}
+
+/**
+ * \brief Take a task from a queue
+ *
+ * \param q Queue
+ * \param newest If non-zero, take the most recent task (owner), otherwise the oldest one (thief)
+ * \param task Pointer to the variable receiving the task
+ * \return 1 if a task was taken, 0 if the queue is empty
+ */
+static int queue_pop(struct TaskQueue *q,int newest,void **task) {
+	pthread_mutex_lock(&q->mutex);
+	if (q->count==0) {pthread_mutex_unlock(&q->mutex);return 0;}
+	if (newest) *task=q->tasks[(q->head+q->count-1)%q->size];
+	else {
+		*task=q->tasks[q->head];
+		q->head=(q->head+1)%q->size;
+	}
+	--q->count;
+	pthread_mutex_unlock(&q->mutex);
+	return 1;
+}
+
+void submit_task(TaskPool *pool,void *task) {
+	__atomic_fetch_add(&pool->pending,1,__ATOMIC_SEQ_CST);
+	if (task_queue==0 || queue_push(task_queue,task)!=0) {	// No room left, run the task right now
+		pool->func(pool,pool->arg,task);
+		__atomic_fetch_sub(&pool->pending,1,__ATOMIC_SEQ_CST);
+		return;
+	}
+	pthread_mutex_lock(&pool->mutex);
+	if (pool->idle>0) pthread_cond_signal(&pool->cond);
+	pthread_mutex_unlock(&pool->mutex);
+}
+
+/**
+ * \brief Argument of a thread of a TaskPool
+ */
+struct TaskWorker {
+	TaskPool *pool;	//!< Pool of the thread
+	unsigned int index;	//!< Index of the queue of the thread
+};
+
+/**
+ * \brief Run tasks, from the queue of the thread or stolen from the others, until all the tasks of the pool are finished
+ *
+ * \param data Pointer to the TaskWorker structure of the thread
+ * \return Always null
+ */
+static void *task_worker(void *data) {
+	struct TaskWorker *w=(struct TaskWorker*)data;
+	TaskPool *pool=w->pool;
+	task_queue=pool->queues+w->index;
+	for (;;) {
+		void *task;
+		int found=queue_pop(task_queue,1,&task);
+		unsigned int i;
+		for (i=1;!found && i<pool->width;++i) found=queue_pop(pool->queues+(w->index+i)%pool->width,0,&task);
+		if (found) {
+			pool->func(pool,pool->arg,task);
+			if (__atomic_sub_fetch(&pool->pending,1,__ATOMIC_SEQ_CST)==0) {
+				pthread_mutex_lock(&pool->mutex);
+				pthread_cond_broadcast(&pool->cond);
+				pthread_mutex_unlock(&pool->mutex);
+			}
+			continue;
+		}
+		// Nothing to run or steal, wait for a new task or for the end of the pool
+		pthread_mutex_lock(&pool->mutex);
+		if (__atomic_load_n(&pool->pending,__ATOMIC_SEQ_CST)==0) {
+			pthread_mutex_unlock(&pool->mutex);
+			break;
+		}
+		++pool->idle;
+		struct timespec ts;
+		clock_gettime(CLOCK_REALTIME,&ts);
+		ts.tv_nsec+=10000000L;	// Tasks may be queued between the scan and the wait, check again soon
+		if (ts.tv_nsec>=1000000000L) {ts.tv_sec++;ts.tv_nsec-=1000000000L;}
+		pthread_cond_timedwait(&pool->cond,&pool->mutex,&ts);
+		--pool->idle;
+		pthread_mutex_unlock(&pool->mutex);
+	}
+	task_queue=0;
+	return 0;
+}
+
+void parallel_tasks(unsigned int width,TaskFunction func,void *arg,void *first) {
+	if (width<1) width=1;
+	struct TaskQueue queues[width];
+	struct TaskWorker workers[width];
+	TaskPool pool={queues,width,1,0,PTHREAD_MUTEX_INITIALIZER,PTHREAD_COND_INITIALIZER,func,arg};
+	unsigned int i,num=0;
+	for (i=0;i<width;++i) {
+		queues[i].tasks=0;
+		queues[i].size=queues[i].head=queues[i].count=0;
+		pthread_mutex_init(&queues[i].mutex,0);
+		workers[i].pool=&pool;
+		workers[i].index=i;
+	}
+	if (queue_push(queues,first)!=0) {	// Run the whole tree on the calling thread
+		pool.width=0;
+		func(&pool,arg,first);
+	} else {
+		pthread_t threads[width];
+		for (i=1;i<width;++i) {
+			int code=pthread_create(threads+num,0,task_worker,workers+i);
+			if (code!=0) {
+				fprintf(stderr,"parallel_tasks: Cannot start thread: %s\n",strerror(code));
+				break;
+			}
+			++num;
+		}
+		task_worker(workers);
+		for (i=0;i<num;++i) pthread_join(threads[i],0);
+	}
+	for (i=0;i<width;++i) {
+		free(queues[i].tasks);
+		pthread_mutex_destroy(&queues[i].mutex);
+	}
+	pthread_cond_destroy(&pool.cond);
+	pthread_mutex_destroy(&pool.mutex);
+}
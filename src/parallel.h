@@ -0,0 +1,73 @@
+/**
+ * \file
+ *
+ * =====================================================================================
+ *
+ *       Filename:  parallel.h
+ *
+ *    Description:  Parallel execution of independent jobs
+ *
+ *        Version:  2.0
+ *        Created:  10/18/2026
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  
+ *        Company:  
+ *
+ * =====================================================================================
+ */
+
+#ifndef  PARALLEL_INC
+#define  PARALLEL_INC
+
+#include <stddef.h>
+
+/**
+ * \brief Type of a job function run by parallel_for
+ *
+ * The function is called with the argument given to parallel_for and the index of the job, between 0 and the number of jobs (excluded).
+ */
+typedef void (*JobFunction)(void*,size_t);
+
+/**
+ * \brief Run independent jobs in parallel
+ *
+ * The function calls func once for each index between 0 and count-1, on at most width threads, including the calling thread. Each thread takes the next index which has not been processed yet, so that slow jobs do not delay the others. The function returns when all the jobs are finished. If threads cannot be created, the remaining jobs are run by the calling thread.
+ * \param count Number of jobs
+ * \param width Maximal number of jobs running at the same time
+ * \param func Function executing one job
+ * \param arg Argument given to each call of func
+ */
+void parallel_for(size_t count,unsigned int width,JobFunction func,void *arg);
+
+typedef struct TaskPool TaskPool;	//!< Pool of threads running tasks which may create new tasks (see parallel_tasks)
+
+/**
+ * \brief Type of a task function run by parallel_tasks
+ *
+ * The function is called with the pool, which it may give to submit_task to create new tasks, the argument given to parallel_tasks, and the task itself.
+ */
+typedef void (*TaskFunction)(TaskPool*,void*,void*);
+
+/**
+ * \brief Run a tree of tasks in parallel with work stealing
+ *
+ * The function runs the first task and all the tasks it creates, directly or not, on at most width threads, including the calling thread. Each thread has its own queue: the tasks it creates are pushed on its queue and it runs the most recent one first, which keeps the walk of a tree depth-first on each thread. A thread without tasks steals the oldest task of another thread, which is usually the root of a large subtree. The function returns when all the tasks are finished.
+ * \param width Maximal number of tasks running at the same time
+ * \param func Function executing one task
+ * \param arg Argument given to each call of func
+ * \param first First task
+ */
+void parallel_tasks(unsigned int width,TaskFunction func,void *arg,void *first);
+
+/**
+ * \brief Create a new task in a pool
+ *
+ * The function must be called by a task function running in the pool. The task is run later by the same thread, or by another thread if it steals it.
+ * \param pool Pool given to the task function
+ * \param task New task
+ */
+void submit_task(TaskPool *pool,void *task);
+
+#endif   /* ----- #ifndef PARALLEL_INC  ----- */
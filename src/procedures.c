@@ -130,7 +130,7 @@ void free_program(Program *program) {
 	free(program->path);
 	char **a=program->args;
 	if (a!=0) {
-		while (*a) free(*(a++));
+		for (;*a!=0 || a==program->filearg;++a) free(*a);	// Skip the null element at the position of the exclamation mark
 		free(program->args);
 	}
 	free(program);
@@ -184,7 +184,7 @@ void free_test(Test *test) {
 	free(test->path);
 	char **a=test->args;
 	if (a!=0) {
-		while (*a) free(*(a++));
+		for (;*a!=0 || a==test->filearg;++a) free(*a);	// Skip the null element at the position of the exclamation mark
 		free(test->args);
 	}
 	if (test->compiled) regfree(test->compiled);
@@ -252,12 +252,89 @@ void free_procedure(Procedure *procedure) {
 	if (procedure==0) return;
 	free_program(procedure->program);
 	free_test(procedure->test);
+	if (procedure->inputs) {
+		char **input;
+		for (input=procedure->inputs;*input!=0;++input) free(*input);
+		free(procedure->inputs);
+	}
 	free(procedure);
 }
 
+/**
+ * \brief Set one option of a procedure
+ *
+ * \param proc Procedure which option is set
+ * \param key Name of the option
+ * \param value Value of the option
+ * \return 0 if the option was set, -1 if the option or its value is unknown
+ */
+static int set_procedure_option(Procedure *proc,const char *key,const char *value) {
+	if (strcasecmp(key,"cache")==0) {
+		if (strcasecmp(value,"never")==0) proc->cache_mode=CACHE_NEVER;
+		else if (strcasecmp(value,"auto")==0) proc->cache_mode=CACHE_AUTO;
+		else if (strcasecmp(value,"always")==0) proc->cache_mode=CACHE_ALWAYS;
+		else return -1;
+	} else if (strcasecmp(key,"ttl")==0) {
+		unsigned long long ttl;
+		if (read_number(value,INT_MAX,&ttl)!=0) return -1;	// cache_store returns the lifetime as an int
+		proc->cache_ttl=ttl;
+	} else if (strcasecmp(key,"compress")==0) {
+		if (strcasecmp(value,"none")==0) proc->compress=COMPRESS_NONE;
+		else if (strcasecmp(value,"gzip")==0) proc->compress=COMPRESS_GZIP;
+		else return -1;
+	} else if (strcasecmp(key,"inputs")==0) {	// Colon-separated list of files
+		size_t num=0;
+		const char *p;
+		if (*value==0) return -1;
+		for (p=value;p!=0;p=strchr(p+1,':')) ++num;
+		char **inputs=(char**)realloc(proc->inputs,(num+1)*sizeof(char*));
+		if (inputs==0) return -1;
+		proc->inputs=inputs;
+		for (num=0,p=value;*p!=0;) {
+			const char *end=strchr(p,':');
+			if (end==0) end=p+strlen(p);
+			inputs[num++]=strndup(p,end-p);
+			p=(*end==':')?end+1:end;
+		}
+		inputs[num]=0;
+	} else return -1;
+	return 0;
+}
+
+/**
+ * \brief Read the options of a procedure
+ *
+ * The options are a comma-separated list of key=value pairs, given after the second semicolon of a procedure (see \ref syntaxdoc "Syntax of command-line").
+ * \param proc Procedure which options are set
+ * \param str String holding the options
+ * \return 0 if all the options were set, -1 otherwise
+ */
+static int read_procedure_options(Procedure *proc,const char *str) {
+	while (*str!=0) {
+		const char *p=str;
+		while (*p!=0 && *p!=',') ++p;
+		char option[p-str+1];
+		strncpy(option,str,p-str);
+		option[p-str]=0;
+		char *value=strchr(option,'=');
+		if (value!=0) *(value++)=0;
+		if (value==0 || set_procedure_option(proc,option,value)!=0) {
+			fprintf(stderr,"Invalid procedure option: %s\n",option);
+			return -1;
+		}
+		str=(*p==',')?p+1:p;
+	}
+	return 0;
+}
+
 Procedure* get_procedure_from_string(const char* str) {
 	if (str==0 || *str==0) return 0;
 	Procedure *proc=(Procedure*)malloc(sizeof(Procedure));
+	proc->test=0;
+	proc->cache_mode=CACHE_DEFAULT;
+	proc->cache_ttl=0;
+	proc->compress=COMPRESS_NONE;
+	proc->inputs=0;
 	const char *p=str;
 	// Find the limit between the program and the test
 	while (*p!=0 && *p!=';') ++p;
@@ -268,7 +345,11 @@ Procedure* get_procedure_from_string(const char* str) {
 	proc->program=get_program_from_string(q);
 	// Read test
 	if (proc->program!=0) {
-		if (*p==0) {
+		// Find the limit between the test and the options
+		const char *t=(*p==';')?p+1:p;
+		const char *o=t;
+		while (*o!=0 && *o!=';') ++o;
+		if (*p==0 || (t==o && *o==';')) {	// No test, or an empty test followed by options
 			if (proc->program->func==&program_external) {	// Choose same external program for the test function
 				proc->test=get_test_from_string(q);
 			} else if (proc->program->func==&program_shell) {	// Choose corresponding test function for shell scripts
@@ -284,15 +365,17 @@ Procedure* get_procedure_from_string(const char* str) {
 		}
 		else {
 			free(q);
-			str=p+1;
-			p=str;
-			while (*p!=0) ++p;
-			q=(char *)malloc((p-str+1)*sizeof(char));
-			strncpy(q,str,p-str);
-			q[p-str]=0;
+			q=(char *)malloc((o-t+1)*sizeof(char));
+			strncpy(q,t,o-t);
+			q[o-t]=0;
 			proc->test=get_test_from_string(q);
 			free(q);
 		}
+		// Read options
+		if (*o==';' && read_procedure_options(proc,o+1)!=0) {
+			free_procedure(proc);
+			proc=0;
+		}
 	} else { // If nothing was declared, release the Procedure structure
 		free(proc);
 		proc=0;
@@ -114,6 +114,24 @@ Test *get_test_from_string(const char *str);
 /********************************************/
 /*                PROCEDURE                 */
 /********************************************/
+/**
+ * \brief Caching policy of the output of the scripts of a procedure
+ */
+enum CacheMode {
+	CACHE_DEFAULT,	//!< Use the global policy (CACHE_AUTO if adaptive caching is enabled, CACHE_NEVER otherwise)
+	CACHE_NEVER,	//!< Always execute the script
+	CACHE_AUTO,	//!< Observe the executions and cache the output of the scripts which prove to be stable and expensive
+	CACHE_ALWAYS	//!< Always cache the output
+};
+
+/**
+ * \brief Format of the compressed siblings of the outputs of the scripts of a procedure
+ */
+enum Compression {
+	COMPRESS_NONE,	//!< No compressed sibling
+	COMPRESS_GZIP	//!< Gzip sibling, named after the script with the .gz suffix
+};
+
 /**
  * \brief Structure gathering information about what do to with a file on the virtual file system
  *
@@ -122,6 +140,10 @@ Test *get_test_from_string(const char *str);
 typedef struct Procedure {
 	Program *program;	//!< Pointer to the Program structure
 	Test *test;	//!< Pointer to the Test structure
+	int cache_mode;	//!< Caching policy of the outputs (see enum CacheMode)
+	unsigned int cache_ttl;	//!< Time to live of cached outputs in seconds, 0 to infer it (CACHE_AUTO) or to keep the output until the script changes (CACHE_ALWAYS)
+	int compress;	//!< Format of the compressed siblings of the outputs (see enum Compression)
+	char **inputs;	//!< Null-terminated array of the files (relative to the mirror folder) read by the scripts besides their source, null if none is declared
 } Procedure;
 
 /**
@@ -134,7 +156,7 @@ void free_procedure(Procedure *procedure);
 /**
  * \brief Reads a procedure from a string
  *
- * This function is used to process the command-line \c -p arguments. One such argument is converted to a Procedure structure. The newly-allocated structure must be released by the user when it is not needed any longer.
+ * This function is used to process the command-line \c -p arguments. One such argument is converted to a Procedure structure. The argument is made of the program, the test and the options of the procedure, separated by semicolons. The newly-allocated structure must be released by the user when it is not needed any longer.
  * \param str String from which the procedure must be read
  * \return Pointer to a newly-created Procedure structure
  */
@@ -0,0 +1,79 @@
+/*
+ * =====================================================================================
+ *
+ *       Filename:  readahead.c
+ *
+ *    Description:  Implementation of the adaptive readahead
+ *
+ *        Version:  2.0
+ *        Created:  10/18/2026
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  
+ *        Company:  
+ *
+ * =====================================================================================
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include "operations.h"
+#include "stats.h"
+#include "readahead.h"
+
+extern struct Persistent persistent;
+
+void init_readahead(FileStruct *fs) {
+	fs->ra_next=0;
+	fs->ra_end=0;
+	fs->ra_window=0;
+	fs->ra_random=0;
+	pthread_mutex_init(&fs->ra_mutex,0);
+}
+
+void free_readahead(FileStruct *fs) {
+	pthread_mutex_destroy(&fs->ra_mutex);
+}
+
+void readahead_hint(FileStruct *fs,off_t offset,size_t size) {
+	if (persistent.readahead_max==0) return;
+	off_t end=offset+size;
+	pthread_mutex_lock(&fs->ra_mutex);	// Concurrent reads of the handle update the same pattern
+	off_t slack=(fs->ra_window!=0)?fs->ra_window:((READAHEAD_MIN<persistent.readahead_max)?READAHEAD_MIN:persistent.readahead_max);
+	if (offset+slack<fs->ra_next || offset>fs->ra_next+slack) {	// Not sequential, the window starts again from scratch
+		fs->ra_next=end;
+		fs->ra_window=0;
+		fs->ra_end=0;
+		if (fs->ra_random<READAHEAD_RANDOM && ++fs->ra_random==READAHEAD_RANDOM) {
+#ifdef TRACE
+			fprintf(stderr,"readahead_hint: Random reads on %s\n",fs->filename);
+#endif
+			posix_fadvise(fs->file_handle,0,0,POSIX_FADV_RANDOM);	// Under the lock, so that the advice follows the order of the transitions
+			STAT_ADD(random_handles,1);
+		}
+		pthread_mutex_unlock(&fs->ra_mutex);
+		return;
+	}
+	if (end>fs->ra_next) fs->ra_next=end;	// Concurrent reads of a sequential reader may arrive slightly out of order
+	else end=fs->ra_next;
+	if (fs->ra_random>=READAHEAD_RANDOM) posix_fadvise(fs->file_handle,0,0,POSIX_FADV_NORMAL);	// Read sequentially again
+	fs->ra_random=0;
+	if (fs->ra_window==0) fs->ra_window=(READAHEAD_MIN<persistent.readahead_max)?READAHEAD_MIN:persistent.readahead_max;
+	if (end+(off_t)fs->ra_window/2<fs->ra_end) {	// More than half of the window is still ahead of the reader
+		pthread_mutex_unlock(&fs->ra_mutex);
+		return;
+	}
+	if (fs->ra_end!=0 && fs->ra_window<persistent.readahead_max) {	// The reader caught up with the previous window, make it larger
+		fs->ra_window*=2;
+		if (fs->ra_window>persistent.readahead_max) fs->ra_window=persistent.readahead_max;
+	}
+	off_t start=(fs->ra_end>end)?fs->ra_end:end;
+	fs->ra_end=end+fs->ra_window;
+	off_t length=fs->ra_end-start;
+	pthread_mutex_unlock(&fs->ra_mutex);
+	if (length>0 && posix_fadvise(fs->file_handle,start,length,POSIX_FADV_WILLNEED)==0) STAT_ADD(readahead_bytes,length);	// Outside of the lock, it may wait for the device
+}
@@ -0,0 +1,55 @@
+/**
+ * \file
+ *
+ * =====================================================================================
+ *
+ *       Filename:  readahead.h
+ *
+ *    Description:  Adaptive readahead on the files of the mirror
+ *
+ *        Version:  2.0
+ *        Created:  10/18/2026
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  
+ *        Company:  
+ *
+ * =====================================================================================
+ */
+
+#ifndef  READAHEAD_INC
+#define  READAHEAD_INC
+
+#include "operations.h"
+
+#define DEFAULT_READAHEAD_MAX 0x800000	//!< Default maximal readahead window on the files of the mirror
+#define READAHEAD_MIN 0x20000	//!< Readahead window once a handle is found to be read sequentially
+#define READAHEAD_RANDOM 3	//!< Number of non-sequential reads in a row after which a handle is advised random
+
+/**
+ * \brief Reset the access pattern of a handle
+ *
+ * \param fs Structure of a file of the mirror which was just opened
+ */
+void init_readahead(FileStruct *fs);
+
+/**
+ * \brief Release the access pattern of a handle
+ *
+ * \param fs Structure of a file of the mirror which is being released, initialized with init_readahead
+ */
+void free_readahead(FileStruct *fs);
+
+/**
+ * \brief Prefetch the data a handle is about to read
+ *
+ * The function is called before each read of a file of the mirror. A read is sequential if it starts within the current window around the highest offset read so far, so that the concurrent reads of a sequential reader, which may arrive out of order, keep the window. A handle read sequentially gets its next bytes prefetched with posix_fadvise(POSIX_FADV_WILLNEED), in a window which doubles each time the reader catches up with it, up to persistent.readahead_max. A handle read at random offsets is advised POSIX_FADV_RANDOM, so that the kernel stops its own readahead, until it is read sequentially again.
+ * The pattern of the handle is updated under its lock (ra_mutex), since the reads of a handle may be served concurrently; the prefetch itself is issued after the lock is released.
+ * \param fs Structure of the file
+ * \param offset Position of the read
+ * \param size Number of bytes of the read
+ */
+void readahead_hint(FileStruct *fs,off_t offset,size_t size);
+
+#endif   /* ----- #ifndef READAHEAD_INC  ----- */
@@ -0,0 +1,421 @@
+/*
+ * =====================================================================================
+ *
+ *       Filename:  remote.c
+ *
+ *    Description:  Implementation of the client of the remote cache
+ *
+ *        Version:  2.0
+ *        Created:  10/18/2026
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  
+ *        Company:  
+ *
+ * =====================================================================================
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/time.h>
+#include <sys/sendfile.h>
+#include "operations.h"
+#include "cache.h"
+#include "stats.h"
+#include "sha256.h"
+#include "remote.h"
+
+extern struct Persistent persistent;
+
+#define REMOTE_LINE_LENGTH 0x100	//!< Maximal length of a line of the protocol
+#define REMOTE_SECRET_LENGTH 0x400	//!< Maximal length of the shared secret
+
+/**
+ * \brief Output waiting to be sent to the remote cache
+ */
+typedef struct RemotePut {
+	RemoteKey key;	//!< Key of the output
+	int fd;	//!< Duplicate of the descriptor of the output
+	struct RemotePut *next;	//!< Next output in the queue
+} RemotePut;
+
+static char *remote_address=0;	//!< Address of the remote cache, null if there is none
+static unsigned char remote_secret[REMOTE_SECRET_LENGTH];	//!< Secret shared with the server and the other hosts, authenticates the outputs
+static size_t remote_secret_length=0;	//!< Length of the secret, 0 if the outputs are not authenticated
+static long long remote_down_until=0;	//!< Time (monotonic, in milliseconds) until which the remote cache is considered unreachable
+static pthread_mutex_t put_mutex=PTHREAD_MUTEX_INITIALIZER;	//!< Protects the queue of the outputs to send
+static pthread_cond_t put_cond=PTHREAD_COND_INITIALIZER;	//!< Signals a new output in the queue, or the end of the sender
+static RemotePut *put_first=0;	//!< First output of the queue
+static RemotePut **put_last=&put_first;	//!< Pointer to the next field of the last output of the queue
+static unsigned int put_queued=0;	//!< Number of outputs in the queue
+static int put_running=0;	//!< Tells if the sender thread was started
+static int put_stop=0;	//!< Tells the sender thread to stop
+static pthread_t put_thread;	//!< Thread sending the outputs to the remote cache
+
+int open_remote_cache(const char *address) {
+	if (strncmp(address,"unix:",5)!=0 && (strncmp(address,"tcp:",4)!=0 || strrchr(address+4,':')==0)) return EINVAL;
+	free(remote_address);
+	remote_address=strdup(address);
+	return 0;
+}
+
+int read_remote_secret(const char *path) {
+	int fd=open(path,O_RDONLY | O_CLOEXEC);
+	if (fd<0) return errno;
+	ssize_t len=read(fd,remote_secret,sizeof remote_secret);
+	int code=(len<0)?errno:0;
+	close(fd);
+	if (code!=0) return code;
+	while (len>0 && (remote_secret[len-1]=='\n' || remote_secret[len-1]=='\r')) --len;
+	if (len==0 || len==sizeof remote_secret) return EINVAL;
+	remote_secret_length=len;
+	return 0;
+}
+
+/**
+ * \brief Add the content of a file of the mirror to a hash
+ *
+ * The size of the file follows its content, so that the boundary between the file and the next data is not ambiguous.
+ * \param s State of the hash
+ * \param relative Path of the file relative to the mirror folder of the current mount
+ * \return 0 if the file was read, -1 otherwise
+ */
+static int hash_file(Sha256 *s,const char *relative) {
+	unsigned char buf[0x10000];
+	ssize_t num;
+	uint64_t size=0;
+	int fd=openat(current_mount()->mirror_fd,relative,O_RDONLY | O_CLOEXEC);
+	if (fd<0) return -1;
+	while ((num=read(fd,buf,sizeof buf))>0) {
+		sha256_update(s,buf,num);
+		size+=num;
+	}
+	close(fd);
+	sha256_update(s,&size,sizeof size);
+	return (num<0)?-1:0;
+}
+
+int remote_key(const char *relative,Procedure *proc,RemoteKey *key) {
+	if (remote_address==0 || cache_mode(proc)!=CACHE_ALWAYS || proc->cache_ttl!=0) return -1;
+	Sha256 s;
+	unsigned char digest[SHA256_SIZE];
+	size_t len;
+	const char *definition=procedure_definition(current_mount(),proc,&len);
+	sha256_init(&s);
+	sha256_update(&s,definition,len);
+	sha256_update(&s,"",1);
+	if (hash_file(&s,relative)!=0) return -1;
+	char **input;
+	for (input=proc->inputs;input!=0 && *input!=0;++input) {
+		sha256_update(&s,*input,strlen(*input)+1);
+		if (hash_file(&s,*input)!=0) sha256_update(&s,"missing",8);
+	}
+	sha256_final(&s,digest);
+	to_hex(digest,sizeof digest,key->name);
+	return 0;
+}
+
+/**
+ * \brief Tell if the remote cache may be contacted
+ *
+ * \return 1 if the remote cache did not fail during the last REMOTE_RETRY seconds, 0 otherwise
+ */
+static int remote_up() {
+	return now_ms()>=__atomic_load_n(&remote_down_until,__ATOMIC_RELAXED);
+}
+
+/**
+ * \brief Record a failure of the remote cache
+ *
+ * The remote cache is not contacted for REMOTE_RETRY seconds, so that the requests do not all wait for the timeout of an unreachable server.
+ */
+static void remote_failed() {
+	STAT_ADD(remote_errors,1);
+	__atomic_store_n(&remote_down_until,now_ms()+REMOTE_RETRY*1000LL,__ATOMIC_RELAXED);
+}
+
+/**
+ * \brief Start the authentication code of an output
+ *
+ * The code authenticates the key and the size of the output, followed by its content (see \ref remoteprotocol "Protocol of the remote cache").
+ * \param m State of the computation
+ * \param key Key of the output
+ * \param size Size of the output
+ */
+static void mac_init(Hmac *m,const RemoteKey *key,long long size) {
+	char line[REMOTE_LINE_LENGTH];
+	int len=snprintf(line,sizeof line,"%s %lld\n",key->name,size);
+	hmac_init(m,remote_secret,remote_secret_length);
+	hmac_update(m,line,len);
+}
+
+/**
+ * \brief Connect to the remote cache
+ *
+ * \return Connected socket, -1 if the remote cache cannot be reached
+ */
+static int remote_connect() {
+	struct timeval tv={REMOTE_TIMEOUT,0};
+	int sock=-1;
+	if (!remote_up()) return -1;
+	if (strncmp(remote_address,"unix:",5)==0) {
+		struct sockaddr_un addr;
+		memset(&addr,0,sizeof addr);
+		addr.sun_family=AF_UNIX;
+		strncpy(addr.sun_path,remote_address+5,sizeof addr.sun_path-1);
+		sock=socket(AF_UNIX,SOCK_STREAM | SOCK_CLOEXEC,0);
+		if (sock>=0) {
+			setsockopt(sock,SOL_SOCKET,SO_RCVTIMEO,&tv,sizeof tv);
+			setsockopt(sock,SOL_SOCKET,SO_SNDTIMEO,&tv,sizeof tv);
+			if (connect(sock,(struct sockaddr*)&addr,sizeof addr)!=0) {close(sock);sock=-1;}
+		}
+	} else {
+		char host[REMOTE_LINE_LENGTH];
+		const char *port=strrchr(remote_address+4,':');
+		snprintf(host,sizeof host,"%.*s",(int)(port-remote_address-4),remote_address+4);
+		struct addrinfo hints,*res,*ai;
+		memset(&hints,0,sizeof hints);
+		hints.ai_socktype=SOCK_STREAM;
+		if (getaddrinfo(host,port+1,&hints,&res)!=0) {
+			remote_failed();
+			return -1;
+		}
+		for (ai=res;ai!=0 && sock<0;ai=ai->ai_next) {
+			sock=socket(ai->ai_family,ai->ai_socktype | SOCK_CLOEXEC,ai->ai_protocol);
+			if (sock<0) continue;
+			setsockopt(sock,SOL_SOCKET,SO_RCVTIMEO,&tv,sizeof tv);
+			setsockopt(sock,SOL_SOCKET,SO_SNDTIMEO,&tv,sizeof tv);
+			if (connect(sock,ai->ai_addr,ai->ai_addrlen)!=0) {close(sock);sock=-1;}
+		}
+		freeaddrinfo(res);
+	}
+	if (sock<0) remote_failed();
+	return sock;
+}
+
+/**
+ * \brief Read a line of the protocol
+ *
+ * \param sock Connected socket
+ * \param line Buffer receiving the line, without the newline character
+ * \param size Size of the buffer
+ * \return 0 if a line was read, -1 otherwise
+ */
+static int read_line(int sock,char *line,size_t size) {
+	size_t len=0;
+	while (len+1<size) {
+		ssize_t num=read(sock,line+len,1);
+		if (num<=0) return -1;
+		if (line[len]=='\n') {line[len]=0;return 0;}
+		++len;
+	}
+	return -1;
+}
+
+/**
+ * \brief Write a whole buffer on a socket
+ *
+ * \param sock Connected socket
+ * \param buf Buffer
+ * \param len Size of the buffer
+ * \return 0 if everything was written, -1 otherwise
+ */
+static int write_all(int sock,const char *buf,size_t len) {
+	while (len>0) {
+		ssize_t num=send(sock,buf,len,MSG_NOSIGNAL);
+		if (num<0 && errno==EINTR) continue;
+		if (num<=0) return -1;
+		buf+=num;
+		len-=num;
+	}
+	return 0;
+}
+
+int remote_get(const RemoteKey *key) {
+	char line[REMOTE_LINE_LENGTH],mac[2*SHA256_SIZE+1];
+	int sock=remote_connect();
+	if (sock<0) return -1;
+	snprintf(line,sizeof line,"GET %s\n",key->name);
+	long long size=-1;
+	*mac=0;
+	if (write_all(sock,line,strlen(line))!=0 || read_line(sock,line,sizeof line)!=0 || (strcmp(line,"MISS")!=0 && sscanf(line,"HIT %lld %64s",&size,mac)<1)) {
+		remote_failed();
+		close(sock);
+		return -1;
+	}
+	if (size<0) {
+		STAT_ADD(remote_misses,1);
+		close(sock);
+		return -1;
+	}
+	char temp_filename[sizeof(persistent.tmp_template)];
+	strncpy(temp_filename,persistent.tmp_template,sizeof temp_filename-1);
+	temp_filename[sizeof temp_filename-1]=0;
+	int fd=mkstemp(temp_filename);
+	if (fd<0) {
+		close(sock);
+		return -1;
+	}
+	unlink(temp_filename);
+	Hmac m;
+	if (remote_secret_length>0) mac_init(&m,key,size);
+	char buf[0x10000];
+	while (size>0) {
+		ssize_t num=read(sock,buf,(size<sizeof buf)?size:sizeof buf);
+		if (num<0 && errno==EINTR) continue;
+		if (num<=0 || write(fd,buf,num)!=num) break;
+		if (remote_secret_length>0) hmac_update(&m,buf,num);
+		size-=num;
+	}
+	close(sock);
+	if (size>0) {	// Truncated answer
+		remote_failed();
+		close(fd);
+		return -1;
+	}
+	if (remote_secret_length>0) {	// Only the outputs sent by a holder of the secret are accepted
+		unsigned char code[SHA256_SIZE];
+		char hex[2*SHA256_SIZE+1];
+		hmac_final(&m,code);
+		to_hex(code,sizeof code,hex);
+		if (strcmp(hex,mac)!=0) {
+			fprintf(stderr,"remote_get: Output %s is not authenticated, ignoring it\n",key->name);
+			STAT_ADD(remote_errors,1);
+			close(fd);
+			return -1;
+		}
+	}
+	STAT_ADD(remote_hits,1);
+	return fd;
+}
+
+/**
+ * \brief Send an output to the remote cache
+ *
+ * \param key Key of the output
+ * \param fd Descriptor of the output
+ */
+static void send_output(const RemoteKey *key,int fd) {
+	char line[REMOTE_LINE_LENGTH],mac[2*SHA256_SIZE+1];
+	struct stat st;
+	if (fstat(fd,&st)!=0) return;
+	*mac=0;
+	if (remote_secret_length>0) {	// The code is given before the output, which is read twice
+		char buf[0x10000];
+		unsigned char code[SHA256_SIZE];
+		Hmac m;
+		off_t offset=0;
+		mac_init(&m,key,st.st_size);
+		while (offset<st.st_size) {
+			ssize_t num=pread(fd,buf,sizeof buf,offset);
+			if (num<0 && errno==EINTR) continue;
+			if (num<=0) return;
+			hmac_update(&m,buf,num);
+			offset+=num;
+		}
+		hmac_final(&m,code);
+		to_hex(code,sizeof code,mac);
+	}
+	int sock=remote_connect();
+	if (sock<0) return;
+	snprintf(line,sizeof line,"PUT %s %lld%s%s\n",key->name,(long long)st.st_size,(*mac)?" ":"",mac);
+	int code=write_all(sock,line,strlen(line));
+	off_t offset=0;
+	while (code==0 && offset<st.st_size) {
+		ssize_t num=sendfile(sock,fd,&offset,st.st_size-offset);
+		if (num<0 && errno==EINTR) continue;
+		if (num<=0) code=-1;
+	}
+	if (code==0 && read_line(sock,line,sizeof line)==0 && strcmp(line,"STORED")==0) STAT_ADD(remote_stores,1);
+	else if (code==0 && strncmp(line,"ERROR",5)==0) {	// The server answered, but refused the output
+		fprintf(stderr,"remote_put: %s: %s\n",key->name,line);
+		STAT_ADD(remote_errors,1);
+	} else remote_failed();
+	close(sock);
+}
+
+/**
+ * \brief Loop of the thread sending the outputs to the remote cache
+ *
+ * \param arg Unused
+ * \return Null pointer
+ */
+static void *put_loop(void *arg) {
+	pthread_mutex_lock(&put_mutex);
+	for (;;) {
+		while (put_first==0 && !put_stop) pthread_cond_wait(&put_cond,&put_mutex);
+		if (put_stop) break;
+		RemotePut *put=put_first;
+		put_first=put->next;
+		if (put_first==0) put_last=&put_first;
+		--put_queued;
+		pthread_mutex_unlock(&put_mutex);
+		send_output(&put->key,put->fd);
+		close(put->fd);
+		free(put);
+		pthread_mutex_lock(&put_mutex);
+	}
+	pthread_mutex_unlock(&put_mutex);
+	return 0;
+}
+
+void remote_put(const RemoteKey *key,int fd) {
+	if (!remote_up()) return;
+	RemotePut *put=(RemotePut*)malloc(sizeof(RemotePut));
+	if (put==0) return;
+	put->key=*key;
+	put->next=0;
+	put->fd=fcntl(fd,F_DUPFD_CLOEXEC,0);	// The output is read with pread and sendfile at explicit offsets, the position of the caller does not move
+	if (put->fd<0) {
+		free(put);
+		return;
+	}
+	pthread_mutex_lock(&put_mutex);
+	if (!put_running && !put_stop) put_running=(pthread_create(&put_thread,0,put_loop,0)==0);	// Started on the first output, after FUSE forked into the background
+	if (!put_running || put_stop || put_queued>=REMOTE_QUEUE) {	// The server does not keep up, this output is not shared
+		pthread_mutex_unlock(&put_mutex);
+		STAT_ADD(remote_errors,1);
+		close(put->fd);
+		free(put);
+		return;
+	}
+	*put_last=put;
+	put_last=&put->next;
+	++put_queued;
+	pthread_cond_signal(&put_cond);
+	pthread_mutex_unlock(&put_mutex);
+}
+
+void close_remote_cache() {
+	pthread_mutex_lock(&put_mutex);
+	int running=put_running;
+	put_stop=1;
+	pthread_cond_broadcast(&put_cond);
+	pthread_mutex_unlock(&put_mutex);
+	if (running) pthread_join(put_thread,0);
+	while (put_first!=0) {	// The outputs which were not sent yet are dropped
+		RemotePut *put=put_first;
+		put_first=put->next;
+		close(put->fd);
+		free(put);
+	}
+	put_last=&put_first;
+	put_queued=0;
+	put_running=put_stop=0;
+	free(remote_address);
+	remote_address=0;
+	memset(remote_secret,0,sizeof remote_secret);
+	remote_secret_length=0;
+}
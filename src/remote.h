@@ -0,0 +1,104 @@
+/**
+ * \file
+ *
+ * =====================================================================================
+ *
+ *       Filename:  remote.h
+ *
+ *    Description:  Client of the remote cache of script outputs
+ *
+ *        Version:  2.0
+ *        Created:  10/18/2026
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  
+ *        Company:  
+ *
+ * =====================================================================================
+ */
+
+#ifndef  REMOTE_INC
+#define  REMOTE_INC
+
+#include "procedures.h"
+
+#define REMOTE_TIMEOUT 5	//!< Delay in seconds after which a remote cache which does not answer is considered missing
+#define REMOTE_RETRY 30	//!< Number of seconds during which the remote cache is not contacted after a failure
+#define REMOTE_QUEUE 64	//!< Maximal number of outputs waiting to be sent to the remote cache
+
+/**
+ * \page remoteprotocol Protocol of the remote cache
+ *
+ * The remote cache is a server reached on a unix socket (address unix:/path/to/socket) or a TCP port (address tcp:host:port). It stores outputs identified by a key of 64 lowercase hexadecimal digits. A connection carries any number of requests, each one starting with a line ending with a newline character:
+ *      - GET key
+ *              The server answers "HIT size mac" followed by the size bytes of the output, or "MISS".
+ *      - PUT key size [mac]
+ *              The line is followed by the size bytes of the output. The server answers "STORED", or "ERROR message" if it does not keep the output.
+ *
+ * The key is the SHA-256 digest, computed by the client, of the definition of the procedure, the content of the script and the names and contents of the inputs declared by the procedure, so that the same generator with the same inputs has the same key on every host. Only the outputs of procedures with cache=always and no ttl are sent to the remote cache, since their output only depends on these contents.
+ *
+ * The key does not authenticate the output: anybody who can connect to the server could store any output under any key. When the hosts and the server share a secret, mac is the HMAC-SHA-256 of the line "key size" (with its newline character) followed by the output, keyed with the secret, in hexadecimal. The server then refuses the PUT requests without a valid mac, and the clients ignore the outputs which GET gives with an invalid one. Without a secret, the server must only be reachable by trusted hosts (permissions of the unix socket, firewall), and mac is 64 zeros. In both cases, the outputs are not encrypted.
+ */
+
+/**
+ * \brief Key of an output in the remote cache
+ */
+typedef struct RemoteKey {
+	char name[65];	//!< Hexadecimal SHA-256 digest, null-terminated
+} RemoteKey;
+
+/**
+ * \brief Set the address of the remote cache
+ *
+ * \param address Address of the server, unix:/path or tcp:host:port
+ * \return 0 if the address is valid, EINVAL otherwise
+ */
+int open_remote_cache(const char *address);
+
+/**
+ * \brief Read the secret shared with the remote cache and the other hosts
+ *
+ * The secret authenticates the outputs exchanged with the remote cache (see \ref remoteprotocol "Protocol of the remote cache"). The trailing newline characters of the file are ignored.
+ * \param path Path of the file holding the secret
+ * \return 0 if the secret was read, an error code otherwise (EINVAL if the file is empty or too long)
+ */
+int read_remote_secret(const char *path);
+
+/**
+ * \brief Forget the address of the remote cache
+ *
+ * The sender thread is stopped, the outputs which were not sent yet are dropped.
+ */
+void close_remote_cache();
+
+/**
+ * \brief Compute the key of the output of a script in the remote cache
+ *
+ * The key is the SHA-256 digest of the definition of the procedure, the content of the script and the names, contents and sizes of the inputs declared by the procedure.
+ * \param relative Path of the script relative to the mirror folder of the current mount
+ * \param proc Procedure producing the output
+ * \param key Structure receiving the key
+ * \return 0 if the output may be sent to the remote cache, -1 otherwise (no remote cache, procedure which does not cache forever, unreadable script)
+ */
+int remote_key(const char *relative,Procedure *proc,RemoteKey *key);
+
+/**
+ * \brief Get an output from the remote cache
+ *
+ * \param key Key of the output
+ * After a failure, the remote cache is not contacted for REMOTE_RETRY seconds. With a shared secret, an output which is not authenticated is ignored.
+ * \return Descriptor of a temporary file holding the output, -1 if the output is not in the remote cache, is not authenticated or the cache cannot be reached
+ */
+int remote_get(const RemoteKey *key);
+
+/**
+ * \brief Send an output to the remote cache
+ *
+ * The output is queued and sent by a dedicated thread, so that the request does not wait for the server. The output is dropped if REMOTE_QUEUE outputs are already waiting, or if the remote cache failed during the last REMOTE_RETRY seconds.
+ * \param key Key of the output
+ * \param fd Descriptor of the output
+ */
+void remote_put(const RemoteKey *key,int fd);
+
+#endif   /* ----- #ifndef REMOTE_INC  ----- */
@@ -24,8 +24,10 @@
 
 #include <stdlib.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <fuse3/fuse.h>
 #include <fuse3/fuse_opt.h>
+#include <fuse3/fuse_lowlevel.h>
 #include <limits.h>
 #include <stdio.h>
 #include <string.h>
@@ -37,14 +39,40 @@
 #include <sys/statvfs.h>
 #include <dirent.h>
 #include <fcntl.h>
+#include <signal.h>
+#include <pthread.h>
 #include "operations.h"
 #include "procedures.h"
+#include "durability.h"
+#include "spool.h"
+#include "readahead.h"
+#include "generation.h"
+#include "compress.h"
+#include "hotpath.h"
+#include "uring.h"
+#include "parallel.h"
+#include "cache.h"
+#include "stats.h"
+#include "index.h"
+#include "materialize.h"
+#include "mount.h"
+#include "handover.h"
+#include "shared.h"
+#include "remote.h"
+#include "affinity.h"
+#include "forkserver.h"
+#include "context.h"
 
 extern struct Persistent persistent;
 
 #define SFS_OPT_KEY(t,u,p) { t ,offsetof(struct options, p ), 1 } , { u ,offsetof(struct options, p ), 1 }	//!< Generate a command-line argument with short name t, long name u. p is an integer variable name and the corresponding variable will be set to 1 if it is found in the arguments
 #define SFS_OPT_KEY2(t,u,p,v) { t ,offsetof(struct options, p ), v } , { u ,offsetof(struct options, p ), v }	//!< Generate a command-line argument with short name t, long name u. p is an integer or string variable name and the corresponding variable will be set to the value of the argument
 
+#define IMMUTABLE_TIMEOUT 1e9	//!< Timeout (in seconds) of the entries and attributes cached by the kernel when the mirror is immutable, virtually infinite
+#define FUSE_MAX_THREADS 1024	//!< Maximal number of FUSE worker threads, unless the max_threads mount option is given
+#define GENERATION_POLL 100	//!< Period (in milliseconds) at which a request waiting for a generation checks whether it was interrupted
+
+static int sessions=0;	//!< Number of FUSE sessions initialized and not destroyed yet
 uid_t uid;	//!< Current user ID
 gid_t gid;	//!< Current group ID
 
@@ -56,14 +84,130 @@ gid_t gid;	//!< Current group ID
  */
 void print_usage(int code) {
 	printf("Syntax: scriptfs [arguments] mirror_folder mount_point\n");
+	printf("        scriptfs [arguments] --mounts=file [mirror_folder mount_point]\n");
 	printf("Arguments:\n");
 	printf("        -l\n\t\tReport final output size for scripts instead of size of source.\n");
 	printf("	-p program[;test]\n\t\tAdd a procedure which tells what to do with files\n");
+	printf("	--io-uring[=depth]\n\t\tServe FUSE requests on per-CPU io_uring queues when the kernel and libfuse support it\n");
+	printf("	--mirror-uring[=depth]\n\t\tDo the I/O on the mirror on per-thread io_uring rings (default depth: %d)\n",URING_DEFAULT_DEPTH);
+	printf("	--size-jobs=number\n\t\tMaximal number of scripts run at once to get sizes when listing a directory with -l\n");
+	printf("	--parallel-tests\n\t\tRun the test programs of all procedures concurrently\n");
+	printf("	--adaptive-cache\n\t\tCache the output of scripts which prove to be stable and expensive\n");
+	printf("	--cache-min-ms=milliseconds\n\t\tMinimal duration of a script for the adaptive cache to keep its output (default: %d)\n",DEFAULT_CACHE_MIN_MS);
+	printf("	--cache-size=megabytes\n\t\tMaximal size of the cached outputs (default: %d)\n",DEFAULT_CACHE_SIZE>>20);
+	printf("	--stats\n\t\tPublish statistics in the virtual folder %s of the mount point\n",CONTROL_FOLDER);
+	printf("	--max-jobs=number\n\t\tMaximal number of scripts run at once, not counting scripts read by other scripts (default: %d, no limit)\n",DEFAULT_MAX_JOBS);
+	printf("	--adaptive-jobs=min:max\n\t\tAdjust the maximal number of scripts run at once between min and max, according to the pressure of the host and the duration of the scripts\n");
+	printf("	--fuse-cpus=list\n\t\tRun the FUSE workers on these CPUs (such as 0-3,8) and never run scripts on them\n");
+	printf("	--script-cpus=list\n\t\tRun the scripts on these CPUs (default: all the CPUs not reserved for the FUSE workers)\n");
+	printf("	--numa-local\n\t\tRun each script and allocate its memory on the NUMA node of the worker which will serve its output\n");
+	printf("	--fork-server=interpreter[:module,...]\n\t\tRun the scripts of this Python interpreter (path of the shebang line) from a preloaded interpreter which forks itself, with these modules imported\n");
+	printf("	--context=script[:seconds]\n\t\tRun this script of the mirror once per lifetime (default: %d s) and give its output to every program run for the mount\n",DEFAULT_CONTEXT_TTL);
+	printf("	--generation-times\n\t\tReport the time of the last change of the output of scripts as modification time, and the time of their last execution as change time\n");
+	printf("	--nested-cache\n\t\tServe scripts read by other scripts from the cache even if the cached output expired\n");
+	printf("	--mounts=file\n\t\tServe all the mounts listed in the file from this process, with shared scheduler, caches and statistics\n");
+	printf("	--shared-cache=folder\n\t\tShare the cached outputs with the other instances of the host using this folder (preferably in /dev/shm)\n");
+	printf("	--shared-cache-size=megabytes\n\t\tMaximal size of the outputs of the shared cache for the whole host (default: %d)\n",DEFAULT_SHARED_CACHE_SIZE>>20);
+	printf("	--remote-cache=unix:/path|tcp:host:port\n\t\tLook for the outputs of procedures with cache=always in this cache server before running them, and send it the new ones\n");
+	printf("	--remote-secret=file\n\t\tAuthenticate the outputs exchanged with the remote cache with the secret held by this file\n");
+	printf("	--handover=socket\n\t\tListen on this unix socket for a new process taking over the mount points\n");
+	printf("	--takeover=socket\n\t\tTake over the mount points and the cache of the process listening on this socket\n");
+	printf("	--immutable\n\t\tDeclare the mirror immutable: index it at mount time and reject writes\n");
+	printf("	--timeout=seconds\n\t\tKill external programs which run longer than this delay\n");
+	printf("	--compress-jobs=number\n\t\tMaximal number of threads compressing outputs for their compressed siblings, all compressions together (default: number of CPUs)\n");
+	printf("	--readahead-max=bytes\n\t\tMaximal window prefetched ahead of the sequential readers of the mirror, 0 to disable (default: %d)\n",DEFAULT_READAHEAD_MAX);
+	printf("	--huge-spool=folder[:bytes]\n\t\tWrite the outputs to the folder, a tmpfs mounted with huge=always, and keep those larger than bytes (default: %d) there\n",DEFAULT_HUGE_THRESHOLD);
+	printf("	--inline-max=bytes\n\t\tMaximal size of the outputs kept in memory when they are opened, 0 to keep them in their temporary file (default: %d)\n",DEFAULT_INLINE_MAX);
+	printf("	--cancel-grace=milliseconds\n\t\tDelay given to a script to finish after its request was interrupted, before it is killed (default: 0)\n");
+	printf("	--durability=none|close|group\n\t\tWhat to do with written files when they are closed (default: close)\n");
+	printf("	--sync-interval=seconds\n\t\tDelay between two commits of the mirror with the group durability policy (default: %d)\n",DEFAULT_SYNC_INTERVAL);
+	printf("	--materialize\n\t\tRender the virtual file system into the folder given instead of the mount point, without mounting it\n");
+	printf("	--link=reflink|hard|copy\n\t\tHow --materialize reproduces the files which are not scripts (default: reflink)\n");
+	printf("	--report=file\n\t\tWrite the duration of the rendering of each file by --materialize in this file\n");
 	printf("	mirror_folder\n\t\tActual folder on the disk that will be the base folder of the mounted structure\n");
 	printf("	mount_point\n\t\tFolder that will be used as the mount point\n");
 	exit(code);
 }
 
+/**
+ * \brief Get the value of a long command-line option
+ *
+ * This function checks if the command-line argument arg is the long option name, written as --name=value, and returns a pointer to the value if it is the case.
+ * \param arg Command-line argument
+ * \param name Name of the option, without the leading dashes and the equal sign
+ * \return Pointer to the value in arg, or null if arg is not the requested option
+ */
+const char *option_value(const char *arg,const char *name) {
+	size_t len=strlen(name);
+	if (arg[0]!='-' || arg[1]!='-' || strncmp(arg+2,name,len)!=0 || arg[len+2]!='=') return 0;
+	return arg+len+3;
+}
+
+/**
+ * \brief Remove arguments from the command line
+ *
+ * This function removes n elements from the array of command-line arguments, starting at position i, so that the remaining arguments can be processed by FUSE. The null pointer at the end of the array is kept.
+ * \param argc Pointer to the number of arguments, updated by the function
+ * \param argv Array of arguments
+ * \param i Position of the first argument to remove
+ * \param n Number of arguments to remove
+ */
+void remove_args(int *argc,char **argv,size_t i,size_t n) {
+	size_t j;
+	for (j=i;j+n<=*argc;++j) argv[j]=argv[j+n];
+	*argc-=n;
+}
+
+/**
+ * \brief Check if a FUSE mount option is given on the command line
+ *
+ * \param argc Number of arguments
+ * \param argv Array of arguments
+ * \param name Name of the option, as written after -o
+ * \return 1 if one of the -o arguments holds the option, 0 otherwise
+ */
+int has_fuse_option(int argc,char **argv,const char *name) {
+	size_t len=strlen(name);
+	int i;
+	for (i=1;i<argc;++i) {
+		const char *opts;
+		if (strcmp(argv[i],"-o")==0 && i+1<argc) opts=argv[++i];
+		else if (strncmp(argv[i],"-o",2)==0) opts=argv[i]+2;
+		else continue;
+		while (opts!=0) {
+			if (strncmp(opts,name,len)==0 && (opts[len]=='=' || opts[len]==',' || opts[len]==0)) return 1;
+			opts=strchr(opts,',');
+			if (opts) ++opts;
+		}
+	}
+	return 0;
+}
+
+/**
+ * \brief Check if FUSE requests can be transported over io_uring
+ *
+ * FUSE over io_uring needs libfuse 3.18 or later and a kernel where the feature is compiled and enabled (fuse module parameter enable_uring). The function checks both and explains on the standard error why the classic /dev/fuse channel will be used otherwise.
+ * \return 1 if io_uring can be used, 0 otherwise
+ */
+int io_uring_supported() {
+	if (fuse_version()<FUSE_MAKE_VERSION(3,18)) {
+		fprintf(stderr,"io_uring: libfuse %d.%d does not support FUSE over io_uring, using /dev/fuse\n",fuse_version()/100,fuse_version()%100);
+		return 0;
+	}
+	FILE *f=fopen("/sys/module/fuse/parameters/enable_uring","r");
+	if (f==0) {
+		fprintf(stderr,"io_uring: Kernel does not support FUSE over io_uring, using /dev/fuse\n");
+		return 0;
+	}
+	int c=fgetc(f);
+	fclose(f);
+	if (c!='Y' && c!='y' && c!='1') {
+		fprintf(stderr,"io_uring: FUSE over io_uring is disabled in the kernel (fuse.enable_uring=0), using /dev/fuse\n");
+		return 0;
+	}
+	return 1;
+}
+
 /**
  * \brief Transform an absolute path in the virtual file system in a path relative to the mirror file system
  *
@@ -115,29 +259,356 @@ void tokenize(char *s,char ***tokens) {
 	(*tokens)[num]=0;
 }
 
+/**
+ * \brief Execution of a script whose output is not in any cache
+ */
+typedef struct OutputJob {
+	char relative[FILENAME_MAX_LENGTH];	//!< Path of the script relative to the mirror folder
+	Procedure *proc;	//!< Procedure of the script
+	Mount *mount;	//!< Mount of the script
+	struct stat source;	//!< Attributes of the script, as given by cache_lookup
+	SharedKey key;	//!< Key of the output in the shared cache
+	int shared;	//!< Non-zero if the output goes to the shared cache
+	int lock;	//!< Lock of the output in the shared cache, -1 if it is not locked
+	RemoteKey rkey;	//!< Key of the output in the remote cache
+	int remote;	//!< Non-zero if the output goes to the remote cache
+	int nested;	//!< Non-zero if the request comes from a script
+	int want_digest;	//!< Non-zero if the requester needs the digest of the output
+	uint64_t digest;	//!< Digest of the output, 0 if it was not computed
+	int handle;	//!< Descriptor of the output, the temporary file before the execution
+	int done;	//!< Non-zero once the output was generated and stored in the caches
+	int abandoned;	//!< Non-zero if the request was interrupted, the thread of the generation then releases it
+	pthread_mutex_t mutex;	//!< Protects done and abandoned
+	pthread_cond_t cond;	//!< Signals the end of the generation
+} OutputJob;
+
+/**
+ * \brief Compute the digest of an output if anything needs it
+ *
+ * The digest is computed once for the cache, the generation times and the compressed sibling.
+ * \param proc Procedure of the script
+ * \param source Attributes of the script, as given by cache_lookup
+ * \param handle Descriptor of the output
+ * \param wanted Non-zero if the requester needs the digest
+ * \return Digest of the output, 0 if nothing needs it
+ */
+static uint64_t output_digest(Procedure *proc, const struct stat *source, int handle, int wanted) {
+	if (!wanted && !persistent.generation_times && (cache_mode(proc) == CACHE_NEVER || source->st_ino == 0)) return 0;
+	return digest_fd(handle);
+}
+
+/**
+ * \brief Execute a script and store its output in the caches
+ *
+ * \param g Job of the output, which digest is set
+ * \return Descriptor of the output, -EINTR if the request was interrupted before the script was over (nothing is recorded then)
+ */
+static int generate(OutputJob *g) {
+	int handle = g->handle;
+	if (acquire_job_slot(g->nested) != 0) {	// Interrupted while waiting for a slot
+		close(handle);
+		shared_unlock(&g->key, g->lock);
+		return -EINTR;
+	}
+	execution_cpu();	// Forget the executions of the tests
+	execution_cancelled();
+	long long start = now_ms();
+	g->proc->program->func(g->proc->program, g->relative, handle);
+	long long duration = now_ms() - start;
+	release_job_slot(g->nested, duration);
+	if (execution_cancelled()) {	// The output is truncated, or still being written during the grace period: record nothing
+		close(handle);
+		shared_unlock(&g->key, g->lock);
+		return -EINTR;
+	}
+	handle = spool_output(handle);
+	g->digest = output_digest(g->proc, &g->source, handle, g->want_digest);
+	record_generation(g->relative, g->digest);
+	STAT_ADD(executions, 1);
+	__atomic_add_fetch(&current_mount()->executions, 1, __ATOMIC_RELAXED);
+	hot_add(HOT_EXECUTIONS, g->relative, 1);
+	hot_add(HOT_CPU, g->relative, execution_cpu());
+	struct stat output;
+	if (fstat(handle, &output) == 0) STAT_ADD(bytes_generated, output.st_size);
+	int ttl = cache_store(g->relative, g->proc, &g->source, handle, g->digest, duration);
+	if (g->shared && ttl >= 0) shared_store(&g->key, handle, ttl);
+	if (g->remote) remote_put(&g->rkey, handle);
+	shared_unlock(&g->key, g->lock);
+	return handle;
+}
+
+/**
+ * \brief Thread of a generation which survives the interruption of its request
+ *
+ * \param arg Pointer to the OutputJob structure
+ * \return Null pointer
+ */
+static void *generation_thread(void *arg) {
+	OutputJob *g = (OutputJob*)arg;
+	set_thread_mount(g->mount);
+	keep_executions(1);
+	int handle = generate(g);
+	pthread_mutex_lock(&g->mutex);
+	g->handle = handle;
+	g->done = 1;
+	int abandoned = g->abandoned;
+	pthread_cond_signal(&g->cond);
+	pthread_mutex_unlock(&g->mutex);
+	if (abandoned) {	// The output is in the cache, nobody reads this descriptor
+		if (handle >= 0) close(handle);
+		pthread_mutex_destroy(&g->mutex);
+		pthread_cond_destroy(&g->cond);
+		free(g);
+	}
+	return 0;
+}
+
+/**
+ * \brief Execute a script on a thread of its own, and wait for it unless the request is interrupted
+ *
+ * If the request is interrupted, the function replies -EINTR at once and the generation goes on in the background, so that its output still fills the caches. If the thread cannot be created, the script is executed on the thread of the request.
+ * \param g Job of the output, released by the function
+ * \param digest Set to the digest of the output, 0 if it was not computed
+ * \return Descriptor of the output, -EINTR if the request was interrupted
+ */
+static int generate_detached(OutputJob *g, uint64_t *digest) {
+	pthread_t thread;
+	pthread_mutex_init(&g->mutex, 0);
+	pthread_cond_init(&g->cond, 0);
+	if (pthread_create(&thread, 0, generation_thread, g) != 0) {
+		keep_executions(1);
+		int handle = generate(g);
+		keep_executions(0);
+		*digest = g->digest;
+		pthread_mutex_destroy(&g->mutex);
+		pthread_cond_destroy(&g->cond);
+		free(g);
+		return handle;
+	}
+	pthread_detach(thread);
+	pthread_mutex_lock(&g->mutex);
+	while (!g->done) {
+		struct timespec ts;
+		clock_gettime(CLOCK_REALTIME, &ts);
+		ts.tv_nsec += GENERATION_POLL*1000000L;
+		if (ts.tv_nsec >= 1000000000L) {ts.tv_sec++; ts.tv_nsec -= 1000000000L;}
+		pthread_cond_timedwait(&g->cond, &g->mutex, &ts);
+		if (!g->done && fuse_interrupted()) {
+			g->abandoned = 1;
+			pthread_mutex_unlock(&g->mutex);
+			STAT_ADD(cancel_spared, 1);
+			return -EINTR;
+		}
+	}
+	pthread_mutex_unlock(&g->mutex);
+	int handle = g->handle;
+	*digest = g->digest;
+	pthread_mutex_destroy(&g->mutex);
+	pthread_cond_destroy(&g->cond);
+	free(g);
+	return handle;
+}
+
 /**
  * \brief Run a script and return a handle to the output
  *
  * Given a script whose "relative path" has already been ascertained, run it and return a handle
  * to the (open) temporary file containing its output. The file will be unlinked so it will disappear
- * once closed.
+ * once closed. If the procedure caches outputs, the cached output is returned when it is still valid,
+ * and the new output is recorded in the cache otherwise. The handle must be read with pread since a
+ * cached output is shared by several handles. Nested requests, which come from scripts reading the
+ * file system, do not wait for an execution slot and may get an expired output with --nested-cache.
+ * With a shared cache, the outputs published by the other instances of the host are used too, and
+ * an output expected to be cached is generated by only one instance at a time. The outputs of the
+ * procedures which cache them forever are also looked for in the remote cache, and sent to it.
+ * An output expected to be cached is generated on a thread of its own: if the request is interrupted,
+ * it gets -EINTR at once while the generation completes in the background and fills the caches.
  * \param relative Name of script in path relative to virtual filesystem
  * \param proc Pointer to Procedure struct of relevant script
  * \param fi File info structure
+ * \param nested Non-zero if the request comes from a script (see nested_request)
+ * \param digest If not null, set to the digest of the output (see digest_fd) when it was computed, 0 otherwise
  * \return Negative error code, else handle if everything went fine
  */
-int run_script(const char *relative, Procedure *proc, struct fuse_file_info *fi) {
+int run_script(const char *relative, Procedure *proc, struct fuse_file_info *fi, int nested, uint64_t *digest) {
 #ifdef TRACE
-	fprintf(stderr,"run_script(%s, %p, %p)\n", relative, proc, fi);
+	fprintf(stderr,"run_script(%s, %p, %p, %d, %p)\n", relative, proc, fi, nested, digest);
 #endif
+	uint64_t computed = 0;
+	if (digest == 0) digest = &computed;
+	*digest = 0;
+	struct stat source;
+	int handle = cache_lookup(relative, proc, &source, nested && persistent.nested_cache);
+	if (handle >= 0) {
+		if (nested) STAT_ADD(nested_cache_hits, 1);
+		if (fi) fi->direct_io=1;
+		return handle;
+	}
+	SharedKey key;
+	int shared = (shared_key(relative, proc, &source, &key) == 0);
+	int lock = -1;
+	if (shared) {
+		handle = shared_lookup(&key);
+		if (handle < 0 && !nested && cache_expected(relative, proc)) {	// Another instance may be generating the same output, wait for it rather than generating it again
+			lock = shared_lock(&key);
+			handle = shared_lookup(&key);
+		}
+		if (handle >= 0) {
+			shared_unlock(&key, lock);
+			if (fi) fi->direct_io=1;
+			return handle;
+		}
+	}
+	RemoteKey rkey;
+	int remote = (remote_key(relative, proc, &rkey) == 0);
+	if (remote && (handle = remote_get(&rkey)) >= 0) {	// Generated by another host, keep it as if it was generated here
+		handle = spool_output(handle);
+		*digest = output_digest(proc, &source, handle, digest != &computed);
+		record_generation(relative, *digest);
+		int ttl = cache_store(relative, proc, &source, handle, *digest, 0);
+		if (shared && ttl >= 0) shared_store(&key, handle, ttl);
+		shared_unlock(&key, lock);
+		if (fi) fi->direct_io=1;
+		return handle;
+	}
+	if ((handle = spool_create()) < 0) {	// The output goes directly to the huge page spool if there is one
+		char temp_filename[sizeof(persistent.tmp_template)];
+		strncpy(temp_filename, persistent.tmp_template, sizeof temp_filename-1);
+		temp_filename[sizeof temp_filename-1] = 0;
+		handle = mkstemp(temp_filename);
+		if (handle <= 0) {
+			int code = errno;
+			shared_unlock(&key, lock);
+			return -code;
+		}
+		unlink(temp_filename);
+	}
+	OutputJob *g = (OutputJob*)calloc(1, sizeof(OutputJob));
+	if (g == 0) {
+		close(handle);
+		shared_unlock(&key, lock);
+		return -ENOMEM;
+	}
+	strncpy(g->relative, relative, sizeof g->relative-1);
+	g->proc = proc;
+	g->mount = current_mount();
+	g->source = source;
+	g->key = key;
+	g->shared = shared;
+	g->lock = lock;
+	g->rkey = rkey;
+	g->remote = remote;
+	g->nested = nested;
+	g->want_digest = (digest != &computed);
+	g->handle = handle;
+	if (cache_expected(relative, proc)) handle = generate_detached(g, digest);	// An interrupted request does not waste an output which will be cached
+	else {
+		handle = generate(g);
+		*digest = g->digest;
+		free(g);
+	}
+	if (handle >= 0 && fi) fi->direct_io=1;	// Force use of FUSE read on this file and do not take into account
+	return handle;
+}
+
+/**
+ * \brief Measure the size of the output of a script
+ *
+ * This function is used when the index of an immutable mirror is built with the -l option.
+ * \param relative Path of the script relative to the mirror folder
+ * \param proc Procedure of the script
+ * \return Size of the output, -1 if the script could not be run
+ */
+off_t measure_script(const char *relative,Procedure *proc) {
+	int handle=run_script(relative,proc,0,0,0);
+	if (handle<=0) return -1;
+	struct stat st;
+	int code=fstat(handle,&st);
+	close(handle);
+	return (code==0)?st.st_size:-1;
+}
+
+/**
+ * \brief Tell if the current request comes from a script
+ *
+ * A request is nested if the calling process is a descendant of one of the processes started by the file system, for example a script which reads the output of another script of the mount point.
+ * \return 1 if the request is nested, 0 otherwise
+ */
+int nested_request() {
+	struct fuse_context *context=(__atomic_load_n(&sessions,__ATOMIC_RELAXED)>0)?fuse_get_context():0;	// Outside of the sessions, libfuse has no context
+	if (context==0 || context->pid<=0) return 0;
+	return is_descendant(context->pid);
+}
+
+/**
+ * \brief Fill the handle structure of an opened output
+ *
+ * If the output is not larger than persistent.inline_max, it is copied in memory and its file is closed: the reads are then served without any system call, and the opened file does not hold a descriptor.
+ * \param fs Structure of the opened file
+ * \param handle Descriptor of the output, closed if the output is kept in memory
+ * \return 1 if the output is kept in memory, 0 otherwise
+ */
+static int set_output(FileStruct *fs,int handle) {
+	fs->file_handle=handle;
+	fs->data=0;
+	fs->data_size=0;
+	struct stat st;
+	if (persistent.inline_max==0 || fstat(handle,&st)!=0 || (size_t)st.st_size>persistent.inline_max) return 0;
+	char *data=(char*)malloc(st.st_size+1);
+	if (data==0) return 0;
+	size_t done=0;
+	while (done<(size_t)st.st_size) {
+		ssize_t num=pread(handle,data+done,st.st_size-done,done);
+		if (num<0 && errno==EINTR) continue;
+		if (num<=0) break;
+		done+=num;
+	}
+	if (done<(size_t)st.st_size) {	// Keep reading from the file
+		free(data);
+		return 0;
+	}
+	close(handle);
+	fs->file_handle=-1;
+	fs->data=data;
+	fs->data_size=done;
+	return 1;
+}
+
+/**
+ * \brief Tell if a virtual path belongs to the control folder
+ *
+ * \param path Virtual path of a file
+ * \return Null if the path is not in the control folder (or control files are disabled), an empty string for the control folder itself, the name of the file in the control folder otherwise
+ */
+const char *control_name(const char *path) {
+	size_t len=strlen(CONTROL_FOLDER);
+	if (!persistent.control || path==0 || strncmp(path,CONTROL_FOLDER,len)!=0) return 0;
+	if (path[len]==0) return "";
+	if (path[len]!='/' || strchr(path+len+1,'/')!=0) return 0;
+	return path+len+1;
+}
+
+/**
+ * \brief Generate the content of a control file
+ *
+ * The content is written on an unlinked temporary file, like the output of a script.
+ * \param control Control file
+ * \return Negative error code, else handle of the temporary file
+ */
+int render_control(const ControlFile *control) {
 	char temp_filename[sizeof(persistent.tmp_template)];
 	strncpy(temp_filename, persistent.tmp_template, sizeof temp_filename-1);
 	temp_filename[sizeof temp_filename-1] = 0;
 	int handle = mkstemp(temp_filename);
 	if (handle <= 0) return -errno;
 	unlink(temp_filename);
-	proc->program->func(proc->program, relative, handle);
-	if (fi) fi->direct_io=1;	// Force use of FUSE read on this file and do not take into account
+	FILE *f = fdopen(dup(handle), "w");
+	if (f == 0) {
+		close(handle);
+		return -errno;
+	}
+	control->render(f);
+	fclose(f);
 	return handle;
 }
 
@@ -147,7 +618,7 @@ int run_script(const char *relative, Procedure *proc, struct fuse_file_info *fi)
  * This function does all the technical stuff which has to be done before the start of the program. In particular, it allocates storage for the structures in memory and defines some of the callback functions used when a script is executed. The fuse_conn_info structure tells which capabilities FUSE provides and which one are needed and activated by the client. The function returns a pointer which will be available in all file operations later.
  * \param conn Capabilities requested by the application
  * \param cfg Fuse configuration
- * \return Pointer to a persistent structure, available in future file operations
+ * \return Mount served by the session, available in future file operations
  */
 void *sfs_init(struct fuse_conn_info *conn,
 	       struct fuse_config *cfg) {
@@ -156,7 +627,18 @@ void *sfs_init(struct fuse_conn_info *conn,
 #endif
 	// Setup connection
 	conn->want=0;
-	return 0;
+	if ((persistent.return_real_size || persistent.immutable) && (conn->capable & FUSE_CAP_READDIRPLUS)) conn->want|=FUSE_CAP_READDIRPLUS;	// Give the attributes with the entries, so that the sizes are computed in parallel (if the kernel supports it)
+	if (persistent.immutable) {	// The mirror never changes, the kernel may keep the entries and attributes forever
+		cfg->entry_timeout=IMMUTABLE_TIMEOUT;
+		cfg->attr_timeout=IMMUTABLE_TIMEOUT;
+		cfg->negative_timeout=IMMUTABLE_TIMEOUT;
+	}
+	if (__atomic_fetch_add(&sessions,1,__ATOMIC_SEQ_CST)==0) {	// The first session starts the shared services
+		start_supervisor(fuse_interrupted);
+		start_group_commit();
+		start_handover();
+	}
+	return fuse_get_context()->private_data;
 }
 
 /**
@@ -169,45 +651,151 @@ void sfs_destroy(void *private_data) {
 #ifdef TRACE
 	fprintf(stderr,"sfs_destroy\n");
 #endif
+	if (__atomic_sub_fetch(&sessions,1,__ATOMIC_SEQ_CST)==0) {	// The last session stops the shared services
+		stop_handover();
+		stop_group_commit();
+		stop_supervisor();
+	}
 }
 
 /**
- * \brief Get the attributes of a file on the virtual filesystem
+ * \brief Find the script of a compressed sibling
  *
- * This function loads the attributes of a chosen file and stores it in the stbuf variable. It is used if no file handle is provided through a fuse_file_info structure.
- * \param path Virtual path of the file on the remote file system
+ * A path names a compressed sibling if it does not exist in the mirror, and if removing its suffix gives a regular file which is a script of a procedure offering this format (see the compress procedure option). With --immutable, the index stands for the mirror.
+ * \param relative Path relative to the mirror folder
+ * \param base Buffer receiving the path of the script
+ * \param size Size of the buffer
+ * \param compression Set to the format of the sibling (see enum Compression)
+ * \return Procedure of the script, null if the path is not a compressed sibling
+ */
+static Procedure *compressed_sibling(const char *relative,char *base,size_t size,int *compression) {
+	struct stat st;
+	int format=sibling_base(relative,base,size);
+	*compression=COMPRESS_NONE;
+	if (format==COMPRESS_NONE) return 0;
+	Procedure *proc;
+	if (persistent.immutable) {
+		const IndexEntry *e;
+		if (find_index(relative)!=0 || (e=find_index(base))==0 || !S_ISREG(e->st.st_mode)) return 0;
+		proc=e->proc;
+	} else {
+		if (fstatat(current_mount()->mirror_fd,relative,&st,AT_SYMLINK_NOFOLLOW)==0 || errno!=ENOENT) return 0;	// A file of the mirror hides the sibling
+		if (fstatat(current_mount()->mirror_fd,base,&st,AT_SYMLINK_NOFOLLOW)!=0 || !S_ISREG(st.st_mode)) return 0;
+		proc=get_script(current_mount()->procs,base);
+	}
+	if (proc==0 || proc->compress!=format) return 0;
+	*compression=format;
+	return proc;
+}
+
+/**
+ * \brief Get the attributes of a file of the mirror as they appear in the virtual file system
+ *
+ * This function loads the attributes of a file of the mirror file system. If the file is a script, write access is removed and, if the real size of scripts is requested, the script is executed to measure the size of its output. With --generation-times, the times of a script are those of its output (see generation_times). A compressed sibling gets the attributes of its script, and the size of the compressed output if the real size is requested.
+ * \param relative Path of the file relative to the mirror folder
  * \param stbuf Structure in which the attributes will be stored
- * \param fi File info structure (not used)
+ * \param nested Non-zero if the request comes from a script
+ * \param stated Non-zero if stbuf already holds the attributes of the file in the mirror (see readdir_plus), which are then not read again
  * \return Error code, 0 if everything went fine
  */
-int sfs_getattr(const char *path,struct stat *stbuf, struct fuse_file_info *fi) {
-#ifdef TRACE
-	fprintf(stderr,"sfs_getattr(%s)\n",path);
-#endif
-	int code;
-	if (path) {
-		Procedure *proc = NULL;
-		char *relative=relative_path(path);
-		code=fstatat(persistent.mirror_fd,relative,stbuf,AT_SYMLINK_NOFOLLOW);
-		if (!code && S_ISREG(stbuf->st_mode) && (proc = get_script(persistent.procs, relative))) {
-			// If the file is a script, remove write access to everyone (for now we don't handle writing on scripts)
-			stbuf->st_mode &= (~(S_IWUSR | S_IWGRP | S_IWOTH));
-			// If we want the actual size of the output, have to run the script and look
-			if (persistent.return_real_size) {
+int get_attributes(const char *relative,struct stat *stbuf,int nested,int stated) {
+	Procedure *proc = NULL;
+	int code=stated?0:fstatat(current_mount()->mirror_fd,relative,stbuf,AT_SYMLINK_NOFOLLOW);
+	if (code) {
+		int error = errno;
+		char base[FILENAME_MAX_LENGTH];
+		int compression;
+		if (error != ENOENT || (proc = compressed_sibling(relative, base, sizeof base, &compression)) == NULL) return -error;
+		if (fstatat(current_mount()->mirror_fd, base, stbuf, AT_SYMLINK_NOFOLLOW)) return -errno;
+		stbuf->st_mode &= (~(S_IWUSR | S_IWGRP | S_IWOTH));
+		if (persistent.return_real_size) {
+			uint64_t digest;
+			int handle = run_script(base, proc, 0, nested, &digest);
+			if (handle > 0) handle = compress_output(base, compression, handle, digest);
+			if (handle > 0) {
 				struct stat realsize;
+				if (fstat(handle, &realsize) == 0) stbuf->st_size = realsize.st_size;
+				close(handle);
+			}
+		}
+		generation_times(base, stbuf);
+		return 0;
+	}
+	if (S_ISREG(stbuf->st_mode) && (proc = get_script(current_mount()->procs, relative))) {
+		// If the file is a script, remove write access to everyone (for now we don't handle writing on scripts)
+		stbuf->st_mode &= (~(S_IWUSR | S_IWGRP | S_IWOTH));
+		// If we want the actual size of the output, have to run the script and look
+		if (persistent.return_real_size) {
+			struct stat realsize;
 
-				int handle = run_script(relative, proc, fi);
+			int handle = run_script(relative, proc, 0, nested, 0);
+			if (handle > 0) {
 				int rstat_code = fstat(handle, &realsize);
 				if (!rstat_code) {
 #ifdef TRACE
-					fprintf(stderr, "sfs_getattr: Changing size from %ld to %zu\n", stbuf->st_size, realsize.st_size);
+					fprintf(stderr, "get_attributes: Changing size from %ld to %zu\n", stbuf->st_size, realsize.st_size);
 #endif
 					stbuf->st_size = realsize.st_size;
 				}
 				close(handle);
 			}
 		}
+		generation_times(relative, stbuf);
+	}
+	return 0;
+}
+
+/**
+ * \brief Get the attributes of a file on the virtual filesystem
+ *
+ * This function loads the attributes of a chosen file and stores it in the stbuf variable. It is used if no file handle is provided through a fuse_file_info structure.
+ * \param path Virtual path of the file on the remote file system
+ * \param stbuf Structure in which the attributes will be stored
+ * \param fi File info structure (not used)
+ * \return Error code, 0 if everything went fine
+ */
+int sfs_getattr(const char *path,struct stat *stbuf, struct fuse_file_info *fi) {
+#ifdef TRACE
+	fprintf(stderr,"sfs_getattr(%s)\n",path);
+#endif
+	int code;
+	const char *control=control_name(path);
+	if (control) {	// Virtual control folder and files
+		memset(stbuf,0,sizeof(struct stat));
+		stbuf->st_uid=uid;
+		stbuf->st_gid=gid;
+		clock_gettime(CLOCK_REALTIME,&stbuf->st_mtim);
+		stbuf->st_atim=stbuf->st_ctim=stbuf->st_mtim;
+		if (*control==0) {
+			stbuf->st_mode=S_IFDIR | 0555;
+			stbuf->st_nlink=2;
+		} else if (get_control_file(control)) {
+			stbuf->st_mode=S_IFREG | 0444;
+			stbuf->st_nlink=1;
+		} else return -ENOENT;
+		return 0;
+	}
+	if (path && persistent.immutable) {
+		char *relative=relative_path(path);
+		hot_add(HOT_LOOKUPS,relative,1);
+		const IndexEntry *e=find_index(relative);
+		char base[FILENAME_MAX_LENGTH];
+		if (e==0 && sibling_base(relative,base,sizeof base)!=COMPRESS_NONE) {	// Compressed siblings are not indexed
+			code=get_attributes(relative,stbuf,persistent.return_real_size && nested_request(),0);
+			free(relative);
+			return code;
+		}
 		free(relative);
+		if (e==0) return -ENOENT;
+		*stbuf=e->st;
+		return 0;
+	}
+	if (path) {
+		char *relative=relative_path(path);
+		hot_add(HOT_LOOKUPS,relative,1);
+		code=get_attributes(relative,stbuf,persistent.return_real_size && nested_request(),0);
+		free(relative);
+		return code;
 	} else {
 		if (fi==NULL) return -EBADF;
 		code=fstat(fi->fh, stbuf);
@@ -227,13 +815,19 @@ int sfs_access(const char *path,int mask) {
 #ifdef TRACE
 	fprintf(stderr,"sfs_access(%s,%o)\n",path,mask);
 #endif
+	const char *control=control_name(path);
+	if (control) {
+		if (*control!=0 && get_control_file(control)==0) return -ENOENT;
+		return ((mask & W_OK)!=0)?-EACCES:0;
+	}
+	if (persistent.immutable && (mask & W_OK)!=0) return -EROFS;
 	char *relative=relative_path(path);
-	int code=faccessat(persistent.mirror_fd,relative,mask,0);
+	int code=faccessat(current_mount()->mirror_fd,relative,mask,0);
 	if (code==0 && (mask & W_OK)!=0) {	// If write-acess is requested, check if the file is a regular file and not a script, because for the moment we don't handle writing on scripts
 		struct stat stbuf;
-		int code2=fstatat(persistent.mirror_fd,relative,&stbuf,0);
+		int code2=fstatat(current_mount()->mirror_fd,relative,&stbuf,0);
 		if (code2!=0) {free(relative);return -code2;}	// Normally, that should not happen
-		if (S_ISREG(stbuf.st_mode) && get_script(persistent.procs,relative)!=0) {free(relative);return -1;}
+		if (S_ISREG(stbuf.st_mode) && get_script(current_mount()->procs,relative)!=0) {free(relative);return -1;}
 	}
 	free(relative);
 	return (code==0)?0:-errno;
@@ -254,7 +848,7 @@ int sfs_readlink(const char *path,char *buf,size_t size) {
 	fprintf(stderr,"sfs_readlink(%s,%p,%zi)\n",path,(void*)buf,size);
 #endif
 	char *relative=relative_path(path);
-	ssize_t length=readlinkat(persistent.mirror_fd,relative,buf,size-1);
+	ssize_t length=readlinkat(current_mount()->mirror_fd,relative,buf,size-1);
 	free(relative);
 	if (length<0) return -errno;
 	buf[length]=0;
@@ -273,8 +867,19 @@ int sfs_opendir(const char *path, struct fuse_file_info *fi) {
 #ifdef TRACE
 	fprintf(stderr,"sfs_opendir(%s,%p)\n",path,(fi==0)?0:(void*)(long)(fi->fh));
 #endif
+	const char *control=control_name(path);
+	if (control) {	// The control folder has no directory flow
+		if (*control!=0) return -ENOTDIR;
+		FileStruct *fs=(FileStruct*)malloc(sizeof(FileStruct));
+		fs->type=T_FOLDER;
+		fs->dir_handle=0;
+		strncpy(fs->filename,CONTROL_FOLDER,FILENAME_MAX_LENGTH-1);
+		fs->filename[FILENAME_MAX_LENGTH-1]=0;
+		fi->fh=(long)(fs);
+		return 0;
+	}
 	char *relative=relative_path(path);
-	int fd=openat(persistent.mirror_fd,relative,O_RDONLY);
+	int fd=openat(current_mount()->mirror_fd,relative,O_RDONLY);
 	if (fd<0) {
 		free(relative);
 		return -errno;
@@ -294,6 +899,133 @@ int sfs_opendir(const char *path, struct fuse_file_info *fi) {
 	return 0;
 }
 
+/**
+ * \brief Entry of a directory read by readdir_plus
+ */
+typedef struct DirEntry {
+	char name[FILENAME_MAX_LENGTH];	//!< Path of the entry relative to the mirror folder
+	size_t base;	//!< Position of the name of the entry (without the folder) in name
+	struct stat st;	//!< Attributes of the entry as they appear in the virtual file system
+	int code;	//!< Result of get_attributes for the entry, 1 before it is called (2 if the attributes in the mirror were already read by readdir_plus_statx), negative error code if the attributes cannot be given
+	int nested;	//!< Non-zero if the directory is read by a script
+	Mount *mount;	//!< Mount of the directory
+} DirEntry;
+
+/**
+ * \brief Job of readdir_plus which gets the attributes of one entry
+ *
+ * \param arg Array of DirEntry structures
+ * \param i Index of the entry in the array
+ */
+static void readdir_plus_job(void *arg,size_t i) {
+	DirEntry *entry=((DirEntry*)arg)+i;
+	if (entry->code<=0) return;
+	set_thread_mount(entry->mount);	// The job may run on a helper thread, which serves no FUSE request
+	entry->code=get_attributes(entry->name,&entry->st,entry->nested,entry->code==2);
+	set_thread_mount(0);
+}
+
+/**
+ * \brief Read the attributes in the mirror of all the entries of a directory at once
+ *
+ * The statx requests of all the entries are submitted together on the io_uring ring of the thread (see uring_statx), instead of one fstatat per entry in the jobs of readdir_plus. The entries which attributes could not be read this way keep the code 1, and get_attributes reads them again.
+ * \param entries Array of the entries
+ * \param num Number of entries
+ * \param mount Mount of the directory
+ */
+static void readdir_plus_statx(DirEntry *entries,size_t num,Mount *mount) {
+	const char **paths=(const char**)malloc(num*sizeof(char*));
+	struct stat *st=(struct stat*)malloc(num*sizeof(struct stat));
+	int *codes=(int*)malloc(num*sizeof(int));
+	size_t *indexes=(size_t*)malloc(num*sizeof(size_t));
+	size_t n=0,i;
+	if (paths && st && codes && indexes) {
+		for (i=0;i<num;++i) if (entries[i].code==1) {
+			indexes[n]=i;
+			paths[n++]=entries[i].name;
+		}
+		if (n>0 && uring_statx(mount->mirror_fd,paths,st,codes,n)==0) {
+			for (i=0;i<n;++i) if (codes[i]==0) {
+				entries[indexes[i]].st=st[i];
+				entries[indexes[i]].code=2;
+			}
+		}
+	}
+	free(paths);
+	free(st);
+	free(codes);
+	free(indexes);
+}
+
+/**
+ * \brief Read the content of a directory with the attributes of its entries
+ *
+ * This function is used instead of the simple listing when the kernel asks for the attributes of the entries together with their names and the real size of scripts is requested. Instead of letting the kernel ask the attributes of each entry one after the other, which runs one script at a time, it computes the attributes of all the entries in parallel (at most persistent.size_jobs at once), then returns the entries in the order of the directory. With --mirror-uring, the attributes of all the entries in the mirror are first read with one batch of statx requests (see readdir_plus_statx).
+ * \param fs Structure of the opened directory
+ * \param buf Buffer given by FUSE
+ * \param filler Filler function provided by the FUSE system
+ * \return 0 if everything went fine, another value otherwise
+ */
+static int readdir_plus(FileStruct *fs,void *buf,fuse_fill_dir_t filler) {
+	DIR *handle=(DIR*)(fs->dir_handle);
+	size_t num=0,size=0x40,i;
+	DirEntry *entries=(DirEntry*)malloc(size*sizeof(DirEntry));
+	if (entries==0) return -ENOMEM;
+	struct dirent* entry;
+	const char *folder=(strcmp(fs->filename,".")==0)?"":fs->filename;
+	int nested=nested_request();	// The jobs do not run on the thread of the request
+	Mount *mount=current_mount();
+	for (;;) {
+		errno=0;
+		entry=readdir(handle);
+		if (entry==0) break;
+		if (num==size) {
+			DirEntry *newentries=(DirEntry*)realloc(entries,2*size*sizeof(DirEntry));
+			if (newentries==0) {free(entries);return -ENOMEM;}
+			entries=newentries;
+			size*=2;
+		}
+		DirEntry *e=entries+num;
+		int len=snprintf(e->name,sizeof e->name,"%s%s%s",folder,(*folder)?"/":"",entry->d_name);
+		e->base=strlen(e->name)-strlen(entry->d_name);
+		e->nested=nested;
+		e->mount=mount;
+		e->code=(len>=sizeof e->name)?-ENAMETOOLONG:1;
+		if (strcmp(entry->d_name,".")==0 || strcmp(entry->d_name,"..")==0) e->code=-ENOENT;	// Their attributes are not given by readdir
+		++num;
+	}
+	int code=-errno;
+	if (code==0) {
+		if (persistent.uring_depth>0) readdir_plus_statx(entries,num,mount);
+		parallel_for(num,persistent.size_jobs,readdir_plus_job,entries);
+		for (i=0;i<num;++i) {
+			if (entries[i].code==0) filler(buf,entries[i].name+entries[i].base,&entries[i].st,0,FUSE_FILL_DIR_PLUS);
+			else filler(buf,entries[i].name+entries[i].base,0,0,0);
+		}
+	}
+	free(entries);
+	return code;
+}
+
+/**
+ * \brief Read the content of a directory from the index of an immutable mirror
+ *
+ * The entries and their attributes are given by the index built at mount time, the mirror is not read.
+ * \param fs Structure of the opened directory
+ * \param buf Buffer given by FUSE
+ * \param filler Filler function provided by the FUSE system
+ * \return 0 if everything went fine, another value otherwise
+ */
+static int readdir_index(FileStruct *fs,void *buf,fuse_fill_dir_t filler) {
+	const IndexEntry *folder=find_index(fs->filename);
+	if (folder==0) return -ENOENT;
+	size_t i;
+	filler(buf,".",0,0,0);
+	filler(buf,"..",0,0,0);
+	for (i=0;i<folder->num_children;++i) filler(buf,folder->children[i]->name,&folder->children[i]->st,0,FUSE_FILL_DIR_PLUS);
+	return 0;
+}
+
 /**
  * \brief Read the content of a directory
  *
@@ -303,7 +1035,7 @@ int sfs_opendir(const char *path, struct fuse_file_info *fi) {
  * \param filler Filler function provided by the FUSE system
  * \param offset Offset of the next directory entry, in the case files are provided one by one
  * \param fi File information structure
- * \param rf Readdir flags for plus mode (not used)
+ * \param rf Readdir flags for plus mode (see readdir_plus)
  * \return 0 if there are no more files or if the filler function returned a non-null value, another value otherwise
  */
 int sfs_readdir(const char *path, void *buf, fuse_fill_dir_t filler, off_t offset,
@@ -311,11 +1043,19 @@ int sfs_readdir(const char *path, void *buf, fuse_fill_dir_t filler, off_t offse
 #ifdef TRACE
 	fprintf(stderr,"sfs_readdir(%s,%p)\n",path,(fi==0)?0:(void*)(long)(fi->fh));
 #endif
-	(void) rf;
 	if (fi==0 || fi->fh==0) return -EBADF;
 	FileStruct *fs=(FileStruct*)(long)(fi->fh);
 	if (fs->type!=T_FOLDER) return -ENOTDIR;
 	DIR *handle=(DIR*)(fs->dir_handle);
+	if (handle==0) {	// Control folder
+		const ControlFile *c;
+		filler(buf,".",0,0,0);
+		filler(buf,"..",0,0,0);
+		for (c=control_files;c->name!=0;++c) filler(buf,c->name,0,0,0);
+		return 0;
+	}
+	if (persistent.immutable) return readdir_index(fs,buf,filler);
+	if (persistent.return_real_size && (rf & FUSE_READDIR_PLUS)) return readdir_plus(fs,buf,filler);
 	struct dirent* entry;
 	do {
 		errno=0;
@@ -343,6 +1083,7 @@ int sfs_releasedir(const char *path,struct fuse_file_info *fi) {
 	if (fs->type!=T_FOLDER) return -ENOTDIR;
 	DIR *handle=(DIR*)(fs->dir_handle);
 	free(fs);
+	if (handle==0) return 0;	// Control folder
 	int code=closedir(handle);
 	return (code==0)?0:-errno;
 }
@@ -359,8 +1100,10 @@ int sfs_mkdir(const char *path,mode_t mode) {
 #ifdef TRACE
 	fprintf(stderr,"sfs_mkdir(%s,%X)\n",path,mode);
 #endif
+	if (persistent.immutable) return -EROFS;
+	if (control_name(path)) return -EACCES;
 	char *relative=relative_path(path);
-	int code=mkdirat(persistent.mirror_fd,relative,mode);
+	int code=mkdirat(current_mount()->mirror_fd,relative,mode);
 	free(relative);
 	return (code==0)?0:-errno;
 }
@@ -376,8 +1119,9 @@ int sfs_rmdir(const char *path) {
 #ifdef TRACE
 	fprintf(stderr,"sfs_rmdir(%s)\n",path);
 #endif
+	if (persistent.immutable) return -EROFS;
 	char *relative=relative_path(path);
-	int code=unlinkat(persistent.mirror_fd,relative,AT_REMOVEDIR);
+	int code=unlinkat(current_mount()->mirror_fd,relative,AT_REMOVEDIR);
 	free(relative);
 	return (code==0)?0:-errno;
 }
@@ -394,8 +1138,9 @@ int sfs_symlink(const char* to,const char *from) {
 #ifdef TRACE
 	fprintf(stderr,"sfs_symlink(%s,%s)\n",to,from);
 #endif
+	if (persistent.immutable) return -EROFS;
 	char *relative=relative_path(to);
-	int code=symlinkat(from,persistent.mirror_fd,relative);
+	int code=symlinkat(from,current_mount()->mirror_fd,relative);
 	free(relative);
 	return (code==0)?0:-errno;
 }
@@ -411,8 +1156,9 @@ int sfs_unlink(const char *path) {
 #ifdef  TRACE
 	fprintf(stderr,"sfs_unlink(%s)\n",path);
 #endif
+	if (persistent.immutable) return -EROFS;
 	char *relative=relative_path(path);
-	int code=unlinkat(persistent.mirror_fd,relative,0);
+	int code=unlinkat(current_mount()->mirror_fd,relative,0);
 	free(relative);
 	return (code==0)?0:-errno;
 }
@@ -429,9 +1175,10 @@ int sfs_link(const char* from,const char *to) {
 #ifdef TRACE
 	fprintf(stderr,"sfs_symlink(%s,%s)\n",from,to);
 #endif
+	if (persistent.immutable) return -EROFS;
 	char *relative_from=relative_path(from);
 	char *relative_to=relative_path(to);
-	int code=linkat(persistent.mirror_fd,relative_from,persistent.mirror_fd,relative_to,0);
+	int code=linkat(current_mount()->mirror_fd,relative_from,current_mount()->mirror_fd,relative_to,0);
 	free(relative_from);
 	free(relative_to);
 	return (code==0)?0:-errno;
@@ -450,9 +1197,10 @@ int sfs_rename(const char *from,const char *to, unsigned int flags) {
 #ifdef  TRACE
 	fprintf(stderr,"sfs_rename(%s,%s)\n",from,to);
 #endif
+	if (persistent.immutable) return -EROFS;
 	char *relative_from=relative_path(from);
 	char *relative_to=relative_path(to);
-	int code=renameat2(persistent.mirror_fd, relative_from, persistent.mirror_fd, relative_to, flags);
+	int code=renameat2(current_mount()->mirror_fd, relative_from, current_mount()->mirror_fd, relative_to, flags);
 	free(relative_from);
 	free(relative_to);
 	return (code==0)?0:-errno;
@@ -470,13 +1218,14 @@ int sfs_chmod(const char *path, mode_t mode, struct fuse_file_info *fi) {
 #ifdef TRACE
 	fprintf(stderr,"sfs_chmod(%s,%X)\n",path,mode);
 #endif
+	if (persistent.immutable) return -EROFS;
 	struct stat stbuf;
 	int code;
 	if (path) {
 		char *relative=relative_path(path);
-		code=fstatat(persistent.mirror_fd, relative, &stbuf, 0);
-		if (code==0 && S_ISREG(stbuf.st_mode) && (mode & (S_IWUSR | S_IWGRP | S_IWOTH))!=0 && get_script(persistent.procs,relative)!=0) mode&= (~(S_IWUSR | S_IWGRP | S_IWOTH));	// If the file is a script, remove write access to the requested permissions
-		code=fchmodat(persistent.mirror_fd, relative, mode, 0);
+		code=fstatat(current_mount()->mirror_fd, relative, &stbuf, 0);
+		if (code==0 && S_ISREG(stbuf.st_mode) && (mode & (S_IWUSR | S_IWGRP | S_IWOTH))!=0 && get_script(current_mount()->procs,relative)!=0) mode&= (~(S_IWUSR | S_IWGRP | S_IWOTH));	// If the file is a script, remove write access to the requested permissions
+		code=fchmodat(current_mount()->mirror_fd, relative, mode, 0);
 		free(relative);
 	} else {
 		if (fi==NULL) return -EBADF;
@@ -499,17 +1248,18 @@ int sfs_truncate(const char *path, off_t size, struct fuse_file_info *fi) {
 #ifdef TRACE
 	fprintf(stderr,"sfs_truncate(%s,%li)\n",path,(long)size);
 #endif
+	if (persistent.immutable) return -EROFS;
 	struct stat stbuf;
 	uint64_t fd;
 	int code;
 	if (path) {
 		char *relative=relative_path(path);
-		code=fstatat(persistent.mirror_fd,relative,&stbuf,0);
-		if (code==0 && S_ISREG(stbuf.st_mode) && get_script(persistent.procs,relative)!=0) {
+		code=fstatat(current_mount()->mirror_fd,relative,&stbuf,0);
+		if (code==0 && S_ISREG(stbuf.st_mode) && get_script(current_mount()->procs,relative)!=0) {
 			free(relative);
 			return -EACCES;
 		}	// Writing on a script is forbidden
-		fd=openat(persistent.mirror_fd,relative,O_WRONLY);
+		fd=openat(current_mount()->mirror_fd,relative,O_WRONLY);
 		free(relative);
 	} else {
 		if (fi == NULL) return -EBADF;
@@ -535,16 +1285,17 @@ int sfs_utimens(const char *path, const struct timespec ts[2], struct fuse_file_
 #ifdef TRACE
 	fprintf(stderr,"sfs_utimens(%s)\n",path);
 #endif
+	if (persistent.immutable) return -EROFS;
 	struct stat stbuf;
 	int code;
 	if (path) {
 		char *relative=relative_path(path);
-		code=fstatat(persistent.mirror_fd,relative,&stbuf,0);
-		if (code==0 && S_ISREG(stbuf.st_mode) && get_script(persistent.procs,relative)!=0) {
+		code=fstatat(current_mount()->mirror_fd,relative,&stbuf,0);
+		if (code==0 && S_ISREG(stbuf.st_mode) && get_script(current_mount()->procs,relative)!=0) {
 			free(relative);
 			return -EACCES;
 		}	// Writing on a script is forbidden
-		code=utimensat(persistent.mirror_fd, relative, ts, 0);
+		code=utimensat(current_mount()->mirror_fd, relative, ts, 0);
 		free(relative);
 	} else {
 		code = futimens(fi->fh, ts);
@@ -583,8 +1334,34 @@ int sfs_open(const char *path,struct fuse_file_info *fi) {
 #endif
 	int handle=0;
 	int typ=0;
+	const char *control=control_name(path);
+	if (control) {	// Control files are generated when they are opened, like scripts
+		const ControlFile *c=get_control_file(control);
+		if (c==0) return (*control==0)?-EISDIR:-ENOENT;
+		if ((fi->flags & O_WRONLY)!=0 || (fi->flags & O_RDWR)!=0) return -EACCES;
+		handle=render_control(c);
+		if (handle<=0) return handle;
+		fi->direct_io=1;
+		FileStruct *fs=(FileStruct*)malloc(sizeof(FileStruct));
+		fs->type=T_SCRIPT;
+		fs->hot_bytes=0;
+		set_output(fs,handle);
+		fs->dirty=0;
+		strncpy(fs->filename,path,FILENAME_MAX_LENGTH-1);
+		fs->filename[FILENAME_MAX_LENGTH-1]=0;
+		fi->fh=(long)fs;
+		return 0;
+	}
+	if (persistent.immutable && ((fi->flags & O_WRONLY)!=0 || (fi->flags & O_RDWR)!=0 || (fi->flags & O_TRUNC)!=0)) return -EROFS;
 	char *relative=relative_path(path);
-	Procedure *proc=get_script(persistent.procs,relative);
+	hot_add(HOT_OPENS,relative,1);
+	Procedure *proc;
+	char base[FILENAME_MAX_LENGTH];
+	int compression=COMPRESS_NONE;
+	if (persistent.immutable) {
+		const IndexEntry *e=find_index(relative);
+		proc=(e==0)?compressed_sibling(relative,base,sizeof base,&compression):e->proc;
+	} else if ((proc=compressed_sibling(relative,base,sizeof base,&compression))==0) proc=get_script(current_mount()->procs,relative);
 	if (proc!=0) {	// If the file is a script, the interpreter is executed to produce the result of the script
 		// If the caller requests to open the file in one of the write modes, immediately abort the opening
 		if ((fi->flags & O_WRONLY)!=0 || (fi->flags & O_RDWR)!=0) {
@@ -592,21 +1369,33 @@ int sfs_open(const char *path,struct fuse_file_info *fi) {
 			return -EACCES;
 		}
 
-		handle = run_script(relative, proc, fi);
+		uint64_t digest;
+		handle = run_script((compression==COMPRESS_NONE)?relative:base, proc, fi, nested_request(), (compression==COMPRESS_NONE)?0:&digest);
+		if (handle > 0 && compression!=COMPRESS_NONE) handle = compress_output(base, compression, handle, digest);
 		if (handle <= 0) {
 			free(relative);
 			return handle;
 		}
 		typ=1;
 	} else {
-		handle=openat(persistent.mirror_fd,relative,fi->flags);
+		handle=openat(current_mount()->mirror_fd,relative,fi->flags);
 		if (handle<=0) {free(relative);return -errno;}
 		typ=2;
 		fi->direct_io=0;	// Authorize direct translation of FUSE IO calls to system calls
+		if (persistent.immutable) fi->keep_cache=1;	// The content cannot change, keep the pages cached by the kernel
 	}
 	FileStruct *fs=(FileStruct*)malloc(sizeof(FileStruct));
 	fs->type=(typ==1)?T_SCRIPT:T_FILE;
-	fs->file_handle=handle;
+	fs->hot_bytes=0;
+	if (typ==1) {
+		if (set_output(fs,handle)) STAT_ADD(inline_outputs,1);	// Control files are not counted
+	}
+	else {
+		fs->file_handle=handle;
+		fs->data=0;
+		init_readahead(fs);
+	}
+	fs->dirty=(typ==2 && (fi->flags & O_TRUNC)!=0);
 	strncpy(fs->filename,relative,FILENAME_MAX_LENGTH-1);
 	fs->filename[FILENAME_MAX_LENGTH-1]=0;
 	fi->fh=(long)fs;
@@ -632,9 +1421,17 @@ int sfs_read(const char *path,char *buf,size_t size,off_t offset,struct fuse_fil
 	if (fi==0 || fi->fh==0) return -EBADF;
 	FileStruct *fs=(FileStruct*)(long)(fi->fh);
 	if (fs->type==T_FOLDER) return -EISDIR;
-	off_t res=lseek(fs->file_handle,offset,SEEK_SET);
-	if (res<0) return -errno;
-	ssize_t num=read(fs->file_handle,buf,size);
+	if (fs->data) {	// Small output kept in memory
+		if (offset<0) return -EINVAL;
+		if ((size_t)offset>=fs->data_size) return 0;
+		if (size>fs->data_size-offset) size=fs->data_size-offset;
+		memcpy(buf,fs->data+offset,size);
+		__atomic_add_fetch(&fs->hot_bytes,size,__ATOMIC_RELAXED);	// Counted in the hot paths when the handle is released
+		return size;
+	}
+	if (fs->type==T_FILE) readahead_hint(fs,offset,size);
+	ssize_t num=(fs->type==T_FILE)?uring_pread(fs->file_handle,buf,size,offset):pread(fs->file_handle,buf,size,offset);
+	if (num>0) __atomic_add_fetch(&fs->hot_bytes,num,__ATOMIC_RELAXED);
 	if (num>=0) return num; else return -errno;
 }
 
@@ -656,9 +1453,9 @@ int sfs_write(const char *path,const char *buf,size_t size,off_t offset,struct f
 	if (fi==0 || fi->fh==0) return -EBADF;
 	FileStruct *fs=(FileStruct*)(long)(fi->fh);
 	if (fs->type==T_FOLDER) return -EISDIR;
-	off_t res=lseek(fs->file_handle,offset,SEEK_SET);
-	if (res<0) return -errno;
-	ssize_t num=write(fs->file_handle,buf,size);
+	if (persistent.immutable) return -EROFS;
+	ssize_t num=pwrite(fs->file_handle,buf,size,offset);
+	if (num>0) fs->dirty=1;
 	if (num>=0) return num; else return -errno;
 }
 
@@ -677,7 +1474,10 @@ int sfs_release(const char *path,struct fuse_file_info *fi) {
 	if (fi==0 || fi->fh==0) return -EBADF;
 	FileStruct *fs=(FileStruct*)(long)(fi->fh);
 	if (fs->type==T_FOLDER) return -EISDIR;
-	int code=close(fs->file_handle);
+	int code=(fs->data)?0:close(fs->file_handle);
+	if (fs->type==T_FILE) free_readahead(fs);
+	hot_add(HOT_BYTES,fs->filename,fs->hot_bytes);
+	free(fs->data);
 	free(fs);
 	return (code==0)?0:-errno;
 }
@@ -698,6 +1498,7 @@ int sfs_fsync(const char *path,int isdatasync,struct fuse_file_info *fi) {
 	if (fi==0 || fi->fh==0) return -EBADF;
 	FileStruct *fs=(FileStruct*)(long)(fi->fh);
 	if (fs->type==T_FOLDER) return -EISDIR;
+	if (fs->data) return 0;
 	int code=fsync(fs->file_handle);
 	return (code==0)?0:-errno;
 }
@@ -705,7 +1506,7 @@ int sfs_fsync(const char *path,int isdatasync,struct fuse_file_info *fi) {
 /**
  * \brief Flush modifications to a file in the virtual file system.
  *
- * The function is called before each close of a function on the virtual file system. It gives a chance to report delayed errors according to the documentation. This one also says that there can be zero, one, or several flush call for each open.
+ * The function is called before each close of a function on the virtual file system. It gives a chance to report delayed errors according to the documentation. This one also says that there can be zero, one, or several flush call for each open. What is done with the written data depends on the durability policy (see durability_flush).
  * \param path Virtual path of the file, not used because the file handle is stored in fi
  * \param fi FUSE file information structure, holding the handle to the mirror file
  * \return Error code, or 0 if everything went fine, but not used by FUSE
@@ -718,7 +1519,7 @@ int sfs_flush(const char *path,struct fuse_file_info *fi) {
 	FileStruct *fs=(FileStruct*)(long)(fi->fh);
 	if (fs->type==T_FOLDER) return -EISDIR;
 	if (fs->type==T_SCRIPT) return 0;
-	int code=fsync(fs->file_handle);
+	int code=durability_flush(fs->file_handle,fs->dirty);
 	return (code==0)?0:-errno;
 }
 
@@ -735,13 +1536,19 @@ int sfs_create(const char *path,mode_t mode,struct fuse_file_info *fi) {
 #ifdef TRACE
 	fprintf(stderr,"sfs_create(%s,%X)\n",path,mode);
 #endif
+	if (persistent.immutable) return -EROFS;
+	if (control_name(path)) return -EACCES;
 	int handle=0;
 	char *relative=relative_path(path);
-	handle=openat(persistent.mirror_fd,relative,O_CREAT | O_WRONLY | O_TRUNC,mode);
+	handle=openat(current_mount()->mirror_fd,relative,O_CREAT | O_WRONLY | O_TRUNC,mode);
 	if (handle<=0) {free(relative);return -errno;}
 	FileStruct *fs=(FileStruct*)malloc(sizeof(FileStruct));
 	fs->type=T_FILE;
+	fs->hot_bytes=0;
 	fs->file_handle=handle;
+	fs->data=0;
+	init_readahead(fs);
+	fs->dirty=1;
 	strncpy(fs->filename,relative,FILENAME_MAX_LENGTH-1);
 	fs->filename[FILENAME_MAX_LENGTH-1]=0;
 	fi->fh=(long)fs;
@@ -757,6 +1564,7 @@ static off_t sfs_lseek(const char *path, off_t off, int whence, struct fuse_file
 	if (fi==0 || fi->fh==0) return -EBADF;
 	FileStruct *fs=(FileStruct*)(long)(fi->fh);
 	if (fs->type==T_FOLDER) return -EISDIR;
+	if (fs->data) return 0;
 	off_t res=lseek(fs->file_handle, off, whence);
 	if (res<0) return -errno;
 	return 0;
@@ -796,17 +1604,221 @@ struct fuse_operations sfs_oper = {
 	.lseek=sfs_lseek,
 };
 
+/**
+ * \brief FUSE session serving one mount of the table
+ */
+typedef struct Session {
+	Mount *mount;	//!< Mount served by the session
+	struct fuse *fuse;	//!< FUSE handle of the session
+	int mounted;	//!< Tells if the mount point is still mounted
+	unsigned int max_threads;	//!< Maximal number of worker threads of the session
+	pthread_t thread;	//!< Thread running the loop of the session
+} Session;
+
+static pthread_mutex_t served_mutex=PTHREAD_MUTEX_INITIALIZER;	//!< Protects the mounted flags of the sessions
+static Session *served=0;	//!< Array of the sessions served by serve_mounts
+static size_t num_served=0;	//!< Number of sessions in the served array
+
+/**
+ * \brief Get the mount of the FUSE request being served by the current thread
+ *
+ * Before the first session is initialized (--materialize, index of an immutable mirror built before mounting), libfuse has no context to give, and current_mount falls back to the mount of the thread or the first mount.
+ * \return Mount given to the session of the request, null if the thread is not serving a request
+ */
+static Mount *request_mount() {
+	struct fuse_context *context=(__atomic_load_n(&sessions,__ATOMIC_RELAXED)>0)?fuse_get_context():0;
+	return (context!=0 && context->fuse!=0)?(Mount*)context->private_data:0;
+}
+
+/**
+ * \brief Unmount all the sessions which are still mounted, so that their loops end
+ *
+ * After a handover, the mount points hold the mounts of the new process: the loops are only stopped, since unmounting the paths would unmount the new process.
+ */
+static void unmount_sessions() {
+	size_t k;
+	int handed=handover_done();
+	pthread_mutex_lock(&served_mutex);
+	for (k=0;k<num_served;++k) if (served[k].mounted) {
+		fuse_exit(served[k].fuse);
+		if (!handed) fuse_unmount(served[k].fuse);
+		served[k].mounted=0;
+	}
+	pthread_mutex_unlock(&served_mutex);
+}
+
+/**
+ * \brief Wait for a termination signal and unmount all the sessions
+ *
+ * The termination signals are blocked in every thread, so that this thread is the only one receiving them.
+ * \param arg Set of the signals to wait for
+ * \return Null pointer
+ */
+static void *wait_signals(void *arg) {
+	int sig;
+	sigwait((sigset_t*)arg,&sig);
+	unmount_sessions();
+	return 0;
+}
+
+/**
+ * \brief Run the loop of a session until it is unmounted
+ *
+ * \param arg Session
+ * \return Null pointer
+ */
+static void *serve_session(void *arg) {
+	Session *session=(Session*)arg;
+	struct fuse_loop_config *config=fuse_loop_cfg_create();
+	if (session->max_threads>0) fuse_loop_cfg_set_max_threads(config,session->max_threads);
+	fuse_loop_mt(session->fuse,config);
+	fuse_loop_cfg_destroy(config);
+	return 0;
+}
+
+/**
+ * \brief Serve all the mounts of the table from the current process
+ *
+ * Each mount gets its own FUSE session, created with the FUSE options of the command line and the mount itself as private data, and its own multi-threaded loop. The process is daemonized once all the mount points are mounted. A termination signal or the end of any loop does not stop the other sessions, the function returns when all of them are unmounted. A single mount is served here too when a handover socket is given, so that the mount point is never unmounted once a new process took it over (see unmount_sessions).
+ * \param argc Number of arguments left for FUSE
+ * \param argv Array of arguments left for FUSE, a mount point given there is ignored (each mount has its own)
+ * \return Error code, 0 if everything went fine
+ */
+static int serve_mounts(int argc,char **argv) {
+	struct fuse_cmdline_opts opts;
+	Mount *m;
+	size_t k;
+	int code=0;
+	for (m=persistent.mounts;m!=0;m=m->next) ++num_served;
+	served=(Session*)calloc(num_served,sizeof(Session));
+	if (served==0) return ENOMEM;
+	memset(&opts,0,sizeof opts);
+	for (k=0,m=persistent.mounts;m!=0;m=m->next,++k) {
+		struct fuse_args args=FUSE_ARGS_INIT(argc,argv);
+		served[k].mount=m;
+		if (fuse_parse_cmdline(&args,&opts)!=0) {
+			fuse_opt_free_args(&args);
+			code=EX_USAGE;
+			break;
+		}
+		free(opts.mountpoint);
+		served[k].max_threads=opts.max_threads;
+		served[k].fuse=fuse_new(&args,&sfs_oper,sizeof(sfs_oper),m);
+		fuse_opt_free_args(&args);
+		if (served[k].fuse==0 || fuse_mount(served[k].fuse,m->mountpoint)!=0) {
+			fprintf(stderr,"Cannot mount %s on %s\n",m->mirror,m->mountpoint);
+			code=1;
+			break;
+		}
+		served[k].mounted=1;
+	}
+	if (code==0 && fuse_daemonize(opts.foreground)!=0) code=1;
+	if (code==0) {
+		sigset_t signals;
+		pthread_t waiter;
+		sigemptyset(&signals);
+		sigaddset(&signals,SIGINT);
+		sigaddset(&signals,SIGTERM);
+		sigaddset(&signals,SIGHUP);
+		pthread_sigmask(SIG_BLOCK,&signals,0);
+		pthread_create(&waiter,0,wait_signals,&signals);
+		for (k=0;k<num_served;++k) pthread_create(&served[k].thread,0,serve_session,served+k);
+		for (k=0;k<num_served;++k) pthread_join(served[k].thread,0);
+		pthread_kill(waiter,SIGTERM);	// Every loop ended, release the waiting thread
+		pthread_join(waiter,0);
+	}
+	unmount_sessions();
+	for (k=0;k<num_served;++k) if (served[k].fuse!=0) fuse_destroy(served[k].fuse);
+	free(served);
+	served=0;
+	num_served=0;
+	return code;
+}
+
 /**
  * \brief Main program, mounts file system
  *
  * The main program processes command line arguments and mounts the file system. In addition to standard \e fusermount command parameters, possible command line arguments are:
  * 	Syntax: scriptfs [-l] [-p procedure|--procedure=procedure...] mirror_path mountpoint
+ * 	        scriptfs [-l] [-p procedure|--procedure=procedure...] --mounts=file [mirror_path mountpoint]
  * 
  * 	- -p procedure
  * 		--procedure=procedure
  * 			Define an execution procedure. This procedure holds the external executable program and the test program that will be used on files. The command can be repeated as many times as needed, and each procedure will be tested in the order they appear in the command-line. For more information about the way to define a procedure, see \ref syntaxdoc "Syntax of command-line".
  *      - -l
  *              Report final output size (in `stat`/`getattr`) instead of size of source script.
+ *      - --io-uring[=depth]
+ *              Transport FUSE requests over per-CPU io_uring queues (with the given queue depth) if the kernel and libfuse support it, otherwise fall back to /dev/fuse.
+ *      - --mirror-uring[=depth]
+ *              Do the I/O on the mirror on per-thread io_uring rings of the given depth (64 entries by default): batched statx requests when a directory is listed with -l, large reads split into concurrent segments and copies made of linked read-write chains.
+ *      - --size-jobs=number
+ *              Maximal number of scripts executed at the same time to get their sizes when a directory is listed with -l.
+ *      - --parallel-tests
+ *              Launch the test programs of all the candidate procedures concurrently, keeping the first-match order.
+ *      - --adaptive-cache
+ *              Observe the executions of the scripts and cache the outputs which are stable and expensive, unless the procedure sets its own caching policy.
+ *      - --cache-min-ms=milliseconds
+ *              Minimal average duration of a script for the adaptive policy to cache its output.
+ *      - --cache-size=megabytes
+ *              Maximal size of the cached outputs.
+ *      - --stats
+ *              Publish statistics, caching decisions and the paths with the most executions, CPU time and bytes read in the virtual control folder.
+ *      - --max-jobs=number
+ *              Maximal number of scripts executed at once for ordinary requests. Requests coming from the scripts themselves are not limited. By default, the executions are not limited.
+ *      - --adaptive-jobs=min:max
+ *              Adjust the limit of scripts executed at once between min and max: it is halved when /proc/pressure reports that the host is short of CPU, memory or I/O, or when the scripts run much slower than usual, and increased by one when requests wait for a slot. The initial limit is the one of --max-jobs.
+ *      - --fuse-cpus=list
+ *              Bind the FUSE worker threads to the CPUs of the list (in the format of the kernel, such as 0-3,8) and keep the scripts off these CPUs.
+ *      - --script-cpus=list
+ *              Run the scripts on the CPUs of the list only. By default, the scripts run on all the CPUs which are not reserved for the FUSE workers.
+ *      - --numa-local
+ *              Run each script on the CPUs of the NUMA node of the FUSE worker which started it, and make it allocate its memory (including the pages of its output) on this node.
+ *      - --fork-server=interpreter[:module,...]
+ *              Start the interpreter once (on the first script which needs it) with the modules preloaded, and make it fork itself to run each script whose shebang line names this interpreter, with the arguments, standard streams and current folder the script would have had. The interpreter must be Python 3. The option may be given for several interpreters. See \ref forkserver "Fork servers".
+ *      - --context=script[:seconds]
+ *              Run the script (a path relative to the mirror, run with the procedures of the mount) and keep its output, the context of the mount, in a sealed memory file for the given lifetime. Every program executed for the mount (scripts, filters and tests) gets a private read-only descriptor of the current context, which number is in the environment variable SCRIPTFS_CONTEXT_FD. The lifetime is at least one second; the script may contain colons if no lifetime is given.
+ *      - --generation-times
+ *              The modification time of a script becomes the time when its output last changed (by comparison of digests), and its change time the time when it was last executed, so that incremental tools see when the generated file actually changed.
+ *      - --nested-cache
+ *              Serve the requests coming from scripts from the output cache, even if the cached output expired.
+ *      - --mounts=file
+ *              Serve every mount listed in the file from this process, each on its own FUSE session, in addition to the mirror and mount point of the command line if they are given. A line of the file gives a mirror folder and a mount point; the following indented lines give the options of this mount: `-p procedure` (the procedures of the command line are used if none is given) and `max-jobs number`, the quota of scripts executed at once for this mount, and `context script [seconds]`, like --context. The scheduler, the supervisor, the caches and the statistics are shared by all the mounts.
+ *      - --shared-cache=folder
+ *              Share the cached outputs with the other instances of the host through files of the folder, keyed by mirror, path, version of the script and procedure. An output expected to be cached is generated by one instance at a time, the others wait for it.
+ *      - --shared-cache-size=megabytes
+ *              Maximal size of the outputs of the shared cache, for the whole host. The least recently used outputs are removed first.
+ *      - --remote-cache=unix:/path|tcp:host:port
+ *              Consult the cache server at this address before running a script whose procedure caches its outputs forever (cache=always without ttl), and send it the outputs generated locally. The key of an output is the SHA-256 digest of the content of the script, the definition of the procedure and the content of the inputs it declares. The outputs are sent by a background thread, and the server is not contacted for a while after a failure. See \ref remoteprotocol "Protocol of the remote cache".
+ *      - --remote-secret=file
+ *              Authenticate the outputs exchanged with the remote cache with the secret held by the file, shared with the server and the other hosts: the outputs without a valid code are ignored.
+ *      - --handover=socket
+ *              Listen on the unix socket for a new process taking over the mount points (see --takeover).
+ *      - --takeover=socket
+ *              Before mounting, get the mirror folders and the output cache of the process listening on the socket, then ask it to detach its mount points lazily and mount them again at once. The old process keeps serving the files already open until they are closed, then exits.
+ *      - --immutable
+ *              Declare that the mirror never changes while it is mounted. The mirror is indexed at mount time (with the output sizes of the scripts if -l is given), metadata are served from the index with infinite kernel timeouts, and writes are rejected.
+ *      - --materialize
+ *              Do not mount the file system: render it into the folder given as mount point. Scripts write their output directly on the destination files and the other files are cloned, linked or copied.
+ *      - --link=reflink|hard|copy
+ *              Way --materialize reproduces the files which are not scripts: copy-on-write clone (default), hard link, or plain copy.
+ *      - --report=file
+ *              File on which --materialize writes the kind, duration, size and path of each rendered entry.
+ *      - --timeout=seconds
+ *              Kill the external programs (and their own children) which run longer than the delay.
+ *      - --compress-jobs=number
+ *              Maximal number of threads compressing the blocks of the outputs for their compressed siblings (see the compress procedure option), shared by all the compressions in progress. By default, one per online CPU.
+ *      - --readahead-max=bytes
+ *              Maximal window prefetched ahead of the handles which read files of the mirror sequentially (8 MiB by default). Handles read at random offsets are advised random instead. 0 disables it.
+ *      - --huge-spool=folder[:bytes]
+ *              Scripts write their output to an anonymous file of the folder, and the outputs smaller than the given size (64 MiB by default) are moved out of it once the script is over. The folder may contain colons if no size is given. The folder should be on a tmpfs mounted with huge=always, so that the readers of large outputs take fewer TLB misses and page faults.
+ *      - --inline-max=bytes
+ *              Outputs not larger than this size are copied in memory when they are opened and their temporary file is closed, so that reading them takes no system call and no descriptor. 0 disables it.
+ *      - --cancel-grace=milliseconds
+ *              When the request waiting for a script is interrupted, let the script run for this delay before killing its process group, in case it was about to finish. Scripts which output goes to a cache are never killed for an interrupted request.
+ *      - --durability=none|close|group
+ *              Choose what is done with written files when they are closed: nothing, fsync on every close (default), or periodic syncfs of the mirror.
+ *      - --sync-interval=seconds
+ *              Delay between two commits of the mirror with the group durability policy.
  *
  * \param argc Number of command line arguments, including the name of the calling program
  * \param argv Array of command line arguments, the first one being the path to the calling program
@@ -830,14 +1842,345 @@ int main(int argc,char **argv,char **envp) {
 #ifdef TRACE
 	fprintf(stderr, "main: Using %s as a temporary file template\n", persistent.tmp_template);
 #endif
-	size_t i,j;
-	Procedures *last=0;
+	size_t i;
+	const char *value;
+	int io_uring=0;
+	int io_uring_depth=0;
+	int materialize_tree=0;
+	int link_mode=LINK_REFLINK;
+	const char *report_path=0;
+	const char *mount_table=0;
+	const char *takeover=0;
+	const char *shared_cache=0;
+	const char *remote_cache=0;
+	const char *remote_secret=0;
+	const char *fuse_cpus=0;
+	const char *script_cpus=0;
+	const char *huge_spool=0;
+	int numa_local=0;
+	char *proc_strings[argc];	// Procedures of the command line, also used by the mounts of the table without their own
+	size_t num_procs=0;
+	Mount *mount=new_mount();	// Mount given by the last two arguments
+	persistent.mounts=mount;
+	persistent.request_mount=request_mount;
 	for (i=1;i<argc && argv[i][0]=='-';++i) {
 		if (argv[i][1]=='o') ++i;	// Skip -o options parameters
 		else if (argv[i][1]=='l') { // Parse -l option (always report real file length)
 			persistent.return_real_size = 1;
-			for (j=i;j<argc;++j) argv[j]=argv[j+1];
-			--argc;
+			remove_args(&argc,argv,i,1);
+			--i;
+		}
+		else if (strcmp(argv[i],"--io-uring")==0) { // Parse --io-uring option (FUSE transport over io_uring)
+			io_uring=1;
+			io_uring_depth=0;
+			remove_args(&argc,argv,i,1);
+			--i;
+		}
+		else if ((value=option_value(argv[i],"io-uring"))!=0) { // Parse --io-uring=depth option (FUSE transport over io_uring with the given queue depth)
+			unsigned long long depth;
+			if (read_number(value,INT_MAX,&depth)!=0 || depth==0) {
+				fprintf(stderr, "--io-uring needs a positive queue depth\n");
+				free_resources();
+				print_usage(EX_USAGE);
+			}
+			io_uring=1;
+			io_uring_depth=depth;
+			remove_args(&argc,argv,i,1);
+			--i;
+		}
+		else if (strcmp(argv[i],"--mirror-uring")==0) { // Parse --mirror-uring option (I/O on the mirror over io_uring)
+			persistent.uring_depth=URING_DEFAULT_DEPTH;
+			remove_args(&argc,argv,i,1);
+			--i;
+		}
+		else if ((value=option_value(argv[i],"mirror-uring"))!=0) { // Parse --mirror-uring=depth option (I/O on the mirror over io_uring rings of the given depth)
+			unsigned long long depth;
+			if (read_number(value,INT_MAX,&depth)!=0 || depth==0) {
+				fprintf(stderr, "--mirror-uring needs a positive ring depth\n");
+				free_resources();
+				print_usage(EX_USAGE);
+			}
+			persistent.uring_depth=depth;
+			remove_args(&argc,argv,i,1);
+			--i;
+		}
+		else if ((value=option_value(argv[i],"size-jobs"))!=0) { // Parse --size-jobs option (parallel size computation in directory listings)
+			unsigned long long jobs;
+			if (read_number(value,UINT_MAX,&jobs)!=0 || jobs==0) {
+				fprintf(stderr, "--size-jobs needs a positive number\n");
+				free_resources();
+				print_usage(EX_USAGE);
+			}
+			persistent.size_jobs=jobs;
+			remove_args(&argc,argv,i,1);
+			--i;
+		}
+		else if (strcmp(argv[i],"--materialize")==0) { // Parse --materialize option (offline rendering instead of mounting)
+			materialize_tree=1;
+			remove_args(&argc,argv,i,1);
+			--i;
+		}
+		else if ((value=option_value(argv[i],"link"))!=0) { // Parse --link option (how materialize reproduces the other files)
+			link_mode=get_link_mode_from_string(value);
+			if (link_mode<0) {
+				fprintf(stderr, "Unknown link mode %s\n", value);
+				free_resources();
+				print_usage(EX_USAGE);
+			}
+			remove_args(&argc,argv,i,1);
+			--i;
+		}
+		else if ((value=option_value(argv[i],"mounts"))!=0) { // Parse --mounts option (table of mounts served by the process)
+			mount_table=value;
+			remove_args(&argc,argv,i,1);
+			--i;
+		}
+		else if ((value=option_value(argv[i],"shared-cache"))!=0) { // Parse --shared-cache option (host-wide cache folder)
+			shared_cache=value;
+			remove_args(&argc,argv,i,1);
+			--i;
+		}
+		else if ((value=option_value(argv[i],"shared-cache-size"))!=0) { // Parse --shared-cache-size option (host-wide budget)
+			unsigned long long size;
+			if (read_number(value,ULLONG_MAX>>20,&size)!=0) {
+				fprintf(stderr, "--shared-cache-size needs a number of megabytes\n");
+				free_resources();
+				print_usage(EX_USAGE);
+			}
+			persistent.shared_cache_size=size<<20;
+			remove_args(&argc,argv,i,1);
+			--i;
+		}
+		else if ((value=option_value(argv[i],"remote-cache"))!=0) { // Parse --remote-cache option (cache server of the fleet)
+			remote_cache=value;
+			remove_args(&argc,argv,i,1);
+			--i;
+		}
+		else if ((value=option_value(argv[i],"remote-secret"))!=0) { // Parse --remote-secret option (authentication of the outputs of the remote cache)
+			remote_secret=value;
+			remove_args(&argc,argv,i,1);
+			--i;
+		}
+		else if ((value=option_value(argv[i],"handover"))!=0) { // Parse --handover option (socket for live upgrades)
+			persistent.handover=value;
+			remove_args(&argc,argv,i,1);
+			--i;
+		}
+		else if ((value=option_value(argv[i],"takeover"))!=0) { // Parse --takeover option (live upgrade of a running process)
+			takeover=value;
+			remove_args(&argc,argv,i,1);
+			--i;
+		}
+		else if ((value=option_value(argv[i],"report"))!=0) { // Parse --report option (per-file timing of materialize)
+			report_path=value;
+			remove_args(&argc,argv,i,1);
+			--i;
+		}
+		else if (strcmp(argv[i],"--parallel-tests")==0) { // Parse --parallel-tests option (concurrent evaluation of test programs)
+			persistent.parallel_tests=1;
+			remove_args(&argc,argv,i,1);
+			--i;
+		}
+		else if (strcmp(argv[i],"--adaptive-cache")==0) { // Parse --adaptive-cache option (adaptive caching policy by default)
+			persistent.adaptive_cache=1;
+			remove_args(&argc,argv,i,1);
+			--i;
+		}
+		else if ((value=option_value(argv[i],"cache-min-ms"))!=0) { // Parse --cache-min-ms option (threshold of the adaptive caching policy)
+			unsigned long long ms;
+			if (read_number(value,UINT_MAX,&ms)!=0) {
+				fprintf(stderr, "--cache-min-ms needs a number of milliseconds\n");
+				free_resources();
+				print_usage(EX_USAGE);
+			}
+			persistent.cache_min_ms=ms;
+			remove_args(&argc,argv,i,1);
+			--i;
+		}
+		else if ((value=option_value(argv[i],"cache-size"))!=0) { // Parse --cache-size option (budget of the cache)
+			unsigned long long size;
+			if (read_number(value,ULLONG_MAX>>20,&size)!=0) {
+				fprintf(stderr, "--cache-size needs a number of megabytes\n");
+				free_resources();
+				print_usage(EX_USAGE);
+			}
+			persistent.cache_size=size<<20;
+			remove_args(&argc,argv,i,1);
+			--i;
+		}
+		else if (strcmp(argv[i],"--stats")==0) { // Parse --stats option (control files)
+			persistent.control=1;
+			remove_args(&argc,argv,i,1);
+			--i;
+		}
+		else if ((value=option_value(argv[i],"max-jobs"))!=0) { // Parse --max-jobs option (limit of concurrent executions)
+			unsigned long long jobs;
+			if (read_number(value,UINT_MAX,&jobs)!=0) {
+				fprintf(stderr, "--max-jobs needs a number (0 for no limit)\n");
+				free_resources();
+				print_usage(EX_USAGE);
+			}
+			persistent.max_jobs=jobs;
+			remove_args(&argc,argv,i,1);
+			--i;
+		}
+		else if ((value=option_value(argv[i],"adaptive-jobs"))!=0) { // Parse --adaptive-jobs option (bounds of the adaptive limit of concurrent executions)
+			char bound[24]="";
+			unsigned long long min,max;
+			const char *colon=strchr(value,':');
+			if (colon!=0 && (size_t)(colon-value)<sizeof bound) snprintf(bound,sizeof bound,"%.*s",(int)(colon-value),value);	// A lower bound too long for the buffer is left empty and rejected
+			if (colon==0 || read_number(bound,UINT_MAX,&min)!=0 || read_number(colon+1,UINT_MAX,&max)!=0 || min==0 || max<min) {
+				fprintf(stderr, "--adaptive-jobs needs two bounds min:max with 0 < min <= max\n");
+				free_resources();
+				print_usage(EX_USAGE);
+			}
+			persistent.adaptive_min_jobs=min;
+			persistent.adaptive_max_jobs=max;
+			remove_args(&argc,argv,i,1);
+			--i;
+		}
+		else if ((value=option_value(argv[i],"fuse-cpus"))!=0) { // Parse --fuse-cpus option (CPUs reserved for the FUSE workers)
+			fuse_cpus=value;
+			remove_args(&argc,argv,i,1);
+			--i;
+		}
+		else if ((value=option_value(argv[i],"script-cpus"))!=0) { // Parse --script-cpus option (CPUs of the scripts)
+			script_cpus=value;
+			remove_args(&argc,argv,i,1);
+			--i;
+		}
+		else if (strcmp(argv[i],"--numa-local")==0) { // Parse --numa-local option (scripts on the NUMA node of their worker)
+			numa_local=1;
+			remove_args(&argc,argv,i,1);
+			--i;
+		}
+		else if ((value=option_value(argv[i],"fork-server"))!=0) { // Parse --fork-server option (preloaded interpreter forking the scripts)
+			int fcode=add_fork_server(value);
+			if (fcode!=0) {
+				fprintf(stderr, "Invalid fork server %s: %s\n",value,strerror(fcode));
+				free_resources();
+				print_usage(EX_USAGE);
+			}
+			remove_args(&argc,argv,i,1);
+			--i;
+		}
+		else if ((value=option_value(argv[i],"context"))!=0) { // Parse --context option (producer of the context of the mount)
+			char script[FILENAME_MAX_LENGTH];
+			unsigned long long ttl=DEFAULT_CONTEXT_TTL;
+			const char *colon=strrchr(value,':');
+			if (colon!=0 && read_number(colon+1,UINT_MAX,&ttl)!=0) {	// The colon belongs to the script
+				colon=0;
+				ttl=DEFAULT_CONTEXT_TTL;
+			}
+			if (ttl==0) {
+				fprintf(stderr, "--context needs a lifetime of at least one second\n");
+				free_resources();
+				print_usage(EX_USAGE);
+			}
+			snprintf(script,sizeof script,"%.*s",(colon!=0)?(int)(colon-value):(int)strlen(value),value);
+			if (set_context(mount,script,ttl)!=0) {
+				fprintf(stderr, "--context needs the path of a script relative to the mirror\n");
+				free_resources();
+				print_usage(EX_USAGE);
+			}
+			remove_args(&argc,argv,i,1);
+			--i;
+		}
+		else if (strcmp(argv[i],"--generation-times")==0) { // Parse --generation-times option (times of scripts taken from their outputs)
+			persistent.generation_times=1;
+			remove_args(&argc,argv,i,1);
+			--i;
+		}
+		else if (strcmp(argv[i],"--nested-cache")==0) { // Parse --nested-cache option (nested requests accept expired cached outputs)
+			persistent.nested_cache=1;
+			remove_args(&argc,argv,i,1);
+			--i;
+		}
+		else if (strcmp(argv[i],"--immutable")==0) { // Parse --immutable option (read-only mirror indexed at mount time)
+			persistent.immutable=1;
+			remove_args(&argc,argv,i,1);
+			--i;
+		}
+		else if ((value=option_value(argv[i],"timeout"))!=0) { // Parse --timeout option (maximal duration of external programs)
+			unsigned long long timeout;
+			if (read_number(value,UINT_MAX,&timeout)!=0 || timeout==0) {
+				fprintf(stderr, "--timeout needs a positive number of seconds\n");
+				free_resources();
+				print_usage(EX_USAGE);
+			}
+			persistent.exec_timeout=timeout;
+			remove_args(&argc,argv,i,1);
+			--i;
+		}
+		else if ((value=option_value(argv[i],"compress-jobs"))!=0) { // Parse --compress-jobs option (threads compressing one output)
+			unsigned long long jobs;
+			if (read_number(value,UINT_MAX,&jobs)!=0 || jobs==0) {
+				fprintf(stderr, "--compress-jobs needs a positive number of threads\n");
+				free_resources();
+				print_usage(EX_USAGE);
+			}
+			persistent.compress_jobs=jobs;
+			remove_args(&argc,argv,i,1);
+			--i;
+		}
+		else if ((value=option_value(argv[i],"readahead-max"))!=0) { // Parse --readahead-max option (maximal readahead window on the mirror)
+			unsigned long long size;
+			if (read_number(value,LLONG_MAX>>2,&size)!=0) {	// The window is added to offsets and doubled
+				fprintf(stderr, "--readahead-max needs a number of bytes\n");
+				free_resources();
+				print_usage(EX_USAGE);
+			}
+			persistent.readahead_max=size;
+			remove_args(&argc,argv,i,1);
+			--i;
+		}
+		else if ((value=option_value(argv[i],"huge-spool"))!=0) { // Parse --huge-spool option (folder of the large outputs)
+			huge_spool=value;
+			remove_args(&argc,argv,i,1);
+			--i;
+		}
+		else if ((value=option_value(argv[i],"inline-max"))!=0) { // Parse --inline-max option (maximal size of the outputs kept in memory)
+			unsigned long long size;
+			if (read_number(value,SIZE_MAX,&size)!=0) {
+				fprintf(stderr, "--inline-max needs a number of bytes\n");
+				free_resources();
+				print_usage(EX_USAGE);
+			}
+			persistent.inline_max=size;
+			remove_args(&argc,argv,i,1);
+			--i;
+		}
+		else if ((value=option_value(argv[i],"cancel-grace"))!=0) { // Parse --cancel-grace option (delay before killing the script of an interrupted request)
+			unsigned long long ms;
+			if (read_number(value,UINT_MAX,&ms)!=0) {
+				fprintf(stderr, "--cancel-grace needs a number of milliseconds\n");
+				free_resources();
+				print_usage(EX_USAGE);
+			}
+			persistent.cancel_grace=ms;
+			remove_args(&argc,argv,i,1);
+			--i;
+		}
+		else if ((value=option_value(argv[i],"durability"))!=0) { // Parse --durability option (what to do with written files on close)
+			int durability=get_durability_from_string(value);
+			if (durability<0) {
+				fprintf(stderr, "Unknown durability policy %s\n", value);
+				free_resources();
+				print_usage(EX_USAGE);
+			}
+			persistent.durability=durability;
+			remove_args(&argc,argv,i,1);
+			--i;
+		}
+		else if ((value=option_value(argv[i],"sync-interval"))!=0) { // Parse --sync-interval option (delay between group commits)
+			unsigned long long interval;
+			if (read_number(value,UINT_MAX,&interval)!=0 || interval==0) {
+				fprintf(stderr, "--sync-interval needs a positive number of seconds\n");
+				free_resources();
+				print_usage(EX_USAGE);
+			}
+			persistent.sync_interval=interval;
+			remove_args(&argc,argv,i,1);
 			--i;
 		}
 		else if (argv[i][1]=='p') { // Parse -p options parameters
@@ -846,79 +2189,182 @@ int main(int argc,char **argv,char **envp) {
 				free_resources();
 				print_usage(EX_USAGE);
 			}
-			Procedure *proc=get_procedure_from_string(argv[i+1]);
-			if (proc!=0) {
-				Procedures *procs=(Procedures*)malloc(sizeof(Procedures));
-				procs->procedure=proc;
-				procs->next=0;
-				if (last==0) persistent.procs=procs; else last->next=procs;
-				last=procs;
-			} else {
+			if (add_procedure(mount,argv[i+1])!=0) {
 				free_resources();
 				fprintf(stderr, "-p option failed\n");
 				exit(1);
 			}
-			for (j=i;j<argc-2;++j) argv[j]=argv[j+2];
-			argc-=2;
-			--i;
 #ifdef TRACE
-			if (proc && proc->program)
-				fprintf(stderr, "Program name is %s\n", proc->program->path);
+			fprintf(stderr, "Procedure is %s\n", argv[i+1]);
 #endif
+			proc_strings[num_procs++]=argv[i+1];
+			remove_args(&argc,argv,i,2);
+			--i;
 		}
 	}
-	if ((argc-i)!=2) {
+	proc_strings[num_procs]=0;
+	if ((argc-i)!=2 && (mount_table==0 || argc!=i)) {
 		fprintf(stderr, "See %ld parameters; need a mirror_folder and a mount_point, and no more\n",
 		       argc-i);
 		free_resources();
 		print_usage(EX_USAGE);
 	}
-	scode = stat(argv[i], &sb);
-	if (scode || ((sb.st_mode & S_IFMT) != S_IFDIR)) {
-		fprintf(stderr, "mirror_folder %s doesn't exist or is not a directory\n", argv[i]);
+	if (mount_table!=0 && materialize_tree) {
+		fprintf(stderr, "--materialize renders a single mirror, it cannot be used with --mounts\n");
 		free_resources();
-		return ENOENT;
+		print_usage(EX_USAGE);
 	}
+	if (argc==i) {	// Only the mounts of the table are served
+		persistent.mounts=0;
+		free_mounts(mount);
+		mount=0;
+	} else {
+		scode = stat(argv[i], &sb);
+		if (scode || ((sb.st_mode & S_IFMT) != S_IFDIR)) {
+			fprintf(stderr, "mirror_folder %s doesn't exist or is not a directory\n", argv[i]);
+			free_resources();
+			return ENOENT;
+		}
 		
-	scode = stat(argv[i+1], &sb);
-	if (scode || ((sb.st_mode & S_IFMT) != S_IFDIR)) {
-		fprintf(stderr, "mount_point %s doesn't exist or is not a directory\n", argv[i+1]);
+		if (materialize_tree && mkdir(argv[i+1], 0755) != 0 && errno != EEXIST) {
+			fprintf(stderr, "Cannot create output folder %s: %s\n", argv[i+1], strerror(errno));
+			free_resources();
+			return EX_CANTCREAT;
+		}
+		scode = stat(argv[i+1], &sb);
+		if (scode || ((sb.st_mode & S_IFMT) != S_IFDIR)) {
+			fprintf(stderr, "%s %s doesn't exist or is not a directory\n", materialize_tree?"output folder":"mount_point", argv[i+1]);
+			free_resources();
+			return ENOENT;
+		}
+		
+		// Open mirror directory
+		if (open_mirror(mount,argv[i])!=0) {
+			fprintf(stderr,"Can't open mirror folder: %s\n",argv[i]);
+			free_resources();
+			return EX_NOPERM;
+		}
+		mount->mountpoint=realpath(argv[i+1],0);
+		argv[i]=argv[i+1];
+		argc--;
+		// Check if no valid procedure was set. In that case, automatically provide a standard procedure
+		default_procedures(mount);
+	}
+	// Add the mounts of the table, which share everything but their mirror, procedures and quota
+	if (mount_table!=0 && read_mount_table(mount_table,proc_strings,&persistent.mounts)!=0) {
 		free_resources();
-		return ENOENT;
+		return EX_CONFIG;
 	}
-		
-	persistent.mirror=realpath(argv[i],0);
-	persistent.mirror_len=strlen(persistent.mirror);
-	argv[i]=argv[i+1];
-	argc--;
-	// Open mirror directory
-	persistent.mirror_fd=open(persistent.mirror,O_RDONLY);
-	if (persistent.mirror_fd<0) {
-		fprintf(stderr,"Can't open mirror folder: %s\n",persistent.mirror);
+	if (persistent.mounts==0) {
+		fprintf(stderr,"The table of mounts %s holds no mount\n",mount_table);
+		free_resources();
+		return EX_CONFIG;
+	}
+	if (remote_cache!=0 && open_remote_cache(remote_cache)!=0) {
+		fprintf(stderr,"Invalid address of the remote cache %s, use unix:/path or tcp:host:port\n",remote_cache);
+		free_resources();
+		print_usage(EX_USAGE);
+	}
+	if (remote_secret!=0 && remote_cache==0) {
+		fprintf(stderr,"--remote-secret needs --remote-cache\n");
+		free_resources();
+		print_usage(EX_USAGE);
+	}
+	if (remote_secret!=0 && (scode=read_remote_secret(remote_secret))!=0) {
+		fprintf(stderr,"Cannot read the secret of the remote cache from %s: %s\n",remote_secret,(scode==EINVAL)?"empty or too long":strerror(scode));
+		free_resources();
+		return EX_NOINPUT;
+	}
+	if (shared_cache!=0 && (scode=open_shared_cache(shared_cache))!=0) {
+		fprintf(stderr,"Cannot open the shared cache %s: %s\n",shared_cache,strerror(scode));
+		free_resources();
+		return EX_CANTCREAT;
+	}
+	if (init_affinity(fuse_cpus,script_cpus,numa_local)!=0) {
+		fprintf(stderr,"Invalid placement: the lists of CPUs must hold online CPUs, and leave at least one CPU to the scripts\n");
+		free_resources();
+		print_usage(EX_USAGE);
+	}
+	if (init_spool(huge_spool)!=0) {
+		fprintf(stderr,"Invalid huge page spool: %s\n",huge_spool);
+		free_resources();
+		print_usage(EX_USAGE);
+	}
+	// Render the tree in the output folder instead of mounting it
+	if (materialize_tree) {
+		char *target=realpath(argv[i],0);
+		if (target==0 || (strncmp(target,mount->mirror,mount->mirror_len)==0 && (target[mount->mirror_len]=='/' || target[mount->mirror_len]==0))) {
+			fprintf(stderr,"The output folder must not be inside the mirror folder\n");
+			free(target);
+			free_resources();
+			return EX_USAGE;
+		}
+		FILE *report=0;
+		if (report_path && (report=fopen(report_path,"w"))==0) {
+			fprintf(stderr,"Cannot create report %s: %s\n",report_path,strerror(errno));
+			free(target);
+			free_resources();
+			return EX_CANTCREAT;
+		}
+		start_supervisor(0);
+		int code=materialize(target,persistent.size_jobs,link_mode,report);
+		stop_supervisor();
+		if (report) fclose(report);
+		free(target);
+		free_resources();
+		return (code==0)?0:EX_IOERR;
+	}
+	// Index the immutable mirror before mounting it, so that every request is served from the index
+	Mount *m;
+	for (m=persistent.mounts;persistent.immutable && m!=0;m=m->next) {
+		long long start=now_ms();
+		set_thread_mount(m);
+		int code=build_index(persistent.size_jobs,persistent.return_real_size?measure_script:0);
+		set_thread_mount(0);
+		if (code!=0) {
+			fprintf(stderr,"Cannot index the immutable mirror %s: %s\n",m->mirror,strerror(code));
+			free_resources();
+			return EX_IOERR;
+		}
+		fprintf(stderr,"Immutable mirror %s indexed in %lld ms\n",m->mirror,now_ms()-start);
+	}
+	if (mount_table!=0 && mount!=0) argc--;	// The mount point of the command line is given to its own session with the others
+	char *fuse_argv[argc+8];
+	memcpy(fuse_argv,argv,(argc+1)*sizeof(char*));
+	argv=fuse_argv;
+	// Ask libfuse to run the session on io_uring queues (one per CPU), or stay on the classic channel
+	char uring_depth[64];
+	if (io_uring && io_uring_supported()) {
+		argv[argc++]="-o";
+		if (io_uring_depth>0) {
+			snprintf(uring_depth,sizeof uring_depth,"io_uring,io_uring_q_depth=%d",io_uring_depth);
+			argv[argc++]=uring_depth;
+		} else argv[argc++]="io_uring";
+		argv[argc]=0;
+	}
+	if (persistent.immutable && !has_fuse_option(argc,argv,"ro")) {	// Let the kernel reject writes too
+		argv[argc++]="-o";
+		argv[argc++]="ro";
+		argv[argc]=0;
+	}
+	// A request waiting for a script (or for an execution slot) holds a FUSE worker thread while the script may read other generated files: raise the limit of libfuse (10 by default since 3.12) so that nested requests always find one
+	char max_threads[64];
+	if (fuse_version()>=FUSE_MAKE_VERSION(3,12) && !has_fuse_option(argc,argv,"max_threads")) {
+		snprintf(max_threads,sizeof max_threads,"max_threads=%d",FUSE_MAX_THREADS);
+		argv[argc++]="-o";
+		argv[argc++]=max_threads;
+		argv[argc]=0;
+	}
+	// Take the mount points over from the running process, which detaches them just before they are mounted again
+	if (takeover!=0 && take_over(takeover)!=0) {
 		free_resources();
-		return EX_NOPERM;
-	}
-	// Check if no valid procedure was set. In that case, automatically provide a standard procedure
-	if (persistent.procs==0) {
-		persistent.procs=(Procedures*)malloc(sizeof(Procedures));
-		persistent.procs->procedure=(Procedure*)malloc(sizeof(Procedure));
-		persistent.procs->procedure->program=(Program*)malloc(sizeof(Program));
-		persistent.procs->procedure->program->path=0;
-		persistent.procs->procedure->program->args=0;
-		persistent.procs->procedure->program->filearg=0;
-		persistent.procs->procedure->program->func=&program_shell;
-		persistent.procs->procedure->test=(Test*)malloc(sizeof(Test));
-		persistent.procs->procedure->test->func=&test_shell_executable;
-		persistent.procs->procedure->test->path=0;
-		persistent.procs->procedure->test->args=0;
-		persistent.procs->procedure->test->filearg=0;
-		persistent.procs->procedure->test->filter=0;
-		persistent.procs->procedure->test->compiled=0;
-		persistent.procs->next=0;
+		return EX_UNAVAILABLE;
 	}
+	// The worker threads created by libfuse inherit the affinity of this thread
+	int acode=bind_fuse_workers();
+	if (acode!=0) fprintf(stderr,"Cannot bind the FUSE workers to their CPUs: %s\n",strerror(acode));
 	// Daemonize the program
-	int code=fuse_main(argc, argv, &sfs_oper, NULL);
+	int code=(mount_table==0 && persistent.handover==0)?fuse_main(argc, argv, &sfs_oper, mount):serve_mounts(argc, argv);	// fuse_main would unmount the mount point of the new process after a handover
 	free_resources();
-	close(persistent.mirror_fd);
 	return code;
 }
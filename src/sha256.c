@@ -0,0 +1,131 @@
+/*
+ * =====================================================================================
+ *
+ *       Filename:  sha256.c
+ *
+ *    Description:  Implementation of SHA-256 (FIPS 180-4) and HMAC-SHA-256 (RFC 2104)
+ *
+ *        Version:  2.0
+ *        Created:  10/18/2026
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  
+ *        Company:  
+ *
+ * =====================================================================================
+ */
+
+#include <string.h>
+#include "sha256.h"
+
+static const uint32_t K[64]={	//!< Round constants
+	0x428a2f98,0x71374491,0xb5c0fbcf,0xe9b5dba5,0x3956c25b,0x59f111f1,0x923f82a4,0xab1c5ed5,
+	0xd807aa98,0x12835b01,0x243185be,0x550c7dc3,0x72be5d74,0x80deb1fe,0x9bdc06a7,0xc19bf174,
+	0xe49b69c1,0xefbe4786,0x0fc19dc6,0x240ca1cc,0x2de92c6f,0x4a7484aa,0x5cb0a9dc,0x76f988da,
+	0x983e5152,0xa831c66d,0xb00327c8,0xbf597fc7,0xc6e00bf3,0xd5a79147,0x06ca6351,0x14292967,
+	0x27b70a85,0x2e1b2138,0x4d2c6dfc,0x53380d13,0x650a7354,0x766a0abb,0x81c2c92e,0x92722c85,
+	0xa2bfe8a1,0xa81a664b,0xc24b8b70,0xc76c51a3,0xd192e819,0xd6990624,0xf40e3585,0x106aa070,
+	0x19a4c116,0x1e376c08,0x2748774c,0x34b0bcb5,0x391c0cb3,0x4ed8aa4a,0x5b9cca4f,0x682e6ff3,
+	0x748f82ee,0x78a5636f,0x84c87814,0x8cc70208,0x90befffa,0xa4506ceb,0xbef9a3f7,0xc67178f2
+};
+
+#define ROTR(x,n) (((x)>>(n)) | ((x)<<(32-(n))))	//!< Right rotation of a 32-bit word
+
+/**
+ * \brief Apply the compression function to a block
+ *
+ * \param h Intermediate hash
+ * \param block Block of SHA256_BLOCK bytes
+ */
+static void sha256_block(uint32_t h[8],const unsigned char *block) {
+	uint32_t w[64],a,b,c,d,e,f,g,k,t1,t2;
+	int i;
+	for (i=0;i<16;++i) w[i]=(uint32_t)block[4*i]<<24 | (uint32_t)block[4*i+1]<<16 | (uint32_t)block[4*i+2]<<8 | block[4*i+3];
+	for (i=16;i<64;++i) w[i]=(ROTR(w[i-2],17) ^ ROTR(w[i-2],19) ^ (w[i-2]>>10))+w[i-7]+(ROTR(w[i-15],7) ^ ROTR(w[i-15],18) ^ (w[i-15]>>3))+w[i-16];
+	a=h[0];b=h[1];c=h[2];d=h[3];e=h[4];f=h[5];g=h[6];k=h[7];
+	for (i=0;i<64;++i) {
+		t1=k+(ROTR(e,6) ^ ROTR(e,11) ^ ROTR(e,25))+((e & f) ^ (~e & g))+K[i]+w[i];
+		t2=(ROTR(a,2) ^ ROTR(a,13) ^ ROTR(a,22))+((a & b) ^ (a & c) ^ (b & c));
+		k=g;g=f;f=e;e=d+t1;d=c;c=b;b=a;a=t1+t2;
+	}
+	h[0]+=a;h[1]+=b;h[2]+=c;h[3]+=d;h[4]+=e;h[5]+=f;h[6]+=g;h[7]+=k;
+}
+
+void sha256_init(Sha256 *s) {
+	static const uint32_t initial[8]={0x6a09e667,0xbb67ae85,0x3c6ef372,0xa54ff53a,0x510e527f,0x9b05688c,0x1f83d9ab,0x5be0cd19};
+	memcpy(s->h,initial,sizeof initial);
+	s->length=0;
+	s->used=0;
+}
+
+void sha256_update(Sha256 *s,const void *data,size_t len) {
+	const unsigned char *p=(const unsigned char*)data;
+	s->length+=len;
+	if (s->used>0) {
+		size_t n=(len<SHA256_BLOCK-s->used)?len:SHA256_BLOCK-s->used;
+		memcpy(s->block+s->used,p,n);
+		s->used+=n;
+		p+=n;
+		len-=n;
+		if (s->used<SHA256_BLOCK) return;
+		sha256_block(s->h,s->block);
+		s->used=0;
+	}
+	for (;len>=SHA256_BLOCK;p+=SHA256_BLOCK,len-=SHA256_BLOCK) sha256_block(s->h,p);
+	memcpy(s->block,p,len);
+	s->used=len;
+}
+
+void sha256_final(Sha256 *s,unsigned char *digest) {
+	uint64_t bits=s->length*8;
+	int i;
+	s->block[s->used++]=0x80;
+	if (s->used>SHA256_BLOCK-8) {
+		memset(s->block+s->used,0,SHA256_BLOCK-s->used);
+		sha256_block(s->h,s->block);
+		s->used=0;
+	}
+	memset(s->block+s->used,0,SHA256_BLOCK-8-s->used);
+	for (i=0;i<8;++i) s->block[SHA256_BLOCK-1-i]=bits>>(8*i);
+	sha256_block(s->h,s->block);
+	for (i=0;i<32;++i) digest[i]=s->h[i/4]>>(24-8*(i%4));
+}
+
+void hmac_init(Hmac *m,const void *key,size_t len) {
+	unsigned char pad[SHA256_BLOCK];
+	size_t i;
+	memset(pad,0,sizeof pad);
+	if (len>SHA256_BLOCK) {	// Long keys are replaced by their digest
+		sha256_init(&m->inner);
+		sha256_update(&m->inner,key,len);
+		sha256_final(&m->inner,pad);
+	} else memcpy(pad,key,len);
+	for (i=0;i<SHA256_BLOCK;++i) pad[i]^=0x36;
+	sha256_init(&m->inner);
+	sha256_update(&m->inner,pad,sizeof pad);
+	for (i=0;i<SHA256_BLOCK;++i) pad[i]^=0x36 ^ 0x5c;
+	sha256_init(&m->outer);
+	sha256_update(&m->outer,pad,sizeof pad);
+}
+
+void hmac_update(Hmac *m,const void *data,size_t len) {
+	sha256_update(&m->inner,data,len);
+}
+
+void hmac_final(Hmac *m,unsigned char *mac) {
+	unsigned char digest[SHA256_SIZE];
+	sha256_final(&m->inner,digest);
+	sha256_update(&m->outer,digest,sizeof digest);
+	sha256_final(&m->outer,mac);
+}
+
+void to_hex(const unsigned char *bytes,size_t len,char *hex) {
+	static const char digits[]="0123456789abcdef";
+	size_t i;
+	for (i=0;i<len;++i) {
+		hex[2*i]=digits[bytes[i]>>4];
+		hex[2*i+1]=digits[bytes[i] & 0xf];
+	}
+	hex[2*len]=0;
+}
@@ -0,0 +1,107 @@
+/**
+ * \file
+ *
+ * =====================================================================================
+ *
+ *       Filename:  sha256.h
+ *
+ *    Description:  SHA-256 and HMAC-SHA-256
+ *
+ *        Version:  2.0
+ *        Created:  10/18/2026
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  
+ *        Company:  
+ *
+ * =====================================================================================
+ */
+
+#ifndef  SHA256_INC
+#define  SHA256_INC
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SHA256_SIZE 32	//!< Number of bytes of a digest
+#define SHA256_BLOCK 64	//!< Number of bytes of a block of the compression function
+
+/**
+ * \brief State of a SHA-256 computation
+ */
+typedef struct Sha256 {
+	uint32_t h[8];	//!< Intermediate hash
+	uint64_t length;	//!< Number of bytes hashed so far
+	unsigned char block[SHA256_BLOCK];	//!< Bytes of the current block
+	size_t used;	//!< Number of bytes in block
+} Sha256;
+
+/**
+ * \brief State of an HMAC-SHA-256 computation
+ */
+typedef struct Hmac {
+	Sha256 inner;	//!< Hash of the inner padded key and of the message
+	Sha256 outer;	//!< Hash of the outer padded key, completed with the inner digest
+} Hmac;
+
+/**
+ * \brief Start a SHA-256 computation
+ *
+ * \param s State of the computation
+ */
+void sha256_init(Sha256 *s);
+
+/**
+ * \brief Add bytes to a SHA-256 computation
+ *
+ * \param s State of the computation
+ * \param data Bytes to add
+ * \param len Number of bytes
+ */
+void sha256_update(Sha256 *s,const void *data,size_t len);
+
+/**
+ * \brief End a SHA-256 computation
+ *
+ * \param s State of the computation, which must be initialized again before another use
+ * \param digest Array receiving the SHA256_SIZE bytes of the digest
+ */
+void sha256_final(Sha256 *s,unsigned char *digest);
+
+/**
+ * \brief Start an HMAC-SHA-256 computation
+ *
+ * \param m State of the computation
+ * \param key Secret key
+ * \param len Number of bytes of the key
+ */
+void hmac_init(Hmac *m,const void *key,size_t len);
+
+/**
+ * \brief Add bytes to an HMAC-SHA-256 computation
+ *
+ * \param m State of the computation
+ * \param data Bytes to add
+ * \param len Number of bytes
+ */
+void hmac_update(Hmac *m,const void *data,size_t len);
+
+/**
+ * \brief End an HMAC-SHA-256 computation
+ *
+ * \param m State of the computation
+ * \param mac Array receiving the SHA256_SIZE bytes of the code
+ */
+void hmac_final(Hmac *m,unsigned char *mac);
+
+/**
+ * \brief Write bytes in lowercase hexadecimal
+ *
+ * \param bytes Bytes to write
+ * \param len Number of bytes
+ * \param hex Buffer receiving the 2*len digits and a null character
+ */
+void to_hex(const unsigned char *bytes,size_t len,char *hex);
+
+#endif   /* ----- #ifndef SHA256_INC  ----- */
@@ -0,0 +1,240 @@
+/*
+ * =====================================================================================
+ *
+ *       Filename:  shared.c
+ *
+ *    Description:  Implementation of the cache of script outputs shared by the instances of a host
+ *
+ *        Version:  2.0
+ *        Created:  10/18/2026
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  
+ *        Company:  
+ *
+ * =====================================================================================
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/file.h>
+#include "operations.h"
+#include "cache.h"
+#include "stats.h"
+#include "shared.h"
+
+extern struct Persistent persistent;
+
+#define SHARED_SEED 0x84222325cbf29ce4ULL	//!< Offset basis of the second half of the keys
+#define SHARED_LOCK_SUFFIX ".lock"	//!< Suffix of the lock files of the outputs
+#define SHARED_SCAN_INTERVAL 10	//!< Maximal number of seconds between two scans of the shared folder for the eviction
+
+/**
+ * \brief Output found while enforcing the budget of the shared cache
+ */
+typedef struct SharedFile {
+	SharedKey key;	//!< Key of the output
+	time_t atime;	//!< Last use of the output
+	off_t size;	//!< Size of the output
+} SharedFile;
+
+static int shared_fd=-1;	//!< Descriptor of the shared folder, -1 if there is no shared cache
+static pthread_mutex_t evict_mutex=PTHREAD_MUTEX_INITIALIZER;	//!< Serializes the evictions of the threads of this process (the flock serializes the processes), protects shared_bytes and shared_scanned
+static unsigned long long shared_bytes=0;	//!< Estimate of the number of bytes of the outputs of the shared folder: size found by the last scan, plus the outputs stored by this process since then
+static time_t shared_scanned=0;	//!< Time of the last scan of the shared folder
+static unsigned int shared_temps=0;	//!< Number of temporary names used to publish outputs, makes them unique in the process
+
+int open_shared_cache(const char *path) {
+	if (mkdir(path,0755)!=0 && errno!=EEXIST) return errno;
+	shared_fd=open(path,O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	return (shared_fd<0)?errno:0;
+}
+
+void close_shared_cache() {
+	if (shared_fd>=0) close(shared_fd);
+	shared_fd=-1;
+}
+
+/**
+ * \brief Add bytes to a 64-bit FNV-1a hash
+ *
+ * \param hash Current value of the hash
+ * \param data Bytes to add
+ * \param len Number of bytes
+ * \return New value of the hash
+ */
+static uint64_t hash_bytes(uint64_t hash,const void *data,size_t len) {
+	const unsigned char *p=(const unsigned char*)data;
+	while (len-->0) {hash^=*(p++);hash*=FNV_PRIME;}
+	return hash;
+}
+
+int shared_key(const char *relative,Procedure *proc,const struct stat *source,SharedKey *key) {
+	struct stat mirror;
+	if (shared_fd<0 || source->st_ino==0 || cache_mode(proc)==CACHE_NEVER || fstat(current_mount()->mirror_fd,&mirror)!=0) return -1;
+	uint64_t identity[7]={mirror.st_dev,mirror.st_ino,source->st_dev,source->st_ino,source->st_size,source->st_mtim.tv_sec,source->st_mtim.tv_nsec};
+	size_t len;
+	const char *definition=procedure_definition(current_mount(),proc,&len);
+	uint64_t h1=FNV_OFFSET,h2=SHARED_SEED;
+	h1=hash_bytes(h1,identity,sizeof identity);
+	h1=hash_bytes(h1,relative,strlen(relative)+1);
+	h1=hash_bytes(h1,definition,len);
+	h2=hash_bytes(h2,definition,len);
+	h2=hash_bytes(h2,relative,strlen(relative)+1);
+	h2=hash_bytes(h2,identity,sizeof identity);
+	snprintf(key->name,sizeof key->name,"%016llx%016llx",(unsigned long long)h1,(unsigned long long)h2);
+	return 0;
+}
+
+int shared_lookup(const SharedKey *key) {
+	if (shared_fd<0) return -1;
+	int fd=openat(shared_fd,key->name,O_RDONLY | O_CLOEXEC);
+	if (fd<0) return -1;
+	struct stat st;
+	if (fstat(fd,&st)!=0 || st.st_mtime<time(0)) {	// The modification time of the file is the expiry date of the output
+		close(fd);
+		return -1;
+	}
+	struct timespec ts[2]={{0,UTIME_NOW},{0,UTIME_OMIT}};
+	futimens(fd,ts);	// Record the use for the eviction, may fail if the output belongs to another user
+	STAT_ADD(shared_hits,1);
+	return fd;
+}
+
+int shared_lock(const SharedKey *key) {
+	char name[sizeof key->name+sizeof SHARED_LOCK_SUFFIX];
+	snprintf(name,sizeof name,"%s%s",key->name,SHARED_LOCK_SUFFIX);
+	int lock=openat(shared_fd,name,O_RDONLY | O_CREAT | O_CLOEXEC,0644);
+	if (lock<0) return -1;
+	if (flock(lock,LOCK_EX | LOCK_NB)!=0) {	// Another instance is generating the output
+		STAT_ADD(shared_waits,1);
+		while (flock(lock,LOCK_EX)!=0 && errno==EINTR);
+	}
+	return lock;
+}
+
+void shared_unlock(const SharedKey *key,int lock) {
+	if (lock<0) return;
+	if (faccessat(shared_fd,key->name,F_OK,0)!=0) {	// No output was published, the lock file would be left behind forever
+		char name[sizeof key->name+sizeof SHARED_LOCK_SUFFIX];
+		snprintf(name,sizeof name,"%s%s",key->name,SHARED_LOCK_SUFFIX);
+		unlinkat(shared_fd,name,0);
+	}
+	close(lock);	// Closing the descriptor releases the lock
+}
+
+/**
+ * \brief Compare two outputs by last use, for qsort
+ *
+ * \param a Pointer to the first SharedFile structure
+ * \param b Pointer to the second SharedFile structure
+ * \return Negative value if a was used before b, positive value if it was used after, 0 otherwise
+ */
+static int compare_use(const void *a,const void *b) {
+	time_t ta=((const SharedFile*)a)->atime,tb=((const SharedFile*)b)->atime;
+	return (ta<tb)?-1:(ta>tb)?1:0;
+}
+
+/**
+ * \brief Remove an output and its lock file from the shared folder
+ *
+ * \param key Key of the output
+ */
+static void shared_remove(const SharedKey *key) {
+	char name[sizeof key->name+sizeof SHARED_LOCK_SUFFIX];
+	unlinkat(shared_fd,key->name,0);
+	snprintf(name,sizeof name,"%s%s",key->name,SHARED_LOCK_SUFFIX);
+	unlinkat(shared_fd,name,0);
+	STAT_ADD(shared_evictions,1);
+}
+
+/**
+ * \brief Make room in the shared cache for a new output
+ *
+ * The shared folder is only scanned when the estimate of its size (see shared_bytes) shows that the new output would exceed the budget, or when the last scan is older than SHARED_SCAN_INTERVAL, so that most stores do not read the whole folder. The outputs stored by the other instances in the meantime are only seen by the next scan, the budget may be exceeded by that much. The scan removes the expired outputs, then the least recently used ones until the new output fits in the budget. It is serialized between the instances with a lock on the shared folder.
+ * \param incoming Size of the new output
+ */
+static void shared_evict(off_t incoming) {
+	pthread_mutex_lock(&evict_mutex);
+	time_t now=time(0);
+	if (now-shared_scanned<SHARED_SCAN_INTERVAL && shared_bytes+incoming<=persistent.shared_cache_size) {
+		shared_bytes+=incoming;
+		pthread_mutex_unlock(&evict_mutex);
+		return;
+	}
+	while (flock(shared_fd,LOCK_EX)!=0 && errno==EINTR);
+	int fd=openat(shared_fd,".",O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	DIR *dir=(fd>=0)?fdopendir(fd):0;
+	SharedFile *files=0;
+	size_t num=0,max=0,i;
+	unsigned long long total=0;
+	struct dirent *de;
+	while (dir!=0 && (de=readdir(dir))!=0) {
+		struct stat st;
+		if (strlen(de->d_name)!=sizeof files->key.name-1 || fstatat(shared_fd,de->d_name,&st,AT_SYMLINK_NOFOLLOW)!=0 || !S_ISREG(st.st_mode)) continue;	// Only the outputs have a name of the size of a key
+		SharedFile file;
+		strcpy(file.key.name,de->d_name);
+		if (st.st_mtime<now) {shared_remove(&file.key);continue;}
+		file.atime=st.st_atime;
+		file.size=st.st_size;
+		if (num==max) {
+			SharedFile *more=(SharedFile*)realloc(files,(max=max?2*max:0x100)*sizeof(SharedFile));
+			if (more==0) break;
+			files=more;
+		}
+		files[num++]=file;
+		total+=file.size;
+	}
+	if (dir!=0) closedir(dir); else if (fd>=0) close(fd);
+	if (total+incoming>persistent.shared_cache_size) {
+		qsort(files,num,sizeof(SharedFile),compare_use);
+		for (i=0;i<num && total+incoming>persistent.shared_cache_size;++i) {
+			shared_remove(&files[i].key);
+			total-=files[i].size;
+		}
+	}
+	free(files);
+	shared_bytes=total+incoming;
+	shared_scanned=now;
+	flock(shared_fd,LOCK_UN);
+	pthread_mutex_unlock(&evict_mutex);
+}
+
+void shared_store(const SharedKey *key,int fd,int ttl) {
+	struct stat st;
+	if (shared_fd<0 || fstat(fd,&st)!=0 || st.st_size>persistent.shared_cache_size) return;
+	shared_evict(st.st_size);
+	int out=openat(shared_fd,".",O_TMPFILE | O_RDWR | O_CLOEXEC,0644);
+	if (out<0) return;
+	if (lseek(fd,0,SEEK_SET)!=0 || copy_data(fd,out)!=st.st_size) {
+		close(out);
+		return;
+	}
+	struct timespec ts[2]={{0,UTIME_NOW},{(ttl>0)?time(0)+ttl:INT32_MAX,0}};
+	futimens(out,ts);
+	char path[64],temp[sizeof key->name+64];
+	snprintf(path,sizeof path,"/proc/self/fd/%d",out);
+	snprintf(temp,sizeof temp,"%s.%d.%u.tmp",key->name,(int)getpid(),__atomic_fetch_add(&shared_temps,1,__ATOMIC_RELAXED));	// Never taken for an output by the eviction, which only knows names of the size of a key
+	if (linkat(AT_FDCWD,path,shared_fd,temp,AT_SYMLINK_FOLLOW)!=0) {
+		close(out);
+		return;
+	}
+	if (renameat(shared_fd,temp,shared_fd,key->name)!=0) {	// The expired output, if any, is replaced atomically: readers see either of them
+		unlinkat(shared_fd,temp,0);
+		close(out);
+		return;
+	}
+	close(out);
+	STAT_ADD(shared_stores,1);
+}
@@ -0,0 +1,99 @@
+/**
+ * \file
+ *
+ * =====================================================================================
+ *
+ *       Filename:  shared.h
+ *
+ *    Description:  Cache of script outputs shared by all the instances of a host
+ *
+ *        Version:  2.0
+ *        Created:  10/18/2026
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  
+ *        Company:  
+ *
+ * =====================================================================================
+ */
+
+#ifndef  SHARED_INC
+#define  SHARED_INC
+
+#include <sys/stat.h>
+#include "procedures.h"
+
+#define DEFAULT_SHARED_CACHE_SIZE 0x40000000	//!< Default maximal number of bytes of the outputs of the shared cache, for the whole host
+
+/**
+ * \brief Key of an output in the shared cache
+ *
+ * The key is a 128-bit hash of the identity of the mirror folder, the path of the script, the identity of the version of the script (device, inode, size and modification time) and the definition of the procedure, written in hexadecimal. It is the name of the file holding the output in the shared folder.
+ */
+typedef struct SharedKey {
+	char name[33];	//!< Hexadecimal hash, null-terminated
+} SharedKey;
+
+/**
+ * \brief Open the folder of the shared cache, creating it if needed
+ *
+ * The folder should be on a memory file system such as /dev/shm. Every instance using the same folder shares the outputs it holds.
+ * \param path Path of the folder
+ * \return 0 if everything went fine, an error code otherwise
+ */
+int open_shared_cache(const char *path);
+
+/**
+ * \brief Close the folder of the shared cache
+ */
+void close_shared_cache();
+
+/**
+ * \brief Compute the key of the output of a script in the shared cache
+ *
+ * \param relative Path of the script relative to the mirror folder of the current mount
+ * \param proc Procedure producing the output
+ * \param source Attributes of the script, as given by cache_lookup
+ * \param key Structure receiving the key
+ * \return 0 if the output may be shared, -1 otherwise (no shared cache, procedure which never caches, unknown script)
+ */
+int shared_key(const char *relative,Procedure *proc,const struct stat *source,SharedKey *key);
+
+/**
+ * \brief Look for an output in the shared cache
+ *
+ * \param key Key of the output
+ * \return New descriptor of the output, which must be closed by the caller and read with pread, -1 if there is no valid output
+ */
+int shared_lookup(const SharedKey *key);
+
+/**
+ * \brief Take the lock of an output, to generate it only once on the host
+ *
+ * If another instance holds the lock, the function waits until it releases it, which usually means that the output was published.
+ * \param key Key of the output
+ * \return Descriptor of the lock, to be given to shared_unlock, -1 if the lock could not be taken
+ */
+int shared_lock(const SharedKey *key);
+
+/**
+ * \brief Release the lock of an output
+ *
+ * If no output was published under the key, the lock file is removed. An instance which was waiting for the lock then generates the output itself, possibly at the same time as an instance which created a new lock file: the work is done twice, but both publish the same output.
+ * \param key Key of the output
+ * \param lock Descriptor of the lock given by shared_lock, -1 to do nothing
+ */
+void shared_unlock(const SharedKey *key,int lock);
+
+/**
+ * \brief Publish an output in the shared cache
+ *
+ * The output is copied to a new file of the shared folder, linked under a temporary name then renamed over the previous one, which it replaces atomically. The oldest outputs (by last use) are removed if the budget of the host would be exceeded.
+ * \param key Key of the output
+ * \param fd Descriptor of the output
+ * \param ttl Time to live of the output in seconds, 0 if it is valid until the script changes
+ */
+void shared_store(const SharedKey *key,int fd,int ttl);
+
+#endif   /* ----- #ifndef SHARED_INC  ----- */
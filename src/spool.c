@@ -0,0 +1,158 @@
+/*
+ * =====================================================================================
+ *
+ *       Filename:  spool.c
+ *
+ *    Description:  Implementation of the huge page spool
+ *
+ *        Version:  2.0
+ *        Created:  10/18/2026
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  
+ *        Company:  
+ *
+ * =====================================================================================
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/vfs.h>
+#include <sys/sendfile.h>
+#include <linux/magic.h>
+#include "operations.h"
+#include "stats.h"
+#include "spool.h"
+
+extern struct Persistent persistent;
+
+static char spool_dir[FILENAME_MAX_LENGTH]="";	//!< Folder of the spool, empty if the spool is disabled
+static dev_t spool_dev=0;	//!< Device of the spool folder, tells the outputs created in the spool
+static int spool_apart=1;	//!< Non-zero if the spool is not on the file system of the temporary files, which otherwise serve as the spool
+static off_t spool_threshold=DEFAULT_HUGE_THRESHOLD;	//!< Minimal size of the outputs kept in the spool
+
+int init_spool(const char *spec) {
+	if (spec==0) return 0;
+	const char *colon=strrchr(spec,':');
+	unsigned long long threshold;
+	if (colon && (read_number(colon+1,LLONG_MAX,&threshold)!=0 || threshold==0)) colon=0;	// The colon belongs to the folder
+	size_t len=(colon==0)?strlen(spec):(size_t)(colon-spec);
+	if (len==0 || len>=sizeof spool_dir) return -1;
+	if (colon) spool_threshold=threshold;
+	memcpy(spool_dir,spec,len);
+	spool_dir[len]=0;
+	struct statfs fs;
+	struct stat st;
+	if (statfs(spool_dir,&fs)!=0 || stat(spool_dir,&st)!=0 || !S_ISDIR(st.st_mode)) {
+		spool_dir[0]=0;
+		return -1;
+	}
+	spool_dev=st.st_dev;
+	char temp[sizeof(persistent.tmp_template)];
+	strncpy(temp,persistent.tmp_template,sizeof temp-1);
+	temp[sizeof temp-1]=0;
+	char *slash=strrchr(temp,'/');
+	if (slash) {
+		*slash=0;
+		spool_apart=(stat((slash==temp)?"/":temp,&st)!=0 || st.st_dev!=spool_dev);
+	}
+	if (fs.f_type!=TMPFS_MAGIC) fprintf(stderr,"init_spool: %s is not on a tmpfs, the outputs will not be on huge pages\n",spool_dir);
+	return 0;
+}
+
+/**
+ * \brief Create an anonymous file in a folder
+ *
+ * \param folder Folder of the file
+ * \return Descriptor of the file, -1 if it could not be created
+ */
+static int anonymous_file(const char *folder) {
+	int fd=open(folder,O_TMPFILE | O_RDWR,S_IRUSR | S_IWUSR);
+	if (fd>=0 || errno!=EOPNOTSUPP) return fd;
+	char name[FILENAME_MAX_LENGTH+16];	// O_TMPFILE is not supported, create and unlink
+	snprintf(name,sizeof name,"%s/sfs.XXXXXX",folder);
+	fd=mkstemp(name);
+	if (fd>=0) unlink(name);
+	return fd;
+}
+
+/**
+ * \brief Create an anonymous file next to the temporary files of the outputs
+ *
+ * \return Descriptor of the file, -1 if it could not be created
+ */
+static int temporary_file() {
+	char name[sizeof(persistent.tmp_template)];
+	strncpy(name,persistent.tmp_template,sizeof name-1);
+	name[sizeof name-1]=0;
+	int fd=mkstemp(name);
+	if (fd>=0) unlink(name);
+	return fd;
+}
+
+/**
+ * \brief Copy an output to another file and replace its descriptor
+ *
+ * The copy stays in the kernel: copy_file_range cannot cross tmpfs instances, so sendfile is used.
+ * \param handle Descriptor of the output, closed if the copy succeeds
+ * \param fd Descriptor of the destination, closed if the copy fails
+ * \param size Size of the output
+ * \return Descriptor of the output, fd on success and handle on failure
+ */
+static int move_output(int handle,int fd,off_t size) {
+	off_t offset=0;
+	while (offset<size) {
+		ssize_t num=sendfile(fd,handle,&offset,size-offset);
+		if (num<0 && errno==EINTR) continue;
+		if (num<=0) break;
+	}
+	if (offset<size) {
+#ifdef TRACE
+		fprintf(stderr,"move_output: Copy failed after %lld bytes: %s\n",(long long)offset,strerror(errno));
+#endif
+		close(fd);
+		return handle;
+	}
+	close(handle);
+	lseek(fd,0,SEEK_SET);
+	return fd;
+}
+
+int spool_create() {
+	if (spool_dir[0]==0) return -1;
+	int fd=anonymous_file(spool_dir);
+	if (fd<0) fprintf(stderr,"spool_create: Cannot create a file in %s: %s\n",spool_dir,strerror(errno));
+	return fd;
+}
+
+int spool_output(int handle) {
+	if (spool_dir[0]==0) return handle;
+	struct stat st;
+	if (fstat(handle,&st)!=0) return handle;
+	int fd;
+	if (st.st_dev==spool_dev) {	// Created in the spool by spool_create
+		if (st.st_size>=spool_threshold) {
+			STAT_ADD(huge_outputs,1);
+			return handle;
+		}
+		if (!spool_apart || (fd=temporary_file())<0) return handle;	// A small output does not hold huge pages of the spool
+		return move_output(handle,fd,st.st_size);
+	}
+	if (st.st_size<spool_threshold) return handle;
+	if ((fd=anonymous_file(spool_dir))<0) {
+		fprintf(stderr,"spool_output: Cannot create a file in %s: %s\n",spool_dir,strerror(errno));
+		return handle;
+	}
+	int moved=move_output(handle,fd,st.st_size);
+	if (moved==fd) STAT_ADD(huge_outputs,1);
+	return moved;
+}
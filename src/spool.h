@@ -0,0 +1,52 @@
+/**
+ * \file
+ *
+ * =====================================================================================
+ *
+ *       Filename:  spool.h
+ *
+ *    Description:  Spool of the large outputs on huge pages
+ *
+ *        Version:  2.0
+ *        Created:  10/18/2026
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  
+ *        Company:  
+ *
+ * =====================================================================================
+ */
+
+#ifndef  SPOOL_INC
+#define  SPOOL_INC
+
+#define DEFAULT_HUGE_THRESHOLD 0x4000000	//!< Default minimal size of an output moved to the huge page spool
+
+/**
+ * \brief Choose the folder in which the large outputs are kept
+ *
+ * The folder should be on a tmpfs mounted with the huge=always (or huge=within_size) option, so that the outputs are backed by transparent huge pages and their readers take fewer TLB misses and page faults. A warning is printed if the folder is not on a tmpfs.
+ * \param spec Folder, optionally followed by a colon and the minimal size in bytes of the outputs kept there. The colon belongs to the folder if it is not followed by a positive number, or null to disable the spool
+ * \return 0 if everything went fine, -1 if the folder cannot be used
+ */
+int init_spool(const char *spec);
+
+/**
+ * \brief Create the output of a script in the huge page spool
+ *
+ * When the spool is enabled, the script writes its output directly to an anonymous file of the spool, so that a large output is never copied. spool_output then moves the outputs that turn out to be smaller than the threshold out of the spool.
+ * \return Descriptor of the file, -1 if the spool is disabled or the file cannot be created
+ */
+int spool_create();
+
+/**
+ * \brief Keep an output in the huge page spool only if it is large enough
+ *
+ * An output created by spool_create stays in the spool if it is larger than the threshold; a smaller one is copied to a temporary file, which is cheap since it is small, so that it does not hold huge pages. Any other output (e.g. fetched from the remote cache) larger than the threshold is copied in the kernel to an anonymous file of the spool. The output is kept where it is if the spool is disabled or if anything fails.
+ * \param handle Descriptor of the output
+ * \return Descriptor of the output, either handle or a new one
+ */
+int spool_output(int handle);
+
+#endif   /* ----- #ifndef SPOOL_INC  ----- */
@@ -0,0 +1,77 @@
+/*
+ * =====================================================================================
+ *
+ *       Filename:  stats.c
+ *
+ *    Description:  Implementation of the statistics and control files
+ *
+ *        Version:  2.0
+ *        Created:  10/18/2026
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  
+ *        Company:  
+ *
+ * =====================================================================================
+ */
+
+#include <string.h>
+#include "stats.h"
+#include "cache.h"
+#include "mount.h"
+#include "supervisor.h"
+#include "hotpath.h"
+
+struct Stats stats;
+
+const ControlFile control_files[]={
+	{"stats",render_stats},
+	{"cache",render_cache},
+	{"mounts",render_mounts},
+	{"top",render_top},
+	{0,0}
+};
+
+const ControlFile *get_control_file(const char *name) {
+	const ControlFile *c;
+	for (c=control_files;c->name!=0;++c) if (strcmp(c->name,name)==0) return c;
+	return 0;
+}
+
+void render_stats(FILE *f) {
+	fprintf(f,"executions %llu\n",__atomic_load_n(&stats.executions,__ATOMIC_RELAXED));
+	fprintf(f,"tests %llu\n",__atomic_load_n(&stats.tests,__ATOMIC_RELAXED));
+	fprintf(f,"bytes_generated %llu\n",__atomic_load_n(&stats.bytes_generated,__ATOMIC_RELAXED));
+	fprintf(f,"cache_hits %llu\n",__atomic_load_n(&stats.cache_hits,__ATOMIC_RELAXED));
+	fprintf(f,"cache_misses %llu\n",__atomic_load_n(&stats.cache_misses,__ATOMIC_RELAXED));
+	fprintf(f,"cache_promotions %llu\n",__atomic_load_n(&stats.cache_promotions,__ATOMIC_RELAXED));
+	fprintf(f,"cache_demotions %llu\n",__atomic_load_n(&stats.cache_demotions,__ATOMIC_RELAXED));
+	fprintf(f,"nested_requests %llu\n",__atomic_load_n(&stats.nested_requests,__ATOMIC_RELAXED));
+	fprintf(f,"nested_cache_hits %llu\n",__atomic_load_n(&stats.nested_cache_hits,__ATOMIC_RELAXED));
+	fprintf(f,"job_waits %llu\n",__atomic_load_n(&stats.job_waits,__ATOMIC_RELAXED));
+	fprintf(f,"job_limit_increases %llu\n",__atomic_load_n(&stats.job_limit_increases,__ATOMIC_RELAXED));
+	fprintf(f,"job_limit_decreases %llu\n",__atomic_load_n(&stats.job_limit_decreases,__ATOMIC_RELAXED));
+	fprintf(f,"shared_hits %llu\n",__atomic_load_n(&stats.shared_hits,__ATOMIC_RELAXED));
+	fprintf(f,"shared_stores %llu\n",__atomic_load_n(&stats.shared_stores,__ATOMIC_RELAXED));
+	fprintf(f,"shared_waits %llu\n",__atomic_load_n(&stats.shared_waits,__ATOMIC_RELAXED));
+	fprintf(f,"shared_evictions %llu\n",__atomic_load_n(&stats.shared_evictions,__ATOMIC_RELAXED));
+	fprintf(f,"remote_hits %llu\n",__atomic_load_n(&stats.remote_hits,__ATOMIC_RELAXED));
+	fprintf(f,"remote_misses %llu\n",__atomic_load_n(&stats.remote_misses,__ATOMIC_RELAXED));
+	fprintf(f,"remote_stores %llu\n",__atomic_load_n(&stats.remote_stores,__ATOMIC_RELAXED));
+	fprintf(f,"remote_errors %llu\n",__atomic_load_n(&stats.remote_errors,__ATOMIC_RELAXED));
+	fprintf(f,"fork_server_runs %llu\n",__atomic_load_n(&stats.fork_server_runs,__ATOMIC_RELAXED));
+	fprintf(f,"context_refreshes %llu\n",__atomic_load_n(&stats.context_refreshes,__ATOMIC_RELAXED));
+	fprintf(f,"compressed_outputs %llu\n",__atomic_load_n(&stats.compressed_outputs,__ATOMIC_RELAXED));
+	fprintf(f,"compressed_hits %llu\n",__atomic_load_n(&stats.compressed_hits,__ATOMIC_RELAXED));
+	fprintf(f,"compressed_evictions %llu\n",__atomic_load_n(&stats.compressed_evictions,__ATOMIC_RELAXED));
+	fprintf(f,"output_changes %llu\n",__atomic_load_n(&stats.output_changes,__ATOMIC_RELAXED));
+	fprintf(f,"readahead_bytes %llu\n",__atomic_load_n(&stats.readahead_bytes,__ATOMIC_RELAXED));
+	fprintf(f,"random_handles %llu\n",__atomic_load_n(&stats.random_handles,__ATOMIC_RELAXED));
+	fprintf(f,"huge_outputs %llu\n",__atomic_load_n(&stats.huge_outputs,__ATOMIC_RELAXED));
+	fprintf(f,"inline_outputs %llu\n",__atomic_load_n(&stats.inline_outputs,__ATOMIC_RELAXED));
+	fprintf(f,"cancellations %llu\n",__atomic_load_n(&stats.cancellations,__ATOMIC_RELAXED));
+	fprintf(f,"cancel_spared %llu\n",__atomic_load_n(&stats.cancel_spared,__ATOMIC_RELAXED));
+	render_jobs(f);
+	render_cache_summary(f);
+}
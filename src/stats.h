@@ -0,0 +1,104 @@
+/**
+ * \file
+ *
+ * =====================================================================================
+ *
+ *       Filename:  stats.h
+ *
+ *    Description:  Statistics of the file system and virtual control files
+ *
+ *        Version:  2.0
+ *        Created:  10/18/2026
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  
+ *        Company:  
+ *
+ * =====================================================================================
+ */
+
+#ifndef  STATS_INC
+#define  STATS_INC
+
+#include <stdio.h>
+
+#define CONTROL_FOLDER "/.scriptfs"	//!< Virtual path of the folder holding the control files, when they are enabled
+
+/**
+ * \brief Counters of the file system
+ *
+ * The counters are updated with atomic operations (see STAT_ADD) and can be read at any time through the stats control file.
+ */
+struct Stats {
+	unsigned long long executions;	//!< Number of scripts executed
+	unsigned long long tests;	//!< Number of test programs executed
+	unsigned long long bytes_generated;	//!< Number of bytes produced by the executed scripts
+	unsigned long long cache_hits;	//!< Number of outputs served from the cache
+	unsigned long long cache_misses;	//!< Number of outputs which had to be generated although their procedure may cache them
+	unsigned long long cache_promotions;	//!< Number of times a script was found stable and expensive enough to be cached
+	unsigned long long cache_demotions;	//!< Number of times the output of a cached script changed
+	unsigned long long nested_requests;	//!< Number of scripts run for requests coming from other scripts
+	unsigned long long nested_cache_hits;	//!< Number of nested requests served from the cache
+	unsigned long long job_waits;	//!< Number of ordinary requests which had to wait for a free execution slot
+	unsigned long long job_limit_increases;	//!< Number of times the adaptive limit of executions was increased
+	unsigned long long job_limit_decreases;	//!< Number of times the adaptive limit of executions was decreased
+	unsigned long long shared_hits;	//!< Number of outputs served from the host-wide shared cache
+	unsigned long long shared_stores;	//!< Number of outputs published in the host-wide shared cache
+	unsigned long long shared_waits;	//!< Number of executions which waited for another instance generating the same output
+	unsigned long long shared_evictions;	//!< Number of outputs removed from the shared cache to respect its budget
+	unsigned long long remote_hits;	//!< Number of outputs served from the remote cache
+	unsigned long long remote_misses;	//!< Number of outputs which were not in the remote cache
+	unsigned long long remote_stores;	//!< Number of outputs sent to the remote cache
+	unsigned long long remote_errors;	//!< Number of failed exchanges with the remote cache
+	unsigned long long fork_server_runs;	//!< Number of scripts run by the fork server of their interpreter
+	unsigned long long context_refreshes;	//!< Number of contexts produced for the mounts
+	unsigned long long compressed_outputs;	//!< Number of outputs compressed for their compressed siblings
+	unsigned long long compressed_hits;	//!< Number of compressed siblings served from a previous compression
+	unsigned long long compressed_evictions;	//!< Number of compressed outputs evicted to make room for a new one
+	unsigned long long output_changes;	//!< Number of outputs different from the previous output of their script (with --generation-times)
+	unsigned long long readahead_bytes;	//!< Number of bytes of the mirror prefetched ahead of sequential readers
+	unsigned long long random_handles;	//!< Number of handles of the mirror advised random
+	unsigned long long huge_outputs;	//!< Number of outputs kept in the huge page spool
+	unsigned long long inline_outputs;	//!< Number of outputs opened from memory rather than from their temporary file
+	unsigned long long cancellations;	//!< Number of executions killed because their request was interrupted
+	unsigned long long cancel_spared;	//!< Number of interrupted requests which let their execution complete because its output goes to a cache
+};
+
+extern struct Stats stats;	//!< Counters of the file system
+
+#define STAT_ADD(field,n) __atomic_fetch_add(&stats.field,(n),__ATOMIC_RELAXED)	//!< Add n to the counter field of the stats structure
+
+/**
+ * \brief Type of a function writing the content of a control file
+ */
+typedef void (*RenderFunction)(FILE*);
+
+/**
+ * \brief Virtual file of the control folder
+ *
+ * Control files do not exist in the mirror. Their content is generated when they are opened.
+ */
+typedef struct ControlFile {
+	const char *name;	//!< Name of the file in the control folder
+	RenderFunction render;	//!< Function writing the content of the file
+} ControlFile;
+
+extern const ControlFile control_files[];	//!< List of the control files, ending with an element with a null name
+
+/**
+ * \brief Find a control file
+ *
+ * \param name Name of the file in the control folder
+ * \return Pointer to the ControlFile structure, null if there is no such file
+ */
+const ControlFile *get_control_file(const char *name);
+
+/**
+ * \brief Write the global counters of the file system
+ *
+ * \param f Stream on which the counters are written
+ */
+void render_stats(FILE *f);
+
+#endif   /* ----- #ifndef STATS_INC  ----- */
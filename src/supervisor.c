@@ -0,0 +1,489 @@
+/*
+ * =====================================================================================
+ *
+ *       Filename:  supervisor.c
+ *
+ *    Description:  Implementation of the supervisor of child processes
+ *
+ *        Version:  2.0
+ *        Created:  10/18/2026
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  
+ *        Company:  
+ *
+ * =====================================================================================
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/pidfd.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include "operations.h"
+#include "supervisor.h"
+#include "stats.h"
+
+extern struct Persistent persistent;
+
+#define SUP_MAX_EVENTS 0x40	//!< Maximal number of events processed at each iteration of the supervisor loop
+#define SUP_POLL_INTERRUPT 100	//!< Delay in milliseconds between two checks of the interruption of a waiting request
+#define LATENCY_SLACK 20	//!< Increase of the average duration (in milliseconds) below which the executions are never considered slower than their baseline
+#define ADAPTIVE_HOLD 5	//!< Number of adjustments without decrease after a decrease, to let the averages of the pressure catch up
+
+static pthread_t sup_thread;	//!< Supervisor thread
+static int sup_running=0;	//!< Tells if the supervisor thread was started
+static int sup_stop=0;	//!< Set to ask the supervisor to kill the remaining children and exit
+static int sup_epoll=-1;	//!< Descriptor of the epoll instance watching the pidfds
+static int sup_event=-1;	//!< Event descriptor used to wake up the supervisor loop
+static Execution *sup_list=0;	//!< List of the executions watched by the supervisor
+static int (*sup_interrupted)(void)=0;	//!< Function telling if the request of the current thread was interrupted
+static pthread_mutex_t sup_mutex=PTHREAD_MUTEX_INITIALIZER;	//!< Protects the list of executions and their state
+static pthread_cond_t sup_cond=PTHREAD_COND_INITIALIZER;	//!< Signaled each time an execution is reaped
+static __thread long long sup_cpu=0;	//!< CPU time of the executions waited for by the current thread since the last call to execution_cpu
+static __thread int sup_cancelled=0;	//!< Non-zero if an execution waited for by the current thread was given up because its request was interrupted, since the last call to execution_cancelled
+static __thread int sup_keep=0;	//!< Non-zero if the executions of the current thread must complete even if its request is interrupted
+static unsigned int slot_used=0;	//!< Number of slots taken by ordinary requests
+static pthread_mutex_t slot_mutex=PTHREAD_MUTEX_INITIALIZER;	//!< Protects the number of slots taken
+static pthread_cond_t slot_cond=PTHREAD_COND_INITIALIZER;	//!< Signaled each time a slot is given back
+static unsigned int slot_waiting=0;	//!< Number of ordinary requests currently waiting for a slot
+static unsigned int slot_waits=0;	//!< Number of ordinary requests which had to wait for a slot since the last adjustment of the adaptive limit
+static unsigned int job_limit=0;	//!< Current adaptive limit of executions, only used if persistent.adaptive_max_jobs is not null
+static unsigned int job_hold=0;	//!< Number of adjustments left before the adaptive limit may be decreased again
+static double job_pressure[3]={-1,-1,-1};	//!< Last pressure read on the CPU, the memory and the I/O, -1 if it is not available
+static long long latency_sum=0;	//!< Sum of the durations of the executions since the last adjustment
+static long long latency_count=0;	//!< Number of executions since the last adjustment
+static long long latency_recent=-1;	//!< Average duration of the executions during the last interval which had some, -1 if none
+static long long latency_baseline=-1;	//!< Baseline of the average duration of the executions, -1 if none was observed yet
+
+/**
+ * \brief Wake up the supervisor loop so that it takes new deadlines or a stop request into account
+ */
+static void sup_wake() {
+	uint64_t one=1;
+	if (write(sup_event,&one,sizeof one)<0) fprintf(stderr,"supervisor: Cannot wake up loop: %s\n",strerror(errno));
+}
+
+/**
+ * \brief Release one reference on an execution, must be called with sup_mutex locked
+ *
+ * \param exec Pointer to the Execution structure, freed when its last reference is released
+ */
+static void sup_unref(Execution *exec) {
+	if (--exec->refs>0) return;
+	if (exec->pidfd>=0) close(exec->pidfd);
+	free(exec);
+}
+
+/**
+ * \brief Convert the CPU time of a resource usage to microseconds
+ *
+ * \param usage Resource usage of a process
+ * \return User and system time in microseconds
+ */
+static long long usage_cpu(const struct rusage *usage) {
+	return (usage->ru_utime.tv_sec+usage->ru_stime.tv_sec)*1000000LL+usage->ru_utime.tv_usec+usage->ru_stime.tv_usec;
+}
+
+/**
+ * \brief Reap a child process which has exited, or get its status from its fork server, must be called with sup_mutex locked
+ *
+ * \param exec Pointer to the Execution structure of the child
+ */
+static void sup_reap(Execution *exec) {
+	int status=0;
+	struct rusage usage;
+	memset(&usage,0,sizeof usage);
+	if (!exec->remote) while (wait4(exec->pid,&status,0,&usage)<0 && errno==EINTR);
+	else if (read(exec->pidfd,&status,sizeof status)!=sizeof status) status=SIGKILL;	// The fork server died, the process is considered killed
+	exec->status=status;
+	exec->cpu_us=usage_cpu(&usage);
+	exec->done=1;
+	epoll_ctl(sup_epoll,EPOLL_CTL_DEL,exec->pidfd,0);
+	if (exec->prev) exec->prev->next=exec->next; else sup_list=exec->next;
+	if (exec->next) exec->next->prev=exec->prev;
+	pthread_cond_broadcast(&sup_cond);
+	sup_unref(exec);
+}
+
+/**
+ * \brief Read the pressure of the host on a resource
+ *
+ * \param resource Name of the resource in /proc/pressure (cpu, memory or io)
+ * \return Share of the last 10 seconds (in percents) during which some tasks were stalled on the resource, -1 if the kernel does not report it
+ */
+static double read_pressure(const char *resource) {
+	char path[64];
+	double avg10=-1;
+	snprintf(path,sizeof path,"/proc/pressure/%s",resource);
+	FILE *f=fopen(path,"re");
+	if (f==0) return -1;
+	if (fscanf(f,"some avg10=%lf",&avg10)!=1) avg10=-1;
+	fclose(f);
+	return avg10;
+}
+
+/**
+ * \brief Adjust the adaptive limit of executions
+ *
+ * The limit is decreased multiplicatively when the host is under pressure or the executions are getting slower, and increased additively when requests had to wait for a slot. It always remains between persistent.adaptive_min_jobs and persistent.adaptive_max_jobs.
+ */
+static void adjust_limit() {
+	double cpu=read_pressure("cpu");
+	double memory=read_pressure("memory");
+	double io=read_pressure("io");
+	pthread_mutex_lock(&slot_mutex);
+	job_pressure[0]=cpu;
+	job_pressure[1]=memory;
+	job_pressure[2]=io;
+	int slower=0;
+	if (latency_count>0) {
+		latency_recent=latency_sum/latency_count;
+		slower=(latency_baseline>=0 && latency_recent>LATENCY_FACTOR*latency_baseline && latency_recent-latency_baseline>LATENCY_SLACK);
+		if (latency_baseline<0 || latency_recent<latency_baseline) latency_baseline=latency_recent;
+		else latency_baseline+=(latency_recent-latency_baseline)/32;	// Follow slowly a lasting change of the workload
+	}
+	latency_sum=latency_count=0;
+	int congested=(cpu>=PRESSURE_CPU_HIGH || memory>=PRESSURE_MEMORY_HIGH || io>=PRESSURE_IO_HIGH || slower);
+	if (job_hold>0) --job_hold;
+	if (congested && job_hold==0 && job_limit>persistent.adaptive_min_jobs) {
+		job_limit=(job_limit/2>persistent.adaptive_min_jobs)?job_limit/2:persistent.adaptive_min_jobs;
+		job_hold=ADAPTIVE_HOLD;
+		STAT_ADD(job_limit_decreases,1);
+#ifdef TRACE
+		fprintf(stderr,"adjust_limit: Limit decreased to %u (cpu %.2f, memory %.2f, io %.2f, latency %lld ms)\n",job_limit,cpu,memory,io,latency_recent);
+#endif
+	} else if (!congested && (slot_waiting>0 || slot_waits>0) && job_limit<persistent.adaptive_max_jobs) {
+		++job_limit;
+		STAT_ADD(job_limit_increases,1);
+		pthread_cond_broadcast(&slot_cond);
+#ifdef TRACE
+		fprintf(stderr,"adjust_limit: Limit increased to %u\n",job_limit);
+#endif
+	}
+	slot_waits=0;
+	pthread_mutex_unlock(&slot_mutex);
+}
+
+/**
+ * \brief Main function of the supervisor thread
+ *
+ * The loop waits for the pidfds of the children to become readable, which means the processes exited, and reaps them. Between two events, it kills the children which exceeded their deadline and adjusts the adaptive limit of executions when it is due. When it is asked to stop, it kills all the remaining children and exits once they have all been reaped.
+ * \param arg Not used
+ * \return Always null
+ */
+static void *sup_loop(void *arg) {
+	struct epoll_event events[SUP_MAX_EVENTS];
+	long long next_adjust=now_ms()+ADAPTIVE_INTERVAL;
+	pthread_mutex_lock(&sup_mutex);
+	while (!sup_stop || sup_list!=0) {
+		long long now=now_ms();
+		long long next=-1;
+		Execution *exec;
+		for (exec=sup_list;exec!=0;exec=exec->next) {
+			if (exec->cancelled) continue;
+			if (sup_stop || (exec->deadline!=0 && exec->deadline<=now)) {
+				if (!sup_stop && exec->abandoned) STAT_ADD(cancellations,1);	// End of the grace period of an interrupted request
+				else if (!sup_stop) fprintf(stderr,"supervisor: Killing process %d after timeout of %u s\n",exec->pid,persistent.exec_timeout);
+				kill(-exec->pid,SIGKILL);
+				exec->cancelled=1;
+			} else if (exec->deadline!=0 && (next<0 || exec->deadline-now<next)) next=exec->deadline-now;
+		}
+		pthread_mutex_unlock(&sup_mutex);
+		if (persistent.adaptive_max_jobs!=0) {
+			if (now>=next_adjust) {
+				adjust_limit();
+				next_adjust=now+ADAPTIVE_INTERVAL;
+			}
+			if (next<0 || next_adjust-now<next) next=next_adjust-now;
+		}
+		int num=epoll_wait(sup_epoll,events,SUP_MAX_EVENTS,(int)next);
+		pthread_mutex_lock(&sup_mutex);
+		int i;
+		for (i=0;i<num;++i) {
+			if (events[i].data.ptr==0) {
+				uint64_t count;
+				if (read(sup_event,&count,sizeof count)<0) continue;
+			} else sup_reap((Execution*)(events[i].data.ptr));
+		}
+	}
+	pthread_mutex_unlock(&sup_mutex);
+	return 0;
+}
+
+int start_supervisor(int (*interrupted)(void)) {
+	if (sup_running) return 0;
+	sup_interrupted=interrupted;
+	sup_epoll=epoll_create1(EPOLL_CLOEXEC);
+	sup_event=eventfd(0,EFD_CLOEXEC | EFD_NONBLOCK);
+	if (sup_epoll<0 || sup_event<0) {
+		fprintf(stderr,"start_supervisor: Cannot create event descriptors: %s\n",strerror(errno));
+		if (sup_epoll>=0) close(sup_epoll);
+		if (sup_event>=0) close(sup_event);
+		sup_epoll=sup_event=-1;
+		return errno;
+	}
+	struct epoll_event ev={.events=EPOLLIN,.data.ptr=0};
+	epoll_ctl(sup_epoll,EPOLL_CTL_ADD,sup_event,&ev);
+	sup_stop=0;
+	if (persistent.adaptive_max_jobs!=0) {	// Start from the static limit, within the bounds
+		job_limit=(persistent.max_jobs!=0)?persistent.max_jobs:persistent.adaptive_max_jobs;
+		if (job_limit<persistent.adaptive_min_jobs) job_limit=persistent.adaptive_min_jobs;
+		if (job_limit>persistent.adaptive_max_jobs) job_limit=persistent.adaptive_max_jobs;
+	}
+	int code=pthread_create(&sup_thread,0,sup_loop,0);
+	if (code!=0) {
+		fprintf(stderr,"start_supervisor: Cannot start thread: %s\n",strerror(code));
+		close(sup_epoll);
+		close(sup_event);
+		sup_epoll=sup_event=-1;
+		return code;
+	}
+	sup_running=1;
+	return 0;
+}
+
+void stop_supervisor() {
+	if (!sup_running) return;
+	pthread_mutex_lock(&sup_mutex);
+	sup_stop=1;
+	sup_wake();
+	pthread_mutex_unlock(&sup_mutex);
+	pthread_join(sup_thread,0);
+	close(sup_epoll);
+	close(sup_event);
+	sup_epoll=sup_event=-1;
+	sup_running=0;
+}
+
+/**
+ * \brief Create the Execution structure of a child process and hand it over to the supervisor
+ *
+ * \param pid ID of the child process
+ * \param fd Descriptor readable when the process exits, a new pidfd if negative
+ * \param remote Non-zero if fd is the descriptor on which a fork server writes the wait status of the process
+ * \return Pointer to the Execution structure, null if there is not enough memory or, for a remote execution, if the supervisor does not watch it
+ */
+static Execution *sup_watch(pid_t pid,int fd,int remote) {
+	Execution *exec=(Execution*)malloc(sizeof(Execution));
+	if (exec==0) return 0;
+	exec->pid=pid;
+	exec->pidfd=-1;
+	exec->remote=remote;
+	exec->done=0;
+	exec->status=0;
+	exec->cancelled=0;
+	exec->abandoned=0;
+	exec->cpu_us=0;
+	exec->deadline=0;
+	exec->refs=1;
+	exec->prev=0;
+	exec->next=0;
+	pthread_mutex_lock(&sup_mutex);
+	if (sup_running && !sup_stop) {
+		exec->pidfd=(fd>=0)?fd:pidfd_open(pid,0);
+		if (exec->pidfd>=0) {
+			struct epoll_event ev={.events=EPOLLIN,.data.ptr=exec};
+			if (epoll_ctl(sup_epoll,EPOLL_CTL_ADD,exec->pidfd,&ev)==0) {
+				exec->refs=2;
+				if (persistent.exec_timeout>0) exec->deadline=now_ms()+persistent.exec_timeout*1000LL;
+				exec->next=sup_list;
+				if (sup_list) sup_list->prev=exec;
+				sup_list=exec;
+				if (exec->deadline!=0) sup_wake();
+			} else {
+				if (!remote) close(exec->pidfd);
+				exec->pidfd=-1;
+			}
+		}
+	}
+	pthread_mutex_unlock(&sup_mutex);
+	if (remote && exec->pidfd<0) {	// Nobody could reap it
+		free(exec);
+		return 0;
+	}
+	return exec;
+}
+
+int supervising() {
+	pthread_mutex_lock(&sup_mutex);
+	int res=sup_running && !sup_stop;
+	pthread_mutex_unlock(&sup_mutex);
+	return res;
+}
+
+Execution *supervise(pid_t pid) {
+	return sup_watch(pid,-1,0);
+}
+
+Execution *supervise_remote(pid_t pid,int status_fd) {
+	return sup_watch(pid,status_fd,1);
+}
+
+int wait_execution(Execution *exec) {
+	int status=0;
+	int done;
+	if (exec->pidfd<0) {	// Not watched by the supervisor, reap the child here
+		struct rusage usage;
+		memset(&usage,0,sizeof usage);
+		while (wait4(exec->pid,&status,0,&usage)<0 && errno==EINTR);
+		sup_cpu+=usage_cpu(&usage);
+		free(exec);
+		done=1;
+	} else {
+		pthread_mutex_lock(&sup_mutex);
+		while (!exec->done) {
+			if (sup_interrupted==0 || sup_keep) {	// Kept executions complete whatever happens to the request
+				pthread_cond_wait(&sup_cond,&sup_mutex);
+				continue;
+			}
+			struct timespec ts;
+			clock_gettime(CLOCK_REALTIME,&ts);
+			ts.tv_nsec+=SUP_POLL_INTERRUPT*1000000L;
+			if (ts.tv_nsec>=1000000000L) {ts.tv_sec++;ts.tv_nsec-=1000000000L;}
+			pthread_cond_timedwait(&sup_cond,&sup_mutex,&ts);
+			if (!exec->done && sup_interrupted()) {	// The request was interrupted
+				if (exec->cancelled || exec->abandoned) break;
+				if (persistent.cancel_grace>0) {	// Let it finish during the grace period, then the supervisor kills it
+					long long deadline=now_ms()+persistent.cancel_grace;
+					if (exec->deadline==0 || deadline<exec->deadline) exec->deadline=deadline;
+					exec->abandoned=1;
+					sup_wake();
+				} else {
+#ifdef TRACE
+					fprintf(stderr,"wait_execution: Request interrupted, killing process %d\n",exec->pid);
+#endif
+					kill(-exec->pid,SIGKILL);
+					exec->cancelled=1;
+					STAT_ADD(cancellations,1);
+				}
+				sup_cancelled=1;
+				break;	// Do not wait any longer, the supervisor will reap the child
+			}
+		}
+		done=exec->done;
+		status=exec->status;
+		if (done) sup_cpu+=exec->cpu_us;
+		sup_unref(exec);
+		pthread_mutex_unlock(&sup_mutex);
+	}
+	if (done && WIFEXITED(status)) return WEXITSTATUS(status);
+	return 1;
+}
+
+void cancel_execution(Execution *exec) {
+	pthread_mutex_lock(&sup_mutex);
+	if (!exec->done && !exec->cancelled) {
+		kill(-exec->pid,SIGKILL);
+		exec->cancelled=1;
+	}
+	pthread_mutex_unlock(&sup_mutex);
+}
+
+void release_execution(Execution *exec) {
+	if (exec->pidfd<0) {	// Not watched by the supervisor, the child must still be reaped
+		while (waitpid(exec->pid,0,0)<0 && errno==EINTR);
+		free(exec);
+		return;
+	}
+	pthread_mutex_lock(&sup_mutex);
+	sup_unref(exec);
+	pthread_mutex_unlock(&sup_mutex);
+}
+
+/**
+ * \brief Tell if an ordinary request of a mount has to wait for a slot, must be called with slot_mutex locked
+ *
+ * \param mount Mount of the request
+ * \return 1 if the global limit or the quota of the mount is reached, 0 otherwise
+ */
+static int slot_full(const Mount *mount) {
+	unsigned int limit=(persistent.adaptive_max_jobs!=0 && job_limit!=0)?job_limit:persistent.max_jobs;
+	return (limit!=0 && slot_used>=limit) || (mount->max_jobs!=0 && mount->jobs>=mount->max_jobs);
+}
+
+int acquire_job_slot(int nested) {
+	if (nested) {	// Reserved capacity, not subject to the limit
+		STAT_ADD(nested_requests,1);
+		return 0;
+	}
+	Mount *mount=current_mount();
+	int interrupted=0;
+	pthread_mutex_lock(&slot_mutex);
+	if (slot_full(mount)) {
+		STAT_ADD(job_waits,1);
+		++slot_waits;
+		++slot_waiting;
+		while (slot_full(mount) && !interrupted) {
+			if (sup_interrupted==0 || sup_keep) {
+				pthread_cond_wait(&slot_cond,&slot_mutex);
+				continue;
+			}
+			struct timespec ts;
+			clock_gettime(CLOCK_REALTIME,&ts);
+			ts.tv_nsec+=SUP_POLL_INTERRUPT*1000000L;
+			if (ts.tv_nsec>=1000000000L) {ts.tv_sec++;ts.tv_nsec-=1000000000L;}
+			pthread_cond_timedwait(&slot_cond,&slot_mutex,&ts);
+			interrupted=slot_full(mount) && sup_interrupted();	// Nobody waits for the output any longer
+		}
+		--slot_waiting;
+	}
+	if (!interrupted) {
+		++slot_used;
+		__atomic_add_fetch(&mount->jobs,1,__ATOMIC_RELAXED);
+	}
+	pthread_mutex_unlock(&slot_mutex);
+	return interrupted?-1:0;
+}
+
+void release_job_slot(int nested,long long duration) {
+	if (nested) return;
+	Mount *mount=current_mount();
+	pthread_mutex_lock(&slot_mutex);
+	--slot_used;
+	latency_sum+=duration;
+	++latency_count;
+	__atomic_sub_fetch(&mount->jobs,1,__ATOMIC_RELAXED);
+	pthread_cond_broadcast(&slot_cond);	// The waiters may wait for different mounts
+	pthread_mutex_unlock(&slot_mutex);
+}
+
+void render_jobs(FILE *f) {
+	pthread_mutex_lock(&slot_mutex);
+	fprintf(f,"job_limit %u\n",(persistent.adaptive_max_jobs!=0 && job_limit!=0)?job_limit:persistent.max_jobs);
+	fprintf(f,"jobs_running %u\n",slot_used);
+	fprintf(f,"pressure_cpu %.2f\n",job_pressure[0]);
+	fprintf(f,"pressure_memory %.2f\n",job_pressure[1]);
+	fprintf(f,"pressure_io %.2f\n",job_pressure[2]);
+	fprintf(f,"latency_ms %lld\n",latency_recent);
+	fprintf(f,"latency_baseline_ms %lld\n",latency_baseline);
+	pthread_mutex_unlock(&slot_mutex);
+}
+
+void keep_executions(int keep) {
+	sup_keep=keep;
+}
+
+int execution_cancelled() {
+	int cancelled=sup_cancelled;
+	sup_cancelled=0;
+	return cancelled;
+}
+
+long long execution_cpu() {
+	long long cpu=sup_cpu;
+	sup_cpu=0;
+	return cpu;
+}
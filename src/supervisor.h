@@ -0,0 +1,171 @@
+/**
+ * \file
+ *
+ * =====================================================================================
+ *
+ *       Filename:  supervisor.h
+ *
+ *    Description:  Supervision of the child processes executing external programs
+ *
+ *        Version:  2.0
+ *        Created:  10/18/2026
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  
+ *        Company:  
+ *
+ * =====================================================================================
+ */
+
+#ifndef  SUPERVISOR_INC
+#define  SUPERVISOR_INC
+
+#include <stdio.h>
+#include <sys/types.h>
+
+#define DEFAULT_MAX_JOBS 0	//!< Default maximal number of scripts executed at once for ordinary requests, 0 for no limit
+#define ADAPTIVE_INTERVAL 1000	//!< Delay in milliseconds between two adjustments of the adaptive limit of executions
+#define PRESSURE_CPU_HIGH 40.0	//!< Share of time (in percents over 10 s) with tasks waiting for a CPU above which the adaptive limit is decreased
+#define PRESSURE_MEMORY_HIGH 10.0	//!< Share of time (in percents over 10 s) with tasks stalled on memory above which the adaptive limit is decreased
+#define PRESSURE_IO_HIGH 30.0	//!< Share of time (in percents over 10 s) with tasks stalled on I/O above which the adaptive limit is decreased
+#define LATENCY_FACTOR 2	//!< Ratio between the average duration of the executions and its baseline above which the adaptive limit is decreased
+
+/**
+ * \brief Running or finished execution of an external program
+ *
+ * Every child process spawned by the file system is registered in such a structure. The supervisor thread watches the process through a pidfd, reaps it when it exits, kills it if its deadline is exceeded, and wakes up the requests waiting for the result. The structure is reference-counted: it is released when the process has been reaped and the requester does not need it any longer.
+ */
+typedef struct Execution {
+	pid_t pid;	//!< ID of the child process, which is also the ID of its process group
+	int pidfd;	//!< Descriptor referring to the child process, -1 if pidfd_open is not supported (the requester then reaps the child itself)
+	int remote;	//!< Non-zero if the process is a child of a fork server, pidfd is then the descriptor on which the server writes its wait status
+	int done;	//!< Non-zero when the child process has been reaped
+	int status;	//!< Wait status of the child process, only valid when done is set
+	long long cpu_us;	//!< CPU time used by the child process and the descendants it waited for, in microseconds, only valid when done is set (0 for the children of a fork server)
+	int cancelled;	//!< Non-zero if the child process was killed before its normal termination
+	int abandoned;	//!< Non-zero if the request was interrupted and the process is only given until its deadline (the grace period) to finish
+	long long deadline;	//!< Time (in milliseconds on the monotonic clock) after which the child process is killed, 0 for no deadline
+	int refs;	//!< Number of references to the structure (supervisor and requester)
+	struct Execution *prev;	//!< Previous running execution in the list of the supervisor
+	struct Execution *next;	//!< Next running execution in the list of the supervisor
+} Execution;
+
+/**
+ * \brief Start the supervisor thread
+ *
+ * The function starts the thread which owns all the child processes. It must be called after the process is daemonized. Until it is called, or if the kernel does not support pidfds, the requesters wait for their child processes themselves. When the adaptive limit of executions is enabled, the thread also adjusts it every ADAPTIVE_INTERVAL milliseconds: the limit is halved (down to persistent.adaptive_min_jobs) when the host is under pressure (see /proc/pressure) or when the executions become LATENCY_FACTOR times slower than their baseline, and increased by one (up to persistent.adaptive_max_jobs) when requests had to wait for a slot.
+ * \param interrupted Function telling if the current request was interrupted, polled while a requester waits for its child process, or null
+ * \return 0 if everything went fine, an error code otherwise
+ */
+int start_supervisor(int (*interrupted)(void));
+
+/**
+ * \brief Stop the supervisor thread
+ *
+ * The function kills all the child processes still running, reaps them, wakes up their requesters and stops the supervisor thread.
+ */
+void stop_supervisor();
+
+/**
+ * \brief Tell if the supervisor thread watches the new executions
+ *
+ * \return Non-zero if the supervisor is running and not stopping
+ */
+int supervising();
+
+/**
+ * \brief Register a child process to the supervisor
+ *
+ * The function creates an Execution structure for the child process, which should have been put in its own process group, and starts watching it. The deadline is computed from the configured execution timeout. The returned structure holds a reference for the requester, which must be released either by wait_execution or release_execution.
+ * \param pid ID of the child process
+ * \return Pointer to the new Execution structure, null if it could not be allocated
+ */
+Execution *supervise(pid_t pid);
+
+/**
+ * \brief Register a process started by a fork server to the supervisor
+ *
+ * The process is not a child of the file system: the fork server reaps it and writes its wait status (an int) on a descriptor. The supervisor watches the descriptor, kills the process group on timeout or cancellation like for the other executions, and considers the process killed if the descriptor is closed without status.
+ * \param pid ID of the process, which is also the ID of its process group
+ * \param status_fd Descriptor on which the fork server writes the wait status, owned by the Execution structure on success
+ * \return Pointer to the Execution structure, null if the supervisor is not running or the structure could not be created
+ */
+Execution *supervise_remote(pid_t pid,int status_fd);
+
+/**
+ * \brief Wait for the end of an execution
+ *
+ * The function blocks until the child process has been reaped. If the request is interrupted while waiting, the function returns immediately and the process is cancelled: it is killed at once, or at the end of the grace period (persistent.cancel_grace) if it did not finish by then. The supervisor still reaps the process later. The executions started by a thread which called keep_executions are not cancelled: the function waits for them without checking the request. The reference of the requester is released, so the structure must not be used after the call.
+ * \param exec Pointer to the Execution structure
+ * \return Exit code of the program, 1 if it did not exit normally (killed, timed out or interrupted)
+ */
+int wait_execution(Execution *exec);
+
+/**
+ * \brief Tell if the executions of the current thread must complete even if its request is interrupted
+ *
+ * It is used when the output of the executions goes to a cache: it will serve the next requests, so the work is not wasted.
+ * \param keep Non-zero to keep the executions, 0 to cancel them on interruption
+ */
+void keep_executions(int keep);
+
+/**
+ * \brief Tell if the current thread gave up an execution because its request was interrupted
+ *
+ * It is the case when wait_execution returned before the child process ended, because it was killed or left to its grace period: its output is then incomplete, and must not be recorded anywhere. The flag is reset by each call to the function.
+ * \return 1 if an execution was given up since the previous call, 0 otherwise
+ */
+int execution_cancelled();
+
+/**
+ * \brief Get the CPU time of the executions the current thread waited for
+ *
+ * The time is counted when wait_execution returns after the child process was reaped, and reset by each call to the function.
+ * \return CPU time in microseconds since the previous call
+ */
+long long execution_cpu();
+
+/**
+ * \brief Kill an execution
+ *
+ * The function kills the whole process group of the execution if it is still running. The process is reaped by the supervisor as usual.
+ * \param exec Pointer to the Execution structure
+ */
+void cancel_execution(Execution *exec);
+
+/**
+ * \brief Release the reference of the requester on an execution
+ *
+ * The function is used by requesters which are not interested in the result any longer (usually after cancel_execution). The child process is still reaped by the supervisor.
+ * \param exec Pointer to the Execution structure
+ */
+void release_execution(Execution *exec);
+
+/**
+ * \brief Take a slot for the execution of a script
+ *
+ * The executions of scripts for ordinary requests are limited to persistent.max_jobs at once for the whole process (or to the adaptive limit, see persistent.adaptive_max_jobs), and to the quota of the mount of the request, the function blocks until a slot is free. Requests coming from the scripts themselves (nested requests) use the reserved capacity: they never wait, so that a script reading another script of the file system cannot be starved by the requests waiting for it.
+ * While it waits, the function periodically checks whether the request was interrupted, unless the thread keeps its executions (see keep_executions): an interrupted request gives up without taking a slot.
+ * \param nested Non-zero if the request comes from a descendant of a child process
+ * \return 0 if a slot was taken, -1 if the request was interrupted while waiting (release_job_slot must then not be called)
+ */
+int acquire_job_slot(int nested);
+
+/**
+ * \brief Give back a slot taken with acquire_job_slot
+ *
+ * \param nested Same value as the one given to acquire_job_slot
+ * \param duration Duration of the execution in milliseconds, observed by the adaptive limit
+ */
+void release_job_slot(int nested,long long duration);
+
+/**
+ * \brief Write the state of the limit of executions
+ *
+ * The function writes the current limit, the number of running executions, the pressure of the host on the CPU, the memory and the I/O (share of the last 10 s during which some tasks were stalled, -1 if the kernel does not report it) and the recent and baseline durations of the executions.
+ * \param f Stream on which the state is written
+ */
+void render_jobs(FILE *f);
+
+#endif   /* ----- #ifndef SUPERVISOR_INC  ----- */
@@ -0,0 +1,409 @@
+/*
+ * =====================================================================================
+ *
+ *       Filename:  uring.c
+ *
+ *    Description:  Implementation of the io_uring engine
+ *
+ *        Version:  2.0
+ *        Created:  10/18/2026
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  
+ *        Company:  
+ *
+ * =====================================================================================
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+#include <linux/io_uring.h>
+#include "operations.h"
+#include "uring.h"
+
+extern struct Persistent persistent;
+
+/**
+ * \brief Ring of a thread
+ *
+ * The rings are used without liburing, through the io_uring_setup and io_uring_enter system calls and the shared memory of the queues. Each thread has its own ring, so that the queues need no lock.
+ */
+typedef struct Ring {
+	int fd;	//!< Descriptor of the ring
+	unsigned entries;	//!< Number of entries of the submission queue
+	unsigned *sq_tail;	//!< Tail of the submission queue, written by the thread
+	unsigned *sq_mask;	//!< Mask of the indexes of the submission queue
+	unsigned *sq_array;	//!< Indexes of the submitted entries
+	struct io_uring_sqe *sqes;	//!< Entries of the submission queue
+	unsigned *cq_head;	//!< Head of the completion queue, written by the thread
+	unsigned *cq_tail;	//!< Tail of the completion queue, written by the kernel
+	unsigned *cq_mask;	//!< Mask of the indexes of the completion queue
+	struct io_uring_cqe *cqes;	//!< Entries of the completion queue
+	void *sq_ptr;	//!< Mapping of the submission queue
+	size_t sq_len;	//!< Size of the mapping of the submission queue
+	void *cq_ptr;	//!< Mapping of the completion queue, equal to sq_ptr if the kernel maps both at once
+	size_t cq_len;	//!< Size of the mapping of the completion queue
+	size_t sqes_len;	//!< Size of the mapping of the entries
+	unsigned pending;	//!< Number of entries prepared and not submitted yet
+} Ring;
+
+static pthread_key_t ring_key;	//!< Key of the ring of each thread, which is released when the thread exits
+static pthread_once_t ring_once=PTHREAD_ONCE_INIT;	//!< Creates ring_key once
+static int ring_failed=0;	//!< Set when io_uring is not available at all (not supported or forbidden), the engine is then disabled
+static __thread long long ring_retry=0;	//!< Time (in milliseconds) before which the thread does not try to create its ring again after a transient failure
+
+/**
+ * \brief Release a ring
+ *
+ * \param arg Pointer to the Ring structure
+ */
+static void ring_free(void *arg) {
+	Ring *r=(Ring*)arg;
+	if (r==0) return;
+	if (r->sqes!=0 && r->sqes!=MAP_FAILED) munmap(r->sqes,r->sqes_len);
+	if (r->cq_ptr!=0 && r->cq_ptr!=MAP_FAILED && r->cq_ptr!=r->sq_ptr) munmap(r->cq_ptr,r->cq_len);
+	if (r->sq_ptr!=0 && r->sq_ptr!=MAP_FAILED) munmap(r->sq_ptr,r->sq_len);
+	if (r->fd>=0) close(r->fd);
+	free(r);
+}
+
+/**
+ * \brief Create the key of the rings of the threads
+ */
+static void ring_key_create() {
+	pthread_key_create(&ring_key,ring_free);
+}
+
+/**
+ * \brief Drop the ring of the calling thread after a failure
+ *
+ * \param r Ring of the thread
+ */
+static void ring_drop(Ring *r) {
+	pthread_setspecific(ring_key,0);
+	ring_free(r);
+}
+
+/**
+ * \brief Handle a failure to create the ring of the calling thread
+ *
+ * If io_uring is not supported or forbidden (for instance by kernel.io_uring_disabled), the engine is disabled for the whole process. Other failures, such as a lack of descriptors or of locked memory, may be transient: the thread only uses blocking calls for URING_RETRY milliseconds, then tries again.
+ * \param what Step which failed
+ * \param code Error code
+ */
+static void ring_setup_failed(const char *what,int code) {
+	if (code==ENOSYS || code==EPERM || code==EACCES || code==EINVAL) {
+		if (!__atomic_exchange_n(&ring_failed,1,__ATOMIC_RELAXED)) fprintf(stderr,"io_uring: Cannot %s a ring for the mirror (%s), using blocking calls\n",what,strerror(code));
+		return;
+	}
+#ifdef TRACE
+	fprintf(stderr,"io_uring: Cannot %s a ring for the mirror (%s), using blocking calls for %d ms\n",what,strerror(code),URING_RETRY);
+#endif
+	ring_retry=now_ms()+URING_RETRY;
+}
+
+/**
+ * \brief Get the ring of the calling thread, creating it if needed
+ *
+ * \return Pointer to the ring, null if the engine is disabled or not available
+ */
+static Ring *ring_get() {
+	if (persistent.uring_depth==0 || __atomic_load_n(&ring_failed,__ATOMIC_RELAXED)) return 0;
+	pthread_once(&ring_once,ring_key_create);
+	Ring *r=(Ring*)pthread_getspecific(ring_key);
+	if (r!=0) return r;
+	if (ring_retry!=0 && now_ms()<ring_retry) return 0;
+	struct io_uring_params p;
+	memset(&p,0,sizeof p);
+	p.flags=IORING_SETUP_CLAMP;
+	r=(Ring*)calloc(1,sizeof(Ring));
+	if (r==0) return 0;
+	r->fd=syscall(__NR_io_uring_setup,persistent.uring_depth,&p);
+	if (r->fd<0) {
+		ring_setup_failed("create",errno);
+		free(r);
+		return 0;
+	}
+	r->sq_len=p.sq_off.array+p.sq_entries*sizeof(unsigned);
+	r->cq_len=p.cq_off.cqes+p.cq_entries*sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		if (r->cq_len>r->sq_len) r->sq_len=r->cq_len;
+		r->cq_len=r->sq_len;
+	}
+	r->sq_ptr=mmap(0,r->sq_len,PROT_READ | PROT_WRITE,MAP_SHARED | MAP_POPULATE,r->fd,IORING_OFF_SQ_RING);
+	if (p.features & IORING_FEAT_SINGLE_MMAP) r->cq_ptr=r->sq_ptr;
+	else r->cq_ptr=mmap(0,r->cq_len,PROT_READ | PROT_WRITE,MAP_SHARED | MAP_POPULATE,r->fd,IORING_OFF_CQ_RING);
+	r->sqes_len=p.sq_entries*sizeof(struct io_uring_sqe);
+	r->sqes=(struct io_uring_sqe*)mmap(0,r->sqes_len,PROT_READ | PROT_WRITE,MAP_SHARED | MAP_POPULATE,r->fd,IORING_OFF_SQES);
+	if (r->sq_ptr==MAP_FAILED || r->cq_ptr==MAP_FAILED || r->sqes==MAP_FAILED) {
+		int code=errno;
+		ring_free(r);
+		ring_setup_failed("map",code);
+		return 0;
+	}
+	char *sq=(char*)r->sq_ptr,*cq=(char*)r->cq_ptr;
+	r->entries=p.sq_entries;
+	r->sq_tail=(unsigned*)(sq+p.sq_off.tail);
+	r->sq_mask=(unsigned*)(sq+p.sq_off.ring_mask);
+	r->sq_array=(unsigned*)(sq+p.sq_off.array);
+	r->cq_head=(unsigned*)(cq+p.cq_off.head);
+	r->cq_tail=(unsigned*)(cq+p.cq_off.tail);
+	r->cq_mask=(unsigned*)(cq+p.cq_off.ring_mask);
+	r->cqes=(struct io_uring_cqe*)(cq+p.cq_off.cqes);
+	pthread_setspecific(ring_key,r);
+	return r;
+}
+
+/**
+ * \brief Prepare a new entry of the submission queue
+ *
+ * At most r->entries entries may be prepared before ring_run is called.
+ * \param r Ring of the thread
+ * \param opcode Operation of the entry
+ * \param fd Descriptor on which the operation applies
+ * \param index Index of the entry in the batch, given back with its result by ring_run
+ * \return Pointer to the entry, cleared except for the parameters given
+ */
+static struct io_uring_sqe *ring_prepare(Ring *r,int opcode,int fd,size_t index) {
+	unsigned idx=(*r->sq_tail+r->pending++) & *r->sq_mask;
+	struct io_uring_sqe *sqe=r->sqes+idx;
+	memset(sqe,0,sizeof *sqe);
+	sqe->opcode=opcode;
+	sqe->fd=fd;
+	sqe->user_data=index;
+	r->sq_array[idx]=idx;
+	return sqe;
+}
+
+/**
+ * \brief Submit the prepared entries and wait for all their completions
+ *
+ * If the submission fails, the completions of the entries already submitted are still waited for, then the ring is dropped so that the next call creates a new one. The results of the entries which were not executed are -ECANCELED.
+ * \param r Ring of the thread
+ * \param results Array receiving the result of each entry, indexed by the index given to ring_prepare
+ */
+static void ring_run(Ring *r,int *results) {
+	unsigned n=r->pending,i,submitted=0;
+	for (i=0;i<n;++i) results[i]=-ECANCELED;
+	r->pending=0;
+	__atomic_store_n(r->sq_tail,*r->sq_tail+n,__ATOMIC_RELEASE);
+	while (submitted<n) {
+		int ret=syscall(__NR_io_uring_enter,r->fd,n-submitted,0,0,0,0);
+		if (ret<0 && errno==EINTR) continue;
+		if (ret<=0) break;
+		submitted+=ret;
+	}
+	unsigned done=0;
+	while (done<submitted) {
+		unsigned head=*r->cq_head;
+		unsigned tail=__atomic_load_n(r->cq_tail,__ATOMIC_ACQUIRE);
+		if (head==tail) {
+			if (syscall(__NR_io_uring_enter,r->fd,0,1,IORING_ENTER_GETEVENTS,0,0)<0 && errno!=EINTR) break;
+			continue;
+		}
+		for (;head!=tail;++head,++done) {
+			const struct io_uring_cqe *cqe=r->cqes+(head & *r->cq_mask);
+			if (cqe->user_data<n) results[cqe->user_data]=cqe->res;
+		}
+		__atomic_store_n(r->cq_head,head,__ATOMIC_RELEASE);
+	}
+	if (submitted<n || done<submitted) {	// The queues are not in a known state any longer
+		fprintf(stderr,"io_uring: Submission failed (%s), recreating the ring\n",strerror(errno));
+		ring_drop(r);
+	}
+}
+
+int uring_statx(int dirfd,const char *const *paths,struct stat *st,int *codes,size_t n) {
+	Ring *r=ring_get();
+	if (r==0) return -1;
+	struct statx *stx=(struct statx*)malloc(r->entries*sizeof(struct statx));
+	int *results=(int*)malloc(r->entries*sizeof(int));
+	if (stx==0 || results==0) {
+		free(stx);
+		free(results);
+		return -1;
+	}
+	size_t first,i;
+	for (first=0;first<n;first+=r->entries) {
+		size_t num=(n-first<r->entries)?n-first:r->entries;
+		for (i=0;i<num;++i) {
+			struct io_uring_sqe *sqe=ring_prepare(r,IORING_OP_STATX,dirfd,i);
+			sqe->addr=(unsigned long)paths[first+i];
+			sqe->len=STATX_BASIC_STATS;
+			sqe->statx_flags=AT_SYMLINK_NOFOLLOW;
+			sqe->off=(unsigned long)(stx+i);
+		}
+		ring_run(r,results);
+		for (i=0;i<num;++i) {
+			codes[first+i]=results[i];
+			if (results[i]!=0) continue;
+			struct stat *s=st+first+i;
+			const struct statx *x=stx+i;
+			memset(s,0,sizeof(struct stat));
+			s->st_dev=makedev(x->stx_dev_major,x->stx_dev_minor);
+			s->st_ino=x->stx_ino;
+			s->st_mode=x->stx_mode;
+			s->st_nlink=x->stx_nlink;
+			s->st_uid=x->stx_uid;
+			s->st_gid=x->stx_gid;
+			s->st_rdev=makedev(x->stx_rdev_major,x->stx_rdev_minor);
+			s->st_size=x->stx_size;
+			s->st_blksize=x->stx_blksize;
+			s->st_blocks=x->stx_blocks;
+			s->st_atim.tv_sec=x->stx_atime.tv_sec;
+			s->st_atim.tv_nsec=x->stx_atime.tv_nsec;
+			s->st_mtim.tv_sec=x->stx_mtime.tv_sec;
+			s->st_mtim.tv_nsec=x->stx_mtime.tv_nsec;
+			s->st_ctim.tv_sec=x->stx_ctime.tv_sec;
+			s->st_ctim.tv_nsec=x->stx_ctime.tv_nsec;
+		}
+		if ((r=ring_get())==0) {	// The ring was dropped, the remaining files are left to the caller
+			for (i=first+num;i<n;++i) codes[i]=-ECANCELED;
+			break;
+		}
+	}
+	free(stx);
+	free(results);
+	return 0;
+}
+
+ssize_t uring_pread(int fd,void *buf,size_t size,off_t offset) {
+	Ring *r=(size>URING_SEGMENT)?ring_get():0;
+	if (r==0) return pread(fd,buf,size,offset);
+	size_t n=(size+URING_SEGMENT-1)/URING_SEGMENT,k;
+	if (n>r->entries) n=r->entries;
+	size_t segment=((size+n-1)/n+0xfff) & ~(size_t)0xfff;	// Whole pages, the last segment is shorter
+	n=(size+segment-1)/segment;
+	int results[n];
+	for (k=0;k<n;++k) {
+		size_t len=(size-k*segment<segment)?size-k*segment:segment;
+		struct io_uring_sqe *sqe=ring_prepare(r,IORING_OP_READ,fd,k);
+		sqe->addr=(unsigned long)((char*)buf+k*segment);
+		sqe->len=len;
+		sqe->off=offset+k*segment;
+	}
+	ring_run(r,results);
+	size_t total=0;
+	for (k=0;k<n;++k) {	// The bytes read are those of the segments before the first short one
+		size_t len=(size-k*segment<segment)?size-k*segment:segment;
+		ssize_t num=results[k];
+		if (num==-ECANCELED) num=pread(fd,(char*)buf+k*segment,len,offset+k*segment);	// Not executed, the ring failed
+		else if (num<0) {
+			errno=-num;
+			num=-1;
+		}
+		if (num<0) return (total>0)?(ssize_t)total:-1;
+		total+=num;
+		if ((size_t)num<len) break;
+	}
+	return total;
+}
+
+/**
+ * \brief Write a whole buffer at a given position
+ *
+ * \param fd Descriptor of the file
+ * \param buf Buffer to write
+ * \param len Number of bytes to write
+ * \param offset Position in the file
+ * \return 0 if everything was written, -1 otherwise (errno is then set)
+ */
+static int pwrite_all(int fd,const char *buf,size_t len,off_t offset) {
+	while (len>0) {
+		ssize_t num=pwrite(fd,buf,len,offset);
+		if (num<0 && errno==EINTR) continue;
+		if (num<=0) {
+			if (num==0) errno=EIO;
+			return -1;
+		}
+		buf+=num;
+		len-=num;
+		offset+=num;
+	}
+	return 0;
+}
+
+ssize_t uring_copy(int fin,int fout) {
+	Ring *r=ring_get();
+	if (r==0) {
+		errno=ENOSYS;
+		return -1;
+	}
+	off_t in=lseek(fin,0,SEEK_CUR);
+	off_t out=lseek(fout,0,SEEK_CUR);
+	if (in<0 || out<0) return -1;
+	size_t chains=r->entries/2,c;
+	if (chains>URING_COPY_CHAINS) chains=URING_COPY_CHAINS;
+	if (chains==0) {
+		errno=ENOSYS;
+		return -1;
+	}
+	char *buf=(char*)malloc(chains*URING_COPY_CHUNK);
+	if (buf==0) return -1;
+	int results[2*URING_COPY_CHAINS];
+	off_t total=0;
+	int error=0,end=0;
+	while (!end && error==0) {
+		if ((r=ring_get())==0) {
+			error=ENOSYS;
+			break;
+		}
+		for (c=0;c<chains;++c) {	// Each write is linked to its read and starts when the read completes
+			struct io_uring_sqe *sqe=ring_prepare(r,IORING_OP_READ,fin,2*c);
+			sqe->addr=(unsigned long)(buf+c*URING_COPY_CHUNK);
+			sqe->len=URING_COPY_CHUNK;
+			sqe->off=in+total+c*URING_COPY_CHUNK;
+			sqe->flags=IOSQE_IO_LINK;
+			sqe=ring_prepare(r,IORING_OP_WRITE,fout,2*c+1);
+			sqe->addr=(unsigned long)(buf+c*URING_COPY_CHUNK);
+			sqe->len=URING_COPY_CHUNK;
+			sqe->off=out+total+c*URING_COPY_CHUNK;
+		}
+		ring_run(r,results);
+		for (c=0;c<chains && !end && error==0;++c) {
+			int num=results[2*c],written=results[2*c+1];
+			if (num==-ECANCELED) error=ENOSYS;	// The ring failed
+			else if (num<0) error=-num;
+			else if (num<URING_COPY_CHUNK) {	// End of the source, the short read cancelled the linked write
+				if (written!=num && pwrite_all(fout,buf+c*URING_COPY_CHUNK,num,out+total)!=0) error=errno;
+				else total+=num;
+				end=1;
+			} else if (written<0) error=-written;
+			else {
+				if (written<num && pwrite_all(fout,buf+c*URING_COPY_CHUNK+written,num-written,out+total+written)!=0) error=errno;
+				else total+=num;
+			}
+		}
+	}
+	if (error==ENOSYS && total>0) {	// The ring failed in the middle of the copy, which ends with blocking calls
+		ssize_t num;
+		error=0;
+		while ((num=pread(fin,buf,URING_COPY_CHUNK,in+total))!=0) {
+			if (num<0 && errno==EINTR) continue;
+			if (num<0 || pwrite_all(fout,buf,num,out+total)!=0) {
+				error=errno;
+				break;
+			}
+			total+=num;
+		}
+	}
+	free(buf);
+	lseek(fin,in+total,SEEK_SET);	// The copy goes on from there if the caller falls back to another method
+	lseek(fout,out+total,SEEK_SET);
+	if (error!=0) {
+		errno=error;
+		return -1;
+	}
+	return total;
+}
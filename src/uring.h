@@ -0,0 +1,69 @@
+/**
+ * \file
+ *
+ * =====================================================================================
+ *
+ *       Filename:  uring.h
+ *
+ *    Description:  io_uring engine for the I/O on the mirror
+ *
+ *        Version:  2.0
+ *        Created:  10/18/2026
+ *       Revision:  none
+ *       Compiler:  gcc
+ *
+ *         Author:  
+ *        Company:  
+ *
+ * =====================================================================================
+ */
+
+#ifndef  URING_INC
+#define  URING_INC
+
+#include <stddef.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#define URING_DEFAULT_DEPTH 64	//!< Default number of entries of the rings of the mirror engine
+#define URING_RETRY 5000	//!< Delay (in milliseconds) before a thread tries again to create its ring after a transient failure
+#define URING_SEGMENT 0x10000	//!< Smallest part of a read submitted on its own, smaller reads are issued with pread
+#define URING_COPY_CHUNK 0x40000	//!< Size of the buffer of each read-write chain of a copy
+#define URING_COPY_CHAINS 8	//!< Maximal number of read-write chains of a copy in flight at once
+
+/**
+ * \brief Get the attributes of several files of a folder at once
+ *
+ * All the statx requests are submitted together on the ring of the calling thread (by batches of the size of the ring), so that a single system call has them all in flight.
+ * \param dirfd Descriptor of the folder
+ * \param paths Paths of the files relative to the folder, the symbolic links are not followed
+ * \param st Array receiving the attributes of the files
+ * \param codes Array receiving 0 for each file which attributes were read, a negative error code otherwise
+ * \param n Number of files
+ * \return 0 if the requests were submitted, -1 if the engine is not available (the arrays are then left untouched)
+ */
+int uring_statx(int dirfd,const char *const *paths,struct stat *st,int *codes,size_t n);
+
+/**
+ * \brief Read from a file at a given position
+ *
+ * A read larger than URING_SEGMENT is split into segments submitted together on the ring of the calling thread, so that the device serves them concurrently. Other reads, or all reads if the engine is not available, are issued with pread.
+ * \param fd Descriptor of the file
+ * \param buf Buffer receiving the data
+ * \param size Number of bytes to read
+ * \param offset Position of the first byte in the file
+ * \return Number of bytes read, -1 if an error occurred (errno is then set)
+ */
+ssize_t uring_pread(int fd,void *buf,size_t size,off_t offset);
+
+/**
+ * \brief Copy the content of a file to another file
+ *
+ * The copy goes from the current position of fin to the current position of fout, as linked read-write chains: up to URING_COPY_CHAINS blocks are read and written concurrently, each write starting in the kernel as soon as its read completes. The positions of both files are moved past the bytes copied.
+ * \param fin Descriptor of the source file, which must be seekable
+ * \param fout Descriptor of the destination file, which must be seekable
+ * \return Number of bytes copied, -1 if an error occurred (errno is then set, to ENOSYS if the engine is not available)
+ */
+ssize_t uring_copy(int fin,int fout);
+
+#endif   /* ----- #ifndef URING_INC  ----- */
@@ -0,0 +1,96 @@
+#!/bin/bash
+# Round trip of scriptfs-cacheserver over TCP: outputs are stored and given
+# back, the budget evicts the least recently used output, and with a secret
+# the outputs which are not authenticated are refused.
+# Usage: tests/cacheserver.sh [path of scriptfs-cacheserver]
+SERVER=${1:-./scriptfs-cacheserver}
+DIR=$(mktemp -d)
+PIDS=
+FAILED=0
+trap 'kill $PIDS 2>/dev/null; wait 2>/dev/null; rm -rf "$DIR"' EXIT
+
+check() {	# check name expected actual
+	if [ "$2" == "$3" ]; then echo "ok   $1"; else echo "FAIL $1: expected '$2', got '$3'"; FAILED=1; fi
+}
+
+start() {	# start folder [arguments], sets PORT
+	local folder=$1 try pid
+	shift
+	for try in $(seq 20); do
+		PORT=$((20000+RANDOM%20000))
+		"$SERVER" "$@" tcp:127.0.0.1:$PORT "$DIR/$folder" 2>/dev/null &
+		pid=$!
+		sleep 0.2
+		if kill -0 $pid 2>/dev/null; then PIDS="$PIDS $pid"; return 0; fi
+	done
+	echo "FAIL cannot start $SERVER"
+	exit 1
+}
+
+connect() {	# Opens the connection on descriptor 3
+	exec 3<>/dev/tcp/127.0.0.1/$PORT
+}
+
+put() {	# put key data [mac], prints the answer
+	connect
+	printf 'PUT %s %d%s\n%s' "$1" ${#2} "${3:+ $3}" "$2" >&3
+	read -r line <&3
+	echo "$line"
+	exec 3>&-
+}
+
+get() {	# get key, prints the answer line then the output on the next line
+	connect
+	printf 'GET %s\n' "$1" >&3
+	read -r line <&3
+	echo "$line"
+	case "$line" in HIT*) set -- $line; head -c "$2" <&3; echo;; esac
+	exec 3>&-
+}
+
+mac() {	# mac secret key data, HMAC-SHA-256 of the line "key size" and the data
+	if command -v openssl >/dev/null; then
+		printf '%s %d\n%s' "$2" ${#3} "$3" | openssl dgst -sha256 -hmac "$1" | sed 's/.* //'
+	else
+		printf '%s %d\n%s' "$2" ${#3} "$3" | python3 -c 'import hmac,sys; print(hmac.new(sys.argv[1].encode(),sys.stdin.buffer.read(),"sha256").hexdigest())' "$1"
+	fi
+}
+
+KEY1=$(echo one | sha256sum | cut -c1-64)
+KEY2=$(echo two | sha256sum | cut -c1-64)
+ZEROS=$(printf '0%.0s' $(seq 64))
+
+start open
+check "miss" "MISS" "$(get $KEY1)"
+check "store" "STORED" "$(put $KEY1 'hello world')"
+check "hit" "HIT 11 $ZEROS
+hello world" "$(get $KEY1)"
+check "replace" "STORED" "$(put $KEY1 'hello again')"
+check "hit after replace" "HIT 11 $ZEROS
+hello again" "$(get $KEY1)"
+check "invalid key" "ERROR output not stored" "$(put 0123 'data')"
+
+start small --size=1
+connect
+{ printf 'PUT %s 700000\n' $KEY1; head -c 700000 /dev/zero; } >&3
+read -r line <&3
+exec 3>&-
+check "first large output" "STORED" "$line"
+connect
+{ printf 'PUT %s 700000\n' $KEY2; head -c 700000 /dev/zero; } >&3
+read -r line <&3
+exec 3>&-
+check "second large output" "STORED" "$line"
+check "eviction" "MISS" "$(get $KEY1)"
+check "newest output kept" "HIT 700000 $ZEROS" "$(connect; printf 'GET %s\n' $KEY2 >&3; read -r line <&3; echo "$line"; exec 3>&-)"
+
+printf 'shared secret\n' >"$DIR/secret"
+start secure --secret="$DIR/secret"
+CODE=$(mac 'shared secret' $KEY1 'trusted output')
+check "output without code" "ERROR output not authenticated" "$(put $KEY1 'forged output')"
+check "output with wrong code" "ERROR output not authenticated" "$(put $KEY1 'forged output' $CODE)"
+check "output with code" "STORED" "$(put $KEY1 'trusted output' $CODE)"
+check "authenticated hit" "HIT 14 $CODE
+trusted output" "$(get $KEY1)"
+
+exit $FAILED